@@ -18,6 +18,9 @@
 #include "hrtimer.h"
 #include "controlpanelthirdpartypm.h"
 #include "packageutils.h"
+#include "transferscheduler.h"
+#include "repositorydelta.h"
+#include "filestore.h"
 
 static bool compareByPackageTitle(const QPair<PackageVersion*, QString>& e1,
         const QPair<PackageVersion*, QString>& e2) {
@@ -72,7 +75,7 @@ int App::process()
 {
     // alphabetically sorted options by the short name
     cl.add("bare-format", 'b', "bare format (no heading or summary)",
-            "", false, "list,list-repos,search,install-dir,which,where,info,path");
+            "", false, "list,list-repos,search,install-dir,which,where,info,path,store-info");
     cl.add("cmd", 'c', "output a .cmd script",
             "", false, "path");
     cl.add("debug", 'd', "turn on the debug output", "", false);
@@ -80,11 +83,11 @@ int App::process()
             "list of ways to close running applications \r\n(c=close, k=kill, s=disconnect from file shares, d=stop services, t=send Ctrl+C). The default value is 'c'.",
             "[c][k][s][t]", false, "remove,rm,update");
     cl.add("file", 'f', "file or directory", "file", false,
-            "add,place,set-install-dir,update,where,which,path");
+            "add,place,set-install-dir,update,where,which,path,delta");
     cl.add("install", 'i',
             "install a package if it was not installed", "", false, "update");
     cl.add("json", 'j', "json format for the output",
-            "", false, "list,list-repos,search,install-dir,which,where,info,path");
+            "", false, "list,list-repos,search,install-dir,which,where,info,path,store-info");
     cl.add("keep-directories", 'k',
             "use the same directories for updated packages", "", false,
            "update");
@@ -129,6 +132,14 @@ int App::process()
             "internal package name (e.g. com.example.Editor or just Editor)",
             "package", true, "build");
 
+    cl.add("old-file", 0, "previous version of a repository (.xml or .zip)",
+            "file", false, "delta");
+    cl.add("output-file", 0, "output file", "file", false, "delta");
+
+    cl.add("delete-unused", 0,
+            "delete the stored files that are not used anymore", "", false,
+            "store-info");
+
     QString err = cl.parse();
     if (!err.isEmpty()) {
         err = "Error: " + err;
@@ -144,6 +155,12 @@ int App::process()
         if (cl.isPresent("local"))
             PackageUtils::globalMode = false;
 
+        TransferScheduler::getDefault()->setBandwidthLimit(
+                static_cast<int64_t>(PackageUtils::getBandwidthLimit()) * 1024);
+
+        // directories that were not deleted by a previous process
+        PackageUtils::emptyTrash();
+
         if (debug) {
             clp.setUpdateRate(0);
 
@@ -248,6 +265,10 @@ int App::process()
             getInstallPath(job);
         } else if (cmd == "build") {
             build(job);
+        } else if (cmd == "delta") {
+            delta(job);
+        } else if (cmd == "store-info") {
+            storeInfo(job);
         } else {
             job->setErrorMessage(QStringLiteral("Wrong command: ") + cmd +
                     QStringLiteral(". Try \"ncl help\""));
@@ -340,6 +361,10 @@ void App::usage(Job* job)
         "        build a package from another one (e.g. a binary from source code)",
         "    ncl check",
         "        checks the installed packages for missing dependencies",
+        "    ncl delta --old-file <old repository> --file <new repository>",
+        "            --output-file <delta>",
+        "        writes the changes between two versions of a repository. A",
+        "        server can send the delta instead of the whole repository.",
         "    ncl detect [--user <user name>] [--password <password>]",
         "            [--proxy-user <proxy user name>] [--proxy-password <proxy password>]",
         "        download repositories and detect packages from the MSI ",
@@ -383,6 +408,10 @@ void App::usage(Job* job)
         "        changes the directory where packages will be installed. The",
         "        default directory for program files is used if the --file",
         "        parameter is missing.",
+        "    ncl store-info [--delete-unused] [--bare-format | --json]",
+        "        shows how much disk space is saved by storing identical files",
+        "        only once. Set the registry value \"deduplication\" to 1 to",
+        "        enable the file store.",
         "    ncl update (--package <package> [--versions <versions>])+",
         "            [--query <search terms>]",
         "            [--end-process <types>]",
@@ -1813,6 +1842,129 @@ void App::build(Job* job)
     job->complete();
 }
 
+void App::delta(Job* job)
+{
+    job->setTitle("Computing the changes in a repository");
+
+    QString oldFile = cl.get("old-file");
+    QString newFile = cl.get("file");
+    QString outputFile = cl.get("output-file");
+    if (oldFile.isNull())
+        job->setErrorMessage("Missing option: --old-file");
+    else if (newFile.isNull())
+        job->setErrorMessage("Missing option: --file");
+    else if (outputFile.isNull())
+        job->setErrorMessage("Missing option: --output-file");
+
+    RepositoryDelta d;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.9,
+                QObject::tr("Comparing the repositories"), true, true);
+        d.create(sub, oldFile, newFile);
+    }
+
+    if (job->shouldProceed()) {
+        QFile f(outputFile);
+        if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+            job->setErrorMessage(QObject::tr("Cannot open the file: %1").
+                    arg(outputFile));
+        } else {
+            QXmlStreamWriter w(&f);
+            w.setAutoFormatting(true);
+            w.writeStartDocument();
+            d.toXML(w);
+            w.writeEndDocument();
+            if (w.hasError())
+                job->setErrorMessage(f.errorString());
+            f.close();
+        }
+    }
+
+    if (job->shouldProceed()) {
+        qCInfo(npackdImportant()).noquote() << QObject::tr(
+                "%1 changed and %2 removed entries were written to %3").
+                arg(d.changed.licenses.size() + d.changed.packages.size() +
+                d.changed.packageVersions.size()).
+                arg(d.removedLicenses.size() + d.removedPackages.size() +
+                d.removedVersions.size()).arg(outputFile);
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+void App::storeInfo(Job* job)
+{
+    bool bare = cl.isPresent("bare-format");
+    bool json = cl.isPresent("json");
+    bool deleteUnused = cl.isPresent("delete-unused");
+
+    InstalledPackages* ip = InstalledPackages::getDefault();
+    if (job->shouldProceed()) {
+        QString r = ip->readRegistryDatabase();
+        if (!r.isEmpty())
+            job->setErrorMessage(r);
+    }
+
+    FileStore::Statistics stats;
+    QStringList dirs;
+    if (job->shouldProceed()) {
+        QStringList parents = PackageUtils::getPackageParentDirectories();
+        for (int i = 0; i < parents.size(); i++) {
+            if (!job->shouldProceed())
+                break;
+
+            FileStore store(parents.at(i));
+            if (!QFileInfo(store.getDirectory()).isDir())
+                continue;
+
+            dirs.append(store.getDirectory());
+            Job* sub = job->newSubJob(0.9 / parents.size(),
+                    QObject::tr("Reading %1").arg(store.getDirectory()),
+                    true, true);
+            stats.add(store.computeStatistics(sub, deleteUnused));
+        }
+    }
+
+    if (job->shouldProceed()) {
+        if (json) {
+            QJsonObject top;
+            QJsonArray stores;
+            for (int i = 0; i < dirs.size(); i++) {
+                stores.append(dirs.at(i));
+            }
+            top["stores"] = stores;
+            top["files"] = static_cast<double>(stats.files);
+            top["size"] = static_cast<double>(stats.size);
+            top["links"] = static_cast<double>(stats.links);
+            top["saved"] = static_cast<double>(stats.saved);
+            top["unusedFiles"] = static_cast<double>(stats.unused);
+            top["unusedSize"] = static_cast<double>(stats.unusedSize);
+            printJSON(top);
+        } else if (bare) {
+            WPMUtils::writeln(QString::number(stats.saved));
+        } else {
+            if (!PackageUtils::getDeduplication())
+                WPMUtils::writeln("The file store is disabled");
+            for (int i = 0; i < dirs.size(); i++) {
+                WPMUtils::writeln("Store: " + dirs.at(i));
+            }
+            WPMUtils::writeln(QString("Stored files: %L1 (%L2 bytes)").
+                    arg(stats.files).arg(stats.size));
+            WPMUtils::writeln(QString("Files in installation directories: %L1").
+                    arg(stats.links));
+            WPMUtils::writeln(QString("Saved space: %L1 bytes").
+                    arg(stats.saved));
+            WPMUtils::writeln(QString("%1: %L2 (%L3 bytes)").
+                    arg(deleteUnused ? "Deleted unused files" : "Unused files").
+                    arg(stats.unused).arg(stats.unusedSize));
+        }
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
 void App::add(Job* job)
 {
     CoInitialize(nullptr);
@@ -2340,11 +2492,11 @@ void App::info(Job* job)
 
             if (!pv) {
                 QString versions, r;
-                QList<PackageVersion*> pvs = rep->getPackageVersions_(
-                        p->name, &r);
+                QList<std::shared_ptr<const PackageVersion> > pvs =
+                        rep->getPackageVersionsShared_(p->name, &r);
                 if (r.isEmpty()) {
                     for (int i = 0; i < pvs.count(); i++) {
-                        PackageVersion* opv = pvs.at(i);
+                        const PackageVersion* opv = pvs.at(i).get();
                         if (i != 0)
                             versions.append(", ");
                         versions.append(opv->version.getVersionString());
@@ -2352,7 +2504,6 @@ void App::info(Job* job)
                 } else {
                     job->setErrorMessage(r);
                 }
-                qDeleteAll(pvs);
                 WPMUtils::writeln("Versions: " + versions);
             }
 
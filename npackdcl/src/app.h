@@ -57,6 +57,8 @@ private:
     void setInstallPath(Job *job);
     void removeSCP(Job *job);
     void build(Job *job);
+    void delta(Job *job);
+    void storeInfo(Job *job);
 
     bool confirm(const QList<InstallOperation *> ops, QString *title,
             QString *err);
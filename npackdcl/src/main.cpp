@@ -12,6 +12,9 @@
 #include "version.h"
 #include "installedpackages.h"
 #include "commandlinemessagehandler.h"
+#include "downloader.h"
+#include "wininettransport.h"
+#include "trash.h"
 
 #include "app.h"
 
@@ -56,6 +59,9 @@ int main(int argc, char *argv[])
 
     qRegisterMetaType<Version>("Version");
 
+    WinINetTransport transport;
+    Downloader::setDefaultTransport(&transport);
+
     InstalledPackages::packageName =
             "com.googlecode.windows-package-manager.NpackdCL";
 
@@ -65,6 +71,9 @@ int main(int argc, char *argv[])
 
     int r = ca.exec();
 
+    // the queued directories would stay in the trash otherwise
+    Trash::getDefault()->waitForDone();
+
     FreeLibrary(m);
 
     return r;
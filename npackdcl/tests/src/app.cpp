@@ -3,17 +3,50 @@
 #include <memory>
 
 #include <QRegExp>
+#include <QBuffer>
 #include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryFile>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <quazip.h>
+#include <quazipfile.h>
 
 #include "app.h"
 #include "wpmutils.h"
 #include "commandline.h"
 #include "downloader.h"
+#include "hashingwriter.h"
+#include "filetransport.h"
+#include "qttransport.h"
+#include "connectionpool.h"
+#include "transferscheduler.h"
+#include "repositorydelta.h"
+#include "zipstreamextractor.h"
+#include "trash.h"
+#include "filestore.h"
+#include "detectionjournal.h"
+#include "snapshotthirdpartypm.h"
+#include "fileinstalledpackagesstorage.h"
 #include "installedpackages.h"
 #include "installedpackageversion.h"
 #include "abstractrepository.h"
 #include "dbrepository.h"
 #include "hrtimer.h"
+#include "stringpool.h"
+#include "memoryarena.h"
+
+void App::initTestCase()
+{
+    // the tests do not depend on WinINet
+    static QtTransport transport;
+    Downloader::setDefaultTransport(&transport);
+}
 
 void App::test()
 {
@@ -126,6 +159,94 @@ void App::testInstalledPackages()
     d.package = "test";
     d.setVersions("[1, 2)");
     QVERIFY(ip->isInstalled(d));
+
+    err = ip->setPackageVersionPath(
+            "test", Version(1, 3), "C:\\test13", false);
+    QVERIFY(err == "");
+
+    ipv = ip->getNewestInstalled("test");
+    QVERIFY(ipv != nullptr);
+    QVERIFY(ipv->version == Version(1, 3));
+    delete ipv;
+
+    d.setVersions("[1, 1.3)");
+    ipv = ip->findHighestInstalledMatch(d);
+    QVERIFY(ipv != nullptr);
+    QVERIFY(ipv->version == Version(1, 2));
+    delete ipv;
+
+    ipv = ip->findOwner("c:/TEST/abc/def");
+    QVERIFY(ipv != nullptr);
+    QVERIFY(ipv->version == Version(1, 2));
+    delete ipv;
+
+    err = ip->setPackageVersionPath("test", Version(1, 2), "", false);
+    QVERIFY(err == "");
+
+    ipv = ip->findOwner("C:\\test");
+    QVERIFY(ipv == nullptr);
+
+    QVERIFY(!ip->isInstalled("test", Version(1, 2)));
+    QVERIFY(ip->getPath("test", Version(1, 2)) == "");
+    QVERIFY(ip->getPath("test", Version(1, 3)) == "C:\\test13");
+
+    QVERIFY(!ip->isInstalled(d));
+
+    // the shared entries are not copied
+    std::shared_ptr<const InstalledPackageVersion> shared =
+            ip->getNewestInstalledShared_("test");
+    QVERIFY(shared.get() != nullptr);
+    QVERIFY(shared->version == Version(1, 3));
+    QVERIFY(ip->findOwnerShared_("C:\\test13\\bin") == shared);
+    QVERIFY(ip->findShared_("test", Version(1, 2)).get() == nullptr);
+    QCOMPARE(ip->getAllShared_().size(), 1);
+
+    // unchanged entries are shared between the snapshots
+    err = ip->setPackageVersionPath("test2", Version(1, 0), "C:\\test2",
+            false);
+    QVERIFY(err == "");
+    QVERIFY(ip->findShared_("test", Version(1, 3)) == shared);
+    QCOMPARE(ip->getByPackageShared_("test2").size(), 1);
+    d.setVersions("[1, 2)");
+    QVERIFY(ip->findHighestInstalledMatchShared_(d) == shared);
+}
+
+void App::testInstalledPackagesUpdate()
+{
+    InstalledPackages ip;
+
+    // the changes are published by the last endUpdate()
+    ip.beginUpdate();
+    ip.beginUpdate();
+    for (int i = 0; i < 100; i++) {
+        QCOMPARE(ip.setPackageVersionPath("test", Version(1, i),
+                QString("C:\\test%1").arg(i), false), QString());
+    }
+    ip.endUpdate();
+    QVERIFY(!ip.isInstalled("test", Version(1, 5)));
+    ip.endUpdate();
+    QVERIFY(ip.isInstalled("test", Version(1, 5)));
+    QCOMPARE(ip.getPath("test", Version(1, 99)), QString("C:\\test99"));
+
+    // a copy has the same entries
+    InstalledPackages copy(ip);
+    QVERIFY(copy.isInstalled("test", Version(1, 5)));
+    QCOMPARE(copy.getPath("test", Version(1, 99)), QString("C:\\test99"));
+
+    // the assignment removes and changes the entries
+    QCOMPARE(ip.setPackageVersionPath("test", Version(1, 5), "", false),
+            QString());
+    QCOMPARE(ip.setPackageVersionPath("test", Version(1, 6), "C:\\other",
+            false), QString());
+    QCOMPARE(ip.setPackageVersionPath("test2", Version(1, 0), "C:\\test2",
+            false), QString());
+    copy = ip;
+    QVERIFY(!copy.isInstalled("test", Version(1, 5)));
+    QCOMPARE(copy.getPath("test", Version(1, 6)), QString("C:\\other"));
+    QVERIFY(copy.isInstalled("test2", Version(1, 0)));
+    QList<InstalledPackageVersion*> all = copy.getAll();
+    QCOMPARE(all.size(), 100);
+    qDeleteAll(all);
 }
 
 void App::testCommandLine()
@@ -198,3 +319,1380 @@ void App::testNormalizePath()
 {
     QCOMPARE(WPMUtils::normalizePath("../", false), "..");
 }
+
+void App::testConditionalDownload()
+{
+    // local HTTP server that knows only one version of one resource
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    int requests = 0;
+    connect(&server, &QTcpServer::newConnection, [&]() {
+        QTcpSocket* s = server.nextPendingConnection();
+        connect(s, &QTcpSocket::readyRead, [&, s]() {
+            QByteArray request = s->peek(s->bytesAvailable());
+            if (!request.contains("\r\n\r\n"))
+                return;
+            s->readAll();
+            requests++;
+
+            if (request.contains("If-None-Match: \"v1\"")) {
+                s->write("HTTP/1.1 304 Not Modified\r\n"
+                        "ETag: \"v1\"\r\n"
+                        "Content-Length: 0\r\n\r\n");
+            } else {
+                s->write("HTTP/1.1 200 OK\r\n"
+                        "ETag: \"v1\"\r\n"
+                        "Last-Modified: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+                        "Content-Type: text/xml\r\n"
+                        "Content-Length: 5\r\n\r\n"
+                        "hello");
+            }
+            s->disconnectFromHost();
+        });
+    });
+
+    QUrl url(QString("http://127.0.0.1:%1/Rep.xml").arg(server.serverPort()));
+
+    // first request: full content and the validators
+    Job* job = new Job("Download");
+    Downloader::Request request(url);
+    request.useCache = false;
+    request.interactive = false;
+    Downloader::Response response;
+    QFuture<QTemporaryFile*> f = QtConcurrent::run(
+            Downloader::downloadToTemporary2, job, request, &response);
+    while (!f.isFinished())
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    QTemporaryFile* tf = f.result();
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response.statusCode, 200);
+    QCOMPARE(response.etag, QString("\"v1\""));
+    QCOMPARE(response.lastModified, QString("Mon, 19 Oct 2026 10:00:00 GMT"));
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), QByteArray("hello"));
+    delete tf;
+    delete job;
+
+    // second request: not modified, no data
+    job = new Job("Conditional download");
+    request.ifNoneMatch = response.etag;
+    request.ifModifiedSince = response.lastModified;
+    Downloader::Response response2;
+    f = QtConcurrent::run(
+            Downloader::downloadToTemporary2, job, request, &response2);
+    while (!f.isFinished())
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    tf = f.result();
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response2.statusCode, 304);
+    QCOMPARE(tf->size(), static_cast<qint64>(0));
+    delete tf;
+    delete job;
+
+    QCOMPARE(requests, 2);
+}
+
+void App::testFileTransport()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray data;
+    for (int i = 0; i < 100000; i++)
+        data.append(static_cast<char>(i % 251));
+    QFile f(dir.path() + "/Rep.xml");
+    QVERIFY(f.open(QFile::WriteOnly));
+    QCOMPARE(f.write(data), static_cast<qint64>(data.size()));
+    f.close();
+
+    FileTransport transport(dir.path());
+    Downloader::setTransport(&transport);
+
+    // the whole file and the hash sum
+    Job* job = new Job("Download");
+    Downloader::Request request(QUrl("http://localhost/Rep.xml"));
+    request.hashSum = true;
+    Downloader::Response response;
+    QTemporaryFile* tf = Downloader::downloadToTemporary2(job, request,
+            &response);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response.statusCode, 200);
+    QCOMPARE(response.mimeType, QString("text/xml"));
+    QCOMPARE(response.hashSum, QString(QCryptographicHash::hash(data,
+            QCryptographicHash::Sha256).toHex()));
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), data);
+    delete tf;
+    delete job;
+
+    // a range
+    job = new Job("Partial download");
+    Downloader::Request request2(request);
+    request2.rangeStart = 1000;
+    request2.rangeEnd = 1999;
+    Downloader::Response response2;
+    tf = Downloader::downloadToTemporary2(job, request2, &response2);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response2.statusCode, 206);
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), data.mid(1000, 1000));
+    delete tf;
+    delete job;
+
+    // not modified
+    job = new Job("Conditional download");
+    Downloader::Request request3(request);
+    request3.ifNoneMatch = response.etag;
+    Downloader::Response response3;
+    tf = Downloader::downloadToTemporary2(job, request3, &response3);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response3.statusCode, 304);
+    QCOMPARE(tf->size(), static_cast<qint64>(0));
+    delete tf;
+    delete job;
+
+    // missing file
+    job = new Job("Missing file");
+    Downloader::Request request4(QUrl("http://localhost/Missing.xml"));
+    Downloader::Response response4;
+    tf = Downloader::downloadToTemporary2(job, request4, &response4);
+    QVERIFY(tf == nullptr);
+    QCOMPARE(response4.statusCode, 404);
+    delete job;
+
+    Downloader::setTransport(nullptr);
+}
+
+void App::testFileCheckSums()
+{
+    // with a partially filled last buffer
+    QList<int> sizes;
+    sizes.append(1234);
+    sizes.append(5 * 512 * 1024 + 1234);
+    for (int k = 0; k < sizes.size(); k++) {
+        int size = sizes.at(k);
+        QByteArray data;
+        for (int i = 0; i < size; i++)
+            data.append(static_cast<char>(i % 253));
+        QTemporaryFile f;
+        QVERIFY(f.open());
+        QCOMPARE(f.write(data), static_cast<qint64>(data.size()));
+
+        QVERIFY(f.seek(0));
+        Job* job = new Job("SHA-1");
+        QString sum = WPMUtils::fileCheckSum(job, &f,
+                QCryptographicHash::Sha1);
+        QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+        QCOMPARE(sum, QString(QCryptographicHash::hash(data,
+                QCryptographicHash::Sha1).toHex()));
+        delete job;
+
+        QVERIFY(f.seek(0));
+        job = new Job("SHA-256");
+        sum = WPMUtils::fileCheckSum(job, &f, QCryptographicHash::Sha256);
+        QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+        QCOMPARE(sum, QString(QCryptographicHash::hash(data,
+                QCryptographicHash::Sha256).toHex()));
+        delete job;
+    }
+}
+
+void App::testHashingWriter()
+{
+    // written in the calling thread and in the background thread with a
+    // partially filled last buffer
+    QList<int> sizes;
+    sizes.append(1234);
+    sizes.append(5 * HashingWriter::BUFFER_SIZE + 1234);
+    for (int k = 0; k < sizes.size(); k++) {
+        int size = sizes.at(k);
+        QByteArray data;
+        for (int i = 0; i < size; i++)
+            data.append(static_cast<char>(i % 253));
+
+        QTemporaryFile f;
+        QVERIFY(f.open());
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        {
+            HashingWriter writer(&f, &hash, size);
+            int pos = 0;
+            while (pos < size) {
+                char* buffer = writer.nextBuffer();
+                QVERIFY(buffer != nullptr);
+                int length = qMin(size - pos, HashingWriter::BUFFER_SIZE);
+                memcpy(buffer, data.constData() + pos,
+                        static_cast<size_t>(length));
+                writer.commit(length);
+                pos += length;
+            }
+            QCOMPARE(writer.finish(), QString());
+            QCOMPARE(writer.getBytesWritten(), static_cast<int64_t>(size));
+        }
+
+        QCOMPARE(hash.result(), QCryptographicHash::hash(data,
+                QCryptographicHash::Sha256));
+        QVERIFY(f.seek(0));
+        QCOMPARE(f.readAll(), data);
+    }
+}
+
+void App::benchmarkCopyFile_data()
+{
+    QTest::addColumn<int>("interval");
+    QTest::newRow("every update") << 0;
+    QTest::newRow("throttled") << 100;
+}
+
+void App::benchmarkCopyFile()
+{
+    QFETCH(int, interval);
+
+    QTemporaryFile src;
+    QVERIFY(src.open());
+    QByteArray block(64 * 1024, 'x');
+    for (int i = 0; i < 512; i++)
+        QCOMPARE(src.write(block), static_cast<qint64>(block.size()));
+    src.close();
+
+    // 4 KB chunks as delivered by a slow connection result in 8192 updates
+    // for 32 MB
+    const int chunkSize = 4 * 1024;
+    QByteArray buffer(chunkSize, Qt::Uninitialized);
+
+    JobProgressReporter::setDefaultInterval(interval);
+    QBENCHMARK {
+        // the updates propagate to the parent job as in the real application
+        Job* job = new Job("Copy");
+        Job* sub = job->newSubJob(1, "Downloading");
+        QFile in(src.fileName());
+        QVERIFY(in.open(QFile::ReadOnly));
+        QTemporaryFile dest;
+        QVERIFY(dest.open());
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        JobProgressReporter progress(sub);
+        int64_t total = in.size(), done = 0;
+        while (true) {
+            qint64 n = in.read(buffer.data(), chunkSize);
+            QVERIFY(n >= 0);
+            if (n == 0)
+                break;
+            QCOMPARE(dest.write(buffer.constData(), n), n);
+            hash.addData(buffer.constData(), static_cast<int>(n));
+            done += n;
+            progress.reportBytes(done, total);
+        }
+        QCOMPARE(done, total);
+        delete job;
+    }
+    JobProgressReporter::setDefaultInterval(100);
+}
+
+void App::benchmarkUnzip_data()
+{
+    QTest::addColumn<int>("interval");
+    QTest::addColumn<int>("threads");
+    QTest::newRow("every update") << 0 << 0;
+    QTest::newRow("throttled") << 100 << 0;
+    QTest::newRow("throttled, 1 thread") << 100 << 1;
+}
+
+void App::benchmarkUnzip()
+{
+    QFETCH(int, interval);
+    QFETCH(int, threads);
+
+    // many small entries
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString zipName = dir.path() + "/test.zip";
+    QuaZip zip(zipName);
+    QVERIFY(zip.open(QuaZip::mdCreate));
+    QuaZipFile zf(&zip);
+    for (int i = 0; i < 20000; i++) {
+        QVERIFY(zf.open(QIODevice::WriteOnly, QuaZipNewInfo(
+                QString("dir%1/sub%2/file%3.txt").arg(i % 10).arg(i % 100).
+                arg(i))));
+        zf.write(QByteArray(100 + i % 5000, static_cast<char>('a' + i % 26)));
+        zf.close();
+    }
+    zip.close();
+
+    JobProgressReporter::setDefaultInterval(interval);
+    QBENCHMARK {
+        QTemporaryDir out;
+        QVERIFY(out.isValid());
+        Job* job = new Job("Unzip");
+        Job* sub = job->newSubJob(1, "Extracting");
+        WPMUtils::unzip(sub, zipName, out.path(), threads);
+        QVERIFY2(sub->getErrorMessage().isEmpty(), qPrintable(sub->getErrorMessage()));
+        delete job;
+
+        QFile f(out.path() + "/dir9/sub99/file19999.txt");
+        QCOMPARE(f.size(), static_cast<qint64>(100 + 19999 % 5000));
+    }
+    JobProgressReporter::setDefaultInterval(100);
+}
+
+void App::testConnectionPool()
+{
+    QList<ConnectionPool::Handle> closed;
+    int a = 1, b = 2, c = 3;
+    {
+        ConnectionPool pool([&](ConnectionPool::Handle h) {
+            closed.append(h);
+        }, 2, 60000);
+
+        QString key = ConnectionPool::getKey(QUrl("https://Example.com/a.png"));
+        QCOMPARE(key, QString("https://example.com:443"));
+        QCOMPARE(ConnectionPool::getKey(QUrl("http://example.com:8080/")),
+                QString("http://example.com:8080"));
+
+        QVERIFY(pool.acquire(key) == nullptr);
+        pool.release(key, &a);
+        pool.release(key, &b);
+        QVERIFY(pool.acquire("http://example.com:80") == nullptr);
+
+        // the most recently used handle first
+        QVERIFY(pool.acquire(key) == &b);
+        QCOMPARE(pool.getHits(), 1);
+        QCOMPARE(pool.getMisses(), 2);
+
+        // only 2 idle handles per key
+        pool.release(key, &b);
+        pool.release(key, &c);
+        QCOMPARE(closed.size(), 1);
+        QVERIFY(closed.at(0) == &a);
+        QCOMPARE(pool.getIdleCount(), 2);
+
+        pool.resetCounters();
+        QCOMPARE(pool.getHits(), 0);
+    }
+
+    // the idle handles are closed by the destructor
+    QCOMPARE(closed.size(), 3);
+
+    // expired handles are closed
+    closed.clear();
+    ConnectionPool pool([&](ConnectionPool::Handle h) {
+        closed.append(h);
+    }, 2, 0);
+    pool.release("http://example.com:80", &a);
+    QTest::qSleep(10);
+    QVERIFY(pool.acquire("http://example.com:80") == nullptr);
+    QCOMPARE(closed.size(), 1);
+}
+
+void App::testTransferScheduler()
+{
+    TransferScheduler s;
+    s.setConcurrency(TransferScheduler::ICON, 2);
+
+    Job* job = new Job("Transfers");
+    Job* cancelled = new Job("Cancelled");
+    cancelled->cancel();
+
+    QVERIFY(s.acquire(job, TransferScheduler::ICON));
+    QVERIFY(s.acquire(job, TransferScheduler::ICON));
+    QCOMPARE(s.getRunning(TransferScheduler::ICON), 2);
+
+    // no free slot
+    QVERIFY(!s.acquire(cancelled, TransferScheduler::ICON));
+    s.release(TransferScheduler::ICON);
+    s.release(TransferScheduler::ICON);
+
+    // only one icon is loaded during an installation
+    QVERIFY(s.acquire(job, TransferScheduler::INSTALL));
+    QVERIFY(s.acquire(job, TransferScheduler::ICON));
+    QVERIFY(!s.acquire(cancelled, TransferScheduler::ICON));
+    s.release(TransferScheduler::ICON);
+    s.release(TransferScheduler::INSTALL);
+
+    // 2 MiB at 10 MiB/s
+    s.setBandwidthLimit(10 * 1024 * 1024);
+    QElapsedTimer t;
+    t.start();
+    for (int i = 0; i < 32; i++)
+        s.transferred(TransferScheduler::INSTALL, 64 * 1024);
+    QVERIFY2(t.elapsed() >= 150, qPrintable(QString::number(t.elapsed())));
+
+    delete cancelled;
+    delete job;
+}
+
+void App::testMirrors()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray data;
+    for (int i = 0; i < 1000000; i++)
+        data.append(static_cast<char>(i % 251));
+    QFile f(dir.path() + "/Package.zip");
+    QVERIFY(f.open(QFile::WriteOnly));
+    QCOMPARE(f.write(data), static_cast<qint64>(data.size()));
+    f.close();
+
+    FileTransport transport(dir.path());
+    Downloader::setTransport(&transport);
+
+    // the primary URL is not available, the data and the hash sum come from
+    // the mirror
+    Job* job = new Job("Download");
+    Downloader::Request request(QUrl("http://localhost/Missing.zip"));
+    request.mirrors.append(QUrl("http://mirror/Package.zip"));
+    request.hashSum = true;
+    request.resumeAttempts = 1;
+    Downloader::Response response;
+    QTemporaryFile* tf = Downloader::downloadToTemporary2(job, request,
+            &response);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(response.bytesReceived, static_cast<int64_t>(data.size()));
+    QCOMPARE(response.hashSum, QString(QCryptographicHash::hash(data,
+            QCryptographicHash::Sha256).toHex()));
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), data);
+    delete tf;
+    delete job;
+
+    // no server has the file
+    job = new Job("Missing file");
+    Downloader::Request request2(QUrl("http://localhost/Missing.zip"));
+    request2.mirrors.append(QUrl("http://mirror/Missing2.zip"));
+    Downloader::Response response2;
+    tf = Downloader::downloadToTemporary2(job, request2, &response2);
+    QVERIFY(tf == nullptr);
+    QVERIFY(!job->getErrorMessage().isEmpty());
+    delete job;
+
+    Downloader::setTransport(nullptr);
+}
+
+/**
+ * @brief FileTransport that drops connections and ignores "Range" like some
+ *     real servers do
+ */
+class FlakyTransport: public FileTransport
+{
+public:
+    /** number of GET responses that will be cut after cutAfter bytes */
+    QAtomicInt cuts;
+
+    /** number of bytes sent before a connection is dropped */
+    qint64 cutAfter;
+
+    /** true = "Range" is ignored and not advertised */
+    bool ignoreRange;
+
+    /** number of GET requests */
+    QAtomicInt gets;
+
+    /** number of HEAD requests */
+    QAtomicInt heads;
+
+    explicit FlakyTransport(const QString& root): FileTransport(root),
+            cutAfter(0), ignoreRange(false) {
+    }
+
+    QIODevice* open(Job* job, const Downloader::Request& request,
+            Downloader::Response* response, bool* gzip) override {
+        Downloader::Request r2(request);
+        if (ignoreRange) {
+            r2.rangeStart = 0;
+            r2.rangeEnd = -1;
+        }
+        QIODevice* d = FileTransport::open(job, r2, response, gzip);
+        if (ignoreRange)
+            response->acceptRanges = false;
+
+        if (request.httpMethod == "HEAD")
+            heads.ref();
+        else
+            gets.ref();
+
+        if (d && request.httpMethod == "GET" &&
+                response->statusCode / 100 == 2 &&
+                cuts.fetchAndAddOrdered(-1) > 0) {
+            QBuffer* b = new QBuffer();
+            b->setData(d->read(cutAfter));
+            b->open(QIODevice::ReadOnly);
+            delete d;
+            d = b;
+        }
+        return d;
+    }
+};
+
+void App::testResumableDownload()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray data(1000000, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i % 251);
+    QFile f(dir.path() + "/Package.zip");
+    QVERIFY(f.open(QFile::WriteOnly));
+    QCOMPARE(f.write(data), static_cast<qint64>(data.size()));
+    f.close();
+
+    QString sha256 = QCryptographicHash::hash(data,
+            QCryptographicHash::Sha256).toHex();
+
+    // the transfer is continued at the last received byte
+    FlakyTransport transport(dir.path());
+    transport.cuts = 1;
+    transport.cutAfter = 300000;
+    Downloader::setTransport(&transport);
+
+    Job* job = new Job("Download");
+    Downloader::Request request(QUrl("http://localhost/Package.zip"));
+    request.hashSum = true;
+    request.resumeAttempts = 2;
+    Downloader::Response response;
+    QTemporaryFile* tf = Downloader::downloadToTemporary2(job, request,
+            &response);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(transport.gets.load(), 2);
+    QCOMPARE(response.bytesReceived, static_cast<int64_t>(data.size()));
+    QCOMPARE(response.hashSum, sha256);
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), data);
+    delete tf;
+    delete job;
+
+    // the server answers the continuation with the whole file. The
+    // download is started again from the beginning.
+    transport.cuts = 1;
+    transport.gets = 0;
+    transport.ignoreRange = true;
+    job = new Job("Download without ranges");
+    Downloader::Response response2;
+    tf = Downloader::downloadToTemporary2(job, request, &response2);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(transport.gets.load(), 3);
+    QCOMPARE(response2.hashSum, sha256);
+    QVERIFY(tf->open());
+    QCOMPARE(tf->readAll(), data);
+    delete tf;
+    delete job;
+
+    // no more attempts
+    transport.cuts = 3;
+    job = new Job("Failed download");
+    Downloader::Response response3;
+    tf = Downloader::downloadToTemporary2(job, request, &response3);
+    QVERIFY(tf == nullptr);
+    QVERIFY(!job->getErrorMessage().isEmpty());
+    delete job;
+
+    Downloader::setTransport(nullptr);
+}
+
+void App::testSegmentedDownload()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // large enough for 2 segments
+    QByteArray data(17 * 1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i % 251);
+    QFile f(dir.path() + "/Package.zip");
+    QVERIFY(f.open(QFile::WriteOnly));
+    QCOMPARE(f.write(data), static_cast<qint64>(data.size()));
+    f.close();
+
+    QString sha256 = QCryptographicHash::hash(data,
+            QCryptographicHash::Sha256).toHex();
+
+    // both segments are written at their positions. The first one is
+    // interrupted and continued.
+    FlakyTransport transport(dir.path());
+    transport.cuts = 1;
+    transport.cutAfter = 1000000;
+    Downloader::setTransport(&transport);
+
+    Job* job = new Job("Download");
+    Downloader::Request request(QUrl("http://localhost/Package.zip"));
+    request.hashSum = true;
+    request.resumeAttempts = 1;
+    request.segments = 4;
+    request.expectedLength = data.size();
+    Downloader::Response response;
+    QTemporaryFile* tf = Downloader::downloadToTemporary2(job, request,
+            &response);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(transport.heads.load(), 1);
+    QCOMPARE(transport.gets.load(), 3);
+    QCOMPARE(response.contentLength, static_cast<int64_t>(data.size()));
+    QCOMPARE(response.hashSum, sha256);
+    QVERIFY(tf->open());
+    QVERIFY(tf->readAll() == data);
+    delete tf;
+    delete job;
+    QCOMPARE(TransferScheduler::getDefault()->getRunning(
+            TransferScheduler::REPOSITORY), 0);
+
+    // the server does not support ranges
+    transport.heads = 0;
+    transport.gets = 0;
+    transport.ignoreRange = true;
+    job = new Job("Download without ranges");
+    Downloader::Response response2;
+    tf = Downloader::downloadToTemporary2(job, request, &response2);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(transport.heads.load(), 1);
+    QCOMPARE(transport.gets.load(), 1);
+    QCOMPARE(response2.hashSum, sha256);
+    QVERIFY(tf->open());
+    QVERIFY(tf->readAll() == data);
+    delete tf;
+    delete job;
+
+    // a small or unknown size does not need the additional request
+    transport.heads = 0;
+    transport.gets = 0;
+    transport.ignoreRange = false;
+    job = new Job("Download with unknown size");
+    Downloader::Request request3(request);
+    request3.expectedLength = -1;
+    Downloader::Response response3;
+    tf = Downloader::downloadToTemporary2(job, request3, &response3);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QCOMPARE(transport.heads.load(), 0);
+    QCOMPARE(transport.gets.load(), 1);
+    QCOMPARE(response3.hashSum, sha256);
+    delete tf;
+    delete job;
+
+    Downloader::setTransport(nullptr);
+}
+
+void App::testRepositoryDelta()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const char* repositories[] = {
+        "<root spec-version='3'>"
+        "<license name='org.gnu.GPLv3'><title>GPL</title></license>"
+        "<package name='com.example.A'><title>A</title></package>"
+        "<package name='com.example.B'><title>B</title></package>"
+        "<version name='1.0' package='com.example.A'>"
+        "<url>http://example.com/a1.zip</url></version>"
+        "<version name='1.0' package='com.example.B'>"
+        "<url>http://example.com/b1.zip</url></version>"
+        "</root>",
+
+        "<root spec-version='3'>"
+        "<license name='org.gnu.GPLv3'><title>GPL</title></license>"
+        "<package name='com.example.A'><title>A editor</title></package>"
+        "<version name='1.0' package='com.example.A'>"
+        "<url>http://example.com/a1.zip</url></version>"
+        "<version name='2.0' package='com.example.A'>"
+        "<url>http://example.com/a2.zip</url></version>"
+        "</root>",
+    };
+    QStringList files;
+    files << dir.path() + "/Old.xml" << dir.path() + "/Rep.xml";
+    for (int i = 0; i < files.size(); i++) {
+        QFile f(files.at(i));
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write(repositories[i]);
+        f.close();
+    }
+
+    Job* job = new Job("Delta");
+    RepositoryDelta d;
+    d.create(job, files.at(0), files.at(1));
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    delete job;
+
+    QCOMPARE(d.from, QString(QCryptographicHash::hash(repositories[0],
+            QCryptographicHash::Sha1).toHex()));
+    QCOMPARE(d.changed.licenses.size(), 0);
+    QCOMPARE(d.changed.packages.size(), 1);
+    QCOMPARE(d.changed.packages.at(0)->title, QString("A editor"));
+    QCOMPARE(d.changed.packageVersions.size(), 1);
+    QVERIFY(d.changed.packageVersions.at(0)->version == Version(2, 0));
+    QCOMPARE(d.removedLicenses.size(), 0);
+    QCOMPARE(d.removedPackages, QStringList("com.example.B"));
+    QCOMPARE(d.removedVersions.size(), 1);
+    QCOMPARE(d.removedVersions.at(0).first, QString("com.example.B"));
+
+    // the delta is sent instead of the repository for the right SHA-1
+    QFile out(files.at(1) + "." + d.from + ".delta");
+    QVERIFY(out.open(QFile::WriteOnly));
+    QXmlStreamWriter w(&out);
+    w.writeStartDocument();
+    d.toXML(w);
+    w.writeEndDocument();
+    out.close();
+
+    FileTransport transport(dir.path());
+    Downloader::setTransport(&transport);
+
+    job = new Job("Download");
+    Downloader::Request request(QUrl("http://localhost/Rep.xml"));
+    request.headers = RepositoryDelta::HEADER + ": " + d.from;
+    Downloader::Response response;
+    QTemporaryFile* tf = Downloader::downloadToTemporary2(job, request,
+            &response);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    QVERIFY(tf != nullptr);
+    QVERIFY(RepositoryDelta::isDelta(tf));
+
+    RepositoryDelta d2;
+    QCOMPARE(d2.parse(tf, request.url), QString());
+    QCOMPARE(d2.from, d.from);
+    QCOMPARE(d2.to, d.to);
+    QCOMPARE(d2.changed.packages.size(), 1);
+    QCOMPARE(d2.changed.packageVersions.size(), 1);
+    QCOMPARE(d2.removedPackages, d.removedPackages);
+    QCOMPARE(d2.removedVersions.size(), 1);
+    delete tf;
+    delete job;
+
+    // the whole repository is sent for an unknown SHA-1
+    job = new Job("Download");
+    request.headers = RepositoryDelta::HEADER + ": " + d.to;
+    tf = Downloader::downloadToTemporary2(job, request, &response);
+    QVERIFY(tf != nullptr);
+    QVERIFY(!RepositoryDelta::isDelta(tf));
+    delete tf;
+    delete job;
+
+    Downloader::setTransport(nullptr);
+}
+
+void App::testZipStreamExtractor()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString zipName = dir.path() + "/test.zip";
+    QuaZip zip(zipName);
+    QVERIFY(zip.open(QuaZip::mdCreate));
+    QuaZipFile zf(&zip);
+    for (int i = 0; i < 100; i++) {
+        QVERIFY(zf.open(QIODevice::WriteOnly, QuaZipNewInfo(
+                QString("dir%1/file%2.txt").arg(i % 3).arg(i))));
+        zf.write(QByteArray(1000 * i, static_cast<char>('a' + i % 26)));
+        zf.close();
+    }
+    zip.close();
+
+    Job* job = new Job("Extract");
+    ZipStreamExtractor extractor(zipName, dir.path() + "/staging");
+    extractor.start(job);
+    extractor.finish(true);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    delete job;
+
+    QString out = dir.path() + "/out";
+    QVERIFY(QDir().mkpath(out));
+    QCOMPARE(extractor.commit(out), QString());
+    QFile f(out + "/dir2/file99.txt");
+    QVERIFY(f.open(QFile::ReadOnly));
+    QCOMPARE(f.readAll(), QByteArray(99000, 'a' + 99 % 26));
+    f.close();
+    QVERIFY(!QFileInfo(dir.path() + "/staging").exists());
+
+    // a damaged file is detected
+    QFile z(zipName);
+    QVERIFY(z.open(QFile::ReadWrite));
+    QVERIFY(z.seek(z.size() / 2));
+    z.write("damaged");
+    z.close();
+
+    job = new Job("Extract");
+    ZipStreamExtractor extractor2(zipName, dir.path() + "/staging2");
+    extractor2.start(job);
+    extractor2.finish(true);
+    QVERIFY(!job->getErrorMessage().isEmpty());
+    delete job;
+    extractor2.discard();
+    QVERIFY(!QFileInfo(dir.path() + "/staging2").exists());
+
+    // entries outside of the target directory are rejected
+    QStringList names;
+    names << "../evil.txt" << "dir/../../evil.txt" << "C:/evil.txt" <<
+            "/evil.txt";
+    for (int i = 0; i < names.size(); i++) {
+        QString evilName = dir.path() + QString("/evil%1.zip").arg(i);
+        QuaZip evil(evilName);
+        QVERIFY(evil.open(QuaZip::mdCreate));
+        QuaZipFile ef(&evil);
+        QVERIFY(ef.open(QIODevice::WriteOnly, QuaZipNewInfo(names.at(i))));
+        ef.write("evil");
+        ef.close();
+        evil.close();
+
+        job = new Job("Extract");
+        ZipStreamExtractor extractor3(evilName, dir.path() + "/s/staging3");
+        extractor3.start(job);
+        extractor3.finish(true);
+        QVERIFY(!job->getErrorMessage().isEmpty());
+        delete job;
+        extractor3.discard();
+        QVERIFY(!QFileInfo(dir.path() + "/s/evil.txt").exists());
+        QVERIFY(!QFileInfo(dir.path() + "/evil.txt").exists());
+    }
+}
+
+void App::testTrash()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString pkg = dir.path() + "/pkg";
+    for (int i = 0; i < 500; i++) {
+        QString sub = pkg + QString("/dir%1").arg(i % 7);
+        QVERIFY(QDir().mkpath(sub));
+        QFile f(sub + QString("/file%1.txt").arg(i));
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write("content");
+        f.close();
+    }
+    QFile ro(pkg + "/readonly.txt");
+    QVERIFY(ro.open(QFile::WriteOnly));
+    ro.close();
+    QVERIFY(ro.setPermissions(QFile::ReadOwner));
+
+    QCOMPARE(Trash::getDefault()->moveToTrash(pkg), QString());
+    QVERIFY(!QFileInfo(pkg).exists());
+
+    Trash::getDefault()->waitForDone();
+    QVERIFY(!QFileInfo(dir.path() + "/.NpackdTrash").exists());
+}
+
+void App::testFileStore()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QStringList dirs;
+    dirs << dir.path() + "/pkg1" << dir.path() + "/pkg2";
+    for (int i = 0; i < dirs.size(); i++) {
+        QVERIFY(QDir().mkpath(dirs.at(i) + "/bin"));
+        QFile f(dirs.at(i) + "/bin/shared.dll");
+        QVERIFY(f.open(QFile::WriteOnly));
+        f.write(QByteArray(10000, 'a'));
+        f.close();
+    }
+    QFile unique(dirs.at(0) + "/unique.dll");
+    QVERIFY(unique.open(QFile::WriteOnly));
+    unique.write(QByteArray(10000, 'b'));
+    unique.close();
+
+    FileStore store(dir.path());
+    for (int i = 0; i < dirs.size(); i++) {
+        Job* job = new Job("Deduplicate");
+        store.deduplicate(job, dirs.at(i));
+        QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+        delete job;
+    }
+
+    QFile f(dirs.at(1) + "/bin/shared.dll");
+    QVERIFY(f.open(QFile::ReadOnly));
+    QCOMPARE(f.readAll(), QByteArray(10000, 'a'));
+    f.close();
+
+    Job* job = new Job("Statistics");
+    FileStore::Statistics stats = store.computeStatistics(job, false);
+    delete job;
+    QCOMPARE(stats.files, static_cast<int64_t>(2));
+    QCOMPARE(stats.links, static_cast<int64_t>(3));
+    QCOMPARE(stats.saved, static_cast<int64_t>(10000));
+    QCOMPARE(stats.unused, static_cast<int64_t>(0));
+
+    // a file changed in place through a link is not shared anymore
+    QVERIFY(f.open(QFile::ReadWrite));
+    f.write(QByteArray(10000, 'c'));
+    f.close();
+    dirs << dir.path() + "/pkg3";
+    QVERIFY(QDir().mkpath(dirs.at(2)));
+    QFile copy(dirs.at(2) + "/shared.dll");
+    QVERIFY(copy.open(QFile::WriteOnly));
+    copy.write(QByteArray(10000, 'a'));
+    copy.close();
+    job = new Job("Deduplicate");
+    store.deduplicate(job, dirs.at(2));
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    delete job;
+    QVERIFY(copy.open(QFile::ReadOnly));
+    QCOMPARE(copy.readAll(), QByteArray(10000, 'a'));
+    copy.close();
+
+    // the stored files are deleted when they are not used anymore
+    for (int i = 0; i < dirs.size(); i++) {
+        QVERIFY(QDir(dirs.at(i)).removeRecursively());
+    }
+    job = new Job("Statistics");
+    stats = store.computeStatistics(job, true);
+    delete job;
+    QCOMPARE(stats.unused, static_cast<int64_t>(2));
+    QVERIFY(QDir(store.getDirectory()).entryList(
+            QDir::AllEntries | QDir::NoDotAndDotDot).isEmpty());
+}
+
+/**
+ * @brief writes a snapshot for SnapshotThirdPartyPM
+ * @param filename output file
+ * @param fingerprint2 fingerprint for the second entry
+ */
+static void writeSnapshot(const QString& filename,
+        const QString& fingerprint2)
+{
+    QJsonArray entries;
+    for (int i = 0; i < 2; i++) {
+        QJsonObject o;
+        o["package"] = QString("snap.Package%1").arg(i);
+        o["version"] = "1.0";
+        o["directory"] = "";
+        o["detectionInfo"] = QString("snap:%1").arg(i);
+        o["fingerprint"] = i == 0 ? "a" : fingerprint2;
+        entries.append(o);
+    }
+    QJsonObject top;
+    top["entries"] = entries;
+    QFile f(filename);
+    QVERIFY(f.open(QFile::WriteOnly));
+    f.write(QJsonDocument(top).toJson());
+    f.close();
+}
+
+void App::testDetectionJournal()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString snapshot = dir.path() + "/snapshot.json";
+    writeSnapshot(snapshot, "b");
+
+    SnapshotThirdPartyPM tpm(snapshot, "snap:");
+    QList<InstalledPackageVersion*> installed;
+    Repository rep;
+    Job* job = new Job("Scan");
+    tpm.scan(job, &installed, &rep);
+    QVERIFY2(job->getErrorMessage().isEmpty(), qPrintable(job->getErrorMessage()));
+    delete job;
+    QCOMPARE(installed.size(), 2);
+    QCOMPARE(rep.packageVersions.size(), 2);
+
+    DetectionJournal journal;
+    journal.setContext("repositories 1");
+    for (int i = 0; i < installed.size(); i++) {
+        DetectionJournal::Entry e;
+        e.fingerprint = DetectionJournal::computeFingerprint(&tpm,
+                *installed.at(i));
+        e.package = installed.at(i)->package;
+        e.version = installed.at(i)->version;
+        e.directory = "C:\\NpackdDetected\\" + e.package;
+        journal.record("snap:", installed.at(i)->detectionInfo, e);
+    }
+
+    QString source = tpm.getSourcesFingerprint();
+    QVERIFY(!source.isEmpty());
+    journal.setSourcesFingerprint("snap:", source);
+
+    QString file = dir.path() + "/journal.json";
+    QCOMPARE(journal.save(file), QString());
+    DetectionJournal journal2;
+    QCOMPARE(journal2.load(file), QString());
+    journal2.setContext("repositories 1");
+    QCOMPARE(journal2.count("snap:"), 2);
+    QCOMPARE(journal2.getEntries("snap:").size(), 2);
+
+    // the unchanged source does not have to be scanned again
+    QCOMPARE(journal2.getSourcesFingerprint("snap:"), source);
+
+    // only the changed entry has to be detected again
+    writeSnapshot(snapshot, "changed");
+    SnapshotThirdPartyPM tpm2(snapshot, "snap:");
+    QVERIFY(tpm2.getSourcesFingerprint() != source);
+    DetectionJournal::Entry e;
+    QVERIFY(journal2.find("snap:", "snap:0",
+            DetectionJournal::computeFingerprint(&tpm2, *installed.at(0)), &e));
+    QCOMPARE(e.package, QString("snap.Package0"));
+    QCOMPARE(e.directory, QString("C:\\NpackdDetected\\snap.Package0"));
+    QVERIFY(!journal2.find("snap:", "snap:1",
+            DetectionJournal::computeFingerprint(&tpm2, *installed.at(1)), &e));
+
+    // the results are not valid for other repositories
+    journal2.setContext("repositories 2");
+    QVERIFY(!journal2.find("snap:", "snap:0",
+            DetectionJournal::computeFingerprint(&tpm2, *installed.at(0)), &e));
+    QCOMPARE(journal2.getSourcesFingerprint("snap:"), QString());
+
+    qDeleteAll(installed);
+}
+
+void App::testConnectionPool()
+{
+    QList<ConnectionPool::Handle> closed;
+    ConnectionPool pool([&closed](ConnectionPool::Handle h) {
+        closed.append(h);
+    }, 2, 60000);
+
+    QString key = ConnectionPool::getKey(QUrl("https://Example.com/a.zip"));
+    QCOMPARE(key, QString("https://example.com:443"));
+
+    int a, b, c;
+    QVERIFY(pool.acquire(key) == nullptr);
+    pool.release(key, &a);
+    pool.release(key, &b);
+
+    // only 2 idle handles are kept for one server
+    pool.release(key, &c);
+    QCOMPARE(closed.size(), 1);
+    QVERIFY(closed.at(0) == &a);
+    QCOMPARE(pool.getIdleCount(), 2);
+
+    // the most recently used handle is re-used first
+    QVERIFY(pool.acquire(key) == &c);
+    QVERIFY(pool.acquire(ConnectionPool::getKey(
+            QUrl("http://example.com/"))) == nullptr);
+    QCOMPARE(pool.getHits(), 1);
+    QCOMPARE(pool.getMisses(), 2);
+
+    pool.clear();
+    QCOMPARE(closed.size(), 2);
+    QCOMPARE(pool.getIdleCount(), 0);
+}
+
+void App::benchmarkIconDownloads()
+{
+    // local HTTP/1.1 server with persistent connections
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    int connections = 0;
+    QByteArray icon(1024, 'i');
+    connect(&server, &QTcpServer::newConnection, [&]() {
+        QTcpSocket* s = server.nextPendingConnection();
+        connections++;
+        connect(s, &QTcpSocket::disconnected, s, &QObject::deleteLater);
+        connect(s, &QTcpSocket::readyRead, [&, s]() {
+            QByteArray data = s->property("buffer").toByteArray() +
+                    s->readAll();
+            int end;
+            while ((end = data.indexOf("\r\n\r\n")) >= 0) {
+                data = data.mid(end + 4);
+                s->write("HTTP/1.1 200 OK\r\n"
+                        "Content-Type: image/png\r\n"
+                        "Content-Length: 1024\r\n\r\n");
+                s->write(icon);
+            }
+            s->setProperty("buffer", data);
+        });
+    });
+
+    QBENCHMARK {
+        QFuture<QString> f = QtConcurrent::run([&]() {
+            QString err;
+            for (int i = 0; i < 500 && err.isEmpty(); i++) {
+                Job* job = new Job("Icon");
+                Downloader::Request request(QUrl(QString(
+                        "http://127.0.0.1:%1/icon%2.png").arg(
+                        server.serverPort()).arg(i)));
+                request.useCache = false;
+                request.interactive = false;
+                request.hashSum = true;
+                Downloader::download(job, request);
+                err = job->getErrorMessage();
+                delete job;
+            }
+            return err;
+        });
+        while (!f.isFinished())
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+        QVERIFY2(f.result().isEmpty(), qPrintable(f.result()));
+    }
+
+    qCDebug(npackd) << "connections:" << connections;
+}
+
+void App::testInstalledPackagesSave()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString file = dir.path() + "/installed.json";
+
+    FileInstalledPackagesStorage* storage =
+            new FileInstalledPackagesStorage(file);
+    std::unique_ptr<InstalledPackages> ip(new InstalledPackages());
+    ip->setStorage(storage);
+    QVERIFY(ip->readRegistryDatabase().isEmpty());
+
+    ip->setPackageVersionPath("a", Version(1, 0), "C:\\a", false);
+    ip->setPackageVersionPath("b", Version(2, 0), "C:\\b", false);
+    ip->setPackageVersionPath("c", Version(3, 0), "C:\\c", false);
+    QVERIFY(ip->save().isEmpty());
+    QCOMPARE(storage->getBatches(), 1);
+    QCOMPARE(storage->getWritten(), 3);
+
+    // nothing changed
+    QVERIFY(ip->save().isEmpty());
+    QCOMPARE(storage->getBatches(), 1);
+
+    // only the changed entries are written
+    ip->setPackageVersionPath("b", Version(2, 0), "", false);
+    ip->setPackageVersionPath("c", Version(3, 0), "C:\\c2", false);
+    QVERIFY(ip->save().isEmpty());
+    QCOMPARE(storage->getBatches(), 2);
+    QCOMPARE(storage->getWritten(), 5);
+
+    std::unique_ptr<InstalledPackages> ip2(new InstalledPackages());
+    ip2->setStorage(new FileInstalledPackagesStorage(file));
+    QVERIFY(ip2->readRegistryDatabase().isEmpty());
+    QCOMPARE(ip2->getPath("a", Version(1, 0)), QString("C:\\a"));
+    QVERIFY(!ip2->isInstalled("b", Version(2, 0)));
+    QCOMPARE(ip2->getPath("c", Version(3, 0)), QString("C:\\c2"));
+
+    // without a load the stored entries are compared with the current ones
+    FileInstalledPackagesStorage* storage3 =
+            new FileInstalledPackagesStorage(file);
+    std::unique_ptr<InstalledPackages> ip3(new InstalledPackages());
+    ip3->setStorage(storage3);
+    ip3->setPackageVersionPath("a", Version(1, 0), "C:\\a", false);
+    QVERIFY(ip3->save().isEmpty());
+    QCOMPARE(storage3->getWritten(), 1);
+
+    QVERIFY(ip2->readRegistryDatabase().isEmpty());
+    QVERIFY(ip2->isInstalled("a", Version(1, 0)));
+    QVERIFY(!ip2->isInstalled("c", Version(3, 0)));
+}
+
+void App::testStringPool()
+{
+    QString a = StringPool::intern(QString("com.example.") + "Test");
+    QString b = StringPool::intern(QString("com.example.Test"));
+    QCOMPARE(a, QString("com.example.Test"));
+    QVERIFY(a.constData() == b.constData());
+
+    // the names are interned when a package version is parsed
+    QString err;
+    std::unique_ptr<PackageVersion> pv(PackageVersion::parse(
+            "<version name='1.0' package='com.example.Test'>"
+            "<dependency package='com.example.Test' versions='[1,2)'/>"
+            "</version>", &err, false));
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(pv->package.constData() == a.constData());
+    QVERIFY(pv->dependencies.at(0)->package.constData() == a.constData());
+
+    // copies share the data without using the pool
+    std::unique_ptr<PackageVersion> copy(pv->clone());
+    QVERIFY(copy->package.constData() == a.constData());
+}
+
+/**
+ * @param pvs package versions
+ * @return bytes used by the distinct data of the package names in the
+ *     package versions and their dependencies
+ */
+static qint64 getPackageNameBytes(const QList<PackageVersion*>& pvs)
+{
+    QSet<const QChar*> seen;
+    qint64 r = 0;
+    for (int i = 0; i < pvs.size(); i++) {
+        const PackageVersion* pv = pvs.at(i);
+        QStringList names;
+        names.append(pv->package);
+        for (int j = 0; j < pv->dependencies.size(); j++) {
+            names.append(pv->dependencies.at(j)->package);
+        }
+        for (int j = 0; j < names.size(); j++) {
+            const QString& name = names.at(j);
+            if (!seen.contains(name.constData())) {
+                seen.insert(name.constData());
+                r += sizeof(QString::Data) + (name.size() + 1) * sizeof(QChar);
+            }
+        }
+    }
+    return r;
+}
+
+void App::benchmarkStringPool_data()
+{
+    QTest::addColumn<bool>("intern");
+    QTest::newRow("copies") << false;
+    QTest::newRow("interned") << true;
+}
+
+void App::benchmarkStringPool()
+{
+    QFETCH(bool, intern);
+
+    // 20000 package versions as in a large repository
+    QList<PackageVersion*> pvs;
+    for (int i = 0; i < 20000; i++) {
+        QString xml = QString("<version name='1.%1' "
+                "package='com.example.Package%2'>").arg(i % 10).arg(i / 10);
+        for (int j = 0; j < 3; j++) {
+            xml.append(QString("<dependency package='com.example.Package%1' "
+                    "versions='[1,2)'/>").arg(j));
+        }
+        xml.append("</version>");
+
+        QString err;
+        PackageVersion* pv = PackageVersion::parse(xml.toUtf8(), &err, false);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // without the pool every parsed name has its own data
+        if (!intern) {
+            pv->package = QString(pv->package.constData(),
+                    pv->package.size());
+            for (int j = 0; j < pv->dependencies.size(); j++) {
+                Dependency* d = pv->dependencies.at(j);
+                d->package = QString(d->package.constData(),
+                        d->package.size());
+            }
+        }
+        pvs.append(pv);
+    }
+
+    qint64 bytes = getPackageNameBytes(pvs);
+    qDeleteAll(pvs);
+
+    QTest::setBenchmarkResult(bytes, QTest::BytesAllocated);
+}
+
+void App::testMemoryArena()
+{
+    PackageVersion* outlives;
+    {
+        MemoryArena arena;
+        MemoryArena::Scope scope(&arena);
+
+        PackageVersion* pv = new PackageVersion("com.example.Test",
+                Version(1, 0));
+        pv->dependencies.append(new Dependency());
+        pv->files.append(new PackageVersionFile("a.txt", "a"));
+        QVERIFY(arena.getAllocated() > 0);
+
+        outlives = pv->clone();
+        delete pv;
+
+        {
+            // nested scopes restore the previous arena
+            MemoryArena::Scope heap(nullptr);
+            int64_t before = arena.getAllocated();
+            delete new Dependency();
+            QCOMPARE(arena.getAllocated(), before);
+        }
+    }
+
+    // the memory stays valid until the last object is deleted
+    QCOMPARE(outlives->package, QString("com.example.Test"));
+    QCOMPARE(outlives->files.at(0)->content, QString("a"));
+    delete outlives;
+
+    // objects allocated outside of an arena use the heap directly
+    PackageVersion* heap = new PackageVersion("com.example.Test",
+            Version(1, 0));
+    heap->files.append(new PackageVersionFile("b.txt", "b"));
+    QCOMPARE(heap->files.at(0)->content, QString("b"));
+    delete heap;
+}
+
+void App::testSharedPackageVersions()
+{
+    Repository rep;
+    PackageVersion a("com.example.Test", Version(1, 0));
+    PackageVersion b("com.example.Test", Version(2, 0));
+    QVERIFY(rep.savePackageVersion(&a, false).isEmpty());
+    QVERIFY(rep.savePackageVersion(&b, false).isEmpty());
+
+    QString err;
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            rep.getPackageVersionsShared_("com.example.Test", &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(pvs.size(), 2);
+    QCOMPARE(pvs.at(0)->version.compare(Version(2, 0)), 0);
+
+    std::shared_ptr<const PackageVersion> pv = rep.findPackageVersionShared_(
+            "com.example.Test", Version(1, 0), &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(pv.get() != nullptr);
+    QCOMPARE(pv->version.compare(Version(1, 0)), 0);
+
+    QVERIFY(rep.findPackageVersionShared_("com.example.Test", Version(3, 0),
+            &err).get() == nullptr);
+}
+
+void App::benchmarkMemoryArena_data()
+{
+    QTest::addColumn<bool>("arena");
+    QTest::newRow("heap") << false;
+    QTest::newRow("arena") << true;
+}
+
+/**
+ * @brief creates, copies and deletes the package versions of a synthetic
+ *     repository
+ * @param arena true = use a MemoryArena
+ */
+static void createPackageVersions(bool arena)
+{
+    std::unique_ptr<MemoryArena> a(arena ? new MemoryArena() : nullptr);
+    MemoryArena::Scope scope(a.get());
+
+    QList<PackageVersion*> pvs;
+    for (int i = 0; i < 5000; i++) {
+        PackageVersion* pv = new PackageVersion(
+                QString("com.example.Package%1").arg(i / 10),
+                Version(1, i % 10));
+        for (int j = 0; j < 3; j++) {
+            Dependency* d = new Dependency();
+            d->package = QString("com.example.Package%1").arg(j);
+            pv->dependencies.append(d);
+        }
+        for (int j = 0; j < 2; j++) {
+            pv->files.append(new PackageVersionFile(
+                    QString(".Npackd\\File%1.bat").arg(j), "echo"));
+        }
+        pvs.append(pv);
+    }
+
+    // planning copies the package versions
+    QList<PackageVersion*> copies;
+    for (int i = 0; i < pvs.size(); i++) {
+        copies.append(pvs.at(i)->clone());
+    }
+
+    qDeleteAll(copies);
+    qDeleteAll(pvs);
+}
+
+void App::benchmarkMemoryArena()
+{
+    QFETCH(bool, arena);
+
+    // an object from an arena that is still alive while the other threads
+    // allocate and delete objects
+    PackageVersion* outlives;
+    {
+        MemoryArena a;
+        MemoryArena::Scope scope(&a);
+        outlives = new PackageVersion("com.example.Test", Version(1, 0));
+    }
+
+    QBENCHMARK {
+        // 4 threads with 5000 package versions each
+        QList<QFuture<void> > futures;
+        for (int i = 0; i < 4; i++) {
+            futures.append(QtConcurrent::run([arena]() {
+                createPackageVersions(arena);
+            }));
+        }
+        for (int i = 0; i < futures.size(); i++) {
+            futures[i].waitForFinished();
+        }
+    }
+
+    delete outlives;
+}
@@ -21,6 +21,11 @@ class App: public QObject
 {
     Q_OBJECT
 private slots:
+    /**
+     * Chooses the transport for http: and https: URLs
+     */
+    void initTestCase();
+
     /**
      * Tests
      */
@@ -31,6 +36,11 @@ private slots:
      */
     void testInstalledPackages();
 
+    /**
+     * Tests for batches of changes and copies of InstalledPackages
+     */
+    void testInstalledPackagesUpdate();
+
     /**
      * Tests for CommandLine
      */
@@ -45,6 +55,128 @@ private slots:
      * Tests for WPMUtils::normalizePath
      */
     void testNormalizePath();
+
+    /**
+     * Tests for conditional requests in Downloader
+     */
+    void testConditionalDownload();
+
+    /**
+     * Tests for Downloader with FileTransport
+     */
+    void testFileTransport();
+
+    /**
+     * Tests for WPMUtils::fileCheckSum
+     */
+    void testFileCheckSums();
+
+    /**
+     * Tests for HashingWriter
+     */
+    void testHashingWriter();
+
+    /**
+     * Benchmark for copying a local file in small chunks with and without
+     * throttled progress updates
+     */
+    void benchmarkCopyFile_data();
+    void benchmarkCopyFile();
+
+    /**
+     * Benchmark for WPMUtils::unzip with and without throttled progress
+     * updates
+     */
+    void benchmarkUnzip_data();
+    void benchmarkUnzip();
+
+    /**
+     * Tests for ConnectionPool
+     */
+    void testConnectionPool();
+
+    /**
+     * Tests for TransferScheduler
+     */
+    void testTransferScheduler();
+
+    /**
+     * Tests for downloads with mirrors
+     */
+    void testMirrors();
+
+    /**
+     * Tests for resumed downloads from a server that drops connections or
+     * ignores "Range"
+     */
+    void testResumableDownload();
+
+    /**
+     * Tests for downloads over several parallel connections
+     */
+    void testSegmentedDownload();
+    /**
+     * Tests applying repository deltas against the previous download
+     */
+    void testRepositoryDelta();
+    /**
+     * Tests extracting a ZIP file while it is being downloaded
+     */
+    void testZipStreamExtractor();
+    /**
+     * Tests moving a package directory to the trash and emptying it
+     */
+    void testTrash();
+    /**
+     * Tests sharing identical files between package directories
+     */
+    void testFileStore();
+    /**
+     * Tests replaying the journal of detected third-party packages and the
+     * fingerprints of their sources
+     */
+    void testDetectionJournal();
+    /**
+     * Tests saving only the changed installed packages
+     */
+    void testInstalledPackagesSave();
+    /**
+     * Tests sharing the package names in the string pool
+     */
+    void testStringPool();
+    /**
+     * Tests allocating package versions in a memory arena
+     */
+    void testMemoryArena();
+    /**
+     * Tests sharing package versions between readers of a repository
+     */
+    void testSharedPackageVersions();
+
+    /**
+     * Benchmark for creating, copying and deleting package versions in 4
+     * threads at the same time with and without a MemoryArena while an
+     * object from another arena is still alive
+     */
+    void benchmarkMemoryArena_data();
+    void benchmarkMemoryArena();
+
+    /**
+     * Benchmark for the memory used by the package names of a large
+     * synthetic repository with and without the StringPool
+     */
+    void benchmarkStringPool_data();
+    void benchmarkStringPool();
+
+    /**
+     * Tests for ConnectionPool
+     */
+    void testConnectionPool();
+
+    /**
+     * Benchmark for downloading 500 small icons from a local server
+     */
+    void benchmarkIconDownloads();
 };
 
 #endif // APP_H
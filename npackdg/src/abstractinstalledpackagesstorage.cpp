@@ -0,0 +1,9 @@
+#include "abstractinstalledpackagesstorage.h"
+
+AbstractInstalledPackagesStorage::AbstractInstalledPackagesStorage()
+{
+}
+
+AbstractInstalledPackagesStorage::~AbstractInstalledPackagesStorage()
+{
+}
@@ -0,0 +1,35 @@
+#ifndef ABSTRACTINSTALLEDPACKAGESSTORAGE_H
+#define ABSTRACTINSTALLEDPACKAGESSTORAGE_H
+
+#include <QString>
+#include <QList>
+
+#include "installedpackageversion.h"
+
+/**
+ * @brief persistent storage for the list of installed package versions
+ */
+class AbstractInstalledPackagesStorage
+{
+public:
+    AbstractInstalledPackagesStorage();
+
+    virtual ~AbstractInstalledPackagesStorage();
+
+    /**
+     * @brief reads all stored installed package versions
+     * @param ipvs [move] the stored entries will be added here
+     * @return error message
+     */
+    virtual QString load(QList<InstalledPackageVersion*>* ipvs) = 0;
+
+    /**
+     * @brief stores the changed entries in one batch
+     * @param ipvs changed entries. Entries with an empty directory are
+     *     removed from the storage.
+     * @return error message
+     */
+    virtual QString save(const QList<InstalledPackageVersion*>& ipvs) = 0;
+};
+
+#endif // ABSTRACTINSTALLEDPACKAGESSTORAGE_H
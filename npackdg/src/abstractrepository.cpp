@@ -6,6 +6,8 @@
 #include "installedpackages.h"
 #include "downloader.h"
 #include "packageutils.h"
+#include "trash.h"
+#include "memoryarena.h"
 
 QSemaphore AbstractRepository::installationScripts(1);
 
@@ -105,6 +107,7 @@ void AbstractRepository::exportPackagesCoInitializeAndFree(Job *job,
             pv->downloadTo(*djob, fn, true);
 
             pv->download.setUrl(QFileInfo(fn).fileName());
+            pv->mirrors.clear();
         }
     }
 
@@ -199,10 +202,11 @@ QList<PackageVersion *> AbstractRepository::findAllMatchesToInstall(
 {
     QList<PackageVersion*> res;
 
-    QList<PackageVersion*> pvs = getPackageVersions_(dep.package, err);
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            getPackageVersionsShared_(dep.package, err);
     if (err->isEmpty()) {
         for (int i = 0; i < pvs.count(); i++) {
-            PackageVersion* pv = pvs.at(i);
+            const PackageVersion* pv = pvs.at(i).get();
             if (dep.test(pv->version) &&
                     pv->download.isValid() &&
                     PackageVersion::indexOf(avoid, pv) < 0) {
@@ -210,7 +214,6 @@ QList<PackageVersion *> AbstractRepository::findAllMatchesToInstall(
             }
         }
     }
-    qDeleteAll(pvs);
 
     return res;
 }
@@ -219,12 +222,13 @@ PackageVersion *AbstractRepository::findBestMatchToInstall(
         const Dependency &dep, const QList<PackageVersion *> &avoid,
         QString *err) const
 {
-    PackageVersion* res = nullptr;
+    const PackageVersion* res = nullptr;
 
-    QList<PackageVersion*> pvs = getPackageVersions_(dep.package, err);
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            getPackageVersionsShared_(dep.package, err);
     if (err->isEmpty()) {
         for (int i = 0; i < pvs.count(); i++) {
-            PackageVersion* pv = pvs.at(i);
+            const PackageVersion* pv = pvs.at(i).get();
             if (dep.test(pv->version) &&
                     pv->download.isValid() &&
                     PackageVersion::indexOf(avoid, pv) < 0) {
@@ -234,12 +238,7 @@ PackageVersion *AbstractRepository::findBestMatchToInstall(
         }
     }
 
-    if (res) {
-        res = res->clone();
-    }
-    qDeleteAll(pvs);
-
-    return res;
+    return res ? res->clone() : nullptr;
 }
 
 QString AbstractRepository::toString(const Dependency &dep,
@@ -298,6 +297,10 @@ void AbstractRepository::process(Job *job,
         }
     }
 
+    // directories that were not deleted by a previous process
+    Trash::getDefault()->emptyLeftovers(
+            PackageUtils::getPackageParentDirectories());
+
     QDir d;
 
     QList<InstallOperation *> install = install_;
@@ -603,10 +606,10 @@ QList<PackageVersion*> AbstractRepository::getInstalled_(QString *err)
     *err = "";
 
     QList<PackageVersion*> ret;
-    QList<InstalledPackageVersion*> ipvs =
-            InstalledPackages::getDefault()->getAll();
+    QList<std::shared_ptr<const InstalledPackageVersion> > ipvs =
+            InstalledPackages::getDefault()->getAllShared_();
     for (int i = 0; i < ipvs.count(); i++) {
-        InstalledPackageVersion* ipv = ipvs.at(i);
+        const InstalledPackageVersion* ipv = ipvs.at(i).get();
         PackageVersion* pv = this->findPackageVersion_(ipv->package,
                 ipv->version, err);
         if (!err->isEmpty())
@@ -615,7 +618,6 @@ QList<PackageVersion*> AbstractRepository::getInstalled_(QString *err)
             ret.append(pv);
         }
     }
-    qDeleteAll(ipvs);
 
     return ret;
 }
@@ -623,6 +625,11 @@ QList<PackageVersion*> AbstractRepository::getInstalled_(QString *err)
 QString AbstractRepository::planAddMissingDeps(InstalledPackages &installed,
         QList<InstallOperation*>& ops)
 {
+    // the created operations keep the memory of the plan until they are
+    // deleted
+    MemoryArena arena;
+    MemoryArena::Scope scope(&arena);
+
     QString err;
 
     QList<PackageVersion*> avoid;
@@ -656,6 +663,9 @@ QString AbstractRepository::planUpdates(InstalledPackages& installed,
         QList<InstallOperation*>& ops, bool keepDirectories,
         bool install, const QString &where_, bool exactLocation)
 {
+    MemoryArena arena;
+    MemoryArena::Scope scope(&arena);
+
     QString err;
 
     QList<PackageVersion*> newest, newesti;
@@ -679,11 +689,11 @@ QString AbstractRepository::planUpdates(InstalledPackages& installed,
                 continue;
             }
 
-            InstalledPackageVersion* ib = installed.getNewestInstalled(p->name);
+            std::shared_ptr<const InstalledPackageVersion> ib =
+                    installed.getNewestInstalledShared_(p->name);
             PackageVersion* b = nullptr;
             if (ib) {
                 b = this->findPackageVersion_(p->name, ib->version, &err);
-                delete ib;
             }
 
             if (!err.isEmpty()) {
@@ -734,7 +744,8 @@ QString AbstractRepository::planUpdates(InstalledPackages& installed,
                 continue;
             }
 
-            InstalledPackageVersion* ipv = installed.findHighestInstalledMatch(*d);
+            std::shared_ptr<const InstalledPackageVersion> ipv =
+                    installed.findHighestInstalledMatchShared_(*d);
             PackageVersion* b = nullptr;
             if (ipv) {
                 b = findPackageVersion_(ipv->package, ipv->version, &err);
@@ -942,27 +953,26 @@ PackageVersion* AbstractRepository::findNewestInstalledPackageVersion_(
 
     PackageVersion* r = nullptr;
 
-    InstalledPackageVersion* ipv = InstalledPackages::getDefault()->
-            getNewestInstalled(name);
+    std::shared_ptr<const InstalledPackageVersion> ipv =
+            InstalledPackages::getDefault()->getNewestInstalledShared_(name);
 
     if (ipv) {
         r = this->findPackageVersion_(name, ipv->version, err);
     }
 
-    delete ipv;
-
     return r;
 }
 
 PackageVersion* AbstractRepository::findNewestInstallablePackageVersion_(
         const QString &package, QString* err) const
 {
-    PackageVersion* r = nullptr;
+    const PackageVersion* r = nullptr;
 
-    QList<PackageVersion*> pvs = this->getPackageVersions_(package, err);
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            this->getPackageVersionsShared_(package, err);
     if (err->isEmpty()) {
         for (int i = 0; i < pvs.count(); i++) {
-            PackageVersion* p = pvs.at(i);
+            const PackageVersion* p = pvs.at(i).get();
             if (r == nullptr || p->version.compare(r->version) > 0) {
                 if (p->download.isValid())
                     r = p;
@@ -970,10 +980,38 @@ PackageVersion* AbstractRepository::findNewestInstallablePackageVersion_(
         }
     }
 
-    if (r)
-        r = r->clone();
+    return r ? r->clone() : nullptr;
+}
+
+QList<std::shared_ptr<const PackageVersion> >
+        AbstractRepository::getPackageVersionsShared_(const QString& package,
+        QString* err) const
+{
+    QList<std::shared_ptr<const PackageVersion> > r;
+
+    QList<PackageVersion*> pvs = getPackageVersions_(package, err);
+    r.reserve(pvs.size());
+    for (int i = 0; i < pvs.size(); i++) {
+        r.append(std::shared_ptr<const PackageVersion>(pvs.at(i)));
+    }
+
+    return r;
+}
 
-    qDeleteAll(pvs);
+std::shared_ptr<const PackageVersion>
+        AbstractRepository::findPackageVersionShared_(const QString& package,
+        const Version& version, QString* err) const
+{
+    std::shared_ptr<const PackageVersion> r;
+
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            getPackageVersionsShared_(package, err);
+    for (int i = 0; i < pvs.size(); i++) {
+        if (pvs.at(i)->version.compare(version) == 0) {
+            r = pvs.at(i);
+            break;
+        }
+    }
 
     return r;
 }
@@ -1046,13 +1084,13 @@ QString AbstractRepository::checkInstallationDirectory(const QString &dir) const
 
     if (err.isEmpty()) {
         InstalledPackages* ip = InstalledPackages::getDefault();
-        InstalledPackageVersion* ipv = ip->findOwner(dir);
+        std::shared_ptr<const InstalledPackageVersion> ipv =
+                ip->findOwnerShared_(dir);
         if (ipv) {
             err = QObject::tr("Cannot change the installation directory to %1. %2 %3 is installed there").
                     arg(dir).
                     arg(getPackageTitleAndName(ipv->package)).
                     arg(ipv->version.getVersionString());
-            delete ipv;
         }
     }
     return err;
@@ -1,6 +1,8 @@
 #ifndef ABSTRACTREPOSITORY_H
 #define ABSTRACTREPOSITORY_H
 
+#include <memory>
+
 #include "stable.h"
 
 #include "packageversion.h"
@@ -98,6 +100,33 @@ public:
     virtual QList<PackageVersion*> getPackageVersions_(
             const QString& package, QString* err) const = 0;
 
+    /**
+     * Finds all package versions without copying them. The returned objects
+     * may be shared with a cache and other callers and must not be changed.
+     * PackageVersion::clone() creates a copy that can be changed.
+     *
+     * @param package full package name
+     * @param err error message will be stored here
+     * @return the list of package versions.
+     *     The first returned object has the highest version number.
+     */
+    virtual QList<std::shared_ptr<const PackageVersion> >
+            getPackageVersionsShared_(const QString& package,
+            QString* err) const;
+
+    /**
+     * Finds a package version without copying it
+     * (see getPackageVersionsShared_).
+     *
+     * @param package full package name
+     * @param version package version
+     * @param err error message will be stored here
+     * @return found package version or nullptr
+     */
+    std::shared_ptr<const PackageVersion> findPackageVersionShared_(
+            const QString& package, const Version& version,
+            QString* err) const;
+
     /**
      * Find the newest installed package version.
      *
@@ -1,6 +1,8 @@
 #include <QThread>
+#include <QCryptographicHash>
 
 #include "abstractthirdpartypm.h"
+#include "windowsregistry.h"
 
 AbstractThirdPartyPM::AbstractThirdPartyPM()
 {
@@ -17,3 +19,49 @@ void AbstractThirdPartyPM::scanRunnable(Job *job, QList<InstalledPackageVersion
     scan(job, installed, rep);
     CoUninitialize();
 }
+
+QString AbstractThirdPartyPM::getFingerprint(
+        const InstalledPackageVersion& /*ipv*/) const
+{
+    return QString();
+}
+
+QString AbstractThirdPartyPM::getSourcesFingerprint() const
+{
+    return QString();
+}
+
+void AbstractThirdPartyPM::addRegistryFingerprint(HKEY root,
+        const QString& path, QStringList* parts)
+{
+    parts->append(path);
+
+    WindowsRegistry k;
+    QString err = k.open(root, path, false, KEY_READ);
+    if (!err.isEmpty()) {
+        parts->append(QStringLiteral("-"));
+        return;
+    }
+
+    // values of the sub-keys do not change the time of the parent key
+    quint64 t = k.getLastWriteTime(&err);
+    parts->append(err.isEmpty() ? QString::number(t) : QStringLiteral("-"));
+
+    QStringList entries = k.list(&err);
+    for (int i = 0; i < entries.count(); i++) {
+        WindowsRegistry sub;
+        QString name = entries.at(i);
+        err = sub.open(k, name, KEY_READ);
+        if (err.isEmpty())
+            t = sub.getLastWriteTime(&err);
+        parts->append(name + ' ' + (err.isEmpty() ? QString::number(t) :
+                QStringLiteral("-")));
+    }
+}
+
+QString AbstractThirdPartyPM::hashFingerprint(const QStringList& parts)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(parts.join('\n').toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
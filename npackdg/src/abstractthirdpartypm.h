@@ -1,7 +1,10 @@
 #ifndef ABSTRACTTHIRDPARTYPM_H
 #define ABSTRACTTHIRDPARTYPM_H
 
+#include <windows.h>
+
 #include <QList>
+#include <QStringList>
 
 #include "package.h"
 #include "packageversion.h"
@@ -54,6 +57,51 @@ public:
      */
     virtual void scan(Job* job, QList<InstalledPackageVersion*>* installed,
             Repository* rep) const = 0;
+
+    /**
+     * @brief computes a fingerprint for the source of a detected package
+     *     version (e.g. the time of the last change of a registry key). The
+     *     detection of an entry is skipped if the fingerprint and the
+     *     detected data did not change (see DetectionJournal). This is only
+     *     used if detectionPrefix is not empty.
+     *
+     * @param ipv a package version returned by scan()
+     * @return fingerprint. The default implementation returns an empty
+     *     string. The detected package name, version, directory and
+     *     detection information are always compared.
+     */
+    virtual QString getFingerprint(const InstalledPackageVersion& ipv) const;
+
+    /**
+     * @brief computes a fingerprint for all sources of this package manager
+     *     (e.g. the times of the last change of the registry keys). This is
+     *     much faster than scan(). If the fingerprint did not change since the
+     *     last detection, scan() is not called and the results of the last
+     *     detection are used (see DetectionJournal). This is only used if
+     *     detectionPrefix is not empty.
+     *
+     * @return fingerprint. The default implementation returns an empty
+     *     string which means that scan() is always called.
+     */
+    virtual QString getSourcesFingerprint() const;
+protected:
+    /**
+     * @brief adds the time of the last change of a registry key and the names
+     *     and times of the last change of all its sub-keys to a fingerprint.
+     *     A missing key is also recorded.
+     *
+     * @param root root key
+     * @param path path to the key under root
+     * @param parts the data will be appended here
+     */
+    static void addRegistryFingerprint(HKEY root, const QString& path,
+            QStringList* parts);
+
+    /**
+     * @param parts data collected for a fingerprint
+     * @return SHA-1 of the data
+     */
+    static QString hashFingerprint(const QStringList& parts);
 };
 
 #endif // ABSTRACTTHIRDPARTYPM_H
@@ -0,0 +1,9 @@
+#include "abstracttransport.h"
+
+AbstractTransport::AbstractTransport()
+{
+}
+
+AbstractTransport::~AbstractTransport()
+{
+}
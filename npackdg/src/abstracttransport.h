@@ -0,0 +1,44 @@
+#ifndef ABSTRACTTRANSPORT_H
+#define ABSTRACTTRANSPORT_H
+
+#include <QIODevice>
+
+#include "downloader.h"
+#include "job.h"
+
+/**
+ * @brief sends HTTP requests and provides access to the response data.
+ *     Downloader uses an implementation of this interface for all http: and
+ *     https: URLs and handles the response data, hash sums, ranges and
+ *     repeated attempts independently of the transport.
+ */
+class AbstractTransport
+{
+public:
+    AbstractTransport();
+
+    virtual ~AbstractTransport();
+
+    /**
+     * @brief sends a request and reads the response headers. This method is
+     *     called from arbitrary threads. The returned device will only be used
+     *     from the calling thread.
+     * @param job job object. The progress is not changed. An error message
+     *     will be set if the request cannot be sent.
+     * @param request HTTP request. Request::canBeCompressed() defines whether
+     *     a compressed response may be requested.
+     * @param response Response::statusCode, mimeType, contentDisposition,
+     *     contentLength, acceptRanges, etag and lastModified will be filled.
+     *     The status code is not checked.
+     * @param gzip true will be stored here if the data returned by the device
+     *     is compressed using gzip or deflate
+     * @return [ownership:caller] a sequential device opened for reading that
+     *     blocks until data is available and returns 0 bytes at the end of the
+     *     response. Deleting the device closes the connection. nullptr is only
+     *     returned if the job has an error message.
+     */
+    virtual QIODevice* open(Job* job, const Downloader::Request& request,
+            Downloader::Response* response, bool* gzip) = 0;
+};
+
+#endif // ABSTRACTTRANSPORT_H
@@ -4,6 +4,7 @@
 #include <QObject>
 
 #include "asyncdownloader.h"
+#include "wininettransport.h"
 #include "wpmutils.h"
 
 #define BUFFER_LEN  4096
@@ -31,7 +32,7 @@ int64_t AsyncDownloader::downloadWin2(Job* job,
     QUrl url = request.url;
     QString* mime = &response->mimeType;
     QString* contentDisposition = &response->contentDisposition;
-    HWND parentWindow = defaultPasswordWindow;
+    HWND parentWindow = WinINetTransport::parentWindow;
     QString* sha1 = &response->hashSum;
     bool useCache = request.useCache;
     QCryptographicHash::Algorithm alg = request.alg;
@@ -985,24 +986,24 @@ DWORD AsyncDownloader::CreateWininetHandles(Job* job, PREQUEST_CONTEXT ReqContex
 
     if (job->shouldProceed()) {
         if (!request.user.isEmpty()) {
-            setStringOption(hConnectHandle, INTERNET_OPTION_USERNAME,
-                    request.user);
+            WinINetTransport::setStringOption(hConnectHandle,
+                    INTERNET_OPTION_USERNAME, request.user);
 
             if (!request.password.isEmpty()) {
-                setStringOption(hConnectHandle, INTERNET_OPTION_PASSWORD,
-                        request.password);
+                WinINetTransport::setStringOption(hConnectHandle,
+                        INTERNET_OPTION_PASSWORD, request.password);
             }
         }
     }
 
     if (job->shouldProceed()) {
         if (!request.proxyUser.isEmpty()) {
-            setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_USERNAME,
-                    request.proxyUser);
+            WinINetTransport::setStringOption(hConnectHandle,
+                    INTERNET_OPTION_PROXY_USERNAME, request.proxyUser);
 
             if (!request.proxyPassword.isEmpty()) {
-                setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_PASSWORD,
-                        request.proxyPassword);
+                WinINetTransport::setStringOption(hConnectHandle,
+                        INTERNET_OPTION_PROXY_PASSWORD, request.proxyPassword);
             }
         }
     }
@@ -19,6 +19,7 @@
 #include "progresstree2.h"
 #include "mainwindow.h"
 #include "packageutils.h"
+#include "transferscheduler.h"
 
 // TODO: i18n
 
@@ -612,6 +613,12 @@ bool CLProcessor::process(int argc, char *argv[], int* errorCode)
 
     QString commandLineParsingError = cl.parse();
 
+    TransferScheduler::getDefault()->setBandwidthLimit(
+            static_cast<int64_t>(PackageUtils::getBandwidthLimit()) * 1024);
+
+    // directories that were not deleted by a previous process
+    PackageUtils::emptyTrash();
+
     // cl.dump();
 
     /*
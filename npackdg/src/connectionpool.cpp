@@ -0,0 +1,133 @@
+#include "connectionpool.h"
+
+ConnectionPool::ConnectionPool(Closer closer, int maxPerHost,
+        int idleTimeout): closer(closer), maxPerHost(maxPerHost),
+        idleTimeout(idleTimeout), hits(0), misses(0)
+{
+    clock.start();
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    clear();
+}
+
+QString ConnectionPool::getKey(const QUrl& url)
+{
+    QString scheme = url.scheme().toLower();
+    return scheme + "://" + url.host().toLower() + ":" +
+            QString::number(url.port(scheme == "https" ? 443 : 80));
+}
+
+void ConnectionPool::removeExpired(QList<Handle>* toClose)
+{
+    qint64 now = clock.elapsed();
+    for (QMap<QString, QList<Entry> >::iterator it = idle.begin();
+            it != idle.end(); ) {
+        QList<Entry>& entries = it.value();
+
+        // the oldest handles are at the beginning
+        while (!entries.isEmpty() &&
+                now - entries.first().idleSince > idleTimeout) {
+            toClose->append(entries.takeFirst().handle);
+        }
+
+        if (entries.isEmpty())
+            it = idle.erase(it);
+        else
+            ++it;
+    }
+}
+
+ConnectionPool::Handle ConnectionPool::acquire(const QString& key)
+{
+    Handle r = nullptr;
+    QList<Handle> toClose;
+
+    mutex.lock();
+    removeExpired(&toClose);
+    QMap<QString, QList<Entry> >::iterator it = idle.find(key);
+    if (it != idle.end()) {
+        r = it.value().takeLast().handle;
+        if (it.value().isEmpty())
+            idle.erase(it);
+    }
+    mutex.unlock();
+
+    for (int i = 0; i < toClose.size(); i++)
+        closer(toClose.at(i));
+
+    if (r)
+        hits.fetchAndAddOrdered(1);
+    else
+        misses.fetchAndAddOrdered(1);
+
+    return r;
+}
+
+void ConnectionPool::release(const QString& key, Handle handle)
+{
+    QList<Handle> toClose;
+
+    mutex.lock();
+    removeExpired(&toClose);
+    QList<Entry>& entries = idle[key];
+    Entry e;
+    e.handle = handle;
+    e.idleSince = clock.elapsed();
+    entries.append(e);
+    if (entries.size() > maxPerHost)
+        toClose.append(entries.takeFirst().handle);
+    mutex.unlock();
+
+    for (int i = 0; i < toClose.size(); i++)
+        closer(toClose.at(i));
+}
+
+void ConnectionPool::clear()
+{
+    QList<Handle> toClose;
+
+    mutex.lock();
+    for (QMap<QString, QList<Entry> >::const_iterator it = idle.constBegin();
+            it != idle.constEnd(); ++it) {
+        const QList<Entry>& entries = it.value();
+        for (int i = 0; i < entries.size(); i++)
+            toClose.append(entries.at(i).handle);
+    }
+    idle.clear();
+    mutex.unlock();
+
+    for (int i = 0; i < toClose.size(); i++)
+        closer(toClose.at(i));
+}
+
+int ConnectionPool::getIdleCount() const
+{
+    int r = 0;
+
+    mutex.lock();
+    for (QMap<QString, QList<Entry> >::const_iterator it = idle.constBegin();
+            it != idle.constEnd(); ++it) {
+        r += it.value().size();
+    }
+    mutex.unlock();
+
+    return r;
+}
+
+int ConnectionPool::getHits() const
+{
+    return hits.loadAcquire();
+}
+
+int ConnectionPool::getMisses() const
+{
+    return misses.loadAcquire();
+}
+
+void ConnectionPool::resetCounters()
+{
+    hits.storeRelease(0);
+    misses.storeRelease(0);
+}
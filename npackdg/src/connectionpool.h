@@ -0,0 +1,121 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <functional>
+
+#include <QString>
+#include <QUrl>
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+/**
+ * @brief idle connection handles that can be re-used for the next request to
+ *     the same server. The handles are grouped by a key (scheme, host and
+ *     port). A handle is taken from the pool for the duration of one request
+ *     and returned afterwards. Handles that were idle for too long or that do
+ *     not fit into the pool are closed.
+ *
+ * This class is thread-safe.
+ */
+class ConnectionPool
+{
+public:
+    typedef void* Handle;
+
+    /** closes a handle */
+    typedef std::function<void(Handle)> Closer;
+private:
+    class Entry
+    {
+    public:
+        Handle handle;
+
+        /** value of ConnectionPool::clock when the handle was released */
+        qint64 idleSince;
+    };
+
+    Closer closer;
+    int maxPerHost;
+    qint64 idleTimeout;
+
+    mutable QMutex mutex;
+
+    /** key -> idle handles. The most recently used handle is at the end. */
+    QMap<QString, QList<Entry> > idle;
+
+    QElapsedTimer clock;
+
+    QAtomicInt hits;
+    QAtomicInt misses;
+
+    /**
+     * @brief removes the expired handles. Should be called under the mutex.
+     * @param toClose the removed handles will be stored here
+     */
+    void removeExpired(QList<Handle>* toClose);
+public:
+    /**
+     * @param closer this function closes a handle
+     * @param maxPerHost maximum number of idle handles for one key
+     * @param idleTimeout idle handles are closed after this number of
+     *     milliseconds
+     */
+    ConnectionPool(Closer closer, int maxPerHost=6, int idleTimeout=60000);
+
+    /**
+     * @brief closes all idle handles
+     */
+    ~ConnectionPool();
+
+    /**
+     * @param url an URL
+     * @return key for the server: scheme://host:port
+     */
+    static QString getKey(const QUrl& url);
+
+    /**
+     * @brief takes an idle handle from the pool
+     * @param key server key
+     * @return the handle or nullptr if there is no idle handle for this key.
+     *     In the latter case the caller should create a new handle.
+     */
+    Handle acquire(const QString& key);
+
+    /**
+     * @brief returns a handle to the pool. The handle is closed if there are
+     *     already maxPerHost idle handles for this key.
+     * @param key server key
+     * @param handle the handle
+     */
+    void release(const QString& key, Handle handle);
+
+    /**
+     * @brief closes all idle handles
+     */
+    void clear();
+
+    /**
+     * @return number of idle handles
+     */
+    int getIdleCount() const;
+
+    /**
+     * @return number of acquire() calls that returned an idle handle
+     */
+    int getHits() const;
+
+    /**
+     * @return number of acquire() calls that did not find an idle handle
+     */
+    int getMisses() const;
+
+    /**
+     * @brief sets the hits and misses to 0
+     */
+    void resetCounters();
+};
+
+#endif // CONNECTIONPOOL_H
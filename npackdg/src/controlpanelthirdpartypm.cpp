@@ -39,6 +39,60 @@ void ControlPanelThirdPartyPM::scan(Job* job,
     job->complete();
 }
 
+QString ControlPanelThirdPartyPM::getSourcesFingerprint() const
+{
+    // the same keys as in scan()
+    QStringList parts;
+    addRegistryFingerprint(HKEY_LOCAL_MACHINE,
+            "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+            &parts);
+    if (WPMUtils::is64BitWindows()) {
+        addRegistryFingerprint(HKEY_LOCAL_MACHINE,
+                "SOFTWARE\\WoW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+                &parts);
+    }
+    addRegistryFingerprint(HKEY_CURRENT_USER,
+            "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+            &parts);
+    if (WPMUtils::is64BitWindows()) {
+        addRegistryFingerprint(HKEY_CURRENT_USER,
+                "SOFTWARE\\WoW6432Node\\Microsoft\\Windows\\CurrentVersion\\Uninstall",
+                &parts);
+    }
+
+    return hashFingerprint(parts);
+}
+
+QString ControlPanelThirdPartyPM::getFingerprint(
+        const InstalledPackageVersion& ipv) const
+{
+    QString r;
+
+    // the detection info is "control-panel:HKEY_...\\<path>"
+    QString path = ipv.detectionInfo.mid(detectionPrefix.length());
+    int pos = path.indexOf('\\');
+    HKEY root = nullptr;
+    if (pos > 0) {
+        QString rootName = path.left(pos);
+        if (rootName == "HKEY_LOCAL_MACHINE")
+            root = HKEY_LOCAL_MACHINE;
+        else if (rootName == "HKEY_CURRENT_USER")
+            root = HKEY_CURRENT_USER;
+    }
+
+    if (root) {
+        WindowsRegistry k;
+        QString err = k.open(root, path.mid(pos + 1), false, KEY_READ);
+        if (err.isEmpty()) {
+            quint64 t = k.getLastWriteTime(&err);
+            if (err.isEmpty())
+                r = QString::number(t);
+        }
+    }
+
+    return r;
+}
+
 void ControlPanelThirdPartyPM::
         detectControlPanelProgramsFrom(QList<InstalledPackageVersion*>* installed,
         Repository* rep, HKEY root,
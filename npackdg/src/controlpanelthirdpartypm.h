@@ -46,6 +46,17 @@ public:
 
     void scan(Job *job, QList<InstalledPackageVersion*>* installed,
             Repository* rep) const;
+
+    /**
+     * @return the time of the last change of the registry key
+     */
+    QString getFingerprint(const InstalledPackageVersion& ipv) const;
+
+    /**
+     * @return the times of the last change of the "Uninstall" registry keys
+     *     and their sub-keys
+     */
+    QString getSourcesFingerprint() const;
 };
 
 #endif // CONTROLPANELTHIRDPARTYPM_H
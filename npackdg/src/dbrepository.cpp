@@ -19,6 +19,10 @@
 #include <QSqlResult>
 #include <QtPlugin>
 #include <QMutexLocker>
+#include <QVector>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
 
 #include "package.h"
 #include "repository.h"
@@ -30,6 +34,8 @@
 #include "repositoryxmlhandler.h"
 #include "downloader.h"
 #include "packageutils.h"
+#include "memoryarena.h"
+#include "stringpool.h"
 
 // this is necessary in Qt 5.11 and earlier versions for the static build
 #if QT_VERSION < QT_VERSION_CHECK(5, 11, 0) && QT_LINK_STATIC == 1
@@ -61,6 +67,7 @@ DBRepository::DBRepository(): mutex(QMutex::Recursive)
     selectCategoryQuery = nullptr;
     insertInstalledQuery = nullptr;
     insertURLSizeQuery = nullptr;
+    titleMatchThreshold = 1;
 
     // please note that words shorter than 3 characters are removed later anyway
     stopWords = QString("version build edition remove only "
@@ -81,6 +88,7 @@ DBRepository::~DBRepository()
     delete replacePackageQuery;
     delete replacePackageVersionQuery;
     delete insertPackageVersionQuery;
+    qDeleteAll(prefetchedFiles);
 }
 
 QString DBRepository::saveInstalled(const QList<InstalledPackageVersion *> &installed)
@@ -149,6 +157,7 @@ QString DBRepository::saveURLSize(const QString& url, int64_t size)
         if (!insertURLSizeQuery->prepare(insertSQL)) {
             err = getErrorString(*insertURLSizeQuery);
             delete insertURLSizeQuery;
+            insertURLSizeQuery = nullptr;
         }
     }
 
@@ -166,6 +175,61 @@ QString DBRepository::saveURLSize(const QString& url, int64_t size)
     return err;
 }
 
+QString DBRepository::saveURLSizes(const QList<URLInfo>& infos)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
+    if (err.isEmpty()) {
+        for (int i = 0; i < infos.size(); i++) {
+            const URLInfo& info = infos.at(i);
+            err = saveURLSize(info.address, info.size);
+            if (!err.isEmpty())
+                break;
+        }
+
+        if (err.isEmpty())
+            err = exec(QStringLiteral("COMMIT"));
+        else
+            exec(QStringLiteral("ROLLBACK"));
+    }
+
+    return err;
+}
+
+QString DBRepository::saveFileHashes(const QList<FileHash>& hashes)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err = exec(QStringLiteral("BEGIN TRANSACTION"));
+    if (err.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("INSERT OR REPLACE INTO FILE_HASH"
+                "(PATH, SIZE, MODIFIED, SHA256) "
+                "VALUES(:PATH, :SIZE, :MODIFIED, :SHA256)")))
+            err = getErrorString(q);
+
+        for (int i = 0; i < hashes.size() && err.isEmpty(); i++) {
+            const FileHash& h = hashes.at(i);
+            q.bindValue(QStringLiteral(":PATH"), h.path);
+            q.bindValue(QStringLiteral(":SIZE"),
+                    static_cast<qlonglong>(h.size));
+            q.bindValue(QStringLiteral(":MODIFIED"),
+                    static_cast<qlonglong>(h.modified));
+            q.bindValue(QStringLiteral(":SHA256"), h.sha256);
+            if (!q.exec())
+                err = getErrorString(q);
+        }
+
+        if (err.isEmpty())
+            err = exec(QStringLiteral("COMMIT"));
+        else
+            exec(QStringLiteral("ROLLBACK"));
+    }
+
+    return err;
+}
+
 DBRepository* DBRepository::getDefault()
 {
     return &def;
@@ -182,6 +246,33 @@ QString DBRepository::exec(const QString& sql)
     return err;
 }
 
+int DBRepository::execUpdate(const QString& sql,
+        const QList<QVariant>& params, QString* err)
+{
+    QMutexLocker ml(&this->mutex);
+
+    int r = 0;
+
+    *err = QStringLiteral("");
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        for (int i = 0; i < params.count(); i++) {
+            q.bindValue(i, params.at(i));
+        }
+
+        if (!q.exec())
+            *err = getErrorString(q);
+        else
+            r = q.numRowsAffected();
+    }
+
+    return r;
+}
+
 int DBRepository::count(const QString& sql, QString* err)
 {
     QMutexLocker ml(&this->mutex);
@@ -223,8 +314,8 @@ QString DBRepository::saveLicense(License* p, bool replace)
     else
         sql += QStringLiteral("IGNORE");
     sql += QStringLiteral(" INTO LICENSE "
-            "(NAME, TITLE, DESCRIPTION, URL)"
-            "VALUES(:NAME, :TITLE, :DESCRIPTION, :URL)");
+            "(NAME, TITLE, DESCRIPTION, URL, REPOSITORY)"
+            "VALUES(:NAME, :TITLE, :DESCRIPTION, :URL, :REPOSITORY)");
     if (!q.prepare(sql))
         err = getErrorString(q);
 
@@ -325,7 +416,7 @@ Package *DBRepository::findPackage_(const QString &name) const
         }
 
         if (err.isEmpty() && q.next()) {
-            r = new Package(name, name);
+            r = new Package(StringPool::intern(name), name);
             r->title = q.value(0).toString();
             r->url = q.value(1).toString();
             r->setIcon(q.value(2).toString());
@@ -413,7 +504,7 @@ QList<Package*> DBRepository::findPackages(const QStringList& names)
 
         QList<Package*> list;
         while (q.next()) {
-            QString name = q.value(0).toString();
+            QString name = StringPool::intern(q.value(0).toString());
             Package* r = new Package(name, name);
             r->title = q.value(1).toString();
             r->url = q.value(2).toString();
@@ -489,6 +580,85 @@ QMap<QString, URLInfo*> DBRepository::findURLInfos(QString* err)
     return ret;
 }
 
+int64_t DBRepository::findURLSize(const QString& url, QString* err)
+{
+    QMutexLocker ml(&this->mutex);
+
+    *err = "";
+
+    int64_t r = -1;
+
+    QString sql("SELECT SIZE FROM URL WHERE ADDRESS = :ADDRESS");
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(QStringLiteral(":ADDRESS"), url);
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty() && q.next())
+        r = q.value(0).toLongLong();
+
+    return r;
+}
+
+QMap<QString, FileHash> DBRepository::findFileHashes(
+        const QStringList& paths, QString* err)
+{
+    QMutexLocker ml(&this->mutex);
+
+    *err = "";
+
+    QMap<QString, FileHash> ret;
+
+    int start = 0;
+    int c = paths.count();
+    const int block = 100;
+
+    QString sql = QStringLiteral(
+            "SELECT PATH, SIZE, MODIFIED, SHA256 FROM FILE_HASH "
+            "WHERE PATH IN (:PATH0");
+    for (int i = 1; i < block; i++) {
+        sql = sql + QStringLiteral(", :PATH") + QString::number(i);
+    }
+    sql += QStringLiteral(")");
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    while (start < c && err->isEmpty()) {
+        // unused parameters are NULL and do not match anything
+        for (int i = 0; i < block; i++) {
+            q.bindValue(QStringLiteral(":PATH") + QString::number(i),
+                    start + i < c ? QVariant(paths.at(start + i)) :
+                    QVariant());
+        }
+
+        if (!q.exec())
+            *err = getErrorString(q);
+
+        if (!err->isEmpty())
+            break;
+
+        while (q.next()) {
+            FileHash h;
+            h.path = q.value(0).toString();
+            h.size = q.value(1).toLongLong();
+            h.modified = q.value(2).toLongLong();
+            h.sha256 = q.value(3).toString();
+            ret.insert(h.path, h);
+        }
+
+        start += block;
+    }
+
+    return ret;
+}
+
 QString DBRepository::findCategory(int cat) const
 {
     QMutexLocker ml(&this->mutex);
@@ -505,6 +675,17 @@ PackageVersion* DBRepository::findPackageVersion_(
 
     *err = "";
 
+    // the versions of a package are often cached after the first access
+    PackageVersionList* pvl = packageVersions.object(package);
+    if (pvl) {
+        for (int i = 0; i < pvl->data.size(); i++) {
+            const PackageVersion* pv = pvl->data.at(i).get();
+            if (pv->version.compare(version) == 0)
+                return pv->clone();
+        }
+        return nullptr;
+    }
+
     Version v = version;
     v.normalize();
     QString version_ = v.getVersionString();
@@ -532,20 +713,37 @@ PackageVersion* DBRepository::findPackageVersion_(
 
 QList<PackageVersion*> DBRepository::getPackageVersions_(const QString& package,
         QString *err) const
+{
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            getPackageVersionsShared_(package, err);
+
+    QList<PackageVersion*> r;
+    r.reserve(pvs.size());
+    for (int i = 0; i < pvs.size(); i++) {
+        r.append(pvs.at(i)->clone());
+    }
+
+    return r;
+}
+
+QList<std::shared_ptr<const PackageVersion> >
+        DBRepository::getPackageVersionsShared_(const QString& package,
+        QString* err) const
 {
     QMutexLocker ml(&this->mutex);
 
     *err = "";
 
-    QList<PackageVersion*> r;
+    QList<std::shared_ptr<const PackageVersion> > r;
 
     PackageVersionList* pvl = packageVersions.object(package);
     if (pvl) {
-        r.reserve(pvl->data.size());
-        for (int i = 0; i < pvl->data.size(); i++) {
-            r.append(pvl->data.at(i)->clone());
-        }
+        r = pvl->data;
     } else {
+        // the cache should not keep the memory of a MemoryArena
+        MemoryArena::Scope heap(nullptr);
+
+        QList<PackageVersion*> pvs;
         MySQLQuery q(db);
         if (!q.prepare(QStringLiteral("SELECT CONTENT FROM PACKAGE_VERSION "
                 "WHERE PACKAGE = :PACKAGE")))
@@ -562,19 +760,21 @@ QList<PackageVersion*> DBRepository::getPackageVersions_(const QString& package,
             PackageVersion* pv = PackageVersion::parse(q.value(0).toByteArray(),
                     err, false);
             if (err->isEmpty())
-                r.append(pv);
+                pvs.append(pv);
         }
 
         // qCDebug(npackd) << vs.count();
 
-        std::sort(r.begin(), r.end(), packageVersionLessThan3);
+        std::sort(pvs.begin(), pvs.end(), packageVersionLessThan3);
+
+        r.reserve(pvs.size());
+        for (int i = 0; i < pvs.size(); i++) {
+            r.append(std::shared_ptr<const PackageVersion>(pvs.at(i)));
+        }
 
         if (err->isEmpty()) {
             pvl = new PackageVersionList();
-            pvl->data.reserve(r.size());
-            for (int i = 0; i < r.size(); i++) {
-                pvl->data.append(r.at(i)->clone());
-            }
+            pvl->data = r;
             this->packageVersions.insert(package, pvl);
         }
     }
@@ -738,33 +938,53 @@ QStringList DBRepository::tokenizeTitle(const QString& title)
     return keywords;
 }
 
+int DBRepository::getRequiredTokens(int n) const
+{
+    int r = static_cast<int>(std::ceil(titleMatchThreshold * n));
+    return std::max(1, std::min(r, n));
+}
+
+void DBRepository::setTitleMatchThreshold(double threshold)
+{
+    QMutexLocker ml(&this->mutex);
+
+    titleMatchThreshold = std::max(0.0, std::min(threshold, 1.0));
+}
+
+double DBRepository::getTitleMatchThreshold() const
+{
+    QMutexLocker ml(&this->mutex);
+
+    return titleMatchThreshold;
+}
+
 QStringList DBRepository::findBetterPackages(const QString& title, QString* err)
 {
+    QMutexLocker ml(&this->mutex);
+
+    *err = QStringLiteral("");
+
     QStringList packages;
 
     QStringList keywords = tokenizeTitle(title);
+    keywords.removeDuplicates();
 
     if (keywords.size() > 0) {
-        QString where = QStringLiteral("select name from package "
-                "where name not like 'msi.%' "
-                "and name not like 'control-panel.%'");
-        QList<QVariant> params;
-
-        for (int i = 0; i < keywords.count(); i++) {
-            QString kw = keywords.at(i);
-            if (kw.length() > 1) {
-                if (!where.isEmpty())
-                    where += QStringLiteral(" AND ");
-                where += QStringLiteral("TITLE_FULLTEXT LIKE :TITLE_FULLTEXT") +
-                        QString::number(i);
-                params.append(QStringLiteral("% ") + kw +
-                        QStringLiteral(" %"));
-            }
+        QString sql = QStringLiteral("SELECT PACKAGE FROM TITLE_TOKEN "
+                "WHERE TOKEN IN (?");
+        for (int i = 1; i < keywords.size(); i++) {
+            sql += QStringLiteral(", ?");
         }
+        sql += QStringLiteral(") GROUP BY PACKAGE HAVING COUNT(*) >= ? "
+                "LIMIT 2");
 
-        where.append(QStringLiteral(" LIMIT 2"));
+        QList<QVariant> params;
+        for (int i = 0; i < keywords.size(); i++) {
+            params.append(keywords.at(i));
+        }
+        params.append(getRequiredTokens(keywords.size()));
 
-        packages = findPackagesWhere(where, params, err);
+        packages = findPackagesWhere(sql, params, err);
 
         QString what;
         if (packages.size() == 1)
@@ -779,6 +999,120 @@ QStringList DBRepository::findBetterPackages(const QString& title, QString* err)
     return packages;
 }
 
+QMap<QString, QString> DBRepository::findBetterPackageNames(
+        const QStringList& packages, QString* err)
+{
+    QMutexLocker ml(&this->mutex);
+
+    *err = QStringLiteral("");
+
+    QMap<QString, QString> result;
+
+    QSet<QString> wanted;
+    for (int i = 0; i < packages.size(); i++) {
+        const QString& p = packages.at(i);
+        if (p.startsWith(QStringLiteral("msi.")) ||
+                p.startsWith(QStringLiteral("control-panel.")))
+            wanted.insert(p);
+    }
+    if (wanted.isEmpty())
+        return result;
+
+    // titles of the generic packages
+    QStringList names;
+    QStringList titles;
+    {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("SELECT NAME, TITLE FROM PACKAGE "
+                "WHERE NAME LIKE 'msi.%' OR NAME LIKE 'control-panel.%'")))
+            *err = getErrorString(q);
+
+        if (err->isEmpty() && !q.exec())
+            *err = getErrorString(q);
+
+        if (err->isEmpty()) {
+            while (q.next()) {
+                QString name = q.value(0).toString();
+                if (wanted.contains(name)) {
+                    names.append(name);
+                    titles.append(q.value(1).toString());
+                }
+            }
+        }
+    }
+
+    // the keywords of all titles are stored in a temporary table and
+    // matched against TITLE_TOKEN in one query
+    if (err->isEmpty() && !names.isEmpty())
+        *err = exec(QStringLiteral("CREATE TEMP TABLE IF NOT EXISTS "
+                "TITLE_QUERY(ID INTEGER NOT NULL, TOKEN TEXT NOT NULL, "
+                "REQUIRED INTEGER NOT NULL)"));
+    if (err->isEmpty() && !names.isEmpty())
+        *err = exec(QStringLiteral("DELETE FROM TITLE_QUERY"));
+    if (err->isEmpty() && !names.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("INSERT INTO TITLE_QUERY"
+                "(ID, TOKEN, REQUIRED) VALUES(:ID, :TOKEN, :REQUIRED)")))
+            *err = getErrorString(q);
+
+        for (int i = 0; i < titles.size() && err->isEmpty(); i++) {
+            QStringList keywords = tokenizeTitle(titles.at(i));
+            keywords.removeDuplicates();
+            int required = getRequiredTokens(keywords.size());
+            for (int j = 0; j < keywords.size(); j++) {
+                q.bindValue(QStringLiteral(":ID"), i);
+                q.bindValue(QStringLiteral(":TOKEN"), keywords.at(j));
+                q.bindValue(QStringLiteral(":REQUIRED"), required);
+                if (!q.exec()) {
+                    *err = getErrorString(q);
+                    break;
+                }
+            }
+        }
+    }
+
+    // a package is only replaced if exactly one other package matches
+    if (err->isEmpty() && !names.isEmpty()) {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral("SELECT Q.ID, T.PACKAGE "
+                "FROM TITLE_QUERY Q JOIN TITLE_TOKEN T ON T.TOKEN = Q.TOKEN "
+                "GROUP BY Q.ID, T.PACKAGE "
+                "HAVING COUNT(*) >= MAX(Q.REQUIRED)")))
+            *err = getErrorString(q);
+
+        if (err->isEmpty() && !q.exec())
+            *err = getErrorString(q);
+
+        QVector<int> counts(names.size());
+        QVector<QString> found(names.size());
+        if (err->isEmpty()) {
+            while (q.next()) {
+                int id = q.value(0).toInt();
+                if (id >= 0 && id < names.size()) {
+                    counts[id]++;
+                    found[id] = q.value(1).toString();
+                }
+            }
+        }
+
+        if (err->isEmpty()) {
+            for (int i = 0; i < names.size(); i++) {
+                if (counts.at(i) == 1)
+                    result.insert(names.at(i), found.at(i));
+
+                qCDebug(npackd) << "searching for" << titles.at(i) <<
+                        "found" << (counts.at(i) == 1 ? found.at(i) :
+                        QString("%1 packages").arg(counts.at(i)));
+            }
+        }
+    }
+
+    if (!names.isEmpty())
+        exec(QStringLiteral("DELETE FROM TITLE_QUERY"));
+
+    return result;
+}
+
 int DBRepository::getMaxStars(QString* err)
 {
     return count("SELECT MAX(STARS) FROM PACKAGE", err);
@@ -1170,6 +1504,75 @@ QString DBRepository::saveLinks(Package* p)
     return err;
 }
 
+QString DBRepository::deleteTitleTokens(const QString& name)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err;
+
+    if (!deleteTitleTokenQuery) {
+        deleteTitleTokenQuery.reset(new MySQLQuery(db));
+        if (!deleteTitleTokenQuery->prepare(QStringLiteral(
+                "DELETE FROM TITLE_TOKEN WHERE PACKAGE=:PACKAGE"))) {
+            err = getErrorString(*deleteTitleTokenQuery);
+            deleteTitleTokenQuery->clear();
+        }
+    }
+
+    if (err.isEmpty()) {
+        deleteTitleTokenQuery->bindValue(QStringLiteral(":PACKAGE"), name);
+        if (!deleteTitleTokenQuery->exec())
+            err = getErrorString(*deleteTitleTokenQuery);
+        deleteTitleTokenQuery->finish();
+    }
+
+    return err;
+}
+
+QString DBRepository::saveTitleTokens(const QString& name,
+        const QString& title)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err;
+
+    // generic packages created by the detection are never searched
+    if (name.startsWith(QStringLiteral("msi.")) ||
+            name.startsWith(QStringLiteral("control-panel.")))
+        return err;
+
+    if (!insertTitleTokenQuery) {
+        insertTitleTokenQuery.reset(new MySQLQuery(db));
+
+        QString insertSQL = QStringLiteral("INSERT INTO TITLE_TOKEN "
+                "(TOKEN, PACKAGE) "
+                "VALUES(:TOKEN, :PACKAGE)");
+
+        if (!insertTitleTokenQuery->prepare(insertSQL)) {
+            err = getErrorString(*insertTitleTokenQuery);
+            insertTitleTokenQuery->clear();
+        }
+    }
+
+    if (err.isEmpty()) {
+        QStringList tokens = tokenizeTitle(title);
+        tokens.removeDuplicates();
+        for (int j = 0; j < tokens.size(); j++) {
+            if (!err.isEmpty())
+                break;
+
+            insertTitleTokenQuery->bindValue(QStringLiteral(":TOKEN"),
+                    tokens.at(j));
+            insertTitleTokenQuery->bindValue(QStringLiteral(":PACKAGE"), name);
+            if (!insertTitleTokenQuery->exec())
+                err = getErrorString(*insertTitleTokenQuery);
+        }
+        insertTitleTokenQuery->finish();
+    }
+
+    return err;
+}
+
 QString DBRepository::saveTags(Package* p)
 {
     QMutexLocker ml(&this->mutex);
@@ -1381,6 +1784,16 @@ QString DBRepository::savePackage(Package *p, bool replace)
             err = saveTags(p);
     }
 
+    if (err.isEmpty()) {
+        if (!exists)
+            err = deleteTitleTokens(p->name);
+    }
+
+    if (err.isEmpty()) {
+        if (!exists)
+            err = saveTitleTokens(p->name, p->title);
+    }
+
     packages.clear();
 
     return err;
@@ -1409,7 +1822,8 @@ QList<Package*> DBRepository::findPackagesByShortName(const QString &name) const
     }
 
     while (err.isEmpty() && q.next()) {
-        Package* p = new Package(q.value(0).toString(), q.value(1).toString());
+        Package* p = new Package(StringPool::intern(q.value(0).toString()),
+                q.value(1).toString());
         p->url = q.value(2).toString();
         p->setIcon(q.value(3).toString());
         p->description = q.value(4).toString();
@@ -1501,10 +1915,10 @@ QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
 
         QString sql = QStringLiteral(" INTO PACKAGE_VERSION "
                 "(NAME, PACKAGE, URL, "
-                "CONTENT, DETECT_FILE_COUNT)"
+                "CONTENT, DETECT_FILE_COUNT, REPOSITORY)"
                 "VALUES(:NAME, :PACKAGE, "
                 ":URL, :CONTENT, "
-                ":DETECT_FILE_COUNT)");
+                ":DETECT_FILE_COUNT, :REPOSITORY)");
 
         if (!replacePackageVersionQuery->prepare(
                 QStringLiteral("INSERT OR REPLACE ") + sql)) {
@@ -1584,7 +1998,8 @@ QString DBRepository::savePackageVersion(PackageVersion *p, bool replace)
         q->finish();
     }
 
-    packageVersions.clear();
+    // findPackageVersion_ and getPackageVersionsShared_ answer from this cache
+    packageVersions.remove(p->package);
 
     return err;
 }
@@ -1636,7 +2051,7 @@ QString DBRepository::clear()
     }
 
     if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.05,
+        Job* sub = job->newSubJob(0.03,
                 QObject::tr("Clearing the tags table"));
         QString err = exec(QStringLiteral("DELETE FROM TAG"));
         if (!err.isEmpty())
@@ -1645,6 +2060,16 @@ QString DBRepository::clear()
             sub->completeWithProgress();
     }
 
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.02,
+                QObject::tr("Clearing the title tokens table"));
+        QString err = exec(QStringLiteral("DELETE FROM TITLE_TOKEN"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            sub->completeWithProgress();
+    }
+
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.03,
                 QObject::tr("Clearing the command line tool definitions"));
@@ -1677,6 +2102,14 @@ QString DBRepository::clear()
         }
     }
 
+    // the validators are only valid together with the loaded data
+    if (job->shouldProceed()) {
+        QString err = exec(QStringLiteral(
+                "UPDATE REPOSITORY SET ETAG=NULL, LAST_MODIFIED=NULL"));
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
     job->complete();
 
     delete job;
@@ -1698,24 +2131,46 @@ void DBRepository::clearCache()
 
 void DBRepository::load(Job* job, const QList<QUrl *> &repositories, bool useCache, bool interactive,
         const QString &user, const QString &password,
-        const QString &proxyUser, const QString &proxyPassword)
+        const QString &proxyUser, const QString &proxyPassword,
+        bool* unchanged)
 {
     QString err;
+    if (unchanged)
+        *unchanged = false;
+
     if (repositories.count() > 0) {
         QStringList reps;
         for (int i = 0; i < repositories.size(); i++) {
             reps.append(repositories.at(i)->toString(QUrl::FullyEncoded));
         }
 
+        // conditional requests are only possible if the database contains
+        // the data for the same repositories
+        QStringList etags, lastModified;
+        bool conditional = unchanged && useCache &&
+                readRepositoryValidators(reps, &etags, &lastModified);
+
         err = saveRepositories(reps);
         if (!err.isEmpty())
             job->setErrorMessage(
                     QObject::tr("Error saving the list of repositories in the database: %1").arg(
                     err));
 
-        QList<QFuture<QTemporaryFile*> > files;
+        QVector<Downloader::Response> responses(repositories.count());
+        QList<QFuture<QTemporaryFile*> > futures;
+        QList<QTemporaryFile*> files;
         for (int i = 0; i < repositories.count(); i++) {
             QUrl* url = repositories.at(i);
+
+            // the data may already be available from loadDeltas()
+            QTemporaryFile* prefetched = prefetchedFiles.take(reps.at(i));
+            files.append(prefetched);
+            if (prefetched) {
+                responses[i] = prefetchedResponses.take(reps.at(i));
+                futures.append(QFuture<QTemporaryFile*>());
+                continue;
+            }
+
             Job* s = job->newSubJob(0.1,
                     QObject::tr("Downloading %1").
                     arg(url->toDisplayString()), false, true);
@@ -1727,44 +2182,103 @@ void DBRepository::load(Job* job, const QList<QUrl *> &repositories, bool useCac
             request.proxyPassword = proxyPassword;
             request.useCache = useCache;
             request.interactive = interactive;
+            request.hashSum = true;
+            request.alg = QCryptographicHash::Sha1;
+            if (conditional) {
+                request.ifNoneMatch = etags.at(i);
+                request.ifModifiedSince = lastModified.at(i);
+            }
             QFuture<QTemporaryFile*> future = QtConcurrent::run(
-                    Downloader::downloadToTemporary, s, request);
-            files.append(future);
+                    Downloader::downloadToTemporary2, s, request,
+                    &responses[i]);
+            futures.append(future);
         }
 
         for (int i = 0; i < repositories.count(); i++) {
-            files[i].waitForFinished();
+            if (!files.at(i)) {
+                futures[i].waitForFinished();
+                files[i] = futures.at(i).result();
+            }
 
             job->setProgress((i + 1.0) / repositories.count() * 0.5);
         }
 
+        bool notModified = conditional && job->shouldProceed();
         for (int i = 0; i < repositories.count(); i++) {
-            if (!job->shouldProceed())
-                break;
+            if (responses.at(i).statusCode != HTTP_STATUS_NOT_MODIFIED)
+                notModified = false;
+        }
 
-            QTemporaryFile* tf = files.at(i).result();
-            Job* s = job->newSubJob(0.49 / repositories.count(), QString(
-                    QObject::tr("Repository %1 of %2")).arg(i + 1).
-                    arg(repositories.count()));
-            this->currentRepository = i;
-            // this is currently unnecessary clearRepository(i);
-            loadOne(s, tf, *repositories.at(i));
-            if (!s->getErrorMessage().isEmpty()) {
-                job->setErrorMessage(QString(
-                        QObject::tr("Error loading the repository %1: %2")).arg(
-                        repositories.at(i)->toString()).arg(
-                        s->getErrorMessage()));
-                break;
+        if (notModified) {
+            qCDebug(npackd) << "DBRepository::load: the repositories have not changed";
+            *unchanged = true;
+            job->setProgress(1);
+        } else {
+            // the data for an unchanged repository is also necessary if
+            // another one has changed
+            for (int i = 0; i < repositories.count(); i++) {
+                if (!job->shouldProceed())
+                    break;
+
+                if (responses.at(i).statusCode == HTTP_STATUS_NOT_MODIFIED) {
+                    QUrl* url = repositories.at(i);
+                    Job* s = job->newSubJob(0.01,
+                            QObject::tr("Downloading %1").
+                            arg(url->toDisplayString()), false, true);
+
+                    Downloader::Request request(*url);
+                    request.user = user;
+                    request.password = password;
+                    request.proxyUser = proxyUser;
+                    request.proxyPassword = proxyPassword;
+                    request.useCache = useCache;
+                    request.interactive = interactive;
+                    request.hashSum = true;
+                    request.alg = QCryptographicHash::Sha1;
+                    delete files.at(i);
+                    files[i] = Downloader::downloadToTemporary2(s, request,
+                            &responses[i]);
+                }
             }
-        }
 
-        for (int i = 0; i < repositories.count(); i++) {
-            if (!job->shouldProceed())
-                break;
+            if (job->shouldProceed()) {
+                err = clear();
+                if (!err.isEmpty())
+                    job->setErrorMessage(err);
+            }
+
+            for (int i = 0; i < repositories.count(); i++) {
+                if (!job->shouldProceed())
+                    break;
 
-            QTemporaryFile* tf = files.at(i).result();
-            delete tf;
+                QTemporaryFile* tf = files.at(i);
+                Job* s = job->newSubJob(0.49 / repositories.count(), QString(
+                        QObject::tr("Repository %1 of %2")).arg(i + 1).
+                        arg(repositories.count()));
+                this->currentRepository = i;
+                // this is currently unnecessary clearRepository(i);
+                loadOne(s, tf, *repositories.at(i));
+                if (!s->getErrorMessage().isEmpty()) {
+                    job->setErrorMessage(QString(
+                            QObject::tr("Error loading the repository %1: %2")).arg(
+                            repositories.at(i)->toString()).arg(
+                            s->getErrorMessage()));
+                    break;
+                }
+
+                err = setRepositoryValidators(reps.at(i),
+                        responses.at(i).etag, responses.at(i).lastModified);
+
+                // the SHA-1 identifies the data for deltas
+                if (err.isEmpty())
+                    setRepositorySHA1(reps.at(i), responses.at(i).hashSum,
+                            &err);
+                if (!err.isEmpty())
+                    job->setErrorMessage(err);
+            }
         }
+
+        qDeleteAll(files);
     } else {
         job->setErrorMessage(QObject::tr("No repositories defined"));
         job->setProgress(1);
@@ -1809,6 +2323,10 @@ void DBRepository::loadOne(Job* job, QFile* f, const QUrl& url) {
     }
 
     if (job->shouldProceed()) {
+        // the parsed objects are deleted after they were saved
+        MemoryArena arena;
+        MemoryArena::Scope scope(&arena);
+
         Job* sub = job->newSubJob(0.9, QObject::tr("Parsing XML"));
         RepositoryXMLHandler handler(this, url);
         QXmlSimpleReader reader;
@@ -1833,7 +2351,8 @@ void DBRepository::clearAndDownloadRepositories(Job* job,
         const QList<QUrl *> &repositories,
         bool interactive, const QString &user,
         const QString &password, const QString &proxyUser,
-        const QString &proxyPassword, bool useCache, bool detect)
+        const QString &proxyPassword, bool useCache, bool detect,
+        bool download)
 {
     bool transactionStarted = false;
     if (job->shouldProceed()) {
@@ -1848,24 +2367,32 @@ void DBRepository::clearAndDownloadRepositories(Job* job,
         }
     }
 
-    if (job->shouldProceed()) {
+    // the database is cleared by load() unless all repositories are unchanged
+    bool unchanged = !download;
+    if (job->shouldProceed() && download) {
+        Job* sub = job->newSubJob(0.28,
+                QObject::tr("Downloading the remote repositories and filling the local database (tempdb)"));
+        load(sub, repositories, useCache, interactive, user, password,
+                proxyUser, proxyPassword, &unchanged);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed() && unchanged) {
+        // the information about installed packages is always re-created
         Job* sub = job->newSubJob(0.01,
-                QObject::tr("Clearing the database"));
-        QString err = clear();
+                QObject::tr("Resetting the installation status"));
+        QString err = exec(QStringLiteral("DELETE FROM INSTALLED"));
         if (err.isEmpty())
+            err = exec(QStringLiteral(
+                    "UPDATE PACKAGE SET STATUS=0 WHERE STATUS<>0"));
+        if (err.isEmpty()) {
+            clearCache();
             sub->completeWithProgress();
-        else
+        } else
             job->setErrorMessage(err);
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.27,
-                QObject::tr("Downloading the remote repositories and filling the local database (tempdb)"));
-        load(sub, repositories, useCache, interactive, user, password, proxyUser, proxyPassword);
-        if (!sub->getErrorMessage().isEmpty())
-            job->setErrorMessage(sub->getErrorMessage());
-    }
-
     if (job->shouldProceed()) {
         InstalledPackages* def = InstalledPackages::getDefault();
         if (detect) {
@@ -1904,6 +2431,11 @@ void DBRepository::clearAndDownloadRepositories(Job* job,
                 "DELETE FROM PACKAGE WHERE STATUS=0 AND NOT EXISTS "
                 "(SELECT 1 FROM PACKAGE_VERSION "
                 "WHERE PACKAGE = PACKAGE.NAME AND URL <>'')"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral(
+                    "DELETE FROM TITLE_TOKEN WHERE NOT EXISTS "
+                    "(SELECT 1 FROM PACKAGE "
+                    "WHERE NAME = TITLE_TOKEN.PACKAGE)"));
         if (err.isEmpty())
             sub->completeWithProgress();
         else
@@ -2008,17 +2540,6 @@ void DBRepository::updateF5Runnable(Job *job, bool useCache)
             job->setErrorMessage(QObject::tr("Cannot load the list of repositories: %1").arg(err));
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.77,
-                QObject::tr("Updating the temporary database"), true, true);
-        CoInitialize(nullptr);
-        tempdb.clearAndDownloadRepositories(sub, urls, true, "", "", "", "", useCache);
-        CoUninitialize();
-    }
-
-    if (tempDatabaseOpen)
-        tempdb.db.close();
-
     // as this runs in a separate thread, we cannot use "this", instead
     // we create another connection to the same default database
     DBRepository dbr;
@@ -2029,15 +2550,97 @@ void DBRepository::updateF5Runnable(Job *job, bool useCache)
             job->setErrorMessage(QObject::tr("Error opening the database: %1").
                     arg(err));
         } else {
-            job->setProgress(0.8);
+            job->setProgress(0.03);
         }
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.2,
-                QObject::tr("Transferring the data from the temporary database"),
-                true, true);
-        dbr.transferFrom(sub, tempFile.fileName());
+    // the servers may send only the changes since the last update. Whole
+    // repositories sent instead are re-used for the temporary database.
+    bool deltas = false;
+    if (job->shouldProceed() && useCache) {
+        Job* sub = job->newSubJob(0.05,
+                QObject::tr("Downloading the changes in the repositories"),
+                true, false);
+        deltas = dbr.loadDeltas(sub, urls, &tempdb);
+    }
+
+    // the repositories are requested once using the HTTP cache validators
+    // stored in the default database. The default database is only changed
+    // after the temporary one was filled completely.
+    bool unchanged = false;
+    if (job->shouldProceed() && !deltas) {
+        QStringList reps;
+        for (int i = 0; i < urls.size(); i++) {
+            reps.append(urls.at(i)->toString(QUrl::FullyEncoded));
+        }
+
+        QStringList etags, lastModified;
+        QString err;
+        if (useCache && dbr.readRepositoryValidators(reps, &etags,
+                &lastModified)) {
+            err = tempdb.saveRepositories(reps);
+            for (int i = 0; i < reps.size(); i++) {
+                if (!err.isEmpty())
+                    break;
+                err = tempdb.setRepositoryValidators(reps.at(i), etags.at(i),
+                        lastModified.at(i));
+            }
+        }
+
+        if (err.isEmpty())
+            err = tempdb.exec(QStringLiteral("BEGIN TRANSACTION"));
+
+        if (err.isEmpty()) {
+            Job* sub = job->newSubJob(0.3,
+                    QObject::tr("Downloading the remote repositories and filling the local database (tempdb)"),
+                    true, true);
+            CoInitialize(nullptr);
+            tempdb.load(sub, urls, useCache, true, "", "", "", "", &unchanged);
+            CoUninitialize();
+
+            if (job->shouldProceed())
+                err = tempdb.exec(QStringLiteral("COMMIT"));
+            else
+                tempdb.exec(QStringLiteral("ROLLBACK"));
+        }
+
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (deltas || unchanged) {
+        // only the installation status is updated
+        if (tempDatabaseOpen)
+            tempdb.db.close();
+
+        if (job->shouldProceed()) {
+            Job* sub = job->newSubJob(0.9 - job->getProgress(),
+                    QObject::tr("Updating the installation status"),
+                    true, true);
+            CoInitialize(nullptr);
+            dbr.clearAndDownloadRepositories(sub, urls, true, "", "", "", "",
+                    useCache, true, false);
+            CoUninitialize();
+        }
+    } else {
+        if (job->shouldProceed()) {
+            Job* sub = job->newSubJob(0.7 - job->getProgress(),
+                    QObject::tr("Updating the temporary database"), true, true);
+            CoInitialize(nullptr);
+            tempdb.clearAndDownloadRepositories(sub, urls, true, "", "", "",
+                    "", useCache, true, false);
+            CoUninitialize();
+        }
+
+        if (tempDatabaseOpen)
+            tempdb.db.close();
+
+        if (job->shouldProceed()) {
+            Job* sub = job->newSubJob(0.2,
+                    QObject::tr("Transferring the data from the temporary database"),
+                    true, true);
+            dbr.transferFrom(sub, tempFile.fileName());
+        }
     }
 
     if (job->shouldProceed()) {
@@ -2248,7 +2851,7 @@ QString DBRepository::getRepositorySHA1(const QString& url, QString* err)
             *err = getErrorString(q);
         else {
             if (q.next()) {
-                r = q.value(1).toString();
+                r = q.value(0).toString();
             }
         }
     }
@@ -2256,6 +2859,36 @@ QString DBRepository::getRepositorySHA1(const QString& url, QString* err)
     return r;
 }
 
+QString DBRepository::getRepositoriesFingerprint(QString* err)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QStringList r;
+
+    MySQLQuery q(db);
+
+    QString sql = QStringLiteral("SELECT URL, SHA1 FROM REPOSITORY ORDER BY ID");
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        if (!q.exec())
+            *err = getErrorString(q);
+        else {
+            while (q.next()) {
+                QString sha1 = q.value(1).toString();
+                if (sha1.isEmpty()) {
+                    r.clear();
+                    break;
+                }
+                r.append(q.value(0).toString() + ' ' + sha1);
+            }
+        }
+    }
+
+    return r.join('\n');
+}
+
 void DBRepository::setRepositorySHA1(const QString& url, const QString& sha1,
         QString* err)
 {
@@ -2277,26 +2910,377 @@ void DBRepository::setRepositorySHA1(const QString& url, const QString& sha1,
 }
 
 
+QString DBRepository::getRepositoryValidators(const QString& url,
+        QString* etag, QString* lastModified)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err;
+
+    etag->clear();
+    lastModified->clear();
+
+    MySQLQuery q(db);
+
+    QString sql = QStringLiteral(
+            "SELECT ETAG, LAST_MODIFIED FROM REPOSITORY WHERE URL=:URL");
+    if (!q.prepare(sql))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":URL"), url);
+
+        if (!q.exec())
+            err = getErrorString(q);
+        else {
+            if (q.next()) {
+                *etag = q.value(0).toString();
+                *lastModified = q.value(1).toString();
+            }
+        }
+    }
+
+    return err;
+}
+
+QString DBRepository::setRepositoryValidators(const QString& url,
+        const QString& etag, const QString& lastModified)
+{
+    QMutexLocker ml(&this->mutex);
+
+    QString err;
+
+    MySQLQuery q(db);
+
+    QString sql = QStringLiteral(
+            "UPDATE REPOSITORY SET ETAG=:ETAG, LAST_MODIFIED=:LAST_MODIFIED "
+            "WHERE URL=:URL");
+    if (!q.prepare(sql))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(QStringLiteral(":ETAG"), etag);
+        q.bindValue(QStringLiteral(":LAST_MODIFIED"), lastModified);
+        q.bindValue(QStringLiteral(":URL"), url);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
+
+    return err;
+}
+
+bool DBRepository::readRepositoryValidators(const QStringList& reps,
+        QStringList* etags, QStringList* lastModified)
+{
+    QString err;
+    QStringList stored = readRepositories(&err);
+    bool r = err.isEmpty() && stored == reps;
+
+    for (int i = 0; i < reps.size(); i++) {
+        if (!r)
+            break;
+
+        QString etag, lm;
+        err = getRepositoryValidators(reps.at(i), &etag, &lm);
+        if (!err.isEmpty() || (etag.isEmpty() && lm.isEmpty()))
+            r = false;
+
+        etags->append(etag);
+        lastModified->append(lm);
+    }
+
+    return r;
+}
+
+bool DBRepository::loadDeltas(Job* job, const QList<QUrl*>& repositories,
+        DBRepository* full)
+{
+    QStringList reps;
+    for (int i = 0; i < repositories.size(); i++) {
+        reps.append(repositories.at(i)->toString(QUrl::FullyEncoded));
+    }
+
+    // a delta can only be applied to the data for the same repositories
+    QString err;
+    bool r = repositories.size() > 0 && readRepositories(&err) == reps &&
+            err.isEmpty();
+
+    QStringList sha1s, etags, lastModified;
+    for (int i = 0; i < reps.size(); i++) {
+        if (!r)
+            break;
+
+        QString sha1 = getRepositorySHA1(reps.at(i), &err);
+        QString etag, lm;
+        if (err.isEmpty())
+            err = getRepositoryValidators(reps.at(i), &etag, &lm);
+        if (!err.isEmpty() || sha1.isEmpty())
+            r = false;
+
+        sha1s.append(sha1);
+        etags.append(etag);
+        lastModified.append(lm);
+    }
+
+    QVector<Downloader::Response> responses(reps.size());
+    QList<QTemporaryFile*> files;
+    if (r) {
+        QList<QFuture<QTemporaryFile*> > futures;
+        for (int i = 0; i < repositories.count(); i++) {
+            QUrl* url = repositories.at(i);
+            Job* s = job->newSubJob(0.5 / repositories.count(),
+                    QObject::tr("Downloading the changes for %1").
+                    arg(url->toDisplayString()), false, false);
+
+            Downloader::Request request(*url);
+            request.headers = RepositoryDelta::HEADER + QStringLiteral(": ") +
+                    sha1s.at(i);
+            request.ifNoneMatch = etags.at(i);
+            request.ifModifiedSince = lastModified.at(i);
+            request.hashSum = true;
+            request.alg = QCryptographicHash::Sha1;
+
+            // the response depends on the header and cannot be cached for
+            // the URL
+            request.useCache = false;
+
+            futures.append(QtConcurrent::run(
+                    Downloader::downloadToTemporary2, s, request,
+                    &responses[i]));
+        }
+
+        for (int i = 0; i < futures.count(); i++) {
+            futures[i].waitForFinished();
+            files.append(futures.at(i).result());
+            if (!files.at(i))
+                r = false;
+        }
+
+        job->setProgress(0.5);
+    }
+
+    QList<RepositoryDelta*> deltas;
+    for (int i = 0; i < files.count(); i++) {
+        QTemporaryFile* f = files.at(i);
+        RepositoryDelta* d = nullptr;
+        if (!f || responses.at(i).statusCode == HTTP_STATUS_NOT_MODIFIED) {
+            // nothing to do
+        } else if (RepositoryDelta::isDelta(f)) {
+            d = new RepositoryDelta();
+            QString e = d->parse(f, *repositories.at(i));
+            if (!e.isEmpty() || d->from != sha1s.at(i)) {
+                qCDebug(npackd) << "DBRepository::loadDeltas: invalid delta" <<
+                        reps.at(i) << e;
+                r = false;
+            } else if (d->hasRemovals() && reps.size() > 1) {
+                // a removed entry may hide an entry with the same name from
+                // another repository that is not available in this database
+                r = false;
+            }
+
+            // packages without versions are removed from the database and
+            // cannot be referenced by new versions
+            for (int j = 0; j < d->changed.packageVersions.size() && r; j++) {
+                QString package = d->changed.packageVersions.at(j)->package;
+                if (!d->changed.findPackage(package)) {
+                    Package* p = findPackage_(package);
+                    if (!p)
+                        r = false;
+                    delete p;
+                }
+            }
+        } else {
+            // the server sent the whole repository
+            full->prefetchedFiles.insert(reps.at(i), f);
+            full->prefetchedResponses.insert(reps.at(i), responses.at(i));
+            files[i] = nullptr;
+            r = false;
+        }
+        deltas.append(d);
+    }
+
+    if (r && job->shouldProceed()) {
+        err = exec(QStringLiteral("BEGIN TRANSACTION"));
+        for (int i = 0; i < deltas.count(); i++) {
+            RepositoryDelta* d = deltas.at(i);
+            if (!err.isEmpty())
+                break;
+            if (!d)
+                continue;
+
+            currentRepository = i;
+            err = applyDelta(*d);
+            if (err.isEmpty())
+                setRepositorySHA1(reps.at(i), d->to, &err);
+            if (err.isEmpty())
+                err = setRepositoryValidators(reps.at(i),
+                        responses.at(i).etag, responses.at(i).lastModified);
+        }
+
+        if (err.isEmpty())
+            err = exec(QStringLiteral("COMMIT"));
+        else
+            exec(QStringLiteral("ROLLBACK"));
+        clearCache();
+
+        if (!err.isEmpty()) {
+            job->setErrorMessage(err);
+            r = false;
+        }
+    }
+
+    qDeleteAll(files);
+    qDeleteAll(deltas);
+
+    qCDebug(npackd) << "DBRepository::loadDeltas" << r;
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+
+    return r;
+}
+
+QString DBRepository::applyDelta(const RepositoryDelta& delta)
+{
+    QString err;
+
+    const QVariant rep(currentRepository);
+
+    // only the removed entries from this repository are deleted
+    for (int i = 0; i < delta.removedVersions.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        const QPair<QString, Version>& v = delta.removedVersions.at(i);
+        int n = execUpdate(QStringLiteral("DELETE FROM PACKAGE_VERSION "
+                "WHERE PACKAGE=? AND NAME=? AND REPOSITORY=?"),
+                QList<QVariant>() << v.first << v.second.getVersionString() <<
+                rep, &err);
+        if (err.isEmpty() && n > 0) {
+            packageVersions.remove(v.first);
+            err = deleteCmdFiles(v.first, v.second);
+        }
+    }
+    for (int i = 0; i < delta.removedPackages.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        const QString& name = delta.removedPackages.at(i);
+        int n = execUpdate(QStringLiteral("DELETE FROM PACKAGE "
+                "WHERE NAME=? AND REPOSITORY=?"),
+                QList<QVariant>() << name << rep, &err);
+        if (err.isEmpty() && n > 0)
+            err = deleteLinks(name);
+        if (err.isEmpty() && n > 0)
+            err = deleteTags(name);
+        if (err.isEmpty() && n > 0)
+            err = deleteTitleTokens(name);
+    }
+    for (int i = 0; i < delta.removedLicenses.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        execUpdate(QStringLiteral("DELETE FROM LICENSE "
+                "WHERE NAME=? AND REPOSITORY=?"),
+                QList<QVariant>() << delta.removedLicenses.at(i) << rep, &err);
+    }
+
+    // added or changed entries replace the entries from this repository and
+    // the repositories with a lower priority. Entries from the repositories
+    // with a higher priority are kept.
+    const Repository& changed = delta.changed;
+    for (int i = 0; i < changed.licenses.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        License* lic = changed.licenses.at(i);
+        execUpdate(QStringLiteral("DELETE FROM LICENSE "
+                "WHERE NAME=? AND REPOSITORY>=?"),
+                QList<QVariant>() << lic->name << rep, &err);
+        if (err.isEmpty())
+            err = saveLicense(lic, false);
+    }
+    for (int i = 0; i < changed.packages.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        Package* p = changed.packages.at(i);
+        execUpdate(QStringLiteral("DELETE FROM PACKAGE "
+                "WHERE NAME=? AND REPOSITORY>=?"),
+                QList<QVariant>() << p->name << rep, &err);
+        if (err.isEmpty())
+            err = savePackage(p, false);
+    }
+    for (int i = 0; i < changed.packageVersions.size(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        PackageVersion* pv = changed.packageVersions.at(i);
+        Version v = pv->version;
+        v.normalize();
+        execUpdate(QStringLiteral("DELETE FROM PACKAGE_VERSION "
+                "WHERE PACKAGE=? AND NAME=? AND REPOSITORY>=?"),
+                QList<QVariant>() << pv->package << v.getVersionString() <<
+                rep, &err);
+        if (err.isEmpty())
+            err = savePackageVersion(pv, false);
+    }
+
+    return err;
+}
+
 QString DBRepository::saveRepositories(const QStringList &reps)
 {
     QMutexLocker ml(&this->mutex);
 
-    QString err = exec(QStringLiteral("DELETE FROM REPOSITORY"));
+    QString err;
+
+    // the SHA1 and HTTP cache validators are kept for unchanged URLs
+    QMap<QString, QStringList> old;
+    {
+        MySQLQuery q(db);
+        if (!q.prepare(QStringLiteral(
+                "SELECT URL, SHA1, ETAG, LAST_MODIFIED FROM REPOSITORY")))
+            err = getErrorString(q);
+        if (err.isEmpty()) {
+            if (!q.exec())
+                err = getErrorString(q);
+            else {
+                while (q.next()) {
+                    QStringList values;
+                    values.append(q.value(1).toString());
+                    values.append(q.value(2).toString());
+                    values.append(q.value(3).toString());
+                    old.insert(q.value(0).toString(), values);
+                }
+            }
+        }
+    }
+
+    if (err.isEmpty())
+        err = exec(QStringLiteral("DELETE FROM REPOSITORY"));
 
     MySQLQuery q(db);
 
     if (err.isEmpty()) {
         QString sql = QStringLiteral("INSERT INTO REPOSITORY "
-                "(ID, URL)"
-                "VALUES(:ID, :URL)");
+                "(ID, URL, SHA1, ETAG, LAST_MODIFIED)"
+                "VALUES(:ID, :URL, :SHA1, :ETAG, :LAST_MODIFIED)");
         if (!q.prepare(sql))
             err = getErrorString(q);
     }
 
     if (err.isEmpty()) {
         for (int i = 0; i < reps.size(); i++) {
+            QStringList values = old.value(reps.at(i),
+                    QStringList() << QString() << QString() << QString());
             q.bindValue(QStringLiteral(":ID"), i + 1);
             q.bindValue(QStringLiteral(":URL"), reps.at(i));
+            q.bindValue(QStringLiteral(":SHA1"), values.at(0));
+            q.bindValue(QStringLiteral(":ETAG"), values.at(1));
+            q.bindValue(QStringLiteral(":LAST_MODIFIED"), values.at(2));
             if (!q.exec())
                 err = getErrorString(q);
         }
@@ -2335,12 +3319,13 @@ QString DBRepository::updateStatus(const QString& package)
 
     QString err;
 
-    QList<PackageVersion*> pvs = getPackageVersions_(package, &err);
-    PackageVersion* newestInstallable = nullptr;
-    PackageVersion* newestInstalled = nullptr;
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            getPackageVersionsShared_(package, &err);
+    const PackageVersion* newestInstallable = nullptr;
+    const PackageVersion* newestInstalled = nullptr;
     if (err.isEmpty()) {
         for (int j = 0; j < pvs.count(); j++) {
-            PackageVersion* pv = pvs.at(j);
+            const PackageVersion* pv = pvs.at(j).get();
             if (pv->installed()) {
                 if (!newestInstalled ||
                         newestInstalled->version.compare(pv->version) < 0)
@@ -2387,7 +3372,6 @@ QString DBRepository::updateStatus(const QString& package)
                 err = getErrorString(q);
         }
     }
-    qDeleteAll(pvs);
 
     return err;
 }
@@ -2458,13 +3442,16 @@ void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
         if (err.isEmpty())
             err = exec(QStringLiteral(
                     "INSERT INTO PACKAGE_VERSION(NAME, PACKAGE, URL, "
-                    "CONTENT, MSIGUID, DETECT_FILE_COUNT) SELECT NAME, "
-                    "PACKAGE, URL, CONTENT, MSIGUID, DETECT_FILE_COUNT "
+                    "CONTENT, MSIGUID, DETECT_FILE_COUNT, REPOSITORY) "
+                    "SELECT NAME, PACKAGE, URL, CONTENT, MSIGUID, "
+                    "DETECT_FILE_COUNT, REPOSITORY "
                     "FROM tempdb.PACKAGE_VERSION"));
         if (err.isEmpty())
             err = exec(QStringLiteral(
-                    "INSERT INTO LICENSE(NAME, TITLE, DESCRIPTION, URL) "
-                    "SELECT NAME, TITLE, DESCRIPTION, URL FROM tempdb.LICENSE"));
+                    "INSERT INTO LICENSE(NAME, TITLE, DESCRIPTION, URL, "
+                    "REPOSITORY) "
+                    "SELECT NAME, TITLE, DESCRIPTION, URL, REPOSITORY "
+                    "FROM tempdb.LICENSE"));
         if (err.isEmpty())
             err = exec(QStringLiteral(
                     "INSERT INTO CATEGORY(ID, NAME, PARENT, LEVEL) "
@@ -2487,6 +3474,18 @@ void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
             err = exec(QStringLiteral(
                     "INSERT INTO TAG(PACKAGE, VALUE) "
                     "SELECT PACKAGE, VALUE FROM tempdb.TAG"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral(
+                    "INSERT INTO TITLE_TOKEN(TOKEN, PACKAGE) "
+                    "SELECT TOKEN, PACKAGE FROM tempdb.TITLE_TOKEN"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral("DELETE FROM REPOSITORY"));
+        if (err.isEmpty())
+            err = exec(QStringLiteral(
+                    "INSERT INTO REPOSITORY(ID, URL, SHA1, ETAG, "
+                    "LAST_MODIFIED) "
+                    "SELECT ID, URL, SHA1, ETAG, LAST_MODIFIED "
+                    "FROM tempdb.REPOSITORY"));
         if (err.isEmpty())
             job->setProgress(0.90);
         else
@@ -2571,6 +3570,9 @@ QString DBRepository::updateDatabase()
 
     bool e = false;
 
+    // true if the repository data was deleted
+    bool dropped = false;
+
     // PACKAGE
     if (err.isEmpty()) {
         e = tableExists(&db, QStringLiteral("PACKAGE"), &err);
@@ -2582,6 +3584,7 @@ QString DBRepository::updateDatabase()
                     "TITLE_FULLTEXT", &err)) {
                 exec(QStringLiteral("DROP TABLE PACKAGE"));
                 e = false;
+                dropped = true;
             }
         }
     }
@@ -2592,6 +3595,7 @@ QString DBRepository::updateDatabase()
                     "STARS", &err)) {
                 exec(QStringLiteral("DROP TABLE PACKAGE"));
                 e = false;
+                dropped = true;
             }
         }
     }
@@ -2685,6 +3689,19 @@ QString DBRepository::updateDatabase()
                     QStringLiteral("URL"), &err)) {
                 exec(QStringLiteral("DROP TABLE PACKAGE_VERSION"));
                 e = false;
+                dropped = true;
+            }
+        }
+    }
+
+    if (err.isEmpty()) {
+        if (e) {
+            // PACKAGE_VERSION.REPOSITORY is new in 1.27
+            if (!columnExists(&db, QStringLiteral("PACKAGE_VERSION"),
+                    QStringLiteral("REPOSITORY"), &err)) {
+                exec(QStringLiteral("DROP TABLE PACKAGE_VERSION"));
+                e = false;
+                dropped = true;
             }
         }
     }
@@ -2694,7 +3711,8 @@ QString DBRepository::updateDatabase()
             db.exec(QStringLiteral(
                     "CREATE TABLE PACKAGE_VERSION(NAME TEXT, "
                     "PACKAGE TEXT, URL TEXT, "
-                    "CONTENT BLOB, MSIGUID TEXT, DETECT_FILE_COUNT INTEGER)"));
+                    "CONTENT BLOB, MSIGUID TEXT, DETECT_FILE_COUNT INTEGER, "
+                    "REPOSITORY INTEGER)"));
             err = toString(db.lastError());
         }
     }
@@ -2738,12 +3756,25 @@ QString DBRepository::updateDatabase()
         e = tableExists(&db, QStringLiteral("LICENSE"), &err);
     }
 
+    if (err.isEmpty()) {
+        if (e) {
+            // LICENSE.REPOSITORY is new in 1.27
+            if (!columnExists(&db, QStringLiteral("LICENSE"),
+                    QStringLiteral("REPOSITORY"), &err)) {
+                exec(QStringLiteral("DROP TABLE LICENSE"));
+                e = false;
+                dropped = true;
+            }
+        }
+    }
+
     if (err.isEmpty()) {
         if (!e) {
             db.exec(QStringLiteral("CREATE TABLE LICENSE(NAME TEXT, "
                     "TITLE TEXT, "
                     "DESCRIPTION TEXT, "
-                    "URL TEXT"
+                    "URL TEXT, "
+                    "REPOSITORY INTEGER"
                     ")"));
             err = toString(db.lastError());
         }
@@ -2766,6 +3797,11 @@ QString DBRepository::updateDatabase()
         ce = columnExists(&db, QStringLiteral("REPOSITORY"),
                 QStringLiteral("SHA1"), &err);
     }
+    if (err.isEmpty() && ce) {
+        // REPOSITORY.ETAG and REPOSITORY.LAST_MODIFIED are new in 1.27
+        ce = columnExists(&db, QStringLiteral("REPOSITORY"),
+                QStringLiteral("ETAG"), &err);
+    }
     if (err.isEmpty()) {
         if (e && !ce) {
             db.exec(QStringLiteral("DROP TABLE REPOSITORY"));
@@ -2777,7 +3813,7 @@ QString DBRepository::updateDatabase()
         if (!e) {
             db.exec(QStringLiteral(
                     "CREATE TABLE REPOSITORY(ID INTEGER PRIMARY KEY ASC, "
-                    "URL TEXT, SHA1 TEXT)"));
+                    "URL TEXT, SHA1 TEXT, ETAG TEXT, LAST_MODIFIED TEXT)"));
             err = toString(db.lastError());
         }
     }
@@ -2789,6 +3825,14 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // the stored SHA1 and HTTP cache validators refer to the deleted data. The
+    // repositories should be downloaded again.
+    if (err.isEmpty() && e && dropped) {
+        db.exec(QStringLiteral(
+                "UPDATE REPOSITORY SET SHA1='', ETAG='', LAST_MODIFIED=''"));
+        err = toString(db.lastError());
+    }
+
     // LINK. This table is new in Npackd 1.20.
     if (err.isEmpty()) {
         e = tableExists(&db, QStringLiteral("LINK"), &err);
@@ -2847,6 +3891,22 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // FILE_HASH is new in 1.27. The hash sums are not related to the
+    // repositories and are kept if the repository data is reloaded.
+    if (err.isEmpty()) {
+        e = tableExists(&db, QStringLiteral("FILE_HASH"), &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec(QStringLiteral("CREATE TABLE FILE_HASH("
+                    "PATH TEXT NOT NULL PRIMARY KEY, "
+                    "SIZE INTEGER, "
+                    "MODIFIED INTEGER, "
+                    "SHA256 TEXT)"));
+            err = toString(db.lastError());
+        }
+    }
+
     // TAG is new in 1.26
     if (err.isEmpty()) {
         e = tableExists(&db, "TAG", &err);
@@ -2866,6 +3926,63 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // TITLE_TOKEN is new in 1.27
+    if (err.isEmpty()) {
+        e = tableExists(&db, "TITLE_TOKEN", &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec("CREATE TABLE TITLE_TOKEN("
+                    "TOKEN TEXT NOT NULL, "
+                    "PACKAGE TEXT NOT NULL)");
+            err = toString(db.lastError());
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec("CREATE INDEX TITLE_TOKEN_TOKEN ON TITLE_TOKEN("
+                    "TOKEN, PACKAGE)");
+            err = toString(db.lastError());
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec("CREATE INDEX TITLE_TOKEN_PACKAGE ON TITLE_TOKEN(PACKAGE)");
+            err = toString(db.lastError());
+        }
+    }
+
+    // the tokens for the existing packages are only created once
+    if (err.isEmpty() && !e) {
+        QStringList names;
+        QStringList titles;
+        {
+            MySQLQuery q(db);
+            if (!q.prepare(QStringLiteral("SELECT NAME, TITLE FROM PACKAGE")))
+                err = getErrorString(q);
+            if (err.isEmpty() && !q.exec())
+                err = getErrorString(q);
+            while (err.isEmpty() && q.next()) {
+                names.append(q.value(0).toString());
+                titles.append(q.value(1).toString());
+            }
+        }
+
+        if (err.isEmpty() && names.size() > 0)
+            err = exec(QStringLiteral("BEGIN TRANSACTION"));
+        if (err.isEmpty() && names.size() > 0) {
+            for (int i = 0; i < names.size(); i++) {
+                err = saveTitleTokens(names.at(i), titles.at(i));
+                if (!err.isEmpty())
+                    break;
+            }
+            if (err.isEmpty())
+                err = exec(QStringLiteral("COMMIT"));
+            else
+                exec(QStringLiteral("ROLLBACK"));
+        }
+    }
+
     return err;
 }
 
@@ -2929,5 +4046,4 @@ QString DBRepository::open(const QString& connectionName, const QString& file,
 
 DBRepository::PackageVersionList::~PackageVersionList()
 {
-    qDeleteAll(data);
 }
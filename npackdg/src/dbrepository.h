@@ -22,6 +22,9 @@
 #include "mysqlquery.h"
 #include "installedpackageversion.h"
 #include "urlinfo.h"
+#include "downloader.h"
+#include "repositorydelta.h"
+#include "filehasher.h"
 
 /**
  * @brief A repository stored in an SQLite database.
@@ -31,7 +34,8 @@ class DBRepository: public AbstractRepository
 private:
     class PackageVersionList {
     public:
-        QList<PackageVersion*> data;
+        /** the objects are shared with the callers and never changed */
+        QList<std::shared_ptr<const PackageVersion> > data;
 
         virtual ~PackageVersionList();
     };
@@ -63,14 +67,31 @@ private:
     MySQLQuery* deleteLinkQuery;
     std::unique_ptr<MySQLQuery> insertTagQuery;
     std::unique_ptr<MySQLQuery> deleteTagQuery;
+    std::unique_ptr<MySQLQuery> insertTitleTokenQuery;
+    std::unique_ptr<MySQLQuery> deleteTitleTokenQuery;
     std::unique_ptr<MySQLQuery> deleteCmdFilesQuery;
     MySQLQuery* insertInstalledQuery;
     MySQLQuery* insertURLSizeQuery;
 
     QStringList stopWords;
 
+    /**
+     * part of the keywords from a title that another package must contain to
+     * be found by findBetterPackages(). 1 = all keywords.
+     */
+    double titleMatchThreshold;
+
     QSqlDatabase db;
 
+    /**
+     * @brief repository URL -> [ownership:this] already downloaded repository
+     *     data. load() uses these files instead of downloading them again.
+     */
+    QMap<QString, QTemporaryFile*> prefetchedFiles;
+
+    /** repository URL -> HTTP response for a file in prefetchedFiles */
+    QMap<QString, Downloader::Response> prefetchedResponses;
+
     QString readCategories();
     QString getCategoryPath(int c0, int c1, int c2, int c3, int c4) const;
     int insertCategory(int parent, int level,
@@ -116,6 +137,24 @@ private:
 
     QString exec(const QString& sql);
 
+    /**
+     * @brief executes an SQL statement with positional parameters
+     * @param sql SQL statement
+     * @param params values for the parameters
+     * @param err error message will be stored here
+     * @return number of affected rows
+     */
+    int execUpdate(const QString& sql, const QList<QVariant>& params,
+            QString* err);
+
+    /**
+     * @brief applies the changes from a delta to the data from the repository
+     *     with the index currentRepository
+     * @param delta the changes
+     * @return error message
+     */
+    QString applyDelta(const RepositoryDelta& delta);
+
     /**
      * Loads the content from the URLs. None of the packages has the information
      * about installation path after this method was called.
@@ -128,10 +167,15 @@ private:
      * @param password password for the HTTP authentication or ""
      * @param user user name for the HTTP proxy authentication or ""
      * @param password password for the HTTP proxy authentication or ""
+     * @param unchanged if not 0 and the database already contains the data
+     *     for the same repositories, conditional HTTP requests will be used.
+     *     If none of the repositories has changed, the database is not
+     *     modified and true is stored here.
      */
     void load(Job *job, const QList<QUrl *>& repositories, bool useCache, bool interactive, const QString& user,
             const QString& password,
-            const QString& proxyUser, const QString& proxyPassword);
+            const QString& proxyUser, const QString& proxyPassword,
+            bool* unchanged=nullptr);
 
     /**
      * @brief loadOne
@@ -145,6 +189,37 @@ private:
     int count(const QString &sql, QString *err);
     QString getRepositorySHA1(const QString &url, QString *err);
     void setRepositorySHA1(const QString &url, const QString &sha1, QString *err);
+
+    /**
+     * @brief reads the HTTP cache validators stored for a repository
+     * @param url repository URL
+     * @param etag value of the ETag header will be stored here
+     * @param lastModified value of the Last-Modified header will be stored here
+     * @return error message
+     */
+    QString getRepositoryValidators(const QString &url, QString *etag,
+            QString *lastModified);
+
+    /**
+     * @brief stores the HTTP cache validators for a repository
+     * @param url repository URL
+     * @param etag value of the ETag header or ""
+     * @param lastModified value of the Last-Modified header or ""
+     * @return error message
+     */
+    QString setRepositoryValidators(const QString &url, const QString &etag,
+            const QString &lastModified);
+
+    /**
+     * @brief reads the HTTP cache validators for conditional requests
+     * @param reps repository URLs
+     * @param etags ETag values will be stored here
+     * @param lastModified Last-Modified values will be stored here
+     * @return true if the database contains the data for exactly the same
+     *     list of repositories and a validator is available for each of them
+     */
+    bool readRepositoryValidators(const QStringList &reps, QStringList *etags,
+            QStringList *lastModified);
     QString clearRepository(int id);
     QString saveLinks(Package *p);
     QString readLinks(Package *p) const;
@@ -155,6 +230,9 @@ private:
     QStringList tokenizeTitle(const QString &title);
     QString deleteTags(const QString &name);
     QString saveTags(Package *p);
+    QString deleteTitleTokens(const QString &name);
+    QString saveTitleTokens(const QString &name, const QString &title);
+    int getRequiredTokens(int n) const;
     QString readTags(Package *p) const;
     QString createQuery(Package::Status minStatus, Package::Status maxStatus,
             const QString &query, int cat0, int cat1, QList<QVariant> &params) const;
@@ -193,6 +271,21 @@ public:
      */
     QString saveURLSize(const QString& url, int64_t size);
 
+    /**
+     * @brief saves the download sizes for many URLs in one transaction
+     * @param infos URLs and sizes
+     * @return error message
+     */
+    QString saveURLSizes(const QList<URLInfo>& infos);
+
+    /**
+     * @brief saves file hash sums in one transaction
+     * @param hashes hash sums. Existing entries for the same paths are
+     *     replaced.
+     * @return error message
+     */
+    QString saveFileHashes(const QList<FileHash>& hashes);
+
     QString saveLicense(License* p, bool replace) override;
 
     QString savePackageVersion(PackageVersion *p, bool replace) override;
@@ -251,11 +344,32 @@ public:
      */
     QMap<QString, URLInfo*> findURLInfos(QString* err);
 
+    /**
+     * @brief reads the stored download size for one URL
+     * @param url URL
+     * @param err error message will be stored here
+     * @return size of the URL or -1 if unknown or -2 if an error occured
+     */
+    int64_t findURLSize(const QString& url, QString* err);
+
+    /**
+     * @brief reads the stored file hash sums
+     * @param paths full file paths (see WPMUtils::normalizePath)
+     * @param err error message will be stored here
+     * @return path -> hash sum. Paths without a stored hash sum are not
+     *     included.
+     */
+    QMap<QString, FileHash> findFileHashes(const QStringList& paths,
+            QString* err);
+
     Package* findPackage_(const QString& name) const override;
 
     QList<PackageVersion*> getPackageVersions_(const QString& package,
             QString *err) const override;
 
+    QList<std::shared_ptr<const PackageVersion> > getPackageVersionsShared_(
+            const QString& package, QString* err) const override;
+
     /**
      * @brief returns all package versions with a <cmd-file> entry with the
      *     specified path
@@ -298,12 +412,28 @@ public:
      * @param proxyPassword password for the HTTP proxy authentication or ""
      * @param useCache true = use the HTTP cache
      * @param detect true = detect software
+     * @param download false = the database already contains the current data
+     *     from the repositories (e.g. after loadDeltas() or load()) and
+     *     only the installation status should be updated
      */
     void clearAndDownloadRepositories(Job *job,
             const QList<QUrl*>& repositories, bool interactive, const QString& user,
             const QString& password,
             const QString& proxyUser, const QString& proxyPassword,
-            bool useCache, bool detect=true);
+            bool useCache, bool detect=true, bool download=true);
+
+    /**
+     * @brief updates the data in this database using deltas
+     *     (see RepositoryDelta) instead of loading the whole repositories.
+     *     Nothing is changed if one of the servers does not support deltas.
+     * @param job job. An error only means that the deltas cannot be used.
+     * @param repositories URLs for the repositories
+     * @param full whole repositories sent by the servers instead of deltas
+     *     will be stored here for the next call to load() on this object
+     * @return true if the data in this database is up-to-date now
+     */
+    bool loadDeltas(Job* job, const QList<QUrl*>& repositories,
+            DBRepository* full);
 
     /**
      * @brief updateF5() that can be used with QtConcurrent::Run
@@ -324,6 +454,14 @@ public:
      */
     void clearCache();
 
+    /**
+     * @param err error message will be stored here
+     * @return URLs and SHA-1 values of all loaded repositories or an empty
+     *     string if the SHA-1 of a repository is unknown. The value changes
+     *     if the repository data changes.
+     */
+    QString getRepositoriesFingerprint(QString* err);
+
     QList<Package*> findPackagesByShortName(const QString &name) const override;
 
     /**
@@ -362,7 +500,8 @@ public:
 
     /**
      * @brief saves the list of given repository URLs. The repositories will
-     *     get the IDs 1, 2, 3, ...
+     *     get the IDs 1, 2, 3, ... The stored SHA1 and HTTP cache validators
+     *     are kept for the URLs that were already present.
      * @param reps URLs
      * @return error message
      */
@@ -377,13 +516,42 @@ public:
     QList<Package*> findPackages(const QStringList &names);
 
     /**
-     * @brief searches for better packages for detection
+     * @brief searches for better packages for detection. The keywords from
+     *     the title are searched in the table TITLE_TOKEN.
      * @param title title of a package
      * @param err error message will be stored here
-     * @return list of found packages.
+     * @return list of found packages (at most 2).
      */
     QStringList findBetterPackages(const QString &title, QString *err);
 
+    /**
+     * @brief changes the part of the keywords from a title that another
+     *     package must contain to be found by findBetterPackages()
+     * @param threshold 0..1. 1 = all keywords. At least one keyword is
+     *     always required.
+     */
+    void setTitleMatchThreshold(double threshold);
+
+    /**
+     * @return part of the keywords from a title that another package must
+     *     contain to be found by findBetterPackages()
+     */
+    double getTitleMatchThreshold() const;
+
+    /**
+     * @brief searches for better packages for the detection of many packages
+     *     at once. The keywords of all titles are matched against the table
+     *     TITLE_TOKEN in one query. The result is the same as from
+     *     findBetterPackages() for every title.
+     * @param packages names of the detected packages. Only the names starting
+     *     with "msi." or "control-panel." are considered.
+     * @param err error message will be stored here
+     * @return detected package name -> better package name. Packages without
+     *     exactly one better package are not in the map.
+     */
+    QMap<QString, QString> findBetterPackageNames(const QStringList &packages,
+            QString *err);
+
     /**
      * @return maximum number of stars for a package
      * @param err error message will be stored here
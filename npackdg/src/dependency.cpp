@@ -5,6 +5,7 @@
 #include "package.h"
 #include "installedpackages.h"
 #include "installedpackageversion.h"
+#include "memoryarena.h"
 
 Dependency::Dependency()
 {
@@ -47,6 +48,16 @@ Dependency *Dependency::clone() const
     return r;
 }
 
+void* Dependency::operator new(size_t size)
+{
+    return MemoryArena::allocate(size);
+}
+
+void Dependency::operator delete(void* p)
+{
+    MemoryArena::free(p);
+}
+
 bool Dependency::autoFulfilledIf(const Dependency& dep)
 {
     bool r;
@@ -0,0 +1,225 @@
+#include <windows.h>
+#include <shlobj.h>
+
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCryptographicHash>
+
+#include "detectionjournal.h"
+#include "packageutils.h"
+#include "wpmutils.h"
+
+QString DetectionJournal::getDefaultFile()
+{
+    QString dir = WPMUtils::getShellDir(PackageUtils::globalMode ?
+            CSIDL_COMMON_APPDATA : CSIDL_APPDATA) +
+            QStringLiteral("\\Npackd");
+    QDir d;
+    if (!d.exists(dir))
+        d.mkpath(dir);
+
+    return QDir::toNativeSeparators(dir + QStringLiteral("\\Detection.json"));
+}
+
+QString DetectionJournal::computeFingerprint(const AbstractThirdPartyPM* tpm,
+        const InstalledPackageVersion& ipv)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QStringList parts;
+    parts << ipv.package << ipv.version.getVersionString() <<
+            ipv.directory << ipv.detectionInfo << tpm->getFingerprint(ipv);
+    hash.addData(parts.join('\n').toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+void DetectionJournal::setContext(const QString& context)
+{
+    if (context != this->context || context.isEmpty()) {
+        entries.clear();
+        sources.clear();
+        this->context = context;
+    }
+}
+
+bool DetectionJournal::find(const QString& prefix,
+        const QString& detectionInfo, const QString& fingerprint,
+        Entry* entry) const
+{
+    if (context.isEmpty())
+        return false;
+
+    QMap<QString, QMap<QString, Entry> >::const_iterator it =
+            entries.constFind(prefix);
+    if (it == entries.constEnd())
+        return false;
+
+    QMap<QString, Entry>::const_iterator e = it->constFind(detectionInfo);
+    if (e == it->constEnd() || e->fingerprint != fingerprint)
+        return false;
+
+    *entry = *e;
+    return true;
+}
+
+void DetectionJournal::record(const QString& prefix,
+        const QString& detectionInfo, const Entry& entry)
+{
+    if (!context.isEmpty())
+        entries[prefix].insert(detectionInfo, entry);
+}
+
+void DetectionJournal::remove(const QString& prefix,
+        const QString& detectionInfo)
+{
+    QMap<QString, QMap<QString, Entry> >::iterator it = entries.find(prefix);
+    if (it != entries.end())
+        it->remove(detectionInfo);
+}
+
+void DetectionJournal::retain(const QString& prefix,
+        const QSet<QString>& detectionInfos)
+{
+    QMap<QString, QMap<QString, Entry> >::iterator it = entries.find(prefix);
+    if (it != entries.end()) {
+        QMap<QString, Entry>::iterator e = it->begin();
+        while (e != it->end()) {
+            if (!detectionInfos.contains(e.key()))
+                e = it->erase(e);
+            else
+                ++e;
+        }
+    }
+}
+
+QMap<QString, DetectionJournal::Entry> DetectionJournal::getEntries(
+        const QString& prefix) const
+{
+    return entries.value(prefix);
+}
+
+QString DetectionJournal::getSourcesFingerprint(const QString& prefix) const
+{
+    if (context.isEmpty())
+        return QString();
+
+    return sources.value(prefix);
+}
+
+void DetectionJournal::setSourcesFingerprint(const QString& prefix,
+        const QString& fingerprint)
+{
+    if (context.isEmpty() || fingerprint.isEmpty())
+        sources.remove(prefix);
+    else
+        sources.insert(prefix, fingerprint);
+}
+
+int DetectionJournal::count(const QString& prefix) const
+{
+    return entries.value(prefix).size();
+}
+
+QString DetectionJournal::load(const QString& filename)
+{
+    QString err;
+
+    context.clear();
+    entries.clear();
+    sources.clear();
+
+    QFile f(filename);
+    if (!f.exists())
+        return err;
+
+    if (!f.open(QFile::ReadOnly))
+        err = QObject::tr("Cannot open the file: %1").arg(filename);
+
+    QJsonObject top;
+    if (err.isEmpty()) {
+        QJsonParseError pe;
+        QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &pe);
+        f.close();
+        if (pe.error != QJsonParseError::NoError)
+            err = QObject::tr("Error parsing %1: %2").arg(filename).
+                    arg(pe.errorString());
+        else
+            top = doc.object();
+    }
+
+    if (err.isEmpty()) {
+        QJsonObject prefixes = top.value(QStringLiteral("entries")).toObject();
+        for (QJsonObject::const_iterator it = prefixes.constBegin();
+                it != prefixes.constEnd(); ++it) {
+            QJsonObject infos = it.value().toObject();
+            QMap<QString, Entry>& map = entries[it.key()];
+            for (QJsonObject::const_iterator e = infos.constBegin();
+                    e != infos.constEnd(); ++e) {
+                QJsonObject o = e.value().toObject();
+                Entry entry;
+                entry.fingerprint = o.value(QStringLiteral("fingerprint")).
+                        toString();
+                entry.package = o.value(QStringLiteral("package")).toString();
+                entry.directory = o.value(QStringLiteral("directory")).
+                        toString();
+                if (entry.version.setVersion(o.value(
+                        QStringLiteral("version")).toString()))
+                    map.insert(e.key(), entry);
+            }
+        }
+        QJsonObject fingerprints = top.value(QStringLiteral("sources")).
+                toObject();
+        for (QJsonObject::const_iterator it = fingerprints.constBegin();
+                it != fingerprints.constEnd(); ++it) {
+            sources.insert(it.key(), it.value().toString());
+        }
+        context = top.value(QStringLiteral("context")).toString();
+    }
+
+    return err;
+}
+
+QString DetectionJournal::save(const QString& filename) const
+{
+    QString err;
+
+    QJsonObject prefixes;
+    for (QMap<QString, QMap<QString, Entry> >::const_iterator it =
+            entries.constBegin(); it != entries.constEnd(); ++it) {
+        QJsonObject infos;
+        for (QMap<QString, Entry>::const_iterator e = it->constBegin();
+                e != it->constEnd(); ++e) {
+            QJsonObject o;
+            o[QStringLiteral("fingerprint")] = e->fingerprint;
+            o[QStringLiteral("package")] = e->package;
+            o[QStringLiteral("version")] = e->version.getVersionString();
+            o[QStringLiteral("directory")] = e->directory;
+            infos[e.key()] = o;
+        }
+        prefixes[it.key()] = infos;
+    }
+
+    QJsonObject top;
+    top[QStringLiteral("context")] = context;
+    top[QStringLiteral("entries")] = prefixes;
+
+    QJsonObject fingerprints;
+    for (QMap<QString, QString>::const_iterator it = sources.constBegin();
+            it != sources.constEnd(); ++it) {
+        fingerprints[it.key()] = it.value();
+    }
+    top[QStringLiteral("sources")] = fingerprints;
+
+    // the old journal stays if the new one cannot be written completely
+    QSaveFile f(filename);
+    if (!f.open(QFile::WriteOnly))
+        err = QObject::tr("Cannot open the file: %1").arg(filename);
+    else {
+        f.write(QJsonDocument(top).toJson(QJsonDocument::Compact));
+        if (!f.commit())
+            err = f.errorString();
+    }
+
+    return err;
+}
@@ -0,0 +1,147 @@
+#ifndef DETECTIONJOURNAL_H
+#define DETECTIONJOURNAL_H
+
+#include <QString>
+#include <QMap>
+#include <QSet>
+
+#include "installedpackageversion.h"
+#include "abstractthirdpartypm.h"
+
+/**
+ * @brief remembers the results of the detection of packages installed by
+ *     third party package managers. For every detected entry a fingerprint
+ *     and the resulting installed package version (the package name may be
+ *     different from the detected one and the directory may be created by
+ *     Npackd) are stored. If the fingerprint did not change, the result can
+ *     be used without detecting the entry again.
+ *
+ * A fingerprint for all sources of a third party package manager is also
+ * stored. If it did not change, all stored results for the package manager
+ * can be used without scanning its sources.
+ *
+ * All stored results are discarded if the context (e.g. the repositories)
+ * changes. This class is not thread-safe.
+ */
+class DetectionJournal
+{
+public:
+    /** result of the detection of one entry */
+    class Entry
+    {
+    public:
+        QString fingerprint;
+        QString package;
+        Version version;
+        QString directory;
+    };
+private:
+    QString context;
+
+    /** detection prefix -> detection info -> entry */
+    QMap<QString, QMap<QString, Entry> > entries;
+
+    /** detection prefix -> fingerprint of the sources */
+    QMap<QString, QString> sources;
+public:
+    /**
+     * @return default file for the journal
+     */
+    static QString getDefaultFile();
+
+    /**
+     * @brief computes the fingerprint for a detected package version
+     * @param tpm the package manager that detected the package version
+     * @param ipv detected package version
+     * @return fingerprint
+     */
+    static QString computeFingerprint(const AbstractThirdPartyPM* tpm,
+            const InstalledPackageVersion& ipv);
+
+    /**
+     * @brief changes the context. All entries are removed if the context
+     *     changes. The journal is not used if the context is empty.
+     * @param context new context
+     */
+    void setContext(const QString& context);
+
+    /**
+     * @brief searches for the result of a previous detection
+     * @param prefix detection prefix
+     * @param detectionInfo detection info
+     * @param fingerprint current fingerprint
+     * @param entry the result will be stored here
+     * @return true if the entry was found and the fingerprint did not change
+     */
+    bool find(const QString& prefix, const QString& detectionInfo,
+            const QString& fingerprint, Entry* entry) const;
+
+    /**
+     * @brief stores the result of a detection
+     * @param prefix detection prefix
+     * @param detectionInfo detection info
+     * @param entry result
+     */
+    void record(const QString& prefix, const QString& detectionInfo,
+            const Entry& entry);
+
+    /**
+     * @brief removes an entry
+     * @param prefix detection prefix
+     * @param detectionInfo detection info
+     */
+    void remove(const QString& prefix, const QString& detectionInfo);
+
+    /**
+     * @brief removes the entries that were not detected anymore
+     * @param prefix detection prefix
+     * @param detectionInfos detection infos of the entries that should be
+     *     kept
+     */
+    void retain(const QString& prefix, const QSet<QString>& detectionInfos);
+
+    /**
+     * @param prefix detection prefix
+     * @return detection info -> entry for all entries with the prefix
+     */
+    QMap<QString, Entry> getEntries(const QString& prefix) const;
+
+    /**
+     * @param prefix detection prefix
+     * @return fingerprint of the sources stored by setSourcesFingerprint() or
+     *     "" if it is unknown or the journal is not used
+     */
+    QString getSourcesFingerprint(const QString& prefix) const;
+
+    /**
+     * @brief stores the fingerprint of the sources after all entries for the
+     *     prefix were detected
+     * @param prefix detection prefix
+     * @param fingerprint fingerprint of the sources (see
+     *     AbstractThirdPartyPM::getSourcesFingerprint()) or "" to remove it
+     */
+    void setSourcesFingerprint(const QString& prefix,
+            const QString& fingerprint);
+
+    /**
+     * @param prefix detection prefix
+     * @return number of entries for the prefix
+     */
+    int count(const QString& prefix) const;
+
+    /**
+     * @brief reads the journal. A missing file is not an error.
+     * @param filename file name
+     * @return error message
+     */
+    QString load(const QString& filename);
+
+    /**
+     * @brief writes the journal
+     * @param filename file name
+     * @return error message
+     */
+    QString save(const QString& filename) const;
+};
+
+#endif // DETECTIONJOURNAL_H
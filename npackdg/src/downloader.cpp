@@ -1,607 +1,685 @@
 #include <math.h>
 #include <stdint.h>
 
-#include <windows.h>
-#include <wininet.h>
-
 #include <zlib.h>
 
+#include <QtGlobal>
+#if defined(_MSC_VER) && (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#endif
+
 #include <QObject>
 #include <QWaitCondition>
 #include <QMutex>
 #include <QCryptographicHash>
 #include <QLoggingCategory>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFuture>
+#include <QThread>
 
 #include "downloader.h"
+#include "abstracttransport.h"
+#include "hashingwriter.h"
+#include "transferscheduler.h"
 #include "job.h"
 #include "wpmutils.h"
 
-HWND defaultPasswordWindow = nullptr;
-QMutex loginDialogMutex;
+/** files smaller than 2 segments are downloaded using one connection */
+static const int64_t MIN_SEGMENT_SIZE = 8 * 1024 * 1024;
 
-DWORD __stdcall myInternetAuthNotifyCallback(DWORD_PTR /* dwContext */,
-        DWORD dwReturn, LPVOID /* lpReserved */) {
-    qCDebug(npackd) << "myInternetAuthNotifyCallback" << dwReturn;
-    return 0;
-}
+/**
+ * number of bytes requested from all mirrors in parallel to find the fastest
+ * one
+ */
+static const int64_t MIRROR_RACE_SIZE = 256 * 1024;
 
-int64_t Downloader::downloadWin(Job* job, const Request& request,
-        Downloader::Response* response)
+/**
+ * @return thread pool for the segments of a download. The global thread pool
+ *     is not used as the downloads themselves may run there.
+ */
+static QThreadPool* getSegmentsThreadPool()
 {
-    QUrl url = request.url;
-    QString verb = request.httpMethod;
-    QFile* file = request.file;
-    QString* mime = &response->mimeType;
-    QString* contentDisposition = &response->contentDisposition;
-    HWND parentWindow = defaultPasswordWindow;
-    QString* sha1 = &response->hashSum;
-    bool useCache = request.useCache;
-    QCryptographicHash::Algorithm alg = request.alg;
-    bool keepConnection = request.keepConnection;
-    bool interactive = request.interactive;
-
-    QString initialTitle = job->getTitle();
-
-    job->setTitle(initialTitle + " / " + QObject::tr("Connecting"));
+    static QThreadPool pool;
+    if (pool.maxThreadCount() < 16)
+        pool.setMaxThreadCount(16);
+    return &pool;
+}
 
-    if (sha1)
-        sha1->clear();
+AbstractTransport* Downloader::transport = nullptr;
 
-    QString server = url.host();
-    QString resource = url.path();
-    QString encQuery = url.query(QUrl::FullyEncoded);
-    if (!encQuery.isEmpty())
-        resource.append('?').append(encQuery);
+AbstractTransport* Downloader::defaultTransport = nullptr;
 
-    QString agent("Npackd/");
-    agent.append(NPACKD_VERSION);
+void Downloader::setTransport(AbstractTransport* t)
+{
+    transport = t;
+}
 
-    agent += " (compatible; MSIE 9.0)";
+void Downloader::setDefaultTransport(AbstractTransport* t)
+{
+    defaultTransport = t;
+}
 
-    HINTERNET internet = InternetOpenW(WPMUtils::toLPWSTR(agent),
-            INTERNET_OPEN_TYPE_PRECONFIG,
-            nullptr, nullptr, 0);
+AbstractTransport* Downloader::getTransport()
+{
+    AbstractTransport* t = transport;
+    if (!t)
+        t = defaultTransport;
+    return t;
+}
 
-    if (internet == nullptr) {
-        QString errMsg;
-        WPMUtils::formatMessage(GetLastError(), &errMsg);
-        job->setErrorMessage(errMsg);
-    }
+int64_t Downloader::downloadHTTP(Job* job, const Request& request,
+        Downloader::Response* response, QCryptographicHash* hash)
+{
+    QString initialTitle = job->getTitle();
 
-    if (job->shouldProceed()) {
-        // change the timeout to 5 minutes
-        DWORD rec_timeout = static_cast<DWORD>(request.timeout) * 1000;
-        InternetSetOption(internet, INTERNET_OPTION_RECEIVE_TIMEOUT,
-                &rec_timeout, sizeof(rec_timeout));
-        InternetSetOption(internet, INTERNET_OPTION_SEND_TIMEOUT,
-                &rec_timeout, sizeof(rec_timeout));
-
-        // enable automatic gzip decoding
-#ifndef INTERNET_OPTION_HTTP_DECODING
-        const DWORD INTERNET_OPTION_HTTP_DECODING = 65;
-#endif
-        BOOL b = TRUE;
-        InternetSetOption(internet, INTERNET_OPTION_HTTP_DECODING,
-                &b, sizeof(b));
+    job->setTitle(initialTitle + " / " + QObject::tr("Connecting"));
 
-        job->setProgress(0.01);
-    }
+    response->hashSum.clear();
 
-    // here "internet" cannot be 0, but we add the comparison to silence
-    // Coverity
-    HINTERNET hConnectHandle = nullptr;
-    if (job->shouldProceed() && internet != nullptr) {
-        INTERNET_PORT port = static_cast<INTERNET_PORT>(
-                url.port(url.scheme() == "https" ?
-                INTERNET_DEFAULT_HTTPS_PORT: INTERNET_DEFAULT_HTTP_PORT));
-        hConnectHandle = InternetConnectW(internet,
-                WPMUtils::toLPWSTR(server), port, nullptr, nullptr, INTERNET_SERVICE_HTTP, 0, 0);
-
-        if (hConnectHandle == nullptr) {
-            QString errMsg;
-            WPMUtils::formatMessage(GetLastError(), &errMsg);
-            job->setErrorMessage(errMsg);
-        }
-    }
+    QCryptographicHash ownHash(request.alg);
+    if (!hash && request.hashSum)
+        hash = &ownHash;
 
+    bool gzip = false;
+    QIODevice* device = nullptr;
+    AbstractTransport* t = getTransport();
+    if (t)
+        device = t->open(job, request, response, &gzip);
+    else
+        job->setErrorMessage(QObject::tr("No transport for %1").
+                arg(request.url.toDisplayString()));
+    if (device)
+        device = TransferScheduler::getDefault()->throttle(device,
+                request.priority);
+    int64_t contentLength = response->contentLength;
 
     if (job->shouldProceed()) {
-        if (!request.user.isEmpty()) {
-            setStringOption(hConnectHandle, INTERNET_OPTION_USERNAME,
-                    request.user);
-
-            if (!request.password.isEmpty()) {
-                setStringOption(hConnectHandle, INTERNET_OPTION_PASSWORD,
-                        request.password);
-            }
+        int status = response->statusCode;
+
+        // 2XX
+        if (request.isConditional() && status == 304) {
+            // nothing. The caller already has the data.
+        } else if (status / 100 != 2) {
+            job->setErrorMessage(QString(
+                    QObject::tr("HTTP status code %1")).arg(status));
+        } else if (request.isPartial() && status != 206) {
+            job->setErrorMessage(QString(
+                    QObject::tr("The server does not support partial downloads (HTTP status code %1)")).
+                    arg(status));
         }
     }
 
     if (job->shouldProceed()) {
-        if (!request.proxyUser.isEmpty()) {
-            setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_USERNAME,
-                    request.proxyUser);
-
-            if (!request.proxyPassword.isEmpty()) {
-                setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_PASSWORD,
-                        request.proxyPassword);
-            }
-        }
+        job->setProgress(0.05);
+        job->setTitle(initialTitle + " / " + QObject::tr("Downloading"));
     }
 
-    // flags: http://msdn.microsoft.com/en-us/library/aa383661(v=vs.85).aspx
-    // We support accepting any mime file type since this is a simple download
-    // of a file
-    //
-    // hConnectHandle is only checked here to silence Coverity
-    HINTERNET hResourceHandle = nullptr;
-    if (job->shouldProceed() && hConnectHandle != nullptr) {
-        LPCTSTR ppszAcceptTypes[2];
-        ppszAcceptTypes[0] = L"*/*";
-        ppszAcceptTypes[1] = nullptr;
-        DWORD flags = (url.scheme() == "https" ? INTERNET_FLAG_SECURE : 0);
-        if (keepConnection)
-            flags |= INTERNET_FLAG_KEEP_CONNECTION;
-        if (!request.useInternet)
-            flags |= INTERNET_FLAG_FROM_CACHE;
-        flags |= INTERNET_FLAG_RESYNCHRONIZE;
-        if (!useCache)
-            flags |= INTERNET_FLAG_DONT_CACHE | INTERNET_FLAG_PRAGMA_NOCACHE |
-                    INTERNET_FLAG_RELOAD;
-        hResourceHandle = HttpOpenRequestW(hConnectHandle,
-                WPMUtils::toLPWSTR(verb),
-                WPMUtils::toLPWSTR(resource),
-                nullptr, nullptr, ppszAcceptTypes,
-                flags, 0);
-        if (hResourceHandle == nullptr) {
-            QString errMsg;
-            WPMUtils::formatMessage(GetLastError(), &errMsg);
-            job->setErrorMessage(errMsg);
+    if (job->shouldProceed()) {
+        if (response->statusCode == 304 || request.ignoreContent) {
+            job->setProgress(1);
+        } else {
+            Job* sub = job->newSubJob(0.95, QObject::tr("Reading the data"));
+            response->bytesReceived = readData(sub, device, request.file,
+                    hash, gzip, contentLength);
+            if (!sub->getErrorMessage().isEmpty())
+                job->setErrorMessage(sub->getErrorMessage());
+            else if (!gzip && contentLength > 0 &&
+                    response->bytesReceived < contentLength)
+                job->setErrorMessage(QString(
+                        QObject::tr("The connection was closed after %L1 of %L2 bytes")).
+                        arg(response->bytesReceived).arg(contentLength));
         }
     }
 
-    qCDebug(npackd) << "HttpOpenRequestW succeeded";
+    delete device;
 
-    int64_t contentLength = -1;
+    if (hash == &ownHash && job->shouldProceed())
+        response->hashSum = ownHash.result().toHex().toLower();
 
-    if (hResourceHandle != nullptr && hConnectHandle != nullptr) {
-        if (job->shouldProceed()) {
-            // do not check for errors here
-            HttpAddRequestHeadersW(hResourceHandle,
-                    L"Accept-Encoding: gzip, deflate",
-                    static_cast<DWORD>(-1),
-                    HTTP_ADDREQ_FLAG_ADD);
-        }
+    if (job->shouldProceed())
+        job->setProgress(1);
 
-        // qCDebug(npackd) << "download.5";
-        int callNumber = 0;
-        while (job->shouldProceed()) {
-            // qCDebug(npackd) << "download.5.1";
+    job->setTitle(initialTitle);
 
-            // NOTE: dwStatus is only valid if sendRequestError == 0
-            DWORD dwStatus = 0, dwStatusSize = sizeof(dwStatus);
+    job->complete();
 
-            DWORD sendRequestError = 0;
+    qCDebug(npackd) << request.url << job->getErrorMessage() << contentLength;
 
-            // the following call uses NULL for headers in case there are no headers
-            // because Windows 2003 generates the error 12150 otherwise
-            if (!HttpSendRequestW(hResourceHandle,
-                    request.headers.length() == 0 ? nullptr : WPMUtils::toLPWSTR(request.headers),
-                    static_cast<DWORD>(-1),
-                    request.postData.length() == 0 ? nullptr : const_cast<char*>(request.postData.data()),
-                    static_cast<DWORD>(request.postData.length()))) {
-                sendRequestError = GetLastError();
-            }
+    return contentLength;
+}
 
-            // http://msdn.microsoft.com/en-us/library/aa384220(v=vs.85).aspx
-            if (sendRequestError == 0) {
-                if (!HttpQueryInfo(hResourceHandle, HTTP_QUERY_FLAG_NUMBER |
-                        HTTP_QUERY_STATUS_CODE, &dwStatus, &dwStatusSize, nullptr)) {
-                    QString errMsg;
-                    WPMUtils::formatMessage(GetLastError(), &errMsg);
-                    job->setErrorMessage(errMsg);
-                    break;
-                }
-            }
+void Downloader::downloadResumable(Job* job, const Request& request,
+        Downloader::Response* response, QCryptographicHash* hash)
+{
+    QCryptographicHash ownHash(request.alg);
+    if (!hash && request.hashSum)
+        hash = &ownHash;
 
-            qCDebug(npackd) << "Downloader::downloadWin callNumber="
-                    << callNumber << ", sendRequestError="
-                    << sendRequestError << ", dwStatus=" << dwStatus;
+    QFile* file = request.file;
+    int64_t start = file ? file->pos() : 0;
+    bool whole = request.rangeStart == 0 && request.rangeEnd < 0;
 
-            // 2XX
-            if (sendRequestError == 0) {
-                DWORD hundreds = dwStatus / 100;
-                if (hundreds == 2 || hundreds == 5)
-                    break;
-            }
+    QString err;
+    int64_t received = 0;
+    for (int attempt = 0; attempt <= request.resumeAttempts; attempt++) {
+        if (job->isCancelled())
+            break;
 
-            // the InternetErrorDlg calls below can either handle
-            // sendRequestError <> 0 or HTTP error code <> 2xx
+        if (attempt > 0) {
+            // give a flaky connection some time to recover
+            QThread::msleep(static_cast<unsigned long>(attempt) * 1000);
+        }
 
-            void* p = nullptr;
+        Downloader::Request r2(request);
+        r2.rangeStart = request.rangeStart + received;
+
+        Job* sub;
+        if (attempt == 0)
+            sub = job->newSubJob(1, "");
+        else
+            sub = job->newSubJob(1 - job->getProgress(), QString(
+                    QObject::tr("Resuming at byte %L1 (attempt %2)")).
+                    arg(r2.rangeStart).arg(attempt + 1));
+
+        Downloader::Response resp;
+        downloadHTTP(sub, r2, &resp, hash);
+
+        if (attempt == 0) {
+            response->mimeType = resp.mimeType;
+            response->contentDisposition = resp.contentDisposition;
+            response->statusCode = resp.statusCode;
+            response->contentLength = resp.contentLength;
+            response->acceptRanges = resp.acceptRanges;
+            response->etag = resp.etag;
+            response->lastModified = resp.lastModified;
+        }
 
-            // both calls to InternetErrorDlg should be enclosed by one
-            // mutex, so that only one dialog will be shown
-            loginDialogMutex.lock();
+        err = sub->getErrorMessage();
+        if (err.isEmpty() && !sub->isCancelled()) {
+            received += resp.bytesReceived;
+            break;
+        }
 
-            DWORD r;
+        if (resp.statusCode / 100 == 4)
+            break;
 
-            // first call is processed differently
-            if (callNumber == 0) {
-                r = InternetErrorDlg(nullptr,
-                       hResourceHandle, sendRequestError,
-                        FLAGS_ERROR_UI_FILTER_FOR_ERRORS |
-                        FLAGS_ERROR_UI_FLAGS_CHANGE_OPTIONS |
-                        FLAGS_ERROR_UI_FLAGS_GENERATE_DATA |
-                        FLAGS_ERROR_UI_FLAGS_NO_UI, &p);
-                if ((r == ERROR_SUCCESS || r == ERROR_INTERNET_INTERNAL_ERROR) && interactive)
-                    r = ERROR_INTERNET_FORCE_RETRY;
-            } else {
-                if (interactive) {
-                    if (parentWindow) {
-                        r = InternetErrorDlg(parentWindow,
-                                hResourceHandle, sendRequestError,
-                                FLAGS_ERROR_UI_FILTER_FOR_ERRORS |
-                                FLAGS_ERROR_UI_FLAGS_CHANGE_OPTIONS |
-                                FLAGS_ERROR_UI_FLAGS_GENERATE_DATA, &p);
-                    } else {
-                        if (sendRequestError == 0) {
-                            QString e = inputPassword(hConnectHandle, dwStatus);
-
-                            //qCDebug(npackd) << "inputPassword: " << e;
-                            if (!e.isEmpty()) {
-                                job->setErrorMessage(e);
-                                r = ERROR_CANCELLED;
-                            } else {
-                                r = ERROR_INTERNET_FORCE_RETRY;
-                            }
-                        } else {
-                            // cannot help
-                            r = ERROR_SUCCESS;
-                        }
-                    }
-                } else {
-                    if (sendRequestError == 0) {
-                        QString e = setPassword(hConnectHandle, dwStatus,
-                                request);
-
-                        if (!e.isEmpty()) {
-                            job->setErrorMessage(e);
-                            r = ERROR_CANCELLED;
-                        } else {
-                            r = ERROR_INTERNET_FORCE_RETRY;
-                        }
-                    } else {
-                        // cannot help
-                        r = ERROR_SUCCESS;
-                    }
-                }
+        if (whole && r2.rangeStart > 0 && resp.statusCode == 200) {
+            // the server ignored the "Range" header. Start from scratch.
+            qCDebug(npackd) << "Downloader::downloadResumable restarting" <<
+                    request.url;
+            if (file) {
+                file->resize(start);
+                file->seek(start);
             }
+            if (hash)
+                hash->reset();
+            received = 0;
+        } else {
+            received += resp.bytesReceived;
+        }
 
-            //qCDebug(npackd) << callNumber << r << dwStatus << url.toString();
-
-            if (job->shouldProceed()) {
-                if (r == ERROR_SUCCESS) {
-                    if (sendRequestError) {
-                        QString errMsg;
-                        WPMUtils::formatMessage(sendRequestError, &errMsg);
-                        job->setErrorMessage(errMsg);
-                    } else {
-                        job->setErrorMessage(QString(
-                                QObject::tr("HTTP status code %1")).arg(dwStatus));
-                    }
-                } else if (r == ERROR_INTERNET_FORCE_RETRY) {
-                    // nothing
-                } else if (r == ERROR_CANCELLED) {
-                    job->setErrorMessage(QObject::tr("Cancelled by the user"));
-                } else if (r == ERROR_INVALID_HANDLE) {
-                    job->setErrorMessage(QObject::tr("Invalid handle"));
-                } else {
-                    job->setErrorMessage(QString(
-                            QObject::tr("Unknown error %1 from InternetErrorDlg in attempt %2")).arg(r).arg(callNumber + 1));
-                }
-            }
+        qCDebug(npackd) << "Downloader::downloadResumable" << request.url <<
+                "attempt" << attempt + 1 << "failed after" << received <<
+                "bytes:" << err;
+    }
 
-            loginDialogMutex.unlock();
+    response->bytesReceived = received;
 
-            if (!job->shouldProceed())
-                break;
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
 
-            // read all the data before re-sending the request
-            char smallBuffer[4 * 1024];
-            while (true) {
-                DWORD read;
-                if (!InternetReadFile(hResourceHandle, &smallBuffer,
-                        sizeof(smallBuffer), &read)) {
-                    QString errMsg;
-                    WPMUtils::formatMessage(GetLastError(), &errMsg);
-                    job->setErrorMessage(errMsg);
-                    goto out;
-                }
+    if (hash == &ownHash && job->shouldProceed())
+        response->hashSum = ownHash.result().toHex().toLower();
 
-                // qCDebug(npackd) << "read some bytes " << read;
-                if (read == 0)
-                    break;
-            }
+    if (job->shouldProceed())
+        job->setProgress(1);
 
-            callNumber++;
-        }; // while (job->shouldProceed())
+    job->complete();
+}
 
-    out:
-        if (job->shouldProceed()) {
-            DWORD dwStatus, dwStatusSize = sizeof(dwStatus);
-
-            // http://msdn.microsoft.com/en-us/library/aa384220(v=vs.85).aspx
-            if (!HttpQueryInfo(hResourceHandle, HTTP_QUERY_FLAG_NUMBER |
-                    HTTP_QUERY_STATUS_CODE, &dwStatus, &dwStatusSize, nullptr)) {
-                QString errMsg;
-                WPMUtils::formatMessage(GetLastError(), &errMsg);
-                job->setErrorMessage(errMsg);
-            } else {
-                // 2XX
-                if (dwStatus / 100 != 2) {
-                    job->setErrorMessage(QString(
-                            QObject::tr("HTTP status code %1")).arg(dwStatus));
-                }
-            }
+/**
+ * @brief updates a hash sum with a part of a file
+ * @param file file opened for reading. The current position is changed.
+ * @param from first byte
+ * @param length number of bytes
+ * @param hash this hash sum will be updated
+ * @return error message or ""
+ */
+static QString hashFileRange(QFile* file, int64_t from, int64_t length,
+        QCryptographicHash* hash)
+{
+    QString err;
+    if (!file->seek(from))
+        err = file->errorString();
+
+    QByteArray buffer(HashingWriter::BUFFER_SIZE, Qt::Uninitialized);
+    while (err.isEmpty() && length > 0) {
+        qint64 c = file->read(buffer.data(),
+                qMin(length, static_cast<int64_t>(buffer.size())));
+        if (c < 0)
+            err = file->errorString();
+        else if (c == 0)
+            err = QObject::tr("Unexpected end of file %1").
+                    arg(file->fileName());
+        else {
+            hash->addData(buffer.constData(), static_cast<int>(c));
+            length -= c;
         }
+    }
 
-        if (job->shouldProceed()) {
-            job->setProgress(0.03);
-            job->setTitle(initialTitle + " / " + QObject::tr("Downloading"));
-        }
+    return err;
+}
 
-        // MIME type
-        if (job->shouldProceed()) {
-            if (mime) {
-                WCHAR mimeBuffer[1024];
-                DWORD bufferLength = sizeof(mimeBuffer);
-                DWORD index = 0;
-                if (!HttpQueryInfoW(hResourceHandle, HTTP_QUERY_CONTENT_TYPE,
-                        &mimeBuffer, &bufferLength, &index)) {
-                    *mime = "application/octet-stream";
-                } else {
-                    *mime = QString::fromWCharArray(
-                            mimeBuffer, bufferLength / 2);
-                }
-            }
-        }
+void Downloader::downloadSegmented(Job* job, const Request& request,
+        Downloader::Response* response)
+{
+    QFile* file = request.file;
+    int64_t start = file->pos();
+
+    // does the server support ranges? Small files are not split and the
+    // additional round trip is only necessary for large ones.
+    Downloader::Response probe;
+    int n = 1;
+    if (request.rangeStart == 0 && request.rangeEnd < 0 &&
+            request.expectedLength >= 2 * MIN_SEGMENT_SIZE &&
+            job->shouldProceed()) {
+        Downloader::Request r2(request);
+        r2.httpMethod = "HEAD";
+        r2.file = nullptr;
+        r2.hashSum = false;
+        r2.ignoreContent = true;
+
+        Job* sub = job->newSubJob(0.02,
+                QObject::tr("Checking for partial downloads support"));
+        downloadHTTP(sub, r2, &probe);
+
+        if (probe.acceptRanges && probe.statusCode / 100 == 2)
+            n = static_cast<int>(qMin(
+                    static_cast<int64_t>(request.segments),
+                    probe.contentLength / MIN_SEGMENT_SIZE));
+    }
 
-        bool gzip = false;
+    // download() holds one slot for the first segment. The other
+    // connections are only opened if the scheduler allows them.
+    TransferScheduler* scheduler = TransferScheduler::getDefault();
+    int slots = 0;
+    while (slots < n - 1 && scheduler->tryAcquire(request.priority))
+        slots++;
+    n = slots + 1;
 
-        // Content-Encoding
+    if (n <= 1) {
         if (job->shouldProceed()) {
-            WCHAR contentEncodingBuffer[1024];
-            DWORD bufferLength = sizeof(contentEncodingBuffer);
-            DWORD index = 0;
-            if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_CONTENT_ENCODING,
-                    &contentEncodingBuffer, &bufferLength, &index)) {
-                QString contentEncoding = QString::fromWCharArray(
-                        contentEncodingBuffer, bufferLength / 2);
-                gzip = contentEncoding == "gzip" || contentEncoding == "deflate";
-            }
-
-            job->setProgress(0.04);
+            Job* sub = job->newSubJob(1 - job->getProgress(), "");
+            downloadResumable(sub, request, response, nullptr);
+            if (!sub->getErrorMessage().isEmpty())
+                job->setErrorMessage(sub->getErrorMessage());
         }
+    } else {
+        int64_t length = probe.contentLength;
+        qCDebug(npackd) << "Downloader::downloadSegmented" << request.url <<
+                n << "segments" << length << "bytes";
+
+        // the segments are written at their positions
+        if (!file->resize(start + length))
+            job->setErrorMessage(file->errorString());
+
+        QCryptographicHash hash(request.alg);
+        int64_t segmentSize = (length + n - 1) / n;
+        QVector<Downloader::Response> responses(n);
+        QList<Downloader::Request> requests;
+        QList<QFile*> files;
+        QList<Job*> subs;
+        for (int i = 0; i < n; i++) {
+            if (!job->shouldProceed())
+                break;
 
-        // Content-Disposition
-        if (job->shouldProceed()) {
-            if (contentDisposition) {
-                WCHAR cdBuffer[1024];
-                wcscpy(cdBuffer, L"Content-Disposition");
-                DWORD bufferLength = sizeof(cdBuffer);
-                DWORD index = 0;
-                if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_CUSTOM,
-                        &cdBuffer, &bufferLength, &index)) {
-                    *contentDisposition = QString::fromWCharArray(
-                            cdBuffer, bufferLength / 2);
+            Downloader::Request r2(request);
+            r2.segments = 1;
+            r2.rangeStart = i * segmentSize;
+            r2.rangeEnd = qMin(length, (i + 1) * segmentSize) - 1;
+
+            // the first segment uses request.file, the others open the same
+            // file again
+            QFile* f = file;
+            if (i > 0) {
+                f = new QFile(file->fileName());
+                files.append(f);
+                if (!f->open(QFile::ReadWrite) ||
+                        !f->seek(start + r2.rangeStart)) {
+                    job->setErrorMessage(QString(
+                            QObject::tr("Error opening file: %1")).
+                            arg(f->fileName()));
+                    break;
                 }
             }
+            r2.file = f;
+            requests.append(r2);
+
+            subs.append(job->newSubJob(0, QString(
+                    QObject::tr("Segment %1 of %2")).arg(i + 1).arg(n),
+                    false, false));
         }
 
-        // content length
-        if (job->shouldProceed()) {
-            WCHAR contentLengthBuffer[100];
-            DWORD bufferLength = sizeof(contentLengthBuffer);
-            DWORD index = 0;
-            if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_CONTENT_LENGTH,
-                    contentLengthBuffer, &bufferLength, &index)) {
-                QString s = QString::fromWCharArray(
-                        contentLengthBuffer, bufferLength / 2);
-                bool ok;
-                contentLength = s.toLongLong(&ok, 10);
-                if (!ok)
-                    contentLength = 0;
+        // the segments run in parallel and update the progress together.
+        // The top-level job reports the changes of all sub-jobs.
+        QMutex progressMutex;
+        double initialProgress = job->getProgress();
+        QMetaObject::Connection connection = QObject::connect(
+                job->getTopJob(), &Job::changed, [&](Job* s) {
+            if (subs.contains(s)) {
+                QMutexLocker ml(&progressMutex);
+                double progress = 0;
+                for (int j = 0; j < subs.size(); j++)
+                    progress += subs.at(j)->getProgress();
+                job->setProgress(initialProgress +
+                        (1 - initialProgress) * progress / n);
             }
-
-            job->setProgress(0.05);
+        });
+
+        QList<QFuture<void> > futures;
+        for (int i = 0; i < requests.size(); i++) {
+            futures.append(QtConcurrent::run(getSegmentsThreadPool(),
+                    Downloader::downloadResumable, subs.at(i),
+                    requests.at(i), &responses[i],
+                    (i == 0 && request.hashSum) ? &hash : nullptr));
         }
 
-        if (job->shouldProceed()) {
-            if (!request.ignoreContent) {
-                Job* sub = job->newSubJob(0.95, QObject::tr("Reading the data"));
-                readData(sub, hResourceHandle, file, sha1, gzip, contentLength, alg);
-                if (!sub->getErrorMessage().isEmpty())
-                    job->setErrorMessage(sub->getErrorMessage());
-            } else {
-                job->setProgress(job->getProgress() + 0.95);
+        // the hash sum covers the segments in order. A segment is read
+        // back while the following ones are still being downloaded.
+        for (int i = 0; i < futures.size(); i++) {
+            futures[i].waitForFinished();
+
+            Job* s = subs.at(i);
+            if (!s->getErrorMessage().isEmpty())
+                job->setErrorMessage(s->getTitle() + ": " +
+                        s->getErrorMessage());
+
+            if (i > 0) {
+                files.at(i - 1)->close();
+                if (request.hashSum && job->shouldProceed()) {
+                    int64_t from = i * segmentSize;
+                    QString err = hashFileRange(file, start + from,
+                            qMin(length, from + segmentSize) - from, &hash);
+                    if (!err.isEmpty())
+                        job->setErrorMessage(err);
+                }
             }
         }
 
-        InternetCloseHandle(hResourceHandle);
+        QObject::disconnect(connection);
+        qDeleteAll(files);
+
+        if (job->shouldProceed())
+            file->seek(start + length);
+
+        response->mimeType = responses[0].mimeType;
+        response->contentDisposition = responses[0].contentDisposition;
+        response->etag = probe.etag;
+        response->lastModified = probe.lastModified;
+        response->statusCode = probe.statusCode;
+        response->contentLength = length;
+        response->acceptRanges = true;
+        response->bytesReceived = 0;
+        for (int i = 0; i < responses.size(); i++)
+            response->bytesReceived += responses.at(i).bytesReceived;
+
+        if (request.hashSum && job->shouldProceed())
+            response->hashSum = hash.result().toHex().toLower();
     }
 
-    if (hConnectHandle)
-        InternetCloseHandle(hConnectHandle);
-    if (internet)
-        InternetCloseHandle(internet);
+    for (int i = 0; i < slots; i++)
+        scheduler->release(request.priority);
 
     if (job->shouldProceed())
         job->setProgress(1);
 
-    job->setTitle(initialTitle);
-
     job->complete();
-
-    qCDebug(npackd) << request.url << job->getErrorMessage() << contentLength;
-
-    return contentLength;
 }
 
-QString Downloader::setStringOption(HINTERNET hInternet, DWORD dwOption,
-        const QString& value)
+void Downloader::downloadMirrored(Job* job, const Request& request,
+        Downloader::Response* response)
 {
-    QString result;
-    if (!InternetSetOptionW(hInternet,
-            dwOption, WPMUtils::toLPWSTR(value),
-            static_cast<DWORD>(value.length() + 1))) {
-        WPMUtils::formatMessage(GetLastError(), &result);
+    QList<QUrl> urls;
+    urls.append(request.url);
+    for (int i = 0; i < request.mirrors.size(); i++) {
+        if (!urls.contains(request.mirrors.at(i)))
+            urls.append(request.mirrors.at(i));
     }
-    return result;
-}
-
-QString Downloader::setPassword(HINTERNET hConnectHandle,
-        DWORD dwStatus, const Request& request)
-{
-    QString result;
 
-    if (dwStatus == HTTP_STATUS_PROXY_AUTH_REQ) {
-        if (request.proxyUser.isEmpty()) {
-            result = QString(QObject::tr("Cannot handle HTTP status code %1")).
-                    arg(dwStatus);
+    QFile* file = request.file;
+    int64_t start = file->pos();
+
+    // the hash sum is updated with the data in the order it is stored
+    QCryptographicHash ownHash(request.alg);
+    QCryptographicHash* hash = request.hashSum ? &ownHash : nullptr;
+
+    // request the first bytes from all servers. Servers without support for
+    // ranges fail here.
+    int n = urls.size();
+    QVector<Downloader::Response> responses(n);
+    QList<QTemporaryFile*> files;
+    QList<Job*> subs;
+    QList<QFuture<int64_t> > futures;
+    for (int i = 0; i < n; i++) {
+        QTemporaryFile* tf = new QTemporaryFile();
+        files.append(tf);
+        if (!tf->open()) {
+            job->setErrorMessage(QString(
+                    QObject::tr("Error opening file: %1")).
+                    arg(tf->fileName()));
+            break;
         }
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                    INTERNET_OPTION_PROXY_USERNAME, request.proxyUser);
-        }
+        Downloader::Request r2(request);
+        r2.url = urls.at(i);
+        r2.mirrors.clear();
+        r2.file = tf;
+        r2.hashSum = false;
+        r2.resumeAttempts = 0;
+        r2.segments = 1;
+        r2.rangeStart = 0;
+        r2.rangeEnd = MIRROR_RACE_SIZE - 1;
+
+        Job* s = job->newSubJob(0.05 / n, urls.at(i).host(), false, false);
+        subs.append(s);
+        futures.append(QtConcurrent::run(getSegmentsThreadPool(),
+                Downloader::downloadHTTP, s, r2, &responses[i],
+                static_cast<QCryptographicHash*>(nullptr)));
+    }
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_PROXY_PASSWORD, request.proxyPassword);
-        }
-    } else if (dwStatus == HTTP_STATUS_DENIED) {
-        if (request.user.isEmpty()) {
-            result = QString(QObject::tr("Cannot handle HTTP status code %1")).
-                    arg(dwStatus);
+    // the other servers are ordered by the time they needed
+    QList<int> order;
+    while (true) {
+        bool finished = true;
+        for (int i = 0; i < futures.size(); i++) {
+            if (!futures.at(i).isFinished()) {
+                finished = false;
+            } else if (!order.contains(i) &&
+                    subs.at(i)->getErrorMessage().isEmpty() &&
+                    !subs.at(i)->isCancelled()) {
+                order.append(i);
+                if (order.size() == 1) {
+                    qCDebug(npackd) << "Downloader::downloadMirrored" <<
+                            "fastest server" << urls.at(i);
+                    for (int j = 0; j < subs.size(); j++) {
+                        if (j != i)
+                            subs.at(j)->cancel();
+                    }
+                }
+            }
         }
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_USERNAME, request.user);
-        }
+        if (finished)
+            break;
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_PASSWORD, request.password);
+        if (job->isCancelled()) {
+            for (int j = 0; j < subs.size(); j++)
+                subs.at(j)->cancel();
         }
-    } else {
-        result = QString(QObject::tr("Cannot handle HTTP status code %1")).
-                arg(dwStatus);
+        QThread::msleep(50);
     }
 
-    return result;
-}
+    if (job->shouldProceed())
+        job->setProgress(0.05);
 
-QString Downloader::inputPassword(HINTERNET hConnectHandle,
-        DWORD dwStatus)
-{
-    QString result;
-
-    QString username, password;
-    if (dwStatus == HTTP_STATUS_PROXY_AUTH_REQ) {
-        WPMUtils::writeln("\r\n" +
-                QObject::tr("The HTTP proxy requires authentication."));
-        WPMUtils::outputTextConsole(QObject::tr("Username") + ": ");
-        username = WPMUtils::inputTextConsole();
-        WPMUtils::outputTextConsole(QObject::tr("Password") + ": ");
-        password = WPMUtils::inputPasswordConsole();
-
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_PROXY_USERNAME, username);
-        }
+    // the cancelled servers can still be used if the winner fails
+    for (int i = 0; i < subs.size(); i++) {
+        if (!order.contains(i) && subs.at(i)->isCancelled())
+            order.append(i);
+    }
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_PROXY_PASSWORD, password);
-        }
-    } else if (dwStatus == HTTP_STATUS_DENIED) {
-        WPMUtils::writeln("\r\n" +
-                QObject::tr("The HTTP server requires authentication.")
-                );
-        WPMUtils::outputTextConsole(QObject::tr("Username") + ": ");
-        username = WPMUtils::inputTextConsole();
-        WPMUtils::outputTextConsole(QObject::tr("Password") + ": ");
-        password = WPMUtils::inputPasswordConsole();
-
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_USERNAME, username);
-        }
+    int64_t received = 0;
+    bool complete = false;
+    if (!order.isEmpty() && job->shouldProceed()) {
+        int w = order.at(0);
+        QTemporaryFile* tf = files.at(w);
+        tf->seek(0);
+        Job* sub = job->newSubJob(0.01, QObject::tr("Copying the data"));
+        received = readDataFlat(sub, tf, file, hash, tf->size());
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+
+        const Downloader::Response& first = responses.at(w);
+        response->mimeType = first.mimeType;
+        response->contentDisposition = first.contentDisposition;
+        response->etag = first.etag;
+        response->lastModified = first.lastModified;
+        response->acceptRanges = true;
+        response->statusCode = 200;
+
+        complete = received < MIRROR_RACE_SIZE;
+    }
+    qDeleteAll(files);
+    files.clear();
+
+    // continue from the fastest server and switch to the next one if the
+    // transfer fails. The hash sum only contains the stored data and is
+    // continued at the same position.
+    QString err;
+    for (int i = 0; i < order.size() && !complete; i++) {
+        if (!job->shouldProceed())
+            break;
 
-        if (result.isEmpty()) {
-            result = setStringOption(hConnectHandle,
-                INTERNET_OPTION_PASSWORD, password);
+        Downloader::Request r2(request);
+        r2.url = urls.at(order.at(i));
+        r2.mirrors.clear();
+        r2.hashSum = false;
+        r2.rangeStart = received;
+
+        Job* sub = job->newSubJob((1 - job->getProgress()) /
+                (order.size() - i), i == 0 ? "" : QString(
+                QObject::tr("Continuing at byte %L1 from %2")).
+                arg(received).arg(r2.url.host()), true, false);
+        Downloader::Response resp;
+        downloadResumable(sub, r2, &resp, hash);
+        received = file->pos() - start;
+
+        err = sub->getErrorMessage();
+        if ((err.isEmpty() && !sub->isCancelled()) ||
+                resp.statusCode == 416) {
+            // 416: the file ends exactly at the requested position
+            complete = true;
+            err.clear();
+        } else {
+            qCDebug(npackd) << "Downloader::downloadMirrored" << r2.url <<
+                    "failed after" << received << "bytes:" << err;
         }
-    } else {
-        result = QString(QObject::tr("Cannot handle HTTP status code %1")).
-                arg(dwStatus);
     }
 
-    return result;
-}
+    // no server supports ranges: try them one after another
+    if (order.isEmpty() && job->shouldProceed()) {
+        for (int i = 0; i < n; i++) {
+            if (job->isCancelled())
+                break;
 
-bool Downloader::internetReadFileFully(HINTERNET resourceHandle,
-        PVOID buffer, DWORD bufferSize, PDWORD bufferLength)
-{
-    DWORD alreadyRead = 0;
-    bool result;
-    while (true) {
-        DWORD len;
-        result = InternetReadFile(resourceHandle,
-                static_cast<uint8_t*>(buffer) + alreadyRead,
-                bufferSize - alreadyRead, &len);
+            file->resize(start);
+            file->seek(start);
+            if (hash)
+                hash->reset();
 
-        if (!result) {
-            *bufferLength = alreadyRead;
-            break;
-        } else {
-            alreadyRead += len;
+            Downloader::Request r2(request);
+            r2.url = urls.at(i);
+            r2.mirrors.clear();
+            r2.hashSum = false;
 
-            if (alreadyRead == bufferSize || len == 0) {
-                *bufferLength = alreadyRead;
+            Job* sub = job->newSubJob((1 - job->getProgress()) / (n - i),
+                    r2.url.host(), true, false);
+            downloadResumable(sub, r2, response, hash);
+            received = file->pos() - start;
+
+            err = sub->getErrorMessage();
+            if (err.isEmpty() && !sub->isCancelled()) {
+                complete = true;
                 break;
             }
         }
     }
-    return result;
+
+    if (job->shouldProceed() && !complete) {
+        if (err.isEmpty() && !subs.isEmpty())
+            err = subs.at(0)->getErrorMessage();
+        if (err.isEmpty())
+            err = QObject::tr("The download failed for all mirrors");
+        job->setErrorMessage(err);
+    }
+
+    response->contentLength = received;
+    response->bytesReceived = received;
+
+    if (hash && job->shouldProceed())
+        response->hashSum = hash->result().toHex().toLower();
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
 }
 
-void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
-        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg)
+qint64 Downloader::readFully(QIODevice* device, char* buffer,
+        qint64 bufferSize)
 {
-    QString initialTitle = job->getTitle();
+    qint64 alreadyRead = 0;
+    while (alreadyRead < bufferSize) {
+        qint64 len = device->read(buffer + alreadyRead,
+                bufferSize - alreadyRead);
+        if (len < 0)
+            return -1;
+        if (len == 0)
+            break;
+        alreadyRead += len;
+    }
+    return alreadyRead;
+}
+
+int64_t Downloader::readDataGZip(Job* job, QIODevice* device,
+        QFile* file, QCryptographicHash* hash, int64_t contentLength)
+{
+    JobProgressReporter progress(job);
 
-    // download/compute SHA1 loop
-    QCryptographicHash hash(alg);
+    // download/compute SHA1 loop. The decompressed data of a large
+    // transfer is written in a background thread.
     const int bufferSize = 512 * 1024;
     unsigned char* buffer = new unsigned char[bufferSize];
-    const int buffer2Size = 512 * 1024;
-    unsigned char* buffer2 = new unsigned char[buffer2Size];
+    HashingWriter writer(file, hash, contentLength);
 
     bool zlibStreamInitialized = false;
     z_stream d_stream;
 
     int err = 0;
     int64_t alreadyRead = 0;
-    DWORD bufferLength;
+    qint64 bufferLength;
     do {
-        if (!internetReadFileFully(hResourceHandle, buffer,
-                bufferSize, &bufferLength)) {
-            QString errMsg;
-            WPMUtils::formatMessage(GetLastError(), &errMsg);
-            job->setErrorMessage(errMsg);
+        bufferLength = readFully(device, reinterpret_cast<char*>(buffer),
+                bufferSize);
+        if (bufferLength < 0) {
+            job->setErrorMessage(device->errorString());
             break;
         }
 
@@ -685,9 +763,7 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
             d_stream.opaque = nullptr;
 
             d_stream.next_in = buffer + cur;
-            d_stream.avail_in = bufferLength - cur;
-            d_stream.avail_out = buffer2Size;
-            d_stream.next_out = buffer2;
+            d_stream.avail_in = static_cast<uInt>(bufferLength) - cur;
             zlibStreamInitialized = true;
 
             // 15 = maximum buffer size, 32 = zlib and gzip formats are parsed
@@ -699,13 +775,19 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
             }
         } else {
             d_stream.next_in = buffer;
-            d_stream.avail_in = bufferLength;
+            d_stream.avail_in = static_cast<uInt>(bufferLength);
         }
 
         // see http://zlib.net/zpipe.c
         do {
-            d_stream.avail_out = buffer2Size;
-            d_stream.next_out = buffer2;
+            char* buffer2 = writer.nextBuffer();
+            if (!buffer2) {
+                job->setErrorMessage(writer.finish());
+                break;
+            }
+
+            d_stream.avail_out = HashingWriter::BUFFER_SIZE;
+            d_stream.next_out = reinterpret_cast<unsigned char*>(buffer2);
 
             int err = inflate(&d_stream, Z_NO_FLUSH);
             if (err == Z_NEED_DICT) {
@@ -720,12 +802,10 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
                 inflateEnd(&d_stream);
                 break;
             } else {
-                if (sha1)
-                    hash.addData(reinterpret_cast<char*>(buffer2),
-                            buffer2Size - static_cast<int>(d_stream.avail_out));
-
-                file->write(reinterpret_cast<char*>(buffer2),
-                        buffer2Size - static_cast<int>(d_stream.avail_out));
+                int len = HashingWriter::BUFFER_SIZE -
+                        static_cast<int>(d_stream.avail_out);
+                if (len > 0)
+                    writer.commit(len);
             }
         } while (d_stream.avail_out == 0);
 
@@ -733,18 +813,7 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
             break;
 
         alreadyRead += bufferLength;
-        if (contentLength > 0) {
-            job->setProgress((static_cast<double>(alreadyRead)) / contentLength);
-            job->setTitle(initialTitle + " / " +
-                    QString(QObject::tr("%L0 of %L1 bytes")).
-                    arg(alreadyRead).
-                    arg(contentLength));
-        } else {
-            job->setProgress(0.5);
-            job->setTitle(initialTitle + " / " +
-                    QString(QObject::tr("%L0 bytes")).
-                    arg(alreadyRead));
-        }
+        progress.reportBytes(alreadyRead, contentLength);
     } while (bufferLength != 0 && !job->isCancelled());
 
     err = inflateEnd(&d_stream);
@@ -753,96 +822,76 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
                 arg(err));
     }
 
-    if (sha1 && job->shouldProceed())
-        *sha1 = hash.result().toHex().toLower();
-
 // out:
     delete[] buffer;
-    delete[] buffer2;
+
+    QString werr = writer.finish();
+    if (!werr.isEmpty())
+        job->setErrorMessage(werr);
 
     if (job->shouldProceed())
         job->setProgress(1);
 
     job->complete();
+
+    return writer.getBytesWritten();
 }
 
-void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
-        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg)
+int64_t Downloader::readDataFlat(Job* job, QIODevice* device,
+        QFile* file, QCryptographicHash* hash, int64_t contentLength)
 {
     qCDebug(npackd) << "Downloader::readDataFlat";
 
-    QString initialTitle = job->getTitle();
+    JobProgressReporter progress(job);
 
-    // download/compute SHA1 loop
-    QCryptographicHash hash(alg);
-    const int bufferSize = 512 * 1024;
-    unsigned char* buffer = new unsigned char[bufferSize];
+    // download loop. The data of a large transfer is written in a
+    // background thread.
+    HashingWriter writer(file, hash, contentLength);
 
     int64_t alreadyRead = 0;
-    DWORD bufferLength;
-    do {
-        if (!InternetReadFile(hResourceHandle, buffer,
-                bufferSize, &bufferLength)) {
-            QString errMsg;
-            WPMUtils::formatMessage(GetLastError(), &errMsg);
-            job->setErrorMessage(errMsg);
+    while (!job->isCancelled()) {
+        char* buffer = writer.nextBuffer();
+        if (!buffer)
             break;
-        }
 
-        qCDebug(npackd) <<
-                "Downloader::readDataFlat InternetReadFile bufferLength=" <<
-                bufferLength;
+        qint64 bufferLength = device->read(buffer, HashingWriter::BUFFER_SIZE);
+        if (bufferLength < 0) {
+            job->setErrorMessage(device->errorString());
+            break;
+        }
 
         if (bufferLength == 0)
             break;
 
-        // update SHA1 if necessary
-        if (sha1)
-            hash.addData(reinterpret_cast<char*>(buffer),
-                    static_cast<int>(bufferLength));
-
-        if (file) {
-            if (file->write(reinterpret_cast<char*>(buffer), bufferLength) < 0) {
-                job->setErrorMessage(file->errorString());
-                break;
-            }
-        }
+        writer.commit(static_cast<int>(bufferLength));
 
         alreadyRead += bufferLength;
-        if (contentLength > 0) {
-            job->setProgress((static_cast<double>(alreadyRead)) /
-                    contentLength);
-            job->setTitle(initialTitle + " / " +
-                    QString(QObject::tr("%L0 of %L1 bytes")).
-                    arg(alreadyRead).
-                    arg(contentLength));
-        } else {
-            job->setProgress(0.5);
-            job->setTitle(initialTitle + " / " +
-                    QString(QObject::tr("%L0 bytes")).
-                    arg(alreadyRead));
-        }
-    } while (bufferLength != 0 && !job->isCancelled());
+        progress.reportBytes(alreadyRead, contentLength);
+    }
+
+    // the hash sum is only updated with the written data, so that an
+    // interrupted download can be continued
+    QString err = writer.finish();
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
 
     if (job->shouldProceed())
         job->setProgress(1);
 
-    if (sha1 && job->shouldProceed())
-        *sha1 = hash.result().toHex().toLower();
-
-    delete[] buffer;
-
     job->complete();
+
+    return writer.getBytesWritten();
 }
 
-void Downloader::readData(Job* job, HINTERNET hResourceHandle, QFile* file,
-        QString* sha1, bool gzip, int64_t contentLength,
-        QCryptographicHash::Algorithm alg)
+int64_t Downloader::readData(Job* job, QIODevice* device, QFile* file,
+        QCryptographicHash* hash, bool gzip, int64_t contentLength)
 {
+    int64_t r;
     if (gzip && file)
-        readDataGZip(job, hResourceHandle, file, sha1, contentLength, alg);
+        r = readDataGZip(job, device, file, hash, contentLength);
     else
-        readDataFlat(job, hResourceHandle, file, sha1, contentLength, alg);
+        r = readDataFlat(job, device, file, hash, contentLength);
+    return r;
 }
 
 void Downloader::copyFile(Job* job, const QString& source, QFile* file,
@@ -851,35 +900,17 @@ void Downloader::copyFile(Job* job, const QString& source, QFile* file,
     if (!srcFile.open(QFile::ReadOnly)) {
         job->setErrorMessage(QObject::tr("Error opening file: %1").
                 arg(source));
+        job->complete();
     } else {
-        qint64 srcSize = srcFile.size();
-        const int SZ = 8192;
-        char* data = new char[SZ];
-
-        qint64 progress = 0;
         QCryptographicHash crypto(alg);
-        while(true) {
-            qint64 c = srcFile.read(data, SZ);
-            if (c <= 0)
-                break;
-
-            if (sha1)
-                crypto.addData(data, static_cast<int>(c));
-            if (file)
-                file->write(data, c);
-
-            progress += c;
-            if (srcSize != 0)
-                job->setProgress((static_cast<double>(progress)) / srcSize);
-        }
+        readDataFlat(job, &srcFile, file, sha1 ? &crypto : nullptr,
+                srcFile.size());
 
-        if (sha1)
+        if (sha1 && job->shouldProceed())
             *sha1 = crypto.result().toHex().toLower();
 
         srcFile.close();
-        delete[] data;
     }
-    job->complete();
 }
 
 Downloader::Response Downloader::download(Job *job,
@@ -888,9 +919,26 @@ Downloader::Response Downloader::download(Job *job,
     Downloader::Response r;
 
     QString* sha1 = request.hashSum ? &r.hashSum : nullptr;
-    if (request.url.scheme() == "https" || request.url.scheme() == "http")
-        downloadWin(job, request, &r);
-    else if (request.url.toString().startsWith("data:image/png;base64,")) {
+    if (request.url.scheme() == "https" || request.url.scheme() == "http") {
+        // all segments and attempts count as one transfer
+        TransferScheduler* scheduler = TransferScheduler::getDefault();
+        if (scheduler->acquire(job, request.priority)) {
+            bool get = request.httpMethod == "GET" &&
+                    request.postData.isEmpty();
+            if (get && !request.mirrors.isEmpty() && request.file &&
+                    !request.isPartial())
+                downloadMirrored(job, request, &r);
+            else if (get && request.segments > 1 && request.file)
+                downloadSegmented(job, request, &r);
+            else if (get && request.resumeAttempts > 0)
+                downloadResumable(job, request, &r, nullptr);
+            else
+                downloadHTTP(job, request, &r);
+            scheduler->release(request.priority);
+        } else {
+            job->complete();
+        }
+    } else if (request.url.toString().startsWith("data:image/png;base64,")) {
         if (request.file) {
             QString dataURL_ = request.url.toString().mid(22);
             QByteArray ba = QByteArray::fromBase64(dataURL_.toLatin1());
@@ -921,7 +969,8 @@ Downloader::Response Downloader::download(Job *job,
 }
 
 int64_t Downloader::getContentLength(Job* job, const QUrl &url,
-        HWND parentWindow)
+        bool keepConnection,
+        TransferScheduler::Priority priority)
 {
     int64_t result = -1;
     if (url.scheme() == "file") {
@@ -935,32 +984,38 @@ int64_t Downloader::getContentLength(Job* job, const QUrl &url,
         }
         job->complete();
     } else {
-        Request req(url);
-        req.httpMethod = "HEAD";
-        req.parentWindow = parentWindow;
-        req.useCache = true;
-        req.keepConnection = false;
-        req.timeout = 15;
-
-        Job* sub = job->newSubJob(1, QObject::tr("Using the HEAD HTTP method"));
-        Response resp;
-        result = downloadWin(sub, req, &resp);
-
-        if (!sub->getErrorMessage().isEmpty()) {
-            Request req2(url);
-            req2.parentWindow = parentWindow;
-            req2.useCache = true;
-            req2.keepConnection = false;
-            req2.timeout = 15;
-            req2.ignoreContent = true;
-
-            Response resp2;
-            Job* sub2 = job->newSubJob(1 - job->getProgress(),
-                    QObject::tr("Using the GET HTTP method"));
-            result = downloadWin(sub2, req2, &resp2);
-            if (!sub2->getErrorMessage().isEmpty())
-                job->setErrorMessage(sub2->getErrorMessage());
+        TransferScheduler* scheduler = TransferScheduler::getDefault();
+        if (scheduler->acquire(job, priority)) {
+            Request req(url);
+            req.httpMethod = "HEAD";
+            req.useCache = true;
+            req.keepConnection = keepConnection;
+            req.timeout = 15;
+            req.priority = priority;
+
+            Job* sub = job->newSubJob(1, QObject::tr("Using the HEAD HTTP method"));
+            Response resp;
+            result = downloadHTTP(sub, req, &resp);
+
+            if (!sub->getErrorMessage().isEmpty()) {
+                Request req2(url);
+                req2.useCache = true;
+                req2.keepConnection = keepConnection;
+                req2.timeout = 15;
+                req2.priority = priority;
+                req2.ignoreContent = true;
+
+                Response resp2;
+                Job* sub2 = job->newSubJob(1 - job->getProgress(),
+                        QObject::tr("Using the GET HTTP method"));
+                result = downloadHTTP(sub2, req2, &resp2);
+                if (!sub2->getErrorMessage().isEmpty())
+                    job->setErrorMessage(sub2->getErrorMessage());
+            }
+
+            scheduler->release(priority);
         }
+        job->complete();
     }
 
     return result;
@@ -968,13 +1023,20 @@ int64_t Downloader::getContentLength(Job* job, const QUrl &url,
 
 QTemporaryFile* Downloader::downloadToTemporary(Job* job,
         const Downloader::Request &request)
+{
+    Downloader::Response response;
+    return downloadToTemporary2(job, request, &response);
+}
+
+QTemporaryFile* Downloader::downloadToTemporary2(Job* job,
+        const Downloader::Request &request, Downloader::Response* response)
 {
     QTemporaryFile* file = new QTemporaryFile();
     Downloader::Request r2(request);
     r2.file = file;
 
     if (file->open()) {
-        download(job, r2);
+        *response = download(job, r2);
         file->close();
 
         if (!job->shouldProceed()) {
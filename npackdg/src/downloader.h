@@ -1,8 +1,6 @@
 #ifndef DOWNLOADER_H
 #define DOWNLOADER_H
 
-#include <windows.h>
-#include <wininet.h>
 #include <stdint.h>
 
 #include <QTemporaryFile>
@@ -13,9 +11,9 @@
 #include <QCryptographicHash>
 
 #include "job.h"
+#include "transferscheduler.h"
 
-extern HWND defaultPasswordWindow;
-extern QMutex loginDialogMutex;
+class AbstractTransport;
 
 /**
  * Blocks execution and downloads a file over http.
@@ -27,36 +25,42 @@ class Downloader: public QObject
     /**
      * @brief readDataFlat
      * @param job
-     * @param hResourceHandle
+     * @param device the data will be read from here until the end
      * @param file 0 = ignore the read data
-     * @param sha1
+     * @param hash 0 or the hash sum that should be updated with the read data
      * @param contentLength
-     * @param alg
+     * @return number of processed bytes. This value is also valid if an
+     *     error occured.
      */
-    static void readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
-            QString* sha1, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+    static int64_t readDataFlat(Job* job, QIODevice* device,
+            QFile* file, QCryptographicHash* hash, int64_t contentLength);
 
-    static void readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
-            QString* sha1, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+    static int64_t readDataGZip(Job* job, QIODevice* device,
+            QFile* file, QCryptographicHash* hash, int64_t contentLength);
 
     /**
      * @brief readData
      * @param job
-     * @param hResourceHandle
+     * @param device the data will be read from here until the end
      * @param file 0 = ignore the read data
-     * @param sha1
+     * @param hash 0 or the hash sum that should be updated with the read data
      * @param gzip
      * @param contentLength
-     * @param alg
+     * @return number of bytes stored in the file
      */
-    static void readData(Job* job, HINTERNET hResourceHandle, QFile* file,
-            QString* sha1, bool gzip, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+    static int64_t readData(Job* job, QIODevice* device, QFile* file,
+            QCryptographicHash* hash, bool gzip, int64_t contentLength);
 
-    static bool internetReadFileFully(HINTERNET resourceHandle,
-            PVOID buffer, DWORD bufferSize, PDWORD bufferLength);
+    /**
+     * @brief reads from a device until the buffer is full or the end of the
+     *     data is reached
+     * @param device a device
+     * @param buffer output buffer
+     * @param bufferSize size of the buffer
+     * @return number of read bytes or -1 if an error occured
+     */
+    static qint64 readFully(QIODevice* device, char* buffer,
+            qint64 bufferSize);
 
     /**
      * Copies a file.
@@ -77,8 +81,6 @@ class Downloader: public QObject
     static void copyFile(Job *job, const QString &source, QFile *file,
             QString *sha1,
                          QCryptographicHash::Algorithm alg);
-
-    static QString inputPassword(HINTERNET hConnectHandle, DWORD dwStatus);
 public:
     /**
      * @brief a download request
@@ -96,9 +98,6 @@ public:
         /** true = ask the user for passwords */
         bool interactive;
 
-        /** parent window handle or 0 */
-        HWND parentWindow;
-
         /** http:/https:/file:/data:image/png;base64 URL*/
         QUrl url;
 
@@ -174,15 +173,112 @@ public:
          */
         bool ignoreContent;
 
+        /**
+         * @brief first byte that should be requested using the "Range" HTTP
+         *     header. This is only applicable to http: and https:.
+         */
+        int64_t rangeStart;
+
+        /**
+         * @brief last byte (inclusive) that should be requested using the
+         *     "Range" HTTP header or -1 for the end of the resource.
+         */
+        int64_t rangeEnd;
+
+        /**
+         * @brief how many times an interrupted http:/https: transfer will be
+         *     continued from the last received byte. 0 = no resumption.
+         */
+        int resumeAttempts;
+
+        /**
+         * @brief maximum number of parallel connections used to download a
+         *     large http:/https: file. The file is only split if the server
+         *     advertises "Accept-Ranges: bytes". 1 = one connection.
+         */
+        int segments;
+
+        /**
+         * @brief size of the resource known from an earlier transfer or -1.
+         *     A segmented download only asks the server for the size and
+         *     "Accept-Ranges" if this value is large enough for at least 2
+         *     segments.
+         */
+        int64_t expectedLength;
+
+        /**
+         * @brief value for the "If-None-Match" HTTP header (ETag from a
+         *     previous response) or "". If this value or ifModifiedSince is
+         *     not empty, the HTTP status code 304 is not an error and no data
+         *     is stored in the file.
+         */
+        QString ifNoneMatch;
+
+        /**
+         * @brief value for the "If-Modified-Since" HTTP header
+         *     (Last-Modified from a previous response) or ""
+         */
+        QString ifModifiedSince;
+
+        /**
+         * @brief priority class for the TransferScheduler. This is only
+         *     applicable to http: and https:.
+         */
+        TransferScheduler::Priority priority;
+
+        /**
+         * @brief alternative URLs for the same file. This is only applicable
+         *     to GET requests for http: and https: URLs with a file. The
+         *     first bytes are requested from all URLs in parallel and the
+         *     download continues from the fastest server. Another server is
+         *     used if a transfer fails.
+         */
+        QList<QUrl> mirrors;
+
         /**
          * @param url http:/https:/file: URL
          */
         explicit Request(const QUrl& url): file(nullptr), interactive(true),
-                parentWindow(nullptr), url(url), hashSum(false),
+                url(url), hashSum(false),
                 alg(QCryptographicHash::Sha256), useCache(true),
                 useInternet(true),
                 keepConnection(true), httpMethod("GET"),
-                timeout(600), ignoreContent(false) {
+                timeout(600), ignoreContent(false), rangeStart(0),
+                rangeEnd(-1), resumeAttempts(0), segments(1),
+                expectedLength(-1),
+                priority(TransferScheduler::REPOSITORY) {
+        }
+
+        /**
+         * @return true if only a part of the resource was requested
+         */
+        bool isPartial() const {
+            return rangeStart > 0 || rangeEnd >= 0;
+        }
+
+        /**
+         * @return true if ifNoneMatch or ifModifiedSince is set
+         */
+        bool isConditional() const {
+            return !ifNoneMatch.isEmpty() || !ifModifiedSince.isEmpty();
+        }
+
+        /**
+         * @return true if the response may be compressed. Byte positions for
+         *     resumed or segmented downloads refer to the unencoded data.
+         */
+        bool canBeCompressed() const {
+            return !isPartial() && resumeAttempts == 0 && segments <= 1;
+        }
+
+        /**
+         * @return value for the "Range" HTTP header like "bytes=100-199"
+         */
+        QString getRange() const {
+            QString range = QString("bytes=%1-").arg(rangeStart);
+            if (rangeEnd >= 0)
+                range.append(QString::number(rangeEnd));
+            return range;
         }
     };
 
@@ -200,6 +296,28 @@ public:
 
         /** if not null, Content-Disposition will be stored here */
         QString contentDisposition;
+
+        /** HTTP status code or 0 if unknown */
+        int statusCode;
+
+        /** value of the Content-Length header or -1 if unknown */
+        int64_t contentLength;
+
+        /** true if the server advertised "Accept-Ranges: bytes" */
+        bool acceptRanges;
+
+        /** number of bytes stored in the file */
+        int64_t bytesReceived;
+
+        /** value of the ETag header or "" */
+        QString etag;
+
+        /** value of the Last-Modified header or "" */
+        QString lastModified;
+
+        Response(): statusCode(0), contentLength(-1), acceptRanges(false),
+                bytesReceived(0) {
+        }
     };
 
     /**
@@ -213,11 +331,15 @@ public:
      * @brief retrieves the content-length header for an URL.
      * @param job job object
      * @param url http:, https: or file:
-     * @param parentWindow window handle or 0 if not UI is required
+     * @param keepConnection true = keep the connection open so that it can be
+     *     re-used for the next request to the same host
+     * @param priority priority class for the TransferScheduler
      * @return the content-length header value or -1 if unknown
      */
     static int64_t getContentLength(Job *job, const QUrl &url,
-                                    HWND parentWindow);
+                                    bool keepConnection=false,
+                                    TransferScheduler::Priority priority=
+                                    TransferScheduler::REPOSITORY);
 
     /**
      * @brief HTTP download to a temporary file
@@ -227,29 +349,104 @@ public:
      */
     static QTemporaryFile *downloadToTemporary(Job *job,
             const Downloader::Request &request);
+
+    /**
+     * @brief HTTP download to a temporary file
+     * @param job job
+     * @param request HTTP request
+     * @param response the response will be stored here. For conditional
+     *     requests Response::statusCode is 304 if the resource has not
+     *     changed and the returned file is empty in this case.
+     * @return the created temporary file or 0 if an error occured
+     */
+    static QTemporaryFile *downloadToTemporary2(Job *job,
+            const Downloader::Request &request, Downloader::Response* response);
+
+    /**
+     * @brief changes the transport used for http: and https: URLs. This
+     *     should only be called while no downloads are running.
+     * @param t [ownership:caller] new transport or nullptr for the default
+     *     transport
+     */
+    static void setTransport(AbstractTransport* t);
+
+    /**
+     * @brief changes the transport used if none was set by setTransport().
+     *     The programs use WinINetTransport and call this once at the start.
+     * @param t [ownership:caller] new default transport
+     */
+    static void setDefaultTransport(AbstractTransport* t);
+
+    /**
+     * @return the transport used for http: and https: URLs or nullptr if
+     *     neither setTransport() nor setDefaultTransport() was called
+     */
+    static AbstractTransport* getTransport();
 private:
+    static AbstractTransport* transport;
+
+    static AbstractTransport* defaultTransport;
+
     /**
-     * It would be nice to handle redirects explicitely so
-     *    that the file name could be derived
-     *    from the last URL:
-     *    http://www.experts-exchange.com/Programming/System/Windows__Programming/MFC/Q_20096714.html
-     * Manual authentication:
-     *    http://msdn.microsoft.com/en-us/library/aa384220(v=vs.85).aspx
-     *
+     * @brief sends one request using the current transport and reads the
+     *     response data
      * @param job job object
      * @param request HTTP request
      * @param response HTTP response
+     * @param hash 0 or the hash sum that should be updated with the received
+     *     data. If 0 and request.hashSum is true, the hash sum will be
+     *     computed and stored in the response.
      * @return "content-length" or -1 if unknown
      */
-    static int64_t downloadWin(Job* job, const Downloader::Request& request,
-                               Response *response);
+    static int64_t downloadHTTP(Job* job, const Downloader::Request& request,
+            Response *response, QCryptographicHash* hash=nullptr);
 
-    static QString setPassword(HINTERNET hConnectHandle, DWORD dwStatus,
-                               const Request &request);
+    /**
+     * @brief downloads a file over http:/https: and continues interrupted
+     *     transfers using the "Range" HTTP header. The data is appended to
+     *     request.file at its current position.
+     * @param job job object
+     * @param request HTTP request. request.resumeAttempts defines the number
+     *     of additional attempts.
+     * @param response HTTP response for the first request
+     * @param hash 0 or the hash sum that should be updated with the received
+     *     data. If 0 and request.hashSum is true, the hash sum will be
+     *     computed and stored in the response.
+     */
+    static void downloadResumable(Job* job, const Downloader::Request& request,
+            Response *response, QCryptographicHash* hash);
 
-protected:
-    static QString setStringOption(HINTERNET hInternet, DWORD dwOption,
-        const QString &value);
+    /**
+     * @brief downloads a large file over http:/https: using up to
+     *     request.segments parallel connections. Every segment is written
+     *     directly at its position in request.file. The hash sum is updated
+     *     with the first segment while it is received and with the others
+     *     as soon as all preceding segments are complete. If the file is
+     *     too small (see Request::expectedLength), the server does not
+     *     support ranges or the TransferScheduler has no free slots, only
+     *     one connection will be used.
+     * @param job job object
+     * @param request HTTP request. request.file should be readable if the
+     *     hash sum should be computed.
+     * @param response HTTP response
+     */
+    static void downloadSegmented(Job* job, const Downloader::Request& request,
+            Response *response);
+
+    /**
+     * @brief downloads a file over http:/https: from request.url or one of
+     *     request.mirrors. The first MIRROR_RACE_SIZE bytes are requested
+     *     from all servers in parallel and the rest is downloaded from the
+     *     first server that delivered them. If the transfer fails, it is
+     *     continued from the next server using the "Range" HTTP header.
+     *     The hash sum is updated with the stored data while it is received
+     *     and continued with the data from the next server.
+     * @param job job object
+     * @param request HTTP request
+     * @param response HTTP response
+     */
+    static void downloadMirrored(Job* job, const Downloader::Request& request,
+            Response *response);
 };
 
 #endif // DOWNLOADER_H
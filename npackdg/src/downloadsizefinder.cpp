@@ -19,74 +19,91 @@
 #include "downloadsizefinder.h"
 #include "downloader.h"
 #include "job.h"
-#include "concurrent.h"
 #include "wpmutils.h"
 
-extern HWND defaultPasswordWindow;
-
 QThreadPool DownloadSizeFinder::threadPool;
 DownloadSizeFinder::_init DownloadSizeFinder::_initializer;
 
+bool DownloadSizeFinder::isObsolete(const URLInfo& info)
+{
+    return info.size == -1 || (info.size >= 0 &&
+            time(nullptr) - info.sizeModified > SIZE_EXPIRATION);
+}
+
 int64_t DownloadSizeFinder::downloadOrQueue(const QString &url)
 {
-    int64_t r;
+    int64_t r = -1;
+    bool start = false;
+    QString host = QUrl(url).host();
 
     this->mutex.lock();
     URLInfo* v = this->sizes.value(url);
-    if (v) {
+    if (v && !isObsolete(*v))
         r = v->size;
 
-        // if the value is older than 10 days, it is considered obsolete
-        if (r >= 0 && time(nullptr) - v->sizeModified > 10 * 24 * 60 * 60) {
-            r = -1;
+    if (r == -1 && !probing.contains(url)) {
+        // the URL that was requested last is probed first
+        QStringList& q = queued[host];
+        q.removeOne(url);
+        q.append(url);
+
+        int n = running.value(host);
+        if (n < MAX_PROBES_PER_HOST) {
+            running.insert(host, n + 1);
+            start = true;
         }
-    } else {
-        r = -1;
     }
     this->mutex.unlock();
 
-    if (r == -1) {
-        this->mutex.lock();
-        QFuture<URLInfo> future = run(&threadPool, this,
-                &DownloadSizeFinder::downloadRunnable, url);
-        QFutureWatcher<URLInfo>* w =
-                new QFutureWatcher<URLInfo>(this);
-        connect(w, SIGNAL(finished()), this, SLOT(watcherFinished()));
-        w->setFuture(future);
-        this->mutex.unlock();
-    }
+    if (start)
+        QtConcurrent::run(&threadPool, this,
+                &DownloadSizeFinder::probeRunnable, host);
 
     return r;
 }
 
-void DownloadSizeFinder::watcherFinished()
+void DownloadSizeFinder::cancelPending()
 {
-    QFutureWatcher<URLInfo>* w = static_cast<
-            QFutureWatcher<URLInfo>*>(sender());
-
-    URLInfo r = w->result();
-
     this->mutex.lock();
-    dbr->saveURLSize(r.address, r.size);
+    for (QMap<QString, QStringList>::iterator it = queued.begin();
+            it != queued.end(); ++it) {
+        it.value().clear();
+    }
     this->mutex.unlock();
+}
 
-    this->mutex.lock();
-    URLInfo* v = this->sizes.value(r.address);
-    if (!v) {
-        v = new URLInfo(r.address);
-        this->sizes.insert(r.address, v);
+void DownloadSizeFinder::openDatabase()
+{
+    if (!this->dbr) {
+        dbr = new DBRepository();
+        QString err = dbr->openDefault("defaultDownloadSizeFinder");
+        qCDebug(npackd) << "DownloadSizeFinder::openDatabase.openDefault" << err;
+        if (err.isEmpty()) {
+            sizes = dbr->findURLInfos(&err);
+            qCDebug(npackd) << "DownloadSizeFinder::openDatabase.sizes" << err;
+        }
     }
-    v->size = r.size;
-    v->sizeModified = r.sizeModified;
-    this->mutex.unlock();
+}
+
+void DownloadSizeFinder::saveSizes(bool all)
+{
+    QMutexLocker sl(&saveMutex);
 
-    emit this->downloadCompleted(r.address, r.size);
+    this->mutex.lock();
+    QList<URLInfo> infos;
+    if (all || unsaved.size() >= SAVE_BATCH_SIZE)
+        infos.swap(unsaved);
+    DBRepository* d = this->dbr;
+    this->mutex.unlock();
 
-    w->deleteLater();
+    if (d && !infos.isEmpty()) {
+        QString err = d->saveURLSizes(infos);
+        if (!err.isEmpty())
+            qCWarning(npackd) << "DownloadSizeFinder::saveSizes" << err;
+    }
 }
 
-URLInfo DownloadSizeFinder::downloadRunnable(
-        const QString& url)
+void DownloadSizeFinder::probeRunnable(const QString& host)
 {
     QThread::currentThread()->setPriority(QThread::LowestPriority);
 
@@ -98,43 +115,71 @@ URLInfo DownloadSizeFinder::downloadRunnable(
 
     CoInitialize(nullptr);
 
-    URLInfo r(url);
-
     this->mutex.lock();
-    if (!this->dbr) {
-        dbr = new DBRepository();
-        QString err = dbr->openDefault("defaultDownloadSizeFinder");
-        qCDebug(npackd) << "DownloadSizeFinder::downloadRunnable.openDefault" << err;
-        if (err.isEmpty()) {
-            sizes = dbr->findURLInfos(&err);
-            qCDebug(npackd) << "DownloadSizeFinder::downloadRunnable.sizes" << err;
+    openDatabase();
+    while (true) {
+        QStringList& q = queued[host];
+        if (q.isEmpty()) {
+            int n = running.value(host) - 1;
+            if (n > 0)
+                running.insert(host, n);
+            else {
+                running.remove(host);
+                queued.remove(host);
+            }
+            break;
         }
-    }
-    this->mutex.unlock();
 
-    this->mutex.lock();
-    URLInfo* v = this->sizes.value(url);
-    if (v) {
-        r = *v;
-    }
-    this->mutex.unlock();
+        QString url = q.takeLast();
+        URLInfo r(url);
+        URLInfo* v = this->sizes.value(url);
+        if (v)
+            r = *v;
+        probing.insert(url);
+        this->mutex.unlock();
 
-    // if the value is older than 10 days, it is considered obsolete
-    if (r.size >= 0 && time(nullptr) - r.sizeModified > 10 * 24 * 60 * 60) {
-        r.size = -1;
-    }
+        bool computed = false;
+        if (isObsolete(r)) {
+            Job* job = new Job();
 
-    if (r.size < 0) {
-        Job* job = new Job();
-        r.size = Downloader::getContentLength(job, url, defaultPasswordWindow);
-        r.sizeModified = time(nullptr);
+            // the connection is re-used for the next URL from the same host
+            r.size = Downloader::getContentLength(job, url, true,
+                    TransferScheduler::SIZE_PROBE);
+            r.sizeModified = time(nullptr);
 
-        if (!job->getErrorMessage().isEmpty() || r.size < 0) {
-            r.size = -2;
+            if (!job->getErrorMessage().isEmpty() || r.size < 0) {
+                r.size = -2;
+            }
+
+            delete job;
+            computed = true;
+        }
+
+        this->mutex.lock();
+        probing.remove(url);
+        v = this->sizes.value(url);
+        if (!v) {
+            v = new URLInfo(url);
+            this->sizes.insert(url, v);
         }
+        v->size = r.size;
+        v->sizeModified = r.sizeModified;
+        if (computed)
+            unsaved.append(r);
+        this->mutex.unlock();
+
+        // delivered to the UI thread
+        emit this->downloadCompleted(r.address, r.size);
+
+        saveSizes(false);
 
-        delete job;
+        this->mutex.lock();
     }
+    bool idle = running.isEmpty();
+    this->mutex.unlock();
+
+    if (idle)
+        saveSizes(true);
 
     CoUninitialize();
 
@@ -142,8 +187,6 @@ URLInfo DownloadSizeFinder::downloadRunnable(
     if (b)
         SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
     */
-
-    return r;
 }
 
 DownloadSizeFinder::DownloadSizeFinder(): dbr(nullptr)
@@ -152,6 +195,8 @@ DownloadSizeFinder::DownloadSizeFinder(): dbr(nullptr)
 
 DownloadSizeFinder::~DownloadSizeFinder()
 {
+    saveSizes(true);
+
     qDeleteAll(this->sizes);
     this->sizes.clear();
     delete this->dbr;
@@ -2,6 +2,7 @@
 #define DOWNLOADSIZEFINDER_H
 
 #include <stdint.h>
+#include <ctime>
 
 #include "qmetatype.h"
 #include <QObject>
@@ -13,34 +14,92 @@
 #include <QMutex>
 #include <QTemporaryDir>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
 #include <QThreadPool>
 
 #include "dbrepository.h"
 #include "urlinfo.h"
 
 /**
- * Loads files from the Internet.
+ * Computes download sizes using HEAD requests.
+ *
+ * The URLs are queued per host. The most recently requested URL (e.g. a row
+ * that has just become visible) is probed first, at most
+ * MAX_PROBES_PER_HOST requests run in parallel for one host and a task
+ * processes the queue for a host re-using the connection. Computed sizes are
+ * stored in the database in batches.
  */
 class DownloadSizeFinder: public QObject
 {
     Q_OBJECT
 
+    /** maximum number of parallel requests for one host */
+    static const int MAX_PROBES_PER_HOST = 2;
+
+    /** computed sizes are written to the database in batches of this size */
+    static const int SAVE_BATCH_SIZE = 32;
+
+    /** sizes older than this number of seconds are computed again */
+    static const time_t SIZE_EXPIRATION = 10 * 24 * 60 * 60;
+
     /**
      * @brief URL -> size as int64_t or -1 if unknown or -2 if an error occured
      *     The data in this field should be accessed under the mutex.
      */
     QMap<QString, URLInfo*> sizes;
 
+    /**
+     * @brief host -> queued URLs. The URL that was requested last is at the
+     *     end. Accessed under the mutex.
+     */
+    QMap<QString, QStringList> queued;
+
+    /** @brief URLs being probed now. Accessed under the mutex. */
+    QSet<QString> probing;
+
+    /**
+     * @brief host -> number of running tasks for this host. Accessed under
+     *     the mutex.
+     */
+    QMap<QString, int> running;
+
+    /**
+     * @brief computed sizes that are not yet stored in the database.
+     *     Accessed under the mutex.
+     */
+    QList<URLInfo> unsaved;
+
     QMutex mutex;
 
+    /** only one batch is written at a time */
+    QMutex saveMutex;
+
     DBRepository* dbr;
 
     /**
-     * @brief downloads a file
-     * @param url this file should be downloaded
-     * @return result
+     * @brief probes the queued URLs for a host until the queue is empty
+     * @param host host name
+     */
+    void probeRunnable(const QString &host);
+
+    /**
+     * @brief opens the database and loads the stored sizes. Should be called
+     *     under the mutex.
+     */
+    void openDatabase();
+
+    /**
+     * @brief writes the computed sizes to the database
+     * @param all true = write all sizes, false = only a full batch
+     */
+    void saveSizes(bool all);
+
+    /**
+     * @param info stored size
+     * @return true if the size should be computed again
      */
-    URLInfo downloadRunnable(const QString &url);
+    static bool isObsolete(const URLInfo& info);
 public:
     static QThreadPool threadPool;
 private:
@@ -61,8 +120,9 @@ public:
     virtual ~DownloadSizeFinder();
 
     /**
-     * @brief download a file. This function does not block.
-     * @param url this file will be downloaded
+     * @brief returns the size of a file or queues the computation. This
+     *     function does not block.
+     * @param url URL of the file
      * @return size or -2 if an error occured or -1 if the size is unknown
      */
     int64_t downloadOrQueue(const QString& url);
@@ -73,8 +133,13 @@ signals:
      * @param size size of the download or -1 if unknown or -2 for an error
      */
     void downloadCompleted(const QString& url, int64_t size);
-private slots:
-    void watcherFinished();
+public slots:
+    /**
+     * @brief removes all queued URLs. Requests that are already running are
+     *     completed. This should be called if the visible rows change as the
+     *     URLs are queued again when the new rows are shown.
+     */
+    void cancelPending();
 };
 
 #endif // DOWNLOADSIZEFINDER_H
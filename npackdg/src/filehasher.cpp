@@ -0,0 +1,161 @@
+#include <windows.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QList>
+#include <QFuture>
+#include <QThreadPool>
+#include <QCryptographicHash>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "filehasher.h"
+#include "dbrepository.h"
+#include "wpmutils.h"
+
+FileHash::FileHash() : size(0), modified(0)
+{
+}
+
+/**
+ * @return thread pool for hashing. The global thread pool is not used as the
+ *     callers may run there. The default number of threads (one per core) is
+ *     kept as more threads would only make the disk seek more.
+ */
+static QThreadPool* getFileHashingThreadPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+QString FileHasher::hashFile(const QString& path, QAtomicInt* stopping,
+        QAtomicInteger<qint64>* done)
+{
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return QString();
+
+    const int64_t bufferSize = 1024 * 1024;
+    QByteArray buffer(bufferSize, Qt::Uninitialized);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    bool ok = true;
+    while (true) {
+        if (stopping->load()) {
+            ok = false;
+            break;
+        }
+
+        int64_t n = f.read(buffer.data(), bufferSize);
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+        if (n == 0)
+            break;
+
+        hash.addData(buffer.constData(), static_cast<int>(n));
+        done->fetchAndAddRelaxed(n);
+    }
+    f.close();
+
+    return ok ? QString::fromLatin1(hash.result().toHex()) : QString();
+}
+
+QStringList FileHasher::computeSHA256(Job* job, const QStringList& paths)
+{
+    QStringList r;
+
+    QList<FileHash> current;
+    QStringList keys;
+    for (int i = 0; i < paths.size(); i++) {
+        QFileInfo fi(paths.at(i));
+        FileHash h;
+        h.path = WPMUtils::normalizePath(paths.at(i));
+        h.size = fi.size();
+        h.modified = fi.lastModified().toMSecsSinceEpoch();
+        current.append(h);
+        keys.append(h.path);
+        r.append(QString());
+    }
+
+    DBRepository* dbr = DBRepository::getDefault();
+    QString err;
+    QMap<QString, FileHash> cached = dbr->findFileHashes(keys, &err);
+    if (!err.isEmpty())
+        qCDebug(npackd).noquote() << err;
+
+    // only new and changed files are read
+    QList<int> pending;
+    int64_t total = 0;
+    for (int i = 0; i < current.size(); i++) {
+        const FileHash& h = current.at(i);
+        QMap<QString, FileHash>::const_iterator it = cached.constFind(h.path);
+        if (it != cached.constEnd() && it->size == h.size &&
+                it->modified == h.modified) {
+            r[i] = it->sha256;
+        } else {
+            pending.append(i);
+            total += h.size;
+        }
+    }
+
+    QAtomicInt stopping;
+    QAtomicInteger<qint64> done;
+    QList<QFuture<QString> > futures;
+    for (int i = 0; i < pending.size(); i++) {
+        futures.append(QtConcurrent::run(getFileHashingThreadPool(),
+                FileHasher::hashFile, paths.at(pending.at(i)), &stopping,
+                &done));
+    }
+
+    JobProgressReporter progress(job);
+    while (true) {
+        bool finished = true;
+        for (int i = 0; i < futures.size(); i++) {
+            if (!futures.at(i).isFinished()) {
+                finished = false;
+                break;
+            }
+        }
+
+        if (finished)
+            break;
+
+        if (!job->shouldProceed())
+            stopping.store(1);
+
+        progress.reportBytes(done.load(), total);
+        Sleep(100);
+    }
+
+    QList<FileHash> computed;
+    for (int i = 0; i < futures.size(); i++) {
+        int index = pending.at(i);
+        QString sha256 = futures.at(i).result();
+        if (!sha256.isEmpty()) {
+            r[index] = sha256;
+
+            // a file changed while it was read is not cached
+            FileHash h = current.at(index);
+            QFileInfo fi(paths.at(index));
+            if (fi.size() == h.size &&
+                    fi.lastModified().toMSecsSinceEpoch() == h.modified) {
+                h.sha256 = sha256;
+                computed.append(h);
+            }
+        }
+    }
+
+    if (!computed.isEmpty()) {
+        err = dbr->saveFileHashes(computed);
+        if (!err.isEmpty())
+            qCDebug(npackd).noquote() << err;
+    }
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+
+    return r;
+}
@@ -0,0 +1,64 @@
+#ifndef FILEHASHER_H
+#define FILEHASHER_H
+
+#include <stdint.h>
+
+#include <QString>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include "job.h"
+
+/**
+ * @brief SHA-256 of a file stored in the database. The value is only valid
+ *     as long as the size and the last modification time of the file do not
+ *     change.
+ */
+class FileHash
+{
+public:
+    /** full file path (see WPMUtils::normalizePath) */
+    QString path;
+
+    /** file size in bytes */
+    int64_t size;
+
+    /** last modification time in milliseconds since 1970-01-01 UTC */
+    int64_t modified;
+
+    /** SHA-256 in lower case */
+    QString sha256;
+
+    FileHash();
+};
+
+/**
+ * @brief computes SHA-256 for many files at once. The files are hashed in
+ *     parallel and the results are cached in the database
+ *     (see DBRepository::findFileHashes). Unchanged files are not read
+ *     again.
+ */
+class FileHasher
+{
+    /**
+     * @brief computes SHA-256 for one file. Executed by the hashing threads.
+     * @param path full file path
+     * @param stopping != 0 = stop reading
+     * @param done the number of read bytes will be added here
+     * @return SHA-256 in lower case or "" if the file cannot be read
+     */
+    static QString hashFile(const QString& path, QAtomicInt* stopping,
+            QAtomicInteger<qint64>* done);
+public:
+    /**
+     * @brief computes SHA-256 for the specified files
+     * @param job job
+     * @param paths full file paths
+     * @return SHA-256 in lower case for every path in the same order or ""
+     *     if a file cannot be read
+     */
+    static QStringList computeSHA256(Job* job, const QStringList& paths);
+};
+
+#endif // FILEHASHER_H
@@ -0,0 +1,129 @@
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+
+#include "fileinstalledpackagesstorage.h"
+#include "packageversion.h"
+
+FileInstalledPackagesStorage::FileInstalledPackagesStorage(
+        const QString& filename) : filename(filename), batches(0), written(0)
+{
+}
+
+QString FileInstalledPackagesStorage::load(
+        QList<InstalledPackageVersion*>* ipvs)
+{
+    QString err;
+
+    QFile f(filename);
+    if (!f.exists())
+        return err;
+
+    if (!f.open(QFile::ReadOnly))
+        err = QObject::tr("Cannot open the file: %1").arg(filename);
+
+    QJsonObject top;
+    if (err.isEmpty()) {
+        QJsonParseError pe;
+        QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &pe);
+        f.close();
+        if (pe.error != QJsonParseError::NoError)
+            err = QObject::tr("Error parsing %1: %2").arg(filename).
+                    arg(pe.errorString());
+        else
+            top = doc.object();
+    }
+
+    if (err.isEmpty()) {
+        for (QJsonObject::const_iterator it = top.constBegin();
+                it != top.constEnd(); ++it) {
+            QJsonObject o = it.value().toObject();
+            Version version;
+            QString package = o.value(QStringLiteral("package")).toString();
+            QString dir = o.value(QStringLiteral("path")).toString();
+            if (!package.isEmpty() && !dir.isEmpty() &&
+                    version.setVersion(o.value(
+                    QStringLiteral("version")).toString())) {
+                InstalledPackageVersion* ipv = new InstalledPackageVersion(
+                        package, version, dir);
+                ipv->detectionInfo = o.value(
+                        QStringLiteral("detectionInfo")).toString();
+                ipvs->append(ipv);
+            }
+        }
+    }
+
+    return err;
+}
+
+QString FileInstalledPackagesStorage::save(
+        const QList<InstalledPackageVersion*>& ipvs)
+{
+    QString err;
+
+    if (ipvs.isEmpty())
+        return err;
+
+    QList<InstalledPackageVersion*> stored;
+    err = load(&stored);
+
+    // the changed entries replace the stored ones
+    QMap<QString, InstalledPackageVersion*> map;
+    for (int i = 0; i < stored.size(); i++) {
+        InstalledPackageVersion* ipv = stored.at(i);
+        map.insert(PackageVersion::getStringId(ipv->package, ipv->version),
+                ipv);
+    }
+    for (int i = 0; i < ipvs.size(); i++) {
+        InstalledPackageVersion* ipv = ipvs.at(i);
+        QString key = PackageVersion::getStringId(ipv->package, ipv->version);
+        if (ipv->installed())
+            map.insert(key, ipv);
+        else
+            map.remove(key);
+    }
+
+    if (err.isEmpty()) {
+        QJsonObject top;
+        for (QMap<QString, InstalledPackageVersion*>::const_iterator it =
+                map.constBegin(); it != map.constEnd(); ++it) {
+            InstalledPackageVersion* ipv = it.value();
+            QJsonObject o;
+            o[QStringLiteral("package")] = ipv->package;
+            o[QStringLiteral("version")] = ipv->version.getVersionString();
+            o[QStringLiteral("path")] = ipv->directory;
+            o[QStringLiteral("detectionInfo")] = ipv->detectionInfo;
+            top[it.key()] = o;
+        }
+
+        QSaveFile f(filename);
+        if (!f.open(QFile::WriteOnly))
+            err = QObject::tr("Cannot open the file: %1").arg(filename);
+        else {
+            f.write(QJsonDocument(top).toJson(QJsonDocument::Compact));
+            if (!f.commit())
+                err = f.errorString();
+        }
+    }
+
+    qDeleteAll(stored);
+
+    if (err.isEmpty()) {
+        batches++;
+        written += ipvs.size();
+    }
+
+    return err;
+}
+
+int FileInstalledPackagesStorage::getBatches() const
+{
+    return batches;
+}
+
+int FileInstalledPackagesStorage::getWritten() const
+{
+    return written;
+}
@@ -0,0 +1,40 @@
+#ifndef FILEINSTALLEDPACKAGESSTORAGE_H
+#define FILEINSTALLEDPACKAGESSTORAGE_H
+
+#include "abstractinstalledpackagesstorage.h"
+
+/**
+ * @brief stores the installed package versions in a JSON file. Every save()
+ *     replaces the whole file atomically. This storage does not depend on
+ *     the Windows registry and is used for tests and measurements.
+ */
+class FileInstalledPackagesStorage: public AbstractInstalledPackagesStorage
+{
+    QString filename;
+
+    /** number of the calls to save() with at least one entry */
+    int batches;
+
+    /** number of the entries written by save() */
+    int written;
+public:
+    /**
+     * @param filename JSON file. A missing file is handled as empty.
+     */
+    explicit FileInstalledPackagesStorage(const QString& filename);
+
+    QString load(QList<InstalledPackageVersion*>* ipvs);
+    QString save(const QList<InstalledPackageVersion*>& ipvs);
+
+    /**
+     * @return number of the calls to save() with at least one entry
+     */
+    int getBatches() const;
+
+    /**
+     * @return number of the entries written by save()
+     */
+    int getWritten() const;
+};
+
+#endif // FILEINSTALLEDPACKAGESSTORAGE_H
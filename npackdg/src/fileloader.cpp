@@ -1,4 +1,5 @@
 #include <windows.h>
+#include <shlobj.h>
 
 #include <QtGlobal>
 #if defined(_MSC_VER) && (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
@@ -10,7 +11,16 @@
 #endif
 #endif
 
+#include <algorithm>
+
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSettings>
+#include <QDateTime>
+#include <QDataStream>
+#include <QImageReader>
+#include <QCryptographicHash>
 #include <QtConcurrent/QtConcurrent>
 #include <QFuture>
 #include <QFutureWatcher>
@@ -20,9 +30,37 @@
 #include "job.h"
 #include "downloadsizefinder.h"
 #include "concurrent.h"
+#include "wpmutils.h"
+
+/** first 4 bytes of a .raw thumbnail file */
+static const quint32 RAW_IMAGE_MAGIC = 0x4e504b31;
+
+FileLoader::FileLoader(): id(0), addedBytes(0)
+{
+    QString d = WPMUtils::getShellDir(CSIDL_LOCAL_APPDATA) +
+            "\\Npackd\\Cache\\Icons";
+    if (QDir().mkpath(d))
+        cacheDir = d;
+    else
+        cacheDir = dir.path();
+
+    QtConcurrent::run(&DownloadSizeFinder::threadPool, this,
+            &FileLoader::trimCache);
+}
+
+QString FileLoader::getCacheKey(const QString& url) const
+{
+    return QString::fromLatin1(QCryptographicHash::hash(url.toUtf8(),
+            QCryptographicHash::Sha1).toHex());
+}
 
-FileLoader::FileLoader(): id(0)
+void FileLoader::watch(const QFuture<DownloadFile>& future)
 {
+    QFutureWatcher<DownloadFile>* w =
+            new QFutureWatcher<DownloadFile>(this);
+    connect(w, SIGNAL(finished()), this,
+            SLOT(watcherFinished()));
+    w->setFuture(future);
 }
 
 QString FileLoader::downloadOrQueue(const QString &url, QString *err)
@@ -35,38 +73,67 @@ QString FileLoader::downloadOrQueue(const QString &url, QString *err)
         DownloadFile file = this->files.value(url);
         if (!file.error.isEmpty())
             *err = file.error;
-        else if (!file.file.isEmpty())
-            r = dir.path() + "\\" + file.file;
+        else
+            r = file.file;
         this->mutex.unlock();
     } else {
         this->mutex.unlock();
 
-        QFuture<DownloadFile> future = run(
-                &DownloadSizeFinder::threadPool, this,
-                &FileLoader::downloadRunnable, url);
-        QFutureWatcher<DownloadFile>* w =
-                new QFutureWatcher<DownloadFile>(this);
-        connect(w, SIGNAL(finished()), this,
-                SLOT(watcherFinished()));
-        w->setFuture(future);
+        watch(run(&DownloadSizeFinder::threadPool, this,
+                &FileLoader::downloadRunnable, url));
     }
 
     return r;
 }
 
+QImage FileLoader::thumbnailOrQueue(const QString& url, int size,
+        QString* err)
+{
+    QImage r;
+    *err = "";
+
+    bool queue = false;
+    this->mutex.lock();
+    if (this->files.contains(url)) {
+        DownloadFile& file = this->files[url];
+        if (!file.error.isEmpty()) {
+            *err = file.error;
+        } else if (file.thumbnails.contains(size)) {
+            r = file.thumbnails.value(size);
+            if (r.isNull())
+                *err = QObject::tr("Cannot decode the image %1").arg(
+                        file.file);
+        } else if (!file.file.isEmpty() &&
+                !file.queuedThumbnails.contains(size)) {
+            file.queuedThumbnails.insert(size);
+            queue = true;
+        }
+        this->mutex.unlock();
+    } else {
+        this->mutex.unlock();
+
+        downloadOrQueue(url, err);
+    }
+
+    if (queue)
+        watch(QtConcurrent::run(&DownloadSizeFinder::threadPool, this,
+                &FileLoader::thumbnailRunnable, url, size));
+
+    return r;
+}
+
 void FileLoader::watcherFinished()
 {
     QFutureWatcher<DownloadFile>* w = static_cast<
             QFutureWatcher<DownloadFile>*>(sender());
     DownloadFile r = w->result();
 
-    if (!r.file.isEmpty() || !r.error.isEmpty()) {
-        QString file = r.file;
-        if (!file.isEmpty())
-            file = dir.path() + "\\" + file;
+    if (!r.unchanged && (!r.file.isEmpty() || !r.error.isEmpty()))
+        emit this->downloadCompleted(r.url, r.file, r.error);
 
-        emit this->downloadCompleted(r.url, file, r.error);
-    }
+    if (r.revalidate)
+        watch(run(&DownloadSizeFinder::threadPool, this,
+                &FileLoader::revalidateRunnable, r.url));
 
     w->deleteLater();
 }
@@ -91,54 +158,28 @@ FileLoader::DownloadFile FileLoader::downloadRunnable(const QString& url)
 
         CoInitialize(nullptr);
 
-        QString filename = QString::number(id.fetchAndAddAcquire(1));
-        QString fn = dir.path() + "\\" + filename;
-        QFile f(fn);
-        if (f.open(QFile::ReadWrite)) {
-            Job* job = new Job();
-            Downloader::Request request{QUrl(url)};
-            request.file = &f;
-            request.useCache = true;
-            request.keepConnection = false;
-            request.timeout = 15;
-
-            Downloader::Response response = Downloader::download(job, request);
-            QString mime = response.mimeType;
-            f.close();
-
-            if (!job->getErrorMessage().isEmpty()) {
-                r.error = job->getErrorMessage();
-            } else {
-                // supported extensions:
-                // "bmp", "cur", "dds", "gif", "icns", "ico", "jp2", "jpeg",
-                // "jpg", "mng", "pbm", "pgm", "png", "ppm", "tga", "tif",
-                // "tiff", "wbmp", "webp", "xbm", "xpm"
-                QString ext;
-                if (mime == "image/png")
-                    ext = ".png";
-                else if (mime == "image/x-icon" || mime == "image/vnd.microsoft.icon")
-                    ext = ".ico";
-                else if (mime == "image/jpeg")
-                    ext = ".jpg";
-                else if (mime == "image/gif")
-                    ext = ".gif";
-                else if (mime == "image/x-windows-bmp" || mime == "image/bmp")
-                    ext = ".bmp";
-                else
-                    ext = ".png";
-
-                // qCDebug(npackd) << ext;
-                f.close();
-                f.rename(fn + ext);
-                r.file = filename + ext;
-            }
-            delete job;
+        QString key = getCacheKey(url);
+        QSettings meta(cacheDir + "\\" + key + ".ini", QSettings::IniFormat);
+        QString file = cacheDir + "\\" + key + meta.value("ext").toString();
+        if (meta.value("url").toString() == url && QFileInfo(file).isFile()) {
+            // the entry is used immediately and validated afterwards
+            r.file = file;
+            r.revalidate = !url.startsWith("data:");
         } else {
-            r.error = QObject::tr("Cannot open the file %1").arg(fn);
+            r = fetch(url, "", "", "");
         }
 
+        // the icon for the package list is needed in most cases
+        if (!r.file.isEmpty())
+            r.thumbnails.insert(THUMBNAIL_LIST,
+                    getThumbnail(key, r.file, THUMBNAIL_LIST));
+
+        DownloadFile stored = r;
+        stored.revalidate = false;
+        stored.unchanged = false;
+
         this->mutex.lock();
-        this->files.insert(r.url, r);
+        this->files.insert(r.url, stored);
         this->mutex.unlock();
 
         CoUninitialize();
@@ -149,3 +190,300 @@ FileLoader::DownloadFile FileLoader::downloadRunnable(const QString& url)
 
     return r;
 }
+
+FileLoader::DownloadFile FileLoader::revalidateRunnable(const QString& url)
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    bool b = SetThreadPriority(GetCurrentThread(),
+            THREAD_MODE_BACKGROUND_BEGIN);
+
+    CoInitialize(nullptr);
+
+    QString key = getCacheKey(url);
+    QString etag, lastModified, sha256;
+    {
+        QSettings meta(cacheDir + "\\" + key + ".ini", QSettings::IniFormat);
+        etag = meta.value("etag").toString();
+        lastModified = meta.value("lastModified").toString();
+        sha256 = meta.value("sha256").toString();
+    }
+
+    DownloadFile r = fetch(url, etag, lastModified, sha256);
+
+    // errors are ignored here (e.g. no network connection) and the cached
+    // file is used
+    if (!r.error.isEmpty()) {
+        r.error.clear();
+        r.unchanged = true;
+    }
+
+    if (!r.unchanged) {
+        r.thumbnails.insert(THUMBNAIL_LIST,
+                getThumbnail(key, r.file, THUMBNAIL_LIST));
+
+        this->mutex.lock();
+        this->files.insert(url, r);
+        this->mutex.unlock();
+    }
+
+    CoUninitialize();
+
+    if (b)
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+
+    return r;
+}
+
+FileLoader::DownloadFile FileLoader::thumbnailRunnable(const QString& url,
+        int size)
+{
+    this->mutex.lock();
+    DownloadFile r = this->files.value(url);
+    this->mutex.unlock();
+
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    QImage img = getThumbnail(getCacheKey(url), r.file, size);
+
+    this->mutex.lock();
+    DownloadFile& file = this->files[url];
+
+    // the file may have been replaced in the meantime
+    if (file.file == r.file)
+        file.thumbnails.insert(size, img);
+    file.queuedThumbnails.remove(size);
+    this->mutex.unlock();
+
+    r.revalidate = false;
+    r.unchanged = false;
+
+    return r;
+}
+
+FileLoader::DownloadFile FileLoader::fetch(const QString& url,
+        const QString& etag, const QString& lastModified,
+        const QString& sha256)
+{
+    DownloadFile r;
+    r.url = url;
+
+    QString key = getCacheKey(url);
+    QString ini = cacheDir + "\\" + key + ".ini";
+    QString tmp = cacheDir + "\\" + key + ".tmp" +
+            QString::number(id.fetchAndAddAcquire(1));
+    QFile f(tmp);
+    if (f.open(QFile::ReadWrite)) {
+        Job* job = new Job();
+        Downloader::Request request{QUrl(url)};
+        request.file = &f;
+        request.useCache = true;
+        request.keepConnection = true;
+        request.timeout = 15;
+        request.priority = TransferScheduler::ICON;
+        request.hashSum = true;
+        request.alg = QCryptographicHash::Sha256;
+        request.ifNoneMatch = etag;
+        request.ifModifiedSince = lastModified;
+
+        Downloader::Response response = Downloader::download(job, request);
+        QString mime = response.mimeType;
+        f.close();
+
+        if (!job->getErrorMessage().isEmpty()) {
+            r.error = job->getErrorMessage();
+            f.remove();
+        } else if (response.statusCode == 304 ||
+                (!sha256.isEmpty() && response.hashSum == sha256)) {
+            f.remove();
+
+            // the modification time of the .ini file is used to find the
+            // least recently validated entries
+            QSettings meta(ini, QSettings::IniFormat);
+            meta.setValue("validated", QDateTime::currentDateTimeUtc());
+            if (!response.etag.isEmpty())
+                meta.setValue("etag", response.etag);
+            r.file = cacheDir + "\\" + key + meta.value("ext").toString();
+            r.unchanged = true;
+        } else {
+            // supported extensions:
+            // "bmp", "cur", "dds", "gif", "icns", "ico", "jp2", "jpeg",
+            // "jpg", "mng", "pbm", "pgm", "png", "ppm", "tga", "tif",
+            // "tiff", "wbmp", "webp", "xbm", "xpm"
+            QString ext;
+            if (mime == "image/png")
+                ext = ".png";
+            else if (mime == "image/x-icon" || mime == "image/vnd.microsoft.icon")
+                ext = ".ico";
+            else if (mime == "image/jpeg")
+                ext = ".jpg";
+            else if (mime == "image/gif")
+                ext = ".gif";
+            else if (mime == "image/x-windows-bmp" || mime == "image/bmp")
+                ext = ".bmp";
+            else
+                ext = ".png";
+
+            // the old file and thumbnails are replaced
+            deleteCacheFiles(key, tmp);
+
+            QString fn = cacheDir + "\\" + key + ext;
+            if (f.rename(fn)) {
+                r.file = fn;
+
+                QSettings meta(ini, QSettings::IniFormat);
+                meta.setValue("url", url);
+                meta.setValue("etag", response.etag);
+                meta.setValue("lastModified", response.lastModified);
+                meta.setValue("sha256", response.hashSum);
+                meta.setValue("ext", ext);
+                meta.setValue("validated", QDateTime::currentDateTimeUtc());
+                meta.sync();
+
+                int size = static_cast<int>(QFileInfo(fn).size());
+                if (addedBytes.fetchAndAddOrdered(size) + size >
+                        MAX_CACHE_SIZE / 10)
+                    trimCache();
+            } else {
+                r.error = f.errorString();
+                f.remove();
+            }
+        }
+        delete job;
+    } else {
+        r.error = QObject::tr("Cannot open the file %1").arg(tmp);
+    }
+
+    return r;
+}
+
+void FileLoader::deleteCacheFiles(const QString& key, const QString& except)
+{
+    QDir d(cacheDir);
+    const QStringList entries = d.entryList(QStringList(key + "*"),
+            QDir::Files);
+    for (int i = 0; i < entries.size(); i++) {
+        QString p = cacheDir + "\\" + entries.at(i);
+        if (p != except)
+            QFile::remove(p);
+    }
+}
+
+QImage FileLoader::getThumbnail(const QString& key, const QString& file,
+        int size)
+{
+    QString raw = cacheDir + "\\" + key + "-" + QString::number(size) +
+            ".raw";
+
+    QImage r;
+    QFileInfo rawInfo(raw);
+    if (rawInfo.isFile() &&
+            rawInfo.lastModified() >= QFileInfo(file).lastModified())
+        r = loadRawImage(raw);
+
+    if (r.isNull()) {
+        QImageReader reader(file);
+        QImage img = reader.read();
+        if (!img.isNull()) {
+            r = img.scaled(size, size, Qt::KeepAspectRatio,
+                    Qt::SmoothTransformation).convertToFormat(
+                    QImage::Format_ARGB32_Premultiplied);
+            if (saveRawImage(r, raw))
+                addedBytes.fetchAndAddOrdered(r.bytesPerLine() * r.height());
+        }
+    }
+
+    return r;
+}
+
+bool FileLoader::saveRawImage(const QImage& image, const QString& filename)
+{
+    QFile f(filename);
+    bool r = f.open(QFile::WriteOnly);
+    if (r) {
+        QDataStream s(&f);
+        s << RAW_IMAGE_MAGIC << static_cast<qint32>(image.width()) <<
+                static_cast<qint32>(image.height()) <<
+                static_cast<qint32>(image.format()) <<
+                static_cast<qint32>(image.bytesPerLine());
+        int n = image.bytesPerLine() * image.height();
+        r = s.writeRawData(reinterpret_cast<const char*>(image.constBits()),
+                n) == n;
+        f.close();
+        if (!r)
+            f.remove();
+    }
+    return r;
+}
+
+QImage FileLoader::loadRawImage(const QString& filename)
+{
+    QImage r;
+    QFile f(filename);
+    if (f.open(QFile::ReadOnly)) {
+        QDataStream s(&f);
+        quint32 magic;
+        qint32 w, h, format, bytesPerLine;
+        s >> magic >> w >> h >> format >> bytesPerLine;
+        if (s.status() == QDataStream::Ok && magic == RAW_IMAGE_MAGIC &&
+                w > 0 && h > 0 && w <= 4096 && h <= 4096 &&
+                format == QImage::Format_ARGB32_Premultiplied) {
+            QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+            if (img.bytesPerLine() == bytesPerLine) {
+                int n = bytesPerLine * h;
+                if (s.readRawData(reinterpret_cast<char*>(img.bits()), n) == n)
+                    r = img;
+            }
+        }
+    }
+    return r;
+}
+
+void FileLoader::trimCache()
+{
+    addedBytes.storeRelease(0);
+
+    QSet<QString> used;
+    this->mutex.lock();
+    for (QMap<QString, DownloadFile>::const_iterator it = files.constBegin();
+            it != files.constEnd(); ++it) {
+        used.insert(getCacheKey(it.key()));
+    }
+    this->mutex.unlock();
+
+    // key -> size of all files for this key
+    QMap<QString, qint64> sizes;
+
+    // key -> last validation (modification time of the .ini file)
+    QMap<QString, qint64> validated;
+
+    qint64 total = 0;
+    QDir d(cacheDir);
+    const QFileInfoList entries = d.entryInfoList(QDir::Files);
+    for (int i = 0; i < entries.size(); i++) {
+        const QFileInfo& fi = entries.at(i);
+        QString key = fi.fileName().left(40);
+        sizes[key] += fi.size();
+        total += fi.size();
+        if (fi.fileName() == key + ".ini")
+            validated.insert(key, fi.lastModified().toMSecsSinceEpoch());
+    }
+
+    // oldest first. Files without an .ini file are left-overs from
+    // interrupted downloads and come first.
+    QList<QPair<qint64, QString> > order;
+    for (QMap<QString, qint64>::const_iterator it = sizes.constBegin();
+            it != sizes.constEnd(); ++it) {
+        order.append(qMakePair(validated.value(it.key(), 0), it.key()));
+    }
+    std::sort(order.begin(), order.end());
+
+    for (int i = 0; i < order.size(); i++) {
+        const QPair<qint64, QString>& p = order.at(i);
+        bool orphan = !validated.contains(p.second);
+        if (!used.contains(p.second) && (orphan || total > MAX_CACHE_SIZE)) {
+            deleteCacheFiles(p.second, "");
+            total -= sizes.value(p.second);
+        }
+    }
+}
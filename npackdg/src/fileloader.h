@@ -11,9 +11,20 @@
 #include <QMutex>
 #include <QTemporaryDir>
 #include <QMap>
+#include <QSet>
+#include <QImage>
 
 /**
  * Loads files from the Internet.
+ *
+ * The files are stored in a persistent cache together with decoded and
+ * scaled thumbnails. An entry from the cache is used immediately and
+ * validated using a conditional HTTP request afterwards.
+ *
+ * Cache files for an URL (key = SHA1 of the URL):
+ *     <key>.ini - URL, ETag, Last-Modified, SHA-256 of the content, extension
+ *     <key>.<ext> - downloaded file
+ *     <key>-<size>.raw - decoded thumbnail
  */
 class FileLoader: public QObject
 {
@@ -23,28 +34,123 @@ class FileLoader: public QObject
     {
     public:
         QString url, file, error;
+
+        /** size -> decoded thumbnail. A null image means a decoding error. */
+        QMap<int, QImage> thumbnails;
+
+        /** sizes of the thumbnails being decoded */
+        QSet<int> queuedThumbnails;
+
+        /** true = the entry was found in the cache and should be validated */
+        bool revalidate = false;
+
+        /** true = the validation did not find any changes */
+        bool unchanged = false;
     };
 
+    /** maximum size of the cache directory in bytes */
+    static const qint64 MAX_CACHE_SIZE = 100 * 1024 * 1024;
+
     /**
-     * @brief URL -> local relative file name in the temporary directory or
-     *     an error message if it starts with an asterisk (*). The data
-     *     in this field should be accessed under the mutex.
+     * @brief URL -> local file name and thumbnails or an error message. The
+     *     data in this field should be accessed under the mutex.
      */
     QMap<QString, DownloadFile> files;
 
     QAtomicInt id;
 
+    /** number of bytes added to the cache since it was trimmed */
+    QAtomicInt addedBytes;
+
     QMutex mutex;
 
+    /** only used if the cache directory cannot be created */
     QTemporaryDir dir;
 
+    /** persistent cache directory */
+    QString cacheDir;
+
     /**
-     * @brief downloads a file
+     * @brief downloads a file or takes it from the cache
      * @param url this file should be downloaded
      * @return result
      */
     DownloadFile downloadRunnable(const QString &url);
+
+    /**
+     * @brief validates a cache entry using a conditional request
+     * @param url URL of the file
+     * @return result. DownloadFile::unchanged is true if the cached file can
+     *     still be used.
+     */
+    DownloadFile revalidateRunnable(const QString &url);
+
+    /**
+     * @brief decodes and scales an image or loads the thumbnail from the
+     *     cache
+     * @param url URL of the file
+     * @param size size of the thumbnail
+     * @return result
+     */
+    DownloadFile thumbnailRunnable(const QString &url, int size);
+
+    /**
+     * @brief downloads a file into the cache
+     * @param url URL
+     * @param etag "If-None-Match" value or ""
+     * @param lastModified "If-Modified-Since" value or ""
+     * @param sha256 SHA-256 of the cached content or ""
+     * @return result. DownloadFile::unchanged is true if the server returned
+     *     304 or the same content.
+     */
+    DownloadFile fetch(const QString& url, const QString& etag,
+            const QString& lastModified, const QString& sha256);
+
+    /**
+     * @brief deletes the least recently validated entries if the cache is
+     *     too big. Entries used in this session are not deleted.
+     */
+    void trimCache();
+
+    /**
+     * @brief queues a background task
+     * @param future task
+     */
+    void watch(const QFuture<DownloadFile>& future);
+
+    /**
+     * @param url an URL
+     * @return prefix for the cache files
+     */
+    QString getCacheKey(const QString& url) const;
+
+    /**
+     * @brief deletes all files for a cache key
+     * @param key cache key
+     * @param except this file should not be deleted or ""
+     */
+    void deleteCacheFiles(const QString& key, const QString& except);
+
+    /**
+     * @brief loads a thumbnail from the cache or decodes and scales the
+     *     image and stores the thumbnail in the cache
+     * @param key cache key
+     * @param file image file
+     * @param size maximum width and height
+     * @return thumbnail or a null image if the file cannot be decoded
+     */
+    QImage getThumbnail(const QString& key, const QString& file, int size);
+
+    static bool saveRawImage(const QImage& image, const QString& filename);
+
+    static QImage loadRawImage(const QString& filename);
 public:
+    /** size of the icons in the package list */
+    static const int THUMBNAIL_LIST = 32;
+
+    /** size of the screen shots on the package details page */
+    static const int THUMBNAIL_DETAILS = 200;
+
     /**
      * The thread is not started.
      */
@@ -59,9 +165,22 @@ public:
      * @return local file name or "" if file is being downloaded
      */
     QString downloadOrQueue(const QString& url, QString* err);
+
+    /**
+     * @brief returns a decoded and scaled image. The decoding happens in a
+     *     background thread. This function does not block.
+     *     downloadCompleted() is emitted when the image is available.
+     * @param url image URL
+     * @param size maximum width and height, e.g. THUMBNAIL_LIST
+     * @param err error message or ""
+     * @return the image or a null image if it is not yet available
+     */
+    QImage thumbnailOrQueue(const QString& url, int size, QString* err);
 signals:
     /**
-     * @brief a download was completed (with or without an error)
+     * @brief a download was completed (with or without an error) or a
+     *     thumbnail was decoded. This signal may be emitted again for the
+     *     same URL if the file has changed on the server.
      * @param url the file from this URL was downloaded
      * @param filename full file name for the downloaded file or ""
      * @param err the error message or ""
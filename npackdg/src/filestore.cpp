@@ -0,0 +1,255 @@
+#include <windows.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QSet>
+
+#include "filestore.h"
+#include "filehasher.h"
+#include "wpmutils.h"
+
+const QString FileStore::NAME = QStringLiteral(".NpackdStore");
+
+FileStore::Statistics::Statistics() : files(0), size(0), links(0), saved(0),
+        unused(0), unusedSize(0)
+{
+}
+
+void FileStore::Statistics::add(const Statistics& s)
+{
+    files += s.files;
+    size += s.size;
+    links += s.links;
+    saved += s.saved;
+    unused += s.unused;
+    unusedSize += s.unusedSize;
+}
+
+FileStore::FileStore(const QString& parentDir)
+{
+    dir = QDir::toNativeSeparators(QDir::cleanPath(parentDir)) + '\\' +
+            NAME;
+}
+
+QString FileStore::getDirectory() const
+{
+    return dir;
+}
+
+QString FileStore::getObjectPath(const QString& sha256) const
+{
+    return dir + '\\' + sha256.left(2) + '\\' + sha256;
+}
+
+int FileStore::getLinkCount(const QString& path)
+{
+    int r = 0;
+
+    HANDLE h = CreateFileW(WPMUtils::toLPWSTR(path), FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (h != INVALID_HANDLE_VALUE) {
+        BY_HANDLE_FILE_INFORMATION info;
+        if (GetFileInformationByHandle(h, &info))
+            r = static_cast<int>(info.nNumberOfLinks);
+        CloseHandle(h);
+    }
+
+    return r;
+}
+
+bool FileStore::deduplicateFile(const QString& path, int64_t size,
+        const QString& sha256, QString* err)
+{
+    QString obj = getObjectPath(sha256);
+    QFileInfo oi(obj);
+    if (!oi.exists()) {
+        // the first copy of a file becomes the stored file
+        if (!QFileInfo(dir).exists()) {
+            QDir().mkpath(dir);
+            SetFileAttributesW(WPMUtils::toLPWSTR(dir),
+                    FILE_ATTRIBUTE_HIDDEN);
+        }
+        QDir().mkpath(oi.absolutePath());
+        if (!CreateHardLinkW(WPMUtils::toLPWSTR(obj),
+                WPMUtils::toLPWSTR(path), nullptr))
+            WPMUtils::formatMessage(GetLastError(), err);
+        return false;
+    }
+
+    // a changed stored file is not used
+    if (oi.size() != size) {
+        *err = QObject::tr("The stored file %1 was changed").arg(obj);
+        return false;
+    }
+
+    // the link is created under a temporary name and then replaces the file
+    QString tmp = WPMUtils::findNonExistingFile(path + ".NpackdLink", "");
+    if (!CreateHardLinkW(WPMUtils::toLPWSTR(tmp), WPMUtils::toLPWSTR(obj),
+            nullptr)) {
+        WPMUtils::formatMessage(GetLastError(), err);
+        return false;
+    }
+    if (!MoveFileExW(WPMUtils::toLPWSTR(tmp), WPMUtils::toLPWSTR(path),
+            MOVEFILE_REPLACE_EXISTING)) {
+        WPMUtils::formatMessage(GetLastError(), err);
+        QFile::remove(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+void FileStore::deduplicate(Job* job, const QString& installationDir)
+{
+    QStringList paths;
+    QList<int64_t> sizes;
+    int64_t total = 0;
+    QDirIterator it(installationDir, QDir::Files | QDir::System |
+            QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo fi = it.fileInfo();
+        if (!fi.isSymLink() && fi.size() >= MIN_SIZE) {
+            // files with more than one link were already processed
+            QString path = QDir::toNativeSeparators(fi.absoluteFilePath());
+            if (getLinkCount(path) == 1) {
+                paths.append(path);
+                sizes.append(fi.size());
+                total += fi.size();
+            }
+        }
+    }
+
+    QStringList sha256s;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.7, QObject::tr("Computing SHA-256"),
+                true, true);
+        sha256s = FileHasher::computeSHA256(sub, paths);
+    }
+
+    // a stored file is also changed if a program changes one of its links
+    // in place. Such a file is removed from the store and the next copy
+    // with the right contents is stored instead.
+    if (job->shouldProceed()) {
+        QStringList objects;
+        QSet<QString> seen;
+        for (int i = 0; i < sha256s.size(); i++) {
+            const QString& sha256 = sha256s.at(i);
+            if (!sha256.isEmpty() && !seen.contains(sha256)) {
+                seen.insert(sha256);
+                QString obj = getObjectPath(sha256);
+                if (QFileInfo::exists(obj))
+                    objects.append(obj);
+            }
+        }
+
+        // the SHA-256 of an unchanged stored file is found in the cache
+        Job* sub = job->newSubJob(0.1,
+                QObject::tr("Verifying the stored files"), true, true);
+        QStringList objectSha256s = FileHasher::computeSHA256(sub, objects);
+        for (int i = 0; i < objects.size(); i++) {
+            const QString& obj = objects.at(i);
+            if (!sub->shouldProceed())
+                break;
+
+            if (objectSha256s.at(i) != QFileInfo(obj).fileName()) {
+                qCDebug(npackd).noquote() << QObject::tr(
+                        "The stored file %1 was changed").arg(obj);
+                if (!QFile::remove(obj))
+                    qCDebug(npackd).noquote() << QObject::tr(
+                            "Cannot delete the file: %1").arg(obj);
+            }
+        }
+    }
+
+    JobProgressReporter progress(job);
+    int64_t done = 0, linked = 0, saved = 0;
+    for (int i = 0; i < paths.size(); i++) {
+        if (!job->shouldProceed())
+            break;
+
+        QString path = paths.at(i);
+        if (sha256s.at(i).isEmpty()) {
+            qCDebug(npackd).noquote() << QObject::tr(
+                    "Cannot read the file %1").arg(path);
+        } else {
+            QString err;
+            if (deduplicateFile(path, sizes.at(i), sha256s.at(i), &err)) {
+                linked++;
+                saved += sizes.at(i);
+            } else if (!err.isEmpty()) {
+                qCDebug(npackd).noquote() << path << err;
+            }
+        }
+
+        done += sizes.at(i);
+        if (total > 0)
+            progress.setProgress(0.8 + 0.2 * done / total);
+    }
+
+    if (job->shouldProceed()) {
+        qCInfo(npackd).noquote() << QObject::tr(
+                "%L1 files (%L2 bytes) in \"%3\" are shared with other installations").
+                arg(linked).arg(saved).arg(installationDir);
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+FileStore::Statistics FileStore::computeStatistics(Job* job,
+        bool deleteUnused)
+{
+    Statistics r;
+
+    QString initialTitle = job->getTitle();
+    JobProgressReporter progress(job);
+    QDirIterator it(dir, QDir::Files | QDir::System | QDir::Hidden,
+            QDirIterator::Subdirectories);
+    while (it.hasNext() && job->shouldProceed()) {
+        it.next();
+        QFileInfo fi = it.fileInfo();
+        int64_t size = fi.size();
+        int n = getLinkCount(fi.absoluteFilePath());
+        if (n <= 1) {
+            r.unused++;
+            r.unusedSize += size;
+            if (deleteUnused && !QFile::remove(fi.absoluteFilePath()))
+                qCDebug(npackd).noquote() << QObject::tr(
+                        "Cannot delete the file: %1").
+                        arg(fi.absoluteFilePath());
+        } else {
+            r.files++;
+            r.size += size;
+            r.links += n - 1;
+
+            // one copy would be necessary anyway
+            r.saved += size * (n - 2);
+        }
+
+        if (progress.isDue())
+            job->setTitle(initialTitle + QStringLiteral(" / ") +
+                    QString(QObject::tr("%L1 files")).arg(
+                    r.files + r.unused));
+    }
+
+    if (deleteUnused && job->shouldProceed()) {
+        QDir d(dir);
+        QStringList subdirs = d.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (int i = 0; i < subdirs.size(); i++) {
+            d.rmdir(subdirs.at(i));
+        }
+    }
+
+    job->setTitle(initialTitle);
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+
+    return r;
+}
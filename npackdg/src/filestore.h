@@ -0,0 +1,119 @@
+#ifndef FILESTORE_H
+#define FILESTORE_H
+
+#include <stdint.h>
+
+#include <QString>
+
+#include "job.h"
+
+/**
+ * @brief content-addressed store for the files of installed package
+ *     versions. Every file is stored once under its SHA-256 in the hidden
+ *     directory ".NpackdStore" next to the installation directories. The
+ *     files in the installation directories are hard links to the stored
+ *     files. The number of links shows how often a file is used.
+ *
+ * A program that changes a hard linked file in place changes it for all
+ * installations. This is why the store is optional and disabled by default
+ * (see PackageUtils::getDeduplication()). The stored files are verified
+ * before new links are created so that a changed file is not shared with
+ * further installations.
+ */
+class FileStore
+{
+public:
+    /** statistics for one or more stores */
+    class Statistics
+    {
+    public:
+        /** number of stored files */
+        int64_t files;
+
+        /** size of the stored files in bytes */
+        int64_t size;
+
+        /** number of files in the installation directories */
+        int64_t links;
+
+        /** saved space in bytes */
+        int64_t saved;
+
+        /** number of stored files not used by any installation */
+        int64_t unused;
+
+        /** size of the unused files in bytes */
+        int64_t unusedSize;
+
+        Statistics();
+
+        /**
+         * @brief adds the values from another object
+         * @param s statistics
+         */
+        void add(const Statistics& s);
+    };
+
+    /** name of the store directory */
+    static const QString NAME;
+
+    /** smaller files are not stored as they do not save a cluster */
+    static const int64_t MIN_SIZE = 4096;
+private:
+    QString dir;
+
+    /**
+     * @param sha256 SHA-256 in lower case
+     * @return path to the stored file
+     */
+    QString getObjectPath(const QString& sha256) const;
+
+    /**
+     * @brief stores one file or replaces it with a link to the stored file
+     * @param path full file path
+     * @param size file size
+     * @param sha256 SHA-256 of the file in lower case
+     * @param err error message will be stored here
+     * @return true if the file was replaced by a link to an existing
+     *     stored file
+     */
+    bool deduplicateFile(const QString& path, int64_t size,
+            const QString& sha256, QString* err);
+
+    /**
+     * @param path a file
+     * @return number of hard links or 0 if unknown
+     */
+    static int getLinkCount(const QString& path);
+public:
+    /**
+     * @param parentDir the store is located in this directory. Only the
+     *     installation directories on the same volume can use the store.
+     */
+    explicit FileStore(const QString& parentDir);
+
+    /**
+     * @return directory of this store
+     */
+    QString getDirectory() const;
+
+    /**
+     * @brief moves the files of an installation directory to the store and
+     *     replaces them with links. Files that cannot be replaced are left
+     *     as they are.
+     * @param job job
+     * @param installationDir an installation directory
+     */
+    void deduplicate(Job* job, const QString& installationDir);
+
+    /**
+     * @brief computes the statistics for this store
+     * @param job job
+     * @param deleteUnused true = delete the stored files that are not used
+     *     by any installation anymore
+     * @return statistics
+     */
+    Statistics computeStatistics(Job* job, bool deleteUnused);
+};
+
+#endif // FILESTORE_H
@@ -0,0 +1,146 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QDateTime>
+#include <QLocale>
+
+#include "filetransport.h"
+#include "repositorydelta.h"
+
+/**
+ * @brief a part of a file
+ */
+class FileRangeDevice: public QIODevice
+{
+    QFile file;
+    qint64 remaining;
+public:
+    explicit FileRangeDevice(const QString& filename): file(filename),
+            remaining(0) {
+    }
+
+    /**
+     * @param start first byte
+     * @param length number of bytes
+     * @return error message or ""
+     */
+    QString openRange(qint64 start, qint64 length) {
+        QString err;
+        if (!file.open(QFile::ReadOnly) || !file.seek(start))
+            err = file.errorString();
+        else {
+            remaining = length;
+            QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        }
+        return err;
+    }
+
+    bool isSequential() const override {
+        return true;
+    }
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        qint64 r = file.read(data, qMin(maxSize, remaining));
+        if (r < 0)
+            setErrorString(file.errorString());
+        else
+            remaining -= r;
+        return r;
+    }
+
+    qint64 writeData(const char * /*data*/, qint64 /*maxSize*/) override {
+        return -1;
+    }
+};
+
+FileTransport::FileTransport(const QString& root): root(root)
+{
+}
+
+QIODevice* FileTransport::open(Job* job, const Downloader::Request& request,
+        Downloader::Response* response, bool* gzip)
+{
+    *gzip = false;
+
+    QFileInfo fi(root + request.url.path());
+
+    // a delta published as <file>.<SHA-1 of the client data>.delta is sent
+    // instead of the whole file. The validators still describe the file.
+    QFileInfo body = fi;
+    const QStringList headers = request.headers.split(QStringLiteral("\r\n"),
+            QString::SkipEmptyParts);
+    for (int i = 0; i < headers.size(); i++) {
+        const QString& header = headers.at(i);
+        int colon = header.indexOf(':');
+        if (colon > 0 && header.left(colon).trimmed().compare(
+                RepositoryDelta::HEADER, Qt::CaseInsensitive) == 0) {
+            QFileInfo delta(fi.absoluteFilePath() + '.' +
+                    header.mid(colon + 1).trimmed().toLower() +
+                    QStringLiteral(".delta"));
+            if (delta.isFile())
+                body = delta;
+        }
+    }
+
+    qint64 size = body.size();
+
+    // the same format as used by many HTTP servers
+    QString etag = QString("\"%1-%2\"").arg(fi.size(), 0, 16).arg(
+            fi.lastModified().toMSecsSinceEpoch(), 0, 16);
+    QString lastModified = QLocale::c().toString(
+            fi.lastModified().toUTC(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+
+    bool notModified = false;
+    if (!request.ifNoneMatch.isEmpty())
+        notModified = request.ifNoneMatch == etag;
+    else if (!request.ifModifiedSince.isEmpty())
+        notModified = request.ifModifiedSince == lastModified;
+
+    qint64 start = 0, length = size;
+    if (request.isPartial()) {
+        start = request.rangeStart;
+        length = (request.rangeEnd >= 0 ?
+                qMin(request.rangeEnd + 1, size) : size) - start;
+    }
+
+    QIODevice* result = nullptr;
+    if (request.httpMethod != "GET" && request.httpMethod != "HEAD") {
+        response->statusCode = 405;
+    } else if (!fi.isFile()) {
+        response->statusCode = 404;
+    } else if (notModified) {
+        response->statusCode = 304;
+        response->etag = etag;
+        response->lastModified = lastModified;
+    } else if (length <= 0 && request.isPartial()) {
+        response->statusCode = 416;
+    } else {
+        response->statusCode = request.isPartial() ? 206 : 200;
+        response->mimeType = body.suffix().toLower() == "xml" ?
+                "text/xml" : "application/octet-stream";
+        response->contentLength = length;
+        response->acceptRanges = true;
+        response->etag = etag;
+        response->lastModified = lastModified;
+
+        if (request.httpMethod == "GET") {
+            FileRangeDevice* d = new FileRangeDevice(body.absoluteFilePath());
+            QString err = d->openRange(start, length);
+            if (err.isEmpty())
+                result = d;
+            else {
+                job->setErrorMessage(err);
+                delete d;
+            }
+        }
+    }
+
+    // no content
+    if (!result && job->getErrorMessage().isEmpty()) {
+        QBuffer* b = new QBuffer();
+        b->open(QIODevice::ReadOnly);
+        result = b;
+    }
+
+    return result;
+}
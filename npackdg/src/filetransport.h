@@ -0,0 +1,30 @@
+#ifndef FILETRANSPORT_H
+#define FILETRANSPORT_H
+
+#include <QString>
+
+#include "abstracttransport.h"
+
+/**
+ * @brief local stand-in for an HTTP server. The path of an http: or https:
+ *     URL is mapped to a file under a root directory. The host name is
+ *     ignored. GET and HEAD, "Range", "If-None-Match" and "If-Modified-Since"
+ *     are supported. A delta <file>.<SHA-1>.delta is sent instead of the
+ *     file for the header RepositoryDelta::HEADER with this SHA-1. This
+ *     transport is used for tests and benchmarks that should not depend on
+ *     the network.
+ */
+class FileTransport: public AbstractTransport
+{
+    QString root;
+public:
+    /**
+     * @param root root directory
+     */
+    explicit FileTransport(const QString& root);
+
+    QIODevice* open(Job* job, const Downloader::Request& request,
+            Downloader::Response* response, bool* gzip) override;
+};
+
+#endif // FILETRANSPORT_H
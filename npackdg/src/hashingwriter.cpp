@@ -0,0 +1,148 @@
+#include "hashingwriter.h"
+
+HashingWriter::WriterThread::WriterThread(HashingWriter* writer):
+        writer(writer)
+{
+}
+
+void HashingWriter::WriterThread::run()
+{
+    writer->write();
+}
+
+HashingWriter::HashingWriter(QFile* file, QCryptographicHash* hash,
+        int64_t size, int count): file(file), hash(hash), produced(0),
+        written(0), hashed(0), finished(false), writerThread(nullptr),
+        bytesWritten(0)
+{
+    // only writing to a file can overlap with the producer
+    bool background = file && size >= MIN_BACKGROUND_SIZE;
+    if (!background)
+        count = 1;
+
+    for (int i = 0; i < count; i++) {
+        buffers.append(new char[BUFFER_SIZE]);
+        lengths.append(0);
+    }
+
+    if (background) {
+        writerThread = new WriterThread(this);
+        writerThread->start();
+    }
+}
+
+HashingWriter::~HashingWriter()
+{
+    finish();
+    for (int i = 0; i < buffers.size(); i++)
+        delete[] buffers.at(i);
+}
+
+void HashingWriter::write()
+{
+    mutex.lock();
+    while (true) {
+        if (written < produced) {
+            int slot = static_cast<int>(written % buffers.size());
+            char* buffer = buffers.at(slot);
+            int length = lengths.at(slot);
+            mutex.unlock();
+
+            QString err;
+            if (file->write(buffer, length) < 0)
+                err = file->errorString();
+
+            mutex.lock();
+            if (!err.isEmpty()) {
+                error = err;
+                break;
+            }
+            written++;
+            bytesWritten += length;
+            spaceAvailable.wakeAll();
+        } else if (finished) {
+            break;
+        } else {
+            dataAvailable.wait(&mutex);
+        }
+    }
+    spaceAvailable.wakeAll();
+    mutex.unlock();
+}
+
+void HashingWriter::hashWritten(int64_t limit)
+{
+    // the buffers up to "limit" are not changed until they are hashed as
+    // only the calling thread fills them
+    while (hashed < limit) {
+        int slot = static_cast<int>(hashed % buffers.size());
+        if (hash)
+            hash->addData(buffers.at(slot), lengths.at(slot));
+        hashed++;
+    }
+}
+
+char* HashingWriter::nextBuffer()
+{
+    if (!writerThread)
+        return error.isEmpty() ? buffers.at(0) : nullptr;
+
+    char* r = nullptr;
+
+    mutex.lock();
+    while (error.isEmpty() && produced - written >= buffers.size())
+        spaceAvailable.wait(&mutex);
+    int64_t limit = written;
+    if (error.isEmpty())
+        r = buffers.at(static_cast<int>(produced % buffers.size()));
+    mutex.unlock();
+
+    // the free buffer may still contain data that was not yet hashed
+    hashWritten(limit);
+
+    return r;
+}
+
+void HashingWriter::commit(int length)
+{
+    if (!writerThread) {
+        char* buffer = buffers.at(0);
+        if (file && file->write(buffer, length) < 0) {
+            error = file->errorString();
+        } else {
+            if (hash)
+                hash->addData(buffer, length);
+            bytesWritten += length;
+        }
+        return;
+    }
+
+    mutex.lock();
+    lengths[static_cast<int>(produced % buffers.size())] = length;
+    produced++;
+    dataAvailable.wakeAll();
+    mutex.unlock();
+}
+
+QString HashingWriter::finish()
+{
+    if (writerThread) {
+        mutex.lock();
+        finished = true;
+        dataAvailable.wakeAll();
+        mutex.unlock();
+
+        writerThread->wait();
+        delete writerThread;
+        writerThread = nullptr;
+
+        hashWritten(written);
+    }
+
+    return error;
+}
+
+int64_t HashingWriter::getBytesWritten() const
+{
+    return bytesWritten;
+}
@@ -0,0 +1,143 @@
+#ifndef HASHINGWRITER_H
+#define HASHINGWRITER_H
+
+#include <stdint.h>
+
+#include <QFile>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCryptographicHash>
+#include <QThread>
+
+/**
+ * @brief writes data to a file and updates a hash sum. The data of a large
+ *     file is passed through a ring of buffers: the calling thread fills the
+ *     buffers (e.g. reading from the network) and one background thread
+ *     writes them to the file. The hash sum is updated in the calling thread
+ *     and only with the data that was already written so that an interrupted
+ *     download can be continued.
+ *
+ * Small amounts of data and data without a file are processed in the calling
+ * thread using only one buffer as the thread would cost more than it saves.
+ *
+ * Usage:
+ *     char* b = w.nextBuffer(); ... w.commit(len); ... err = w.finish();
+ */
+class HashingWriter
+{
+    /**
+     * @brief writes the committed buffers to the file
+     */
+    class WriterThread: public QThread
+    {
+    public:
+        HashingWriter* writer;
+
+        explicit WriterThread(HashingWriter* writer);
+
+        void run();
+    };
+
+    QFile* file;
+    QCryptographicHash* hash;
+    QVector<char*> buffers;
+    QVector<int> lengths;
+
+    QMutex mutex;
+
+    /** new data was committed or no more data will be committed */
+    QWaitCondition dataAvailable;
+
+    /** a buffer was written or the writer thread has exited */
+    QWaitCondition spaceAvailable;
+
+    /** number of committed buffers */
+    int64_t produced;
+
+    /** number of written buffers */
+    int64_t written;
+
+    /**
+     * number of buffers added to the hash sum. Only accessed by the calling
+     * thread.
+     */
+    int64_t hashed;
+
+    /** true = no more data will be committed */
+    bool finished;
+
+    /** nullptr = the data is processed in the calling thread */
+    WriterThread* writerThread;
+
+    int64_t bytesWritten;
+
+    QString error;
+
+    /**
+     * @brief writes the buffers until finish() is called or an error occurs.
+     *     Executed by the writer thread.
+     */
+    void write();
+
+    /**
+     * @brief updates the hash sum with the buffers written so far
+     * @param limit number of written buffers
+     */
+    void hashWritten(int64_t limit);
+public:
+    /** size of one buffer */
+    static const int BUFFER_SIZE = 512 * 1024;
+
+    /**
+     * smaller amounts of data or data with an unknown size are processed in
+     *     the calling thread
+     */
+    static const int64_t MIN_BACKGROUND_SIZE = 4 * BUFFER_SIZE;
+
+    /**
+     * @param file 0 or the output file. The file should not be accessed
+     *     until finish() is called.
+     * @param hash [ownership:caller] 0 or the hash sum that will be updated
+     * @param size expected number of bytes or -1 if unknown. The background
+     *     thread is only used for a file with at least MIN_BACKGROUND_SIZE
+     *     bytes.
+     * @param count number of buffers in the ring
+     */
+    HashingWriter(QFile* file, QCryptographicHash* hash, int64_t size,
+            int count=4);
+
+    /**
+     * @brief calls finish()
+     */
+    ~HashingWriter();
+
+    /**
+     * @brief blocks until a buffer is free
+     * @return a buffer with BUFFER_SIZE bytes or 0 if an error occured. The
+     *     buffer should be passed to commit().
+     */
+    char* nextBuffer();
+
+    /**
+     * @brief passes the buffer returned by the last call to nextBuffer() to
+     *     the writer thread
+     * @param length number of valid bytes in the buffer
+     */
+    void commit(int length);
+
+    /**
+     * @brief waits until all committed data is processed
+     * @return error message or ""
+     */
+    QString finish();
+
+    /**
+     * @return number of bytes written to the file or processed if there is
+     *     no file. The hash sum was updated with exactly this data. Only
+     *     valid after finish().
+     */
+    int64_t getBytesWritten() const;
+};
+
+#endif // HASHINGWRITER_H
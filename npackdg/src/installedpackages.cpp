@@ -3,6 +3,7 @@
 #include <windows.h>
 #include <msi.h>
 #include <memory>
+#include <algorithm>
 #include <shlobj.h>
 
 #include <QtGlobal>
@@ -32,6 +33,8 @@
 #include "dbrepository.h"
 #include "packageutils.h"
 #include "wuathirdpartypm.h"
+#include "registryinstalledpackagesstorage.h"
+#include "stringpool.h"
 
 InstalledPackages InstalledPackages::def;
 
@@ -42,55 +45,104 @@ InstalledPackages* InstalledPackages::getDefault()
     return &def;
 }
 
-InstalledPackages::InstalledPackages() : mutex(QMutex::Recursive)
+InstalledPackages::DetectionContext::DetectionContext() :
+        is64BitWindows(false)
+{
+}
+
+InstalledPackages::DetectionContext::~DetectionContext()
+{
+    qDeleteAll(all);
+}
+
+InstalledPackages::InstalledPackages() : mutex(QMutex::Recursive),
+        storage(new RegistryInstalledPackagesStorage()), loaded(false),
+        updating(0), unpublished(false), snapshot(new Snapshot())
 {
 }
 
 InstalledPackages::InstalledPackages(const InstalledPackages &other) :
-        QObject(), mutex(QMutex::Recursive)
+        QObject(), mutex(QMutex::Recursive),
+        storage(new RegistryInstalledPackagesStorage()), loaded(false),
+        updating(0), unpublished(false), snapshot(new Snapshot())
 {
     *this = other;
 }
 
+void InstalledPackages::setStorage(AbstractInstalledPackagesStorage* storage)
+{
+    this->mutex.lock();
+    this->storage.reset(storage);
+    this->loaded = false;
+    this->mutex.unlock();
+}
+
+void InstalledPackages::markDirtyNoCopy(const QString& package,
+        const Version& version)
+{
+    // internal method, mutex is not used
+
+    QString id = PackageVersion::getStringId(package, version);
+    this->dirty.insert(id, qMakePair(package, version));
+    this->unpublishedIds.insert(id);
+}
+
 InstalledPackages &InstalledPackages::operator=(const InstalledPackages &other)
 {
+    if (this == &other)
+        return *this;
+
     qCDebug(npackd) << "Setting installed packages";
     this->dump();
 
     other.dump();
 
-    QList<InstalledPackageVersion*> myInfos = getAll();
-    for (int i = 0; i < myInfos.size(); i++) {
-        InstalledPackageVersion* myIpv = myInfos.at(i);
-        InstalledPackageVersion* otherIpv = other.find(
-                myIpv->package, myIpv->version);
-
-        if (!otherIpv) {
-            setPackageVersionPath(myIpv->package,
-                    myIpv->version, "", false);
-        } else if (*myIpv != *otherIpv) {
-            setOne(*otherIpv);
-        }
-
-        delete otherIpv;
-    }
-    qDeleteAll(myInfos);
-    myInfos.clear();
-
+    // the other entries are copied first so that both mutexes are never
+    // locked at the same time
     QList<InstalledPackageVersion*> otherInfos = other.getAll();
+    QMap<QString, InstalledPackageVersion*> otherData;
     for (int i = 0; i < otherInfos.size(); i++) {
         InstalledPackageVersion* otherIpv = otherInfos.at(i);
-        InstalledPackageVersion* myIpv = find(
-                otherIpv->package, otherIpv->version);
+        otherData.insert(PackageVersion::getStringId(otherIpv->package,
+                otherIpv->version), otherIpv);
+    }
 
-        if (!myIpv) {
-            setOne(*otherIpv);
+    QList<QPair<QString, Version> > changed;
+
+    this->mutex.lock();
+
+    for (QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            this->data.constBegin(); it != this->data.constEnd(); ++it) {
+        InstalledPackageVersion* myIpv = it.value();
+        if (myIpv->installed() && !otherData.contains(it.key())) {
+            setPathNoCopy(myIpv, QString());
+            changed.append(qMakePair(myIpv->package, myIpv->version));
         }
+    }
 
-        delete myIpv;
+    for (QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            otherData.constBegin(); it != otherData.constEnd(); ++it) {
+        InstalledPackageVersion* otherIpv = it.value();
+        InstalledPackageVersion* myIpv = this->data.value(it.key());
+        if (!myIpv) {
+            insertNoCopy(otherIpv->clone());
+            changed.append(qMakePair(otherIpv->package, otherIpv->version));
+        } else if (*myIpv != *otherIpv) {
+            assignNoCopy(myIpv, *otherIpv);
+            changed.append(qMakePair(otherIpv->package, otherIpv->version));
+        }
     }
+
+    if (!changed.isEmpty())
+        publishNoCopy();
+
+    this->mutex.unlock();
+
     qDeleteAll(otherInfos);
-    otherInfos.clear();
+
+    for (int i = 0; i < changed.size(); i++) {
+        fireStatusChanged(changed.at(i).first, changed.at(i).second);
+    }
 
     return *this;
 }
@@ -98,9 +150,179 @@ InstalledPackages &InstalledPackages::operator=(const InstalledPackages &other)
 InstalledPackages::~InstalledPackages()
 {
     this->mutex.lock();
+    clearNoCopy();
+    this->mutex.unlock();
+}
+
+QString InstalledPackages::getDirectoryKey(const QString& directory)
+{
+    return WPMUtils::normalizePath(directory, true);
+}
+
+void InstalledPackages::insertNoCopy(InstalledPackageVersion* ipv)
+{
+    // internal method, mutex is not used
+
+    // the entries are kept for the whole run and share the names and paths
+    ipv->package = StringPool::intern(ipv->package);
+    ipv->setPath(StringPool::intern(ipv->getDirectory()));
+
+    this->data.insert(PackageVersion::getStringId(ipv->package, ipv->version),
+            ipv);
+    markDirtyNoCopy(ipv->package, ipv->version);
+
+    QList<InstalledPackageVersion*>& versions = this->byPackage[ipv->package];
+    QList<InstalledPackageVersion*>::iterator it = std::upper_bound(
+            versions.begin(), versions.end(), ipv,
+            [](const InstalledPackageVersion* a,
+            const InstalledPackageVersion* b) {
+        return a->version < b->version;
+    });
+    versions.insert(it, ipv);
+
+    if (ipv->installed())
+        this->byDirectory.insert(getDirectoryKey(ipv->getDirectory()), ipv);
+}
+
+void InstalledPackages::removeNoCopy(InstalledPackageVersion* ipv)
+{
+    // internal method, mutex is not used
+
+    this->data.remove(PackageVersion::getStringId(ipv->package,
+            ipv->version));
+    markDirtyNoCopy(ipv->package, ipv->version);
+
+    QHash<QString, QList<InstalledPackageVersion*> >::iterator it =
+            this->byPackage.find(ipv->package);
+    if (it != this->byPackage.end()) {
+        it->removeOne(ipv);
+        if (it->isEmpty())
+            this->byPackage.erase(it);
+    }
+
+    if (ipv->installed())
+        this->byDirectory.remove(getDirectoryKey(ipv->getDirectory()), ipv);
+}
+
+void InstalledPackages::assignNoCopy(InstalledPackageVersion* ipv,
+        const InstalledPackageVersion& other)
+{
+    // internal method, mutex is not used
+
+    if (ipv->installed())
+        this->byDirectory.remove(getDirectoryKey(ipv->getDirectory()), ipv);
+
+    *ipv = other;
+    markDirtyNoCopy(ipv->package, ipv->version);
+
+    if (ipv->installed())
+        this->byDirectory.insert(getDirectoryKey(ipv->getDirectory()), ipv);
+}
+
+void InstalledPackages::setPathNoCopy(InstalledPackageVersion* ipv,
+        const QString& directory)
+{
+    // internal method, mutex is not used
+
+    if (ipv->installed())
+        this->byDirectory.remove(getDirectoryKey(ipv->getDirectory()), ipv);
+
+    ipv->setPath(StringPool::intern(directory));
+    markDirtyNoCopy(ipv->package, ipv->version);
+
+    if (ipv->installed())
+        this->byDirectory.insert(getDirectoryKey(ipv->getDirectory()), ipv);
+}
+
+void InstalledPackages::publishNoCopy()
+{
+    // internal method, mutex is not used
+
+    if (this->updating > 0) {
+        this->unpublished = true;
+        return;
+    }
+
+    std::shared_ptr<const Snapshot> old = getSnapshot();
+
+    Snapshot* s = new Snapshot();
+    s->byId.reserve(this->byDirectory.size());
+    s->byDirectory.reserve(this->byDirectory.size());
+    for (QMultiHash<QString, InstalledPackageVersion*>::const_iterator it =
+            this->byDirectory.constBegin();
+            it != this->byDirectory.constEnd(); ++it) {
+        InstalledPackageVersion* ipv = it.value();
+        QString id = PackageVersion::getStringId(ipv->package, ipv->version);
+
+        // unchanged entries are shared with the previous snapshot
+        std::shared_ptr<const InstalledPackageVersion> e;
+        if (!this->unpublishedIds.contains(id))
+            e = old->byId.value(id);
+        if (!e)
+            e.reset(ipv->clone());
+
+        s->byId.insert(id, e);
+        s->byDirectory.insert(it.key(), e);
+    }
+
+    for (QHash<QString, QList<InstalledPackageVersion*> >::const_iterator it =
+            this->byPackage.constBegin(); it != this->byPackage.constEnd();
+            ++it) {
+        const QList<InstalledPackageVersion*>& versions = it.value();
+        QList<std::shared_ptr<const InstalledPackageVersion> > installed;
+        for (int i = 0; i < versions.count(); i++) {
+            InstalledPackageVersion* ipv = versions.at(i);
+            if (ipv->installed())
+                installed.append(s->byId.value(PackageVersion::getStringId(
+                        ipv->package, ipv->version)));
+        }
+        if (!installed.isEmpty())
+            s->byPackage.insert(it.key(), installed);
+    }
+
+    this->unpublishedIds.clear();
+
+    std::atomic_store(&this->snapshot,
+            std::shared_ptr<const Snapshot>(s));
+}
+
+void InstalledPackages::beginUpdate()
+{
+    this->mutex.lock();
+    this->updating++;
+    this->mutex.unlock();
+}
+
+void InstalledPackages::endUpdate()
+{
+    this->mutex.lock();
+    this->updating--;
+    if (this->updating == 0 && this->unpublished) {
+        this->unpublished = false;
+        publishNoCopy();
+    }
+    this->mutex.unlock();
+}
+
+std::shared_ptr<const InstalledPackages::Snapshot>
+        InstalledPackages::getSnapshot() const
+{
+    return std::atomic_load(&this->snapshot);
+}
+
+void InstalledPackages::clearNoCopy()
+{
+    // internal method, mutex is not used
+
+    for (QMap<QString, InstalledPackageVersion*>::const_iterator it =
+            this->data.constBegin(); it != this->data.constEnd(); ++it) {
+        markDirtyNoCopy(it.value()->package, it.value()->version);
+    }
+
     qDeleteAll(this->data);
     this->data.clear();
-    this->mutex.unlock();
+    this->byPackage.clear();
+    this->byDirectory.clear();
 }
 
 InstalledPackageVersion* InstalledPackages::findNoCopy(const QString& package,
@@ -131,31 +353,40 @@ InstalledPackageVersion* InstalledPackages::find(const QString& package,
 
 QList<InstalledPackageVersion *> InstalledPackages::findAllInstalledMatches(const Dependency &dep) const
 {
+    this->mutex.lock();
+
     QList<InstalledPackageVersion*> r;
-    QList<InstalledPackageVersion*> installed = getAll();
-    for (int i = 0; i < installed.count(); i++) {
-        InstalledPackageVersion* ipv = installed.at(i);
-        if (ipv->package == dep.package &&
-                dep.test(ipv->version)) {
+    const QList<InstalledPackageVersion*> versions =
+            this->byPackage.value(dep.package);
+    for (int i = 0; i < versions.count(); i++) {
+        InstalledPackageVersion* ipv = versions.at(i);
+        if (ipv->installed() && dep.test(ipv->version)) {
             r.append(ipv->clone());
         }
     }
-    qDeleteAll(installed);
+
+    this->mutex.unlock();
+
     return r;
 }
 
 InstalledPackageVersion *InstalledPackages::findHighestInstalledMatch(const Dependency &dep) const
 {
-    QList<InstalledPackageVersion*> list = findAllInstalledMatches(dep);
+    this->mutex.lock();
+
+    // the versions are sorted in ascending order
     InstalledPackageVersion* res = nullptr;
-    for (int i = 0; i < list.count(); i++) {
-        InstalledPackageVersion* ipv = list.at(i);
-        if (res == nullptr || ipv->version.compare(res->version) > 0)
-            res = ipv;
+    const QList<InstalledPackageVersion*> versions =
+            this->byPackage.value(dep.package);
+    for (int i = versions.count() - 1; i >= 0; i--) {
+        InstalledPackageVersion* ipv = versions.at(i);
+        if (ipv->installed() && dep.test(ipv->version)) {
+            res = ipv->clone();
+            break;
+        }
     }
-    if (res)
-        res = res->clone();
-    qDeleteAll(list);
+
+    this->mutex.unlock();
 
     return res;
 }
@@ -210,48 +441,239 @@ QString InstalledPackages::updateNpackdCLEnvVar()
 
 void InstalledPackages::detect3rdParty(Job* job, DBRepository* r,
         const QList<InstalledPackageVersion*>& installed,
-        const QString& detectionInfoPrefix)
+        const AbstractThirdPartyPM* tpm, DetectionJournal* journal)
 {
     // this method does not manipulate "data" directly => no locking
 
+    QString detectionInfoPrefix = tpm->detectionPrefix;
+    bool useJournal = journal && !detectionInfoPrefix.isEmpty();
+
+    // getPath() and isInstalled() see the changes only at the end
+    beginUpdate();
+
+    QSet<QString> foundDetectionInfos;
+    for (int i = 0; i < installed.count(); i++) {
+        InstalledPackageVersion* ipv = installed.at(i);
+        foundDetectionInfos.insert(ipv->detectionInfo);
+    }
+
     // if all installed package versions created by a third party
     // package managers have a detection info with the same prefix,
     // we can delete already existing installed package versions if
     // they are not in the list of currently detected
     if (job->shouldProceed()) {
-        if (!detectionInfoPrefix.isEmpty()) {
-            QSet<QString> foundDetectionInfos;
-            for (int i = 0; i < installed.count(); i++) {
-                InstalledPackageVersion* ipv = installed.at(i);
-                foundDetectionInfos.insert(ipv->detectionInfo);
-            }
+        if (!detectionInfoPrefix.isEmpty())
+            reset3rdParty(detectionInfoPrefix, foundDetectionInfos);
+    }
 
-            QList<InstalledPackageVersion*> all = getAll();
-            for (int i = 0; i < all.size(); i++) {
-                InstalledPackageVersion* ipv = all.at(i);
-                if (ipv->detectionInfo.startsWith(detectionInfoPrefix)) {
-                    if (!foundDetectionInfos.contains(ipv->detectionInfo)) {
-                        this->setPackageVersionPath(ipv->package, ipv->version, QString());
-                    }
-                }
+    if (job->shouldProceed()) {
+        DetectionContext context;
+        context.windowsDir = WPMUtils::getWindowsDir();
+        context.programFilesDir = WPMUtils::getProgramFilesDir();
+        context.programFilesX86Dir = WPMUtils::getShellDir(
+                CSIDL_PROGRAM_FILESX86);
+        context.is64BitWindows = WPMUtils::is64BitWindows();
+        context.all = getAll();
+
+        // entries with an unchanged fingerprint are not processed again
+        QStringList fingerprints;
+        QList<DetectionJournal::Entry> entries;
+        QList<bool> journaled;
+        QStringList names;
+        for (int i = 0; i < installed.count(); i++) {
+            InstalledPackageVersion* ipv = installed.at(i);
+            DetectionJournal::Entry entry;
+            bool f = false;
+            if (useJournal) {
+                fingerprints.append(DetectionJournal::computeFingerprint(
+                        tpm, *ipv));
+                f = journal->find(detectionInfoPrefix, ipv->detectionInfo,
+                        fingerprints.last(), &entry);
+            } else {
+                fingerprints.append(QString());
             }
-            qDeleteAll(all);
+            entries.append(entry);
+            journaled.append(f);
+            if (!f)
+                names.append(ipv->package);
         }
-    }
 
-    if (job->shouldProceed()) {
+        // all generic package names are replaced at once
+        QString err;
+        context.betterNames = r->findBetterPackageNames(names, &err);
+        if (err.isEmpty())
+            context.searched = names.toSet();
+        else
+            qCWarning(npackd).noquote() << err;
+
+        int replayed = 0;
         for (int i = 0; i < installed.count(); i++) {
             InstalledPackageVersion* ipv = installed.at(i);
 
-            processOneInstalled3rdParty(r, ipv, detectionInfoPrefix);
+            bool done = false;
+            if (journaled.at(i)) {
+                done = replayOneInstalled3rdParty(r, ipv, entries.at(i),
+                        &context);
+                if (done)
+                    replayed++;
+            }
+
+            if (!done) {
+                InstalledPackageVersion* result = processOneInstalled3rdParty(
+                        r, ipv, detectionInfoPrefix, &context);
+                if (result) {
+                    if (useJournal) {
+                        DetectionJournal::Entry entry;
+                        entry.fingerprint = fingerprints.at(i);
+                        entry.package = result->package;
+                        entry.version = result->version;
+                        entry.directory = result->getDirectory();
+                        journal->record(detectionInfoPrefix,
+                                ipv->detectionInfo, entry);
+                    }
+                    context.all.append(result);
+                } else if (useJournal) {
+                    journal->remove(detectionInfoPrefix, ipv->detectionInfo);
+                }
+            }
 
             job->setProgress((i + 1.0) / installed.size());
         }
+
+        if (useJournal) {
+            journal->retain(detectionInfoPrefix, foundDetectionInfos);
+
+            qCDebug(npackd) << "InstalledPackages::detect3rdParty" <<
+                    detectionInfoPrefix << replayed << "of" <<
+                    installed.count() << "entries were not changed";
+        }
     }
 
+    endUpdate();
+
     job->complete();
 }
 
+void InstalledPackages::reset3rdParty(const QString& detectionInfoPrefix,
+        const QSet<QString>& keep)
+{
+    QList<InstalledPackageVersion*> all = getAll();
+    for (int i = 0; i < all.size(); i++) {
+        InstalledPackageVersion* ipv = all.at(i);
+        if (ipv->detectionInfo.startsWith(detectionInfoPrefix)) {
+            if (!keep.contains(ipv->detectionInfo)) {
+                this->setPackageVersionPath(ipv->package, ipv->version, QString());
+            }
+        }
+    }
+    qDeleteAll(all);
+}
+
+bool InstalledPackages::replay3rdParty(DBRepository* r,
+        const AbstractThirdPartyPM* tpm, const DetectionJournal& journal)
+{
+    // this method does not manipulate "data" directly => no locking
+
+    QString detectionInfoPrefix = tpm->detectionPrefix;
+    QMap<QString, DetectionJournal::Entry> entries =
+            journal.getEntries(detectionInfoPrefix);
+
+    beginUpdate();
+
+    reset3rdParty(detectionInfoPrefix, entries.keys().toSet());
+
+    DetectionContext context;
+    context.all = getAll();
+
+    bool ok = true;
+    for (QMap<QString, DetectionJournal::Entry>::const_iterator it =
+            entries.constBegin(); it != entries.constEnd(); ++it) {
+        InstalledPackageVersion found(it->package, it->version, QString());
+        found.detectionInfo = it.key();
+        if (!replayOneInstalled3rdParty(r, &found, it.value(), &context)) {
+            ok = false;
+            break;
+        }
+    }
+
+    // the package versions will be detected again
+    if (!ok)
+        reset3rdParty(detectionInfoPrefix, QSet<QString>());
+
+    qCDebug(npackd) << "InstalledPackages::replay3rdParty" <<
+            detectionInfoPrefix << entries.size() << "entries" << ok;
+
+    endUpdate();
+
+    return ok;
+}
+
+bool InstalledPackages::replayOneInstalled3rdParty(DBRepository *r,
+        const InstalledPackageVersion* found,
+        const DetectionJournal::Entry& entry,
+        DetectionContext* context)
+{
+    QString d = entry.directory;
+
+    // the directory could have been deleted
+    bool ok = !d.isEmpty() && QDir().exists(d);
+
+    // the package version is already installed
+    if (ok) {
+        InstalledPackageVersion* existing = find(entry.package, entry.version);
+        if (existing && existing->installed())
+            ok = false;
+        delete existing;
+    }
+
+    // another package was installed in a nested directory
+    if (ok) {
+        const QList<InstalledPackageVersion*>& all = context->all;
+        for (int i = 0; i < all.size(); i++) {
+            QString other = all.at(i)->getDirectory();
+            if (!other.isEmpty() && (WPMUtils::isUnderOrEquals(d, other) ||
+                    WPMUtils::isUnderOrEquals(other, d))) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // the package version was created in a database that was replaced since
+    // then
+    if (ok) {
+        QString err;
+        std::unique_ptr<PackageVersion> pv(r->findPackageVersion_(
+                entry.package, entry.version, &err));
+        ok = err.isEmpty() && pv;
+    }
+
+    if (ok) {
+        // the snapshot is published once for the whole batch in
+        // detect3rdParty()
+        this->mutex.lock();
+        QString err;
+        InstalledPackageVersion* ipv2 = this->findOrCreate(entry.package,
+                entry.version, &err);
+        ok = err.isEmpty();
+        if (ok) {
+            ipv2->detectionInfo = found->detectionInfo;
+            setPathNoCopy(ipv2, d);
+            context->all.append(ipv2->clone());
+        }
+        this->mutex.unlock();
+    }
+
+    if (ok) {
+        const InstalledPackageVersion* ipv2 = context->all.last();
+        qCDebug(npackd) << "InstalledPackages::replayOneInstalled3rdParty" <<
+                ipv2->package << ipv2->version.getVersionString() <<
+                ipv2->getDirectory() << ipv2->detectionInfo;
+    }
+
+    return ok;
+}
+
 void InstalledPackages::addPackages(Job* job, DBRepository* r,
         Repository* rep,
         const QList<InstalledPackageVersion*>& installed,
@@ -328,8 +750,9 @@ QString InstalledPackages::findBetterPackageName(DBRepository *r,
     return result;
 }
 
-void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
-        const InstalledPackageVersion* found, const QString& detectionInfoPrefix)
+InstalledPackageVersion* InstalledPackages::processOneInstalled3rdParty(
+        DBRepository *r, const InstalledPackageVersion* found,
+        const QString& detectionInfoPrefix, DetectionContext* context)
 {
     // this is a consistent output place for all packages detected by
     // third party package managers and should be kept for eventual
@@ -348,8 +771,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
 
     // if we already have a package version detected, we just use the directory
     if (!detectionInfoPrefix.isEmpty()) {
-        InstalledPackageVersion* orig = InstalledPackages::getDefault()->
-                find(ipv.package, ipv.version);
+        InstalledPackageVersion* orig = find(ipv.package, ipv.version);
         if (orig) {
             d = orig->getDirectory();
             delete orig;
@@ -368,7 +790,11 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
     // trying to find an existing "real" package name
     // instead of a generic "msi.xxx" or "control-panel.xxx"
     if (err.isEmpty()) {
-        QString b = findBetterPackageName(r, ipv.package);
+        QString b;
+        if (context->searched.contains(ipv.package))
+            b = context->betterNames.value(ipv.package);
+        else
+            b = findBetterPackageName(r, ipv.package);
         if (!b.isEmpty()) {
             ipv.package = b;
         }
@@ -383,7 +809,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         delete existing;
     }
 
-    QString windowsDir = WPMUtils::getWindowsDir();
+    const QString& windowsDir = context->windowsDir;
 
     // ancestor of the Windows directory
     if (err.isEmpty()) {
@@ -412,7 +838,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         }
     }
 
-    QString programFilesDir = WPMUtils::getProgramFilesDir();
+    const QString& programFilesDir = context->programFilesDir;
 
     // ancestor of "C:\Program Files"
     if (err.isEmpty()) {
@@ -422,11 +848,11 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         }
     }
 
-    QString programFilesX86Dir = WPMUtils::getShellDir(CSIDL_PROGRAM_FILESX86);
+    const QString& programFilesX86Dir = context->programFilesX86Dir;
 
     // ancestor of "C:\Program Files (x86)"
     if (err.isEmpty()) {
-        if (!d.isEmpty() && WPMUtils::is64BitWindows() &&
+        if (!d.isEmpty() && context->is64BitWindows &&
                 (WPMUtils::isUnder(programFilesX86Dir, d) ||
                 WPMUtils::pathEquals(d,
                 programFilesX86Dir))) {
@@ -439,7 +865,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
     // we cannot handle nested directories
     if (err.isEmpty()) {
         if (!d.isEmpty()) {
-            QList<InstalledPackageVersion*> all = this->getAll();
+            const QList<InstalledPackageVersion*>& all = context->all;
 
             for (int i = 0; i < all.size(); i++) {
                 InstalledPackageVersion* v = all.at(i);
@@ -471,8 +897,6 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
                     break;
                 }
             }
-
-            qDeleteAll(all);
         }
     }
 
@@ -514,7 +938,7 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         Package* p = r->findPackage_(ipv.package);
 
         d = WPMUtils::normalizePath(
-                WPMUtils::getProgramFilesDir(),
+                programFilesDir,
                 false) +
                 "\\NpackdDetected\\" +
                 WPMUtils::makeValidFilename(p ? p->title : ipv.package, '_');
@@ -534,13 +958,18 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
     InstalledPackageVersion* ipv2 = nullptr;
     if (err.isEmpty()) {
         // qCDebug(npackd) << "    4";
-        ipv2 = this->findOrCreate(ipv.package, ipv.version, &err);
-    }
 
-    if (err.isEmpty()) {
-        // qCDebug(npackd) << "    5";
-        ipv2->detectionInfo = ipv.detectionInfo;
-        ipv2->setPath(d);
+        // the snapshot is published once for the whole batch in
+        // detect3rdParty()
+        this->mutex.lock();
+        InstalledPackageVersion* registered = this->findOrCreate(ipv.package,
+                ipv.version, &err);
+        if (err.isEmpty()) {
+            registered->detectionInfo = ipv.detectionInfo;
+            setPathNoCopy(registered, d);
+            ipv2 = registered->clone();
+        }
+        this->mutex.unlock();
     }
 
     // this is a consistent output place for all packages detected by
@@ -554,6 +983,8 @@ void InstalledPackages::processOneInstalled3rdParty(DBRepository *r,
         qCDebug(npackd) << "InstalledPackages::processOneInstalled3rdParty leave" <<
                 "error" << err;
     }
+
+    return ipv2;
 }
 
 InstalledPackageVersion* InstalledPackages::findOrCreate(const QString& package,
@@ -567,7 +998,7 @@ InstalledPackageVersion* InstalledPackages::findOrCreate(const QString& package,
     InstalledPackageVersion* r = this->data.value(key);
     if (!r) {
         r = new InstalledPackageVersion(package, version, "");
-        this->data.insert(key, r);
+        insertNoCopy(r);
     }
 
     return r;
@@ -586,16 +1017,22 @@ QString InstalledPackages::setPackageVersionPath(const QString& package,
     InstalledPackageVersion* ipv = this->findNoCopy(package, version);
     if (!ipv) {
         ipv = new InstalledPackageVersion(package, version, directory);
-        this->data.insert(package + "/" + version.getVersionString(), ipv);
+        insertNoCopy(ipv);
         changed = true;
     } else {
         if (ipv->getDirectory() != directory) {
-            ipv->setPath(directory);
+            setPathNoCopy(ipv, directory);
             changed = true;
         }
     }
-    if (updateRegistry)
-        err = saveToRegistry(ipv);
+    if (changed)
+        publishNoCopy();
+
+    if (updateRegistry) {
+        err = storage->save(QList<InstalledPackageVersion*>() << ipv);
+        if (err.isEmpty())
+            this->dirty.remove(PackageVersion::getStringId(package, version));
+    }
 
     this->mutex.unlock();
 
@@ -610,16 +1047,19 @@ InstalledPackageVersion *InstalledPackages::findOwner(
 {
     this->mutex.lock();
 
+    // the path and its parent directories are searched in the index. The
+    // nearest installation directory is returned.
     InstalledPackageVersion* f = nullptr;
-    QList<InstalledPackageVersion*> ipvs = this->data.values();
-    for (int i = 0; i < ipvs.count(); ++i) {
-        InstalledPackageVersion* ipv = ipvs.at(i);
-        QString dir = ipv->getDirectory();
-        if (!dir.isEmpty() && (WPMUtils::pathEquals(filePath, dir) ||
-                WPMUtils::isUnder(filePath, dir))) {
-            f = ipv;
+    QString key = getDirectoryKey(filePath);
+    while (!key.isEmpty()) {
+        f = this->byDirectory.value(key);
+        if (f)
             break;
-        }
+
+        int pos = key.lastIndexOf('\\');
+        if (pos < 0)
+            break;
+        key.truncate(pos);
     }
 
     if (f)
@@ -630,6 +1070,79 @@ InstalledPackageVersion *InstalledPackages::findOwner(
     return f;
 }
 
+std::shared_ptr<const InstalledPackageVersion>
+        InstalledPackages::findShared_(const QString& package,
+        const Version& version) const
+{
+    return getSnapshot()->byId.value(PackageVersion::getStringId(package,
+            version));
+}
+
+QList<std::shared_ptr<const InstalledPackageVersion> >
+        InstalledPackages::getByPackageShared_(const QString& package) const
+{
+    return getSnapshot()->byPackage.value(package);
+}
+
+std::shared_ptr<const InstalledPackageVersion>
+        InstalledPackages::getNewestInstalledShared_(
+        const QString& package) const
+{
+    std::shared_ptr<const Snapshot> s = getSnapshot();
+    const QList<std::shared_ptr<const InstalledPackageVersion> > versions =
+            s->byPackage.value(package);
+
+    // the versions are sorted in ascending order
+    return versions.isEmpty() ?
+            std::shared_ptr<const InstalledPackageVersion>() : versions.last();
+}
+
+std::shared_ptr<const InstalledPackageVersion>
+        InstalledPackages::findHighestInstalledMatchShared_(
+        const Dependency& dep) const
+{
+    std::shared_ptr<const Snapshot> s = getSnapshot();
+    const QList<std::shared_ptr<const InstalledPackageVersion> > versions =
+            s->byPackage.value(dep.package);
+
+    // the versions are sorted in ascending order
+    for (int i = versions.count() - 1; i >= 0; i--) {
+        if (dep.test(versions.at(i)->version))
+            return versions.at(i);
+    }
+
+    return std::shared_ptr<const InstalledPackageVersion>();
+}
+
+std::shared_ptr<const InstalledPackageVersion>
+        InstalledPackages::findOwnerShared_(const QString& filePath) const
+{
+    std::shared_ptr<const Snapshot> s = getSnapshot();
+
+    // the path and its parent directories are searched in the index. The
+    // nearest installation directory is returned.
+    QString key = getDirectoryKey(filePath);
+    while (!key.isEmpty()) {
+        std::shared_ptr<const InstalledPackageVersion> f =
+                s->byDirectory.value(key);
+        if (f)
+            return f;
+
+        int pos = key.lastIndexOf('\\');
+        if (pos < 0)
+            break;
+        key.truncate(pos);
+    }
+
+    return std::shared_ptr<const InstalledPackageVersion>();
+}
+
+QList<std::shared_ptr<const InstalledPackageVersion> >
+        InstalledPackages::getAllShared_() const
+{
+    return getSnapshot()->byId.values();
+}
+
 QList<InstalledPackageVersion*> InstalledPackages::getAll() const
 {
     this->mutex.lock();
@@ -652,11 +1165,12 @@ QList<InstalledPackageVersion *> InstalledPackages::getByPackage(
 {
     this->mutex.lock();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
+    const QList<InstalledPackageVersion*> versions =
+            this->byPackage.value(package);
     QList<InstalledPackageVersion*> r;
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed() && ipv->package == package)
+    for (int i = 0; i < versions.count(); i++) {
+        InstalledPackageVersion* ipv = versions.at(i);
+        if (ipv->installed())
             r.append(ipv->clone());
     }
 
@@ -669,14 +1183,14 @@ void InstalledPackages::remove(const QString &package)
 {
     this->mutex.lock();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->package == package) {
-            data.remove(PackageVersion::getStringId(package, ipv->version));
-            delete ipv;
-        }
+    const QList<InstalledPackageVersion*> versions =
+            this->byPackage.value(package);
+    for (int i = 0; i < versions.count(); i++) {
+        InstalledPackageVersion* ipv = versions.at(i);
+        removeNoCopy(ipv);
+        delete ipv;
     }
+    publishNoCopy();
 
     this->mutex.unlock();
 }
@@ -686,19 +1200,18 @@ InstalledPackageVersion* InstalledPackages::getNewestInstalled(
 {
     this->mutex.lock();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
+    // the versions are sorted in ascending order
+    const QList<InstalledPackageVersion*> versions =
+            this->byPackage.value(package);
     InstalledPackageVersion* r = nullptr;
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->package == package && ipv->installed()) {
-            if (!r || r->version < ipv->version)
-                r = ipv;
+    for (int i = versions.count() - 1; i >= 0; i--) {
+        InstalledPackageVersion* ipv = versions.at(i);
+        if (ipv->installed()) {
+            r = ipv->clone();
+            break;
         }
     }
 
-    if (r)
-        r = r->clone();
-
     this->mutex.unlock();
 
     return r;
@@ -706,30 +1219,33 @@ InstalledPackageVersion* InstalledPackages::getNewestInstalled(
 
 bool InstalledPackages::isInstalled(const Dependency& dep) const
 {
-    QList<InstalledPackageVersion*> installed = getAll();
-    bool res = false;
-    for (int i = 0; i < installed.count(); i++) {
-        InstalledPackageVersion* ipv = installed.at(i);
-        if (ipv->package == dep.package &&
-                dep.test(ipv->version)) {
-            res = true;
-            break;
-        }
+    // the snapshot is used without locking
+    std::shared_ptr<const Snapshot> s = getSnapshot();
+    const QList<std::shared_ptr<const InstalledPackageVersion> > versions =
+            s->byPackage.value(dep.package);
+    for (int i = 0; i < versions.count(); i++) {
+        if (dep.test(versions.at(i)->version))
+            return true;
     }
-    qDeleteAll(installed);
-    return res;
+
+    return false;
 }
 
 QSet<QString> InstalledPackages::getPackages() const
 {
     this->mutex.lock();
 
-    QList<InstalledPackageVersion*> all = this->data.values();
     QSet<QString> r;
-    for (int i = 0; i < all.count(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed())
-            r.insert(ipv->package);
+    for (QHash<QString, QList<InstalledPackageVersion*> >::const_iterator it =
+            this->byPackage.constBegin(); it != this->byPackage.constEnd();
+            ++it) {
+        const QList<InstalledPackageVersion*>& versions = it.value();
+        for (int i = 0; i < versions.count(); i++) {
+            if (versions.at(i)->installed()) {
+                r.insert(it.key());
+                break;
+            }
+        }
     }
 
     this->mutex.unlock();
@@ -840,6 +1356,9 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
 
     // no direct usage of "data" here => no mutex
 
+    // the whole detection is published once
+    beginUpdate();
+
     if (job->shouldProceed()) {
         clear();
         job->setProgress(0.2);
@@ -852,6 +1371,23 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
 
     // MSI package detection should happen before the detection for
     // control panel programs
+    // results of the previous detection. They are only valid for the same
+    // repository data.
+    DetectionJournal journal;
+    QString journalFile = DetectionJournal::getDefaultFile();
+    if (job->shouldProceed()) {
+        QString err = journal.load(journalFile);
+        if (!err.isEmpty())
+            qCDebug(npackd) << err;
+
+        QString context = rep->getRepositoriesFingerprint(&err);
+        if (err.isEmpty() && !context.isEmpty())
+            journal.setContext(QStringLiteral(NPACKD_VERSION) + '\n' +
+                    context);
+        else
+            journal.setContext(QString());
+    }
+
     if (job->shouldProceed()) {
         QList<AbstractThirdPartyPM*> tpms;
         QList<bool> replace;
@@ -887,6 +1423,22 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
             installeds.append(new QList<InstalledPackageVersion*>());
         }
 
+        // the sources that did not change since the last detection are
+        // neither scanned nor saved again. The fingerprints are computed
+        // before scanning so that a change during the scan is detected the
+        // next time.
+        QStringList sources;
+        QList<bool> unchanged;
+        for (int i = 0; i < tpms.count(); i++) {
+            AbstractThirdPartyPM* tpm = tpms.at(i);
+            QString source;
+            if (!tpm->detectionPrefix.isEmpty())
+                source = tpm->getSourcesFingerprint();
+            sources.append(source);
+            unchanged.append(!source.isEmpty() && source ==
+                    journal.getSourcesFingerprint(tpm->detectionPrefix));
+        }
+
         // detect everything in threads
         QList<QFuture<void> > futures;
         for (int i = 0; i < tpms.count(); i++) {
@@ -894,24 +1446,33 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
             Job* s = job->newSubJob(0.1,
                     jobTitles.at(i), false, tpm->detectionPrefix != "wua:"); // Windows Updates are not important
 
-            QFuture<void> future = QtConcurrent::run(
-                    tpm,
-                    &AbstractThirdPartyPM::scan, s,
-                    installeds.at(i), repositories.at(i));
-            futures.append(future);
+            if (unchanged.at(i)) {
+                s->completeWithProgress();
+                futures.append(QFuture<void>());
+            } else {
+                QFuture<void> future = QtConcurrent::run(
+                        tpm,
+                        &AbstractThirdPartyPM::scan, s,
+                        installeds.at(i), repositories.at(i));
+                futures.append(future);
+            }
         }
 
         // waiting for threads to end and store the detected
         // packages, versions and licenses
         for (int i = 0; i < futures.count(); i++) {
-            futures[i].waitForFinished();
+            if (!unchanged.at(i))
+                futures[i].waitForFinished();
 
             Job* sub = job->newSubJob(0.1,
                     QObject::tr("Saving detected packages %1").arg(i),
                     false, true);
-            addPackages(sub, rep, repositories.at(i),
-                    *installeds.at(i),
-                    replace.at(i));
+            if (unchanged.at(i))
+                sub->completeWithProgress();
+            else
+                addPackages(sub, rep, repositories.at(i),
+                        *installeds.at(i),
+                        replace.at(i));
 
             job->setProgress(0.2 + (i + 1.0) / futures.count() * 0.4);
         }
@@ -931,7 +1492,32 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
                 remove("com.microsoft.Windows64");
             }
 
-            detect3rdParty(sub, rep, *installeds.at(i), tpms.at(i)->detectionPrefix);
+            AbstractThirdPartyPM* tpm = tpms.at(i);
+            if (unchanged.at(i) && !replay3rdParty(rep, tpm, journal)) {
+                // the stored results cannot be used (e.g. a directory was
+                // deleted) => the sources are scanned after all
+                qCDebug(npackd) << "InstalledPackages::refresh" <<
+                        tpm->detectionPrefix << "is scanned again";
+                Job* s = job->newSubJob(0, jobTitles.at(i), false, true);
+                tpm->scan(s, installeds.at(i), repositories.at(i));
+                s = job->newSubJob(0,
+                        QObject::tr("Saving detected packages %1").arg(i),
+                        false, true);
+                addPackages(s, rep, repositories.at(i),
+                        *installeds.at(i),
+                        replace.at(i));
+                unchanged[i] = false;
+            }
+
+            if (unchanged.at(i)) {
+                sub->completeWithProgress();
+            } else {
+                detect3rdParty(sub, rep, *installeds.at(i), tpm, &journal);
+
+                // the fingerprint is only valid for a complete detection
+                journal.setSourcesFingerprint(tpm->detectionPrefix,
+                        job->shouldProceed() ? sources.at(i) : QString());
+            }
             qDeleteAll(*installeds.at(i));
 
             job->setProgress(0.6 + (i + 1.0) / futures.count() * 0.2);
@@ -942,6 +1528,14 @@ void InstalledPackages::refresh(DBRepository *rep, Job *job)
         qDeleteAll(tpms);
     }
 
+    endUpdate();
+
+    if (job->shouldProceed()) {
+        QString err = journal.save(journalFile);
+        if (!err.isEmpty())
+            qCDebug(npackd) << err;
+    }
+
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.2,
                 QObject::tr("Setting the NPACKD_CL environment variable"));
@@ -972,54 +1566,70 @@ QString InstalledPackages::save()
     qCDebug(npackd) << "Saving installed packages";
     this->dump();
 
-    InstalledPackages other;
+    QString err;
 
-    QString err = other.readRegistryDatabase();
+    this->mutex.lock();
 
-    if (err.isEmpty()) {
-        qCDebug(npackd) << "Installed packages just read from the registry";
-        other.dump();
-
-        // save entries that are not yet in the Windows registry
-        QList<InstalledPackageVersion*> myInfos = getAll();
-        for (int i = 0; i < myInfos.size(); i++) {
-            InstalledPackageVersion* myIpv = myInfos.at(i);
-            InstalledPackageVersion* otherIpv = other.find(
-                    myIpv->package, myIpv->version);
-
-            if (!otherIpv || !(*myIpv == *otherIpv)) {
-                err = saveToRegistry(myIpv);
-            }
+    // without a previous load the stored entries are compared with the
+    // current ones
+    if (!loaded) {
+        QList<InstalledPackageVersion*> stored;
+        err = storage->load(&stored);
 
-            delete otherIpv;
+        if (err.isEmpty()) {
+            this->dirty.clear();
+
+            QSet<QString> keys;
+            for (int i = 0; i < stored.size(); i++) {
+                InstalledPackageVersion* otherIpv = stored.at(i);
+                QString key = PackageVersion::getStringId(otherIpv->package,
+                        otherIpv->version);
+                keys.insert(key);
+                InstalledPackageVersion* myIpv = this->data.value(key);
+                if (!myIpv || !(*myIpv == *otherIpv))
+                    markDirtyNoCopy(otherIpv->package, otherIpv->version);
+            }
 
-            if (!err.isEmpty())
-                break;
-        }
-        qDeleteAll(myInfos);
-        myInfos.clear();
-
-        // remove unnecessary entries from the Windows registry
-        QList<InstalledPackageVersion*> otherInfos = other.getAll();
-        for (int i = 0; i < otherInfos.size(); i++) {
-            InstalledPackageVersion* otherIpv = otherInfos.at(i);
-            InstalledPackageVersion* myIpv = find(
-                    otherIpv->package, otherIpv->version);
-
-            if (!myIpv || !myIpv->installed()) {
-                err = setPackageVersionPath(otherIpv->package,
-                        otherIpv->version, "", true);
+            for (QMap<QString, InstalledPackageVersion*>::const_iterator it =
+                    this->data.constBegin(); it != this->data.constEnd();
+                    ++it) {
+                InstalledPackageVersion* myIpv = it.value();
+                if (myIpv->installed() && !keys.contains(it.key()))
+                    markDirtyNoCopy(myIpv->package, myIpv->version);
             }
+        }
 
-            delete myIpv;
+        qDeleteAll(stored);
+    }
 
-            if (!err.isEmpty())
-                break;
+    // all changed entries are written in one batch. Removed entries are
+    // passed with an empty directory.
+    QList<InstalledPackageVersion*> changed;
+    if (err.isEmpty()) {
+        for (QHash<QString, QPair<QString, Version> >::const_iterator it =
+                this->dirty.constBegin(); it != this->dirty.constEnd(); ++it) {
+            InstalledPackageVersion* ipv = this->data.value(it.key());
+            if (ipv)
+                changed.append(ipv->clone());
+            else
+                changed.append(new InstalledPackageVersion(it.value().first,
+                        it.value().second, ""));
         }
-        qDeleteAll(otherInfos);
-        otherInfos.clear();
+
+        qCDebug(npackd) << "Saving" << changed.size() << "changed entries";
+
+        err = storage->save(changed);
     }
 
+    if (err.isEmpty()) {
+        this->dirty.clear();
+        this->loaded = true;
+    }
+
+    this->mutex.unlock();
+
+    qDeleteAll(changed);
+
     return err;
 }
 
@@ -1032,7 +1642,8 @@ QString InstalledPackages::setOne(const InstalledPackageVersion& other)
     InstalledPackageVersion* ipv =
             this->findOrCreate(other.package, other.version, &err);
     if (*ipv != other) {
-        *ipv = other;
+        assignNoCopy(ipv, other);
+        publishNoCopy();
         changed = true;
     }
     this->mutex.unlock();
@@ -1046,29 +1657,19 @@ QString InstalledPackages::setOne(const InstalledPackageVersion& other)
 QString InstalledPackages::getPath(const QString &package,
         const Version &version) const
 {
-    this->mutex.lock();
-
-    QString r;
-    InstalledPackageVersion* ipv = findNoCopy(package, version);
-    if (ipv)
-        r = ipv->getDirectory();
-
-    this->mutex.unlock();
-
-    return r;
+    // the snapshot is used without locking
+    std::shared_ptr<const InstalledPackageVersion> ipv =
+            getSnapshot()->byId.value(PackageVersion::getStringId(package,
+            version));
+    return ipv ? ipv->getDirectory() : QString();
 }
 
 bool InstalledPackages::isInstalled(const QString &package,
         const Version &version) const
 {
-    this->mutex.lock();
-
-    InstalledPackageVersion* ipv = findNoCopy(package, version);
-    bool r = ipv && ipv->installed();
-
-    this->mutex.unlock();
-
-    return r;
+    // the snapshot is used without locking
+    return getSnapshot()->byId.contains(PackageVersion::getStringId(package,
+            version));
 }
 
 void InstalledPackages::fireStatusChanged(const QString &package,
@@ -1083,89 +1684,21 @@ QString InstalledPackages::readRegistryDatabase()
 
     // "data" is only used at the bottom of this method
 
-    QString err;
-
-    WindowsRegistry packagesWR;
-    LONG e;
-    err = packagesWR.open(
-        PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
-            "SOFTWARE\\Npackd\\Npackd\\Packages", false, KEY_READ, &e);
-
     QList<InstalledPackageVersion*> ipvs;
-    if (e == ERROR_FILE_NOT_FOUND || e == ERROR_PATH_NOT_FOUND) {
-        err = "";
-    } else if (err.isEmpty()) {
-        QStringList entries = packagesWR.list(&err);
-        for (int i = 0; i < entries.count(); ++i) {
-            QString name = entries.at(i);
-            int pos = name.lastIndexOf("-");
-            if (pos <= 0)
-                continue;
-
-            QString packageName = name.left(pos);
-            if (!Package::isValidName(packageName))
-                continue;
-
-            QString versionName = name.right(name.length() - pos - 1);
-            Version version;
-            if (!version.setVersion(versionName))
-                continue;
-
-            WindowsRegistry entryWR;
-            err = entryWR.open(packagesWR, name, KEY_READ);
-            if (!err.isEmpty())
-                continue;
-
-            QString p = entryWR.get("Path", &err).trimmed();
-            if (!err.isEmpty())
-                continue;
-
-            QString dir;
-            if (p.isEmpty())
-                dir = "";
-            else {
-                QDir d(p);
-                if (d.exists()) {
-                    dir = p;
-                } else {
-                    dir = "";
-                }
-            }
-
-            if (dir.isEmpty()) {
-                packagesWR.remove(name);
-            } else {
-                dir = WPMUtils::normalizePath(dir, false);
-
-                InstalledPackageVersion* ipv = new InstalledPackageVersion(
-                        packageName, version, dir);
-                ipv->detectionInfo = entryWR.get("DetectionInfo", &err);
-                if (!err.isEmpty()) {
-                    // ignore
-                    ipv->detectionInfo = "";
-                    err = "";
-                }
-
-                if (!ipv->directory.isEmpty()) {
-                    /*
-                    qCDebug(npackd) << "adding " << ipv->package <<
-                            ipv->version.getVersionString() << "in" <<
-                            ipv->directory;*/
-                    ipvs.append(ipv);
-                } else {
-                    delete ipv;
-                }
-            }
-        }
-    }
 
     this->mutex.lock();
-    qDeleteAll(this->data);
-    this->data.clear();
+    QString err = storage->load(&ipvs);
+    clearNoCopy();
     for (int i = 0; i < ipvs.count(); i++) {
         InstalledPackageVersion* ipv = ipvs.at(i);
-        this->data.insert(PackageVersion::getStringId(ipv->package,
-                ipv->version), ipv->clone());
+        insertNoCopy(ipv->clone());
+    }
+    publishNoCopy();
+
+    // the data corresponds to the storage now
+    if (err.isEmpty()) {
+        this->dirty.clear();
+        this->loaded = true;
     }
     this->mutex.unlock();
 
@@ -1183,8 +1716,8 @@ QString InstalledPackages::readRegistryDatabase()
 void InstalledPackages::clear()
 {
     this->mutex.lock();
-    qDeleteAll(this->data);
-    this->data.clear();
+    clearNoCopy();
+    publishNoCopy();
     this->mutex.unlock();
 }
 
@@ -1260,48 +1793,3 @@ QString InstalledPackages::findPath_npackdcl(const Dependency& dep)
     return ret;
 }
 
-QString InstalledPackages::saveToRegistry(InstalledPackageVersion *ipv)
-{
-    WindowsRegistry machineWR(
-            PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
-			false);
-    QString r;
-    QString keyName = "SOFTWARE\\Npackd\\Npackd\\Packages";
-    Version v = ipv->version;
-    v.normalize();
-    QString pn = ipv->package + "-" + v.getVersionString();
-
-    /*WPMUtils::outputTextConsole(
-            "InstalledPackages::saveToRegistry " + ipv->directory + " " +
-            ipv->package + " " + ipv->version.getVersionString() + " " +
-            ipv->detectionInfo + "\r\n");*/
-
-    if (!ipv->directory.isEmpty()) {
-        WindowsRegistry wr = machineWR.createSubKey(keyName + "\\" + pn, &r);
-        if (r.isEmpty()) {
-            wr.set("DetectionInfo", ipv->detectionInfo);
-
-            // for compatibility with Npackd 1.16 and earlier. They
-            // see all package versions by default as "externally installed"
-            wr.setDWORD("External", 0);
-
-            r = wr.set("Path", ipv->directory);
-        }
-        // qCDebug(npackd) << "saveToRegistry 1 " << r;
-    } else {
-        // qCDebug(npackd) << "deleting " << pn;
-        WindowsRegistry packages;
-        r = packages.open(machineWR, keyName, KEY_ALL_ACCESS);
-        if (r.isEmpty()) {
-            r = packages.remove(pn);
-        }
-        // qCDebug(npackd) << "saveToRegistry 2 " << r;
-    }
-    //qCDebug(npackd) << "InstalledPackageVersion::save " << pn << " " <<
-    //        this->directory;
-
-    // qCDebug(npackd) << "saveToRegistry returns " << r;
-
-    return r;
-}
-
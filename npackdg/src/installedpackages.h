@@ -5,6 +5,8 @@
 #include <memory>
 
 #include <QMap>
+#include <QHash>
+#include <QMultiHash>
 #include <QObject>
 #include <QSet>
 #include <QString>
@@ -14,6 +16,8 @@
 #include "windowsregistry.h"
 #include "job.h"
 #include "abstractthirdpartypm.h"
+#include "detectionjournal.h"
+#include "abstractinstalledpackagesstorage.h"
 #include "dependency.h"
 
 class DBRepository;
@@ -34,14 +38,212 @@ private:
     /** please use the mutex to access the data */
     QMap<QString, InstalledPackageVersion*> data;
 
+    /**
+     * package name -> entries from "data" sorted by the version in ascending
+     * order. Please use the mutex.
+     */
+    QHash<QString, QList<InstalledPackageVersion*> > byPackage;
+
+    /**
+     * directory in lower case normalized by WPMUtils::normalizePath() ->
+     * installed entries from "data". Please use the mutex.
+     */
+    QMultiHash<QString, InstalledPackageVersion*> byDirectory;
+
+    /** [ownership:this] persistent storage */
+    std::unique_ptr<AbstractInstalledPackagesStorage> storage;
+
+    /**
+     * PackageVersion::getStringId() -> package and version for the entries
+     * changed since the last load or save. Please use the mutex.
+     */
+    QHash<QString, QPair<QString, Version> > dirty;
+
+    /** true if the data was read from the storage. Please use the mutex. */
+    bool loaded;
+
+    /**
+     * number of beginUpdate() calls without a matching endUpdate(). Please
+     * use the mutex.
+     */
+    int updating;
+
+    /**
+     * true if "data" was changed during an update and the snapshot should
+     * be published by endUpdate(). Please use the mutex.
+     */
+    bool unpublished;
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief marks an entry as changed since the last load or save
+     * @param package full package name
+     * @param version package version
+     */
+    void markDirtyNoCopy(const QString& package, const Version& version);
+
+    /**
+     * PackageVersion::getStringId() for the entries changed since the last
+     * published snapshot. Please use the mutex.
+     */
+    QSet<QString> unpublishedIds;
+
+    /**
+     * @brief immutable copy of the installed package versions for the
+     *     readers. The entries are shared between the snapshots as long as
+     *     they do not change.
+     */
+    class Snapshot
+    {
+    public:
+        /** PackageVersion::getStringId() -> installed entry */
+        QHash<QString, std::shared_ptr<const InstalledPackageVersion> > byId;
+
+        /**
+         * package name -> installed entries sorted by the version in
+         * ascending order
+         */
+        QHash<QString, QList<std::shared_ptr<const InstalledPackageVersion> > >
+                byPackage;
+
+        /** key from getDirectoryKey() -> installed entry */
+        QHash<QString, std::shared_ptr<const InstalledPackageVersion> >
+                byDirectory;
+    };
+
+    /**
+     * current snapshot. A new one is published by every change or once for
+     * all changes between beginUpdate() and endUpdate(). Please use
+     * std::atomic_load() and std::atomic_store() to access the pointer. The
+     * mutex is not necessary.
+     */
+    std::shared_ptr<const Snapshot> snapshot;
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief publishes a new snapshot created from "data". During an update
+     *     (see beginUpdate()) the snapshot is only published by the last
+     *     endUpdate().
+     */
+    void publishNoCopy();
+
+    /**
+     * @return current snapshot. This method is thread-safe and does not use
+     *     the mutex.
+     */
+    std::shared_ptr<const Snapshot> getSnapshot() const;
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief adds an entry to "data" and the indexes
+     * @param ipv [ownership:this] new entry
+     */
+    void insertNoCopy(InstalledPackageVersion* ipv);
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief removes an entry from "data" and the indexes
+     * @param ipv an entry from "data". The object is not deleted.
+     */
+    void removeNoCopy(InstalledPackageVersion* ipv);
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief changes an entry from "data" and updates the indexes
+     * @param ipv an entry from "data"
+     * @param other new values. The package and version should not change.
+     */
+    void assignNoCopy(InstalledPackageVersion* ipv,
+            const InstalledPackageVersion& other);
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief changes the directory of an entry from "data" and updates the
+     *     indexes
+     * @param ipv an entry from "data"
+     * @param directory new directory or ""
+     */
+    void setPathNoCopy(InstalledPackageVersion* ipv, const QString& directory);
+
+    /**
+     * THIS METHOD IS NOT THREAD-SAFE
+     *
+     * @brief deletes all entries
+     */
+    void clearNoCopy();
+
+    /**
+     * @param directory a directory
+     * @return key for "byDirectory"
+     */
+    static QString getDirectoryKey(const QString& directory);
+
+    /**
+     * @brief values computed once for all package versions detected by a
+     *     third party package manager
+     */
+    class DetectionContext
+    {
+    public:
+        QString windowsDir;
+        QString programFilesDir;
+        QString programFilesX86Dir;
+        bool is64BitWindows;
+
+        /**
+         * detected package name -> better package name. See
+         * DBRepository::findBetterPackageNames()
+         */
+        QMap<QString, QString> betterNames;
+
+        /** package names that were searched for betterNames */
+        QSet<QString> searched;
+
+        /**
+         * installed package versions for the check of nested directories.
+         * The registered package versions are added here.
+         */
+        QList<InstalledPackageVersion*> all;
+
+        DetectionContext();
+        ~DetectionContext();
+    };
+
     /**
      * @brief processOneInstalled3rdParty
      * @param r database repository
      * @param found detected package version
+     * @param context values shared by all detected package versions
+     * @return [move] copy of the registered installed package version or 0 if
+     *     the detected package version was ignored
      * @threadsafe
      */
-    void processOneInstalled3rdParty(DBRepository *r,
-            const InstalledPackageVersion *found, const QString &detectionInfoPrefix);
+    InstalledPackageVersion* processOneInstalled3rdParty(DBRepository *r,
+            const InstalledPackageVersion *found, const QString &detectionInfoPrefix,
+            DetectionContext* context);
+
+    /**
+     * @brief registers a detected package version using the result of a
+     *     previous detection
+     * @param r database repository
+     * @param found detected package version
+     * @param entry result of the previous detection
+     * @param context values shared by all detected package versions. The
+     *     registered package version will be added to the list of all
+     *     installed package versions.
+     * @return true if the package version was registered, false if it should
+     *     be processed by processOneInstalled3rdParty()
+     */
+    bool replayOneInstalled3rdParty(DBRepository *r,
+            const InstalledPackageVersion *found,
+            const DetectionJournal::Entry& entry,
+            DetectionContext* context);
 
     /**
      * THIS METHOD IS NOT THREAD-SAFE
@@ -55,13 +257,6 @@ private:
     InstalledPackageVersion* findOrCreate(const QString& package,
             const Version& version, QString* err);
 
-    /**
-     * @brief saves the information in the Windows registry
-     * @param ipv information about an installed package version
-     * @return error message
-     */
-    static QString saveToRegistry(InstalledPackageVersion* ipv);
-
     /**
      * THIS METHOD IS NOT THREAD-SAFE
      *
@@ -101,16 +296,46 @@ private:
      * @param job job
      * @param r repository where all the data will be stored
      * @param installed detected package versions
-     * @param replace should the existing entries be replaced?
-     * @param detectionInfoPrefix prefix for all detection info values
-     *     generated by this package manager like "control-panel:" or an empty
-     *     string if there is none. If
+     * @param tpm the package manager that detected the package versions.
+     *     AbstractThirdPartyPM::detectionPrefix is the prefix for all
+     *     detection info values generated by this package manager like
+     *     "control-panel:" or an empty string if there is none. If
      *     the value is not empty, the package manager should return all
      *     installed packages and the packages not returned are considered to
      *     be not installed anymore.
+     * @param journal results of the previous detection or 0. Entries with
+     *     an unchanged fingerprint are not processed again. Only used if the
+     *     detection prefix is not empty.
      */
     void detect3rdParty(Job* job, DBRepository* r,
-            const QList<InstalledPackageVersion*>& installed, const QString& detectionInfoPrefix);
+            const QList<InstalledPackageVersion*>& installed,
+            const AbstractThirdPartyPM* tpm, DetectionJournal* journal);
+
+    /**
+     * @brief registers the package versions from the last detection for a
+     *     package manager whose sources did not change (see
+     *     AbstractThirdPartyPM::getSourcesFingerprint()) without scanning
+     *     them
+     *
+     * @param r repository where all the data will be stored
+     * @param tpm the package manager. The detection prefix cannot be empty.
+     * @param journal results of the previous detection
+     * @return true if all package versions were registered. If false is
+     *     returned, no package versions with the detection prefix are
+     *     installed and detect3rdParty() should be called.
+     */
+    bool replay3rdParty(DBRepository* r, const AbstractThirdPartyPM* tpm,
+            const DetectionJournal& journal);
+
+    /**
+     * @brief marks all package versions detected by a package manager as not
+     *     installed
+     * @param detectionInfoPrefix detection prefix of the package manager
+     * @param keep detection infos of the package versions that should stay
+     *     installed
+     */
+    void reset3rdParty(const QString& detectionInfoPrefix,
+            const QSet<QString>& keep);
 
     QString findBetterPackageName(DBRepository *r, const QString &package);
 
@@ -145,18 +370,38 @@ public:
     virtual ~InstalledPackages();
 
     /**
-     * Reads the package statuses from the registry.
+     * Reads the package statuses from the registry (or another storage, see
+     * setStorage()).
      *
      * @return error message
      */
     QString readRegistryDatabase();
 
+    /**
+     * @brief changes the storage. The Windows registry is used by default.
+     * @param storage [ownership:this] new storage
+     */
+    void setStorage(AbstractInstalledPackagesStorage* storage);
+
     /**
      * @brief deletes all information from this object without storing the
      *     changes in the registry
      */
     void clear();
 
+    /**
+     * @brief starts a batch of changes. getPath() and isInstalled() see the
+     *     changes only after the matching endUpdate(). The calls can be
+     *     nested.
+     */
+    void beginUpdate();
+
+    /**
+     * @brief ends a batch of changes started by beginUpdate() and publishes
+     *     all of them at once
+     */
+    void endUpdate();
+
     /**
      * @brief finds the specified installed package version
      * @param package full package name
@@ -237,6 +482,56 @@ public:
      */
     QList<InstalledPackageVersion*> getByPackage(const QString& package) const;
 
+    /**
+     * @brief finds an installed package version without copying it. This
+     *     and the other methods ending with Shared_ do not use the mutex and
+     *     see the changes as soon as they are published
+     *     (see beginUpdate()).
+     * @param package full package name
+     * @param version package version
+     * @return shared immutable entry or nullptr if the package version is
+     *     not installed
+     */
+    std::shared_ptr<const InstalledPackageVersion> findShared_(
+            const QString& package, const Version& version) const;
+
+    /**
+     * @param package full package name
+     * @return shared immutable installed versions of the package sorted by
+     *     the version in ascending order
+     */
+    QList<std::shared_ptr<const InstalledPackageVersion> >
+            getByPackageShared_(const QString& package) const;
+
+    /**
+     * @param package full package name
+     * @return shared immutable newest installed version or nullptr
+     */
+    std::shared_ptr<const InstalledPackageVersion> getNewestInstalledShared_(
+            const QString& package) const;
+
+    /**
+     * @param dep a dependency
+     * @return shared immutable newest installed version that matches the
+     *     dependency or nullptr
+     */
+    std::shared_ptr<const InstalledPackageVersion>
+            findHighestInstalledMatchShared_(const Dependency& dep) const;
+
+    /**
+     * @param filePath full file or directory path
+     * @return shared immutable installed package version that "owns" the
+     *     specified file or directory or nullptr
+     */
+    std::shared_ptr<const InstalledPackageVersion> findOwnerShared_(
+            const QString& filePath) const;
+
+    /**
+     * @return shared immutable installed package versions
+     */
+    QList<std::shared_ptr<const InstalledPackageVersion> >
+            getAllShared_() const;
+
     /**
      * @brief paths to all installed package versions
      * @return list of directories
@@ -252,7 +547,10 @@ public:
     void refresh(DBRepository *rep, Job* job);
 
     /**
-     * Saves the information to the Windows Registry.
+     * Saves the information to the Windows Registry (or another storage, see
+     * setStorage()). Only the entries changed since the last
+     * readRegistryDatabase() or save() are written in one batch. If the data
+     * was never read, the stored entries are compared with the current ones.
      *
      * @return error message
      */
@@ -262,12 +560,14 @@ public:
      * @brief returns the path of an installed package version
      * @param package full package name
      * @param version package version
-     * @return installation path or "" if the package version is not installed
+     * @return installation path or "" if the package version is not installed.
+     *     This method does not use the mutex.
      */
     QString getPath(const QString& package, const Version& version) const;
 
     /**
-     * @brief checks whether a package version is installed
+     * @brief checks whether a package version is installed. This method does
+     *     not use the mutex.
      * @param package full package name
      * @param version version number
      * @return true = installed
@@ -301,7 +601,8 @@ public:
 
     /**
      * @param dep a dependency
-     * @return true if a package, that satisfies this dependency, is installed
+     * @return true if a package, that satisfies this dependency, is installed.
+     *     This method does not use the mutex.
      */
     bool isInstalled(const Dependency& dep) const;
 
@@ -6,6 +6,7 @@
 #include "windowsregistry.h"
 #include "repository.h"
 #include "installedpackages.h"
+#include "memoryarena.h"
 
 InstalledPackageVersion::InstalledPackageVersion(const QString &package,
         const Version &version, const QString &directory): version(version)
@@ -49,6 +50,16 @@ InstalledPackageVersion *InstalledPackageVersion::clone() const
     return r;
 }
 
+void* InstalledPackageVersion::operator new(size_t size)
+{
+    return MemoryArena::allocate(size);
+}
+
+void InstalledPackageVersion::operator delete(void* p)
+{
+    MemoryArena::free(p);
+}
+
 QString InstalledPackageVersion::toString() const
 {
     return this->package + " " + this->version.getVersionString() + " " +
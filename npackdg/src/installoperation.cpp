@@ -1,6 +1,7 @@
 #include "installoperation.h"
 #include "dbrepository.h"
 #include "abstractrepository.h"
+#include "memoryarena.h"
 
 InstallOperation::InstallOperation()
 {
@@ -20,6 +21,16 @@ InstallOperation *InstallOperation::clone() const
     return r;
 }
 
+void* InstallOperation::operator new(size_t size)
+{
+    return MemoryArena::allocate(size);
+}
+
+void InstallOperation::operator delete(void* p)
+{
+    MemoryArena::free(p);
+}
+
 QString InstallOperation::toString() const
 {
     return package + " " + version.getVersionString() + " " +
@@ -42,6 +42,18 @@ public:
      */
     PackageVersion* findPackageVersion(QString *err) const;
 
+    /**
+     * @brief allocates the memory from the current MemoryArena
+     * @param size size of the object
+     * @return memory
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * @param p memory allocated by operator new
+     */
+    static void operator delete(void* p);
+
     /**
      * @return [move] copy of this object
      */
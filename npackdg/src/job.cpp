@@ -418,3 +418,53 @@ void Job::setErrorMessage(const QString &errorMessage)
     }
 }
 
+QAtomicInt JobProgressReporter::defaultInterval(100);
+
+JobProgressReporter::JobProgressReporter(Job* job, int interval): job(job),
+        initialTitle(job->getTitle()),
+        interval(interval < 0 ? getDefaultInterval() : interval)
+{
+}
+
+void JobProgressReporter::setDefaultInterval(int interval)
+{
+    defaultInterval.storeRelease(interval);
+}
+
+int JobProgressReporter::getDefaultInterval()
+{
+    return defaultInterval.loadAcquire();
+}
+
+bool JobProgressReporter::isDue()
+{
+    bool r = interval == 0 || !timer.isValid() ||
+            timer.elapsed() >= interval;
+    if (r && interval != 0)
+        timer.start();
+    return r;
+}
+
+void JobProgressReporter::setProgress(double progress)
+{
+    if (isDue())
+        job->setProgress(progress);
+}
+
+void JobProgressReporter::reportBytes(int64_t done, int64_t total)
+{
+    if (isDue()) {
+        if (total > 0) {
+            job->setProgress((static_cast<double>(done)) / total);
+            job->setTitle(initialTitle + QStringLiteral(" / ") +
+                    QObject::tr("%L0 of %L1 bytes").
+                    arg(done).
+                    arg(total));
+        } else {
+            job->setProgress(0.5);
+            job->setTitle(initialTitle + QStringLiteral(" / ") +
+                    QObject::tr("%L0 bytes").
+                    arg(done));
+        }
+    }
+}
@@ -22,5 +22,7 @@ void License::toXML(QXmlStreamWriter &w) const
         w.writeTextElement("title", this->title);
     if (!this->url.isEmpty())
         w.writeTextElement("url", this->url);
+    if (!this->description.isEmpty())
+        w.writeTextElement("description", this->description);
     w.writeEndElement();
 }
@@ -27,6 +27,9 @@
 #include "uiutils.h"
 #include "clprocessor.h"
 #include "uimessagehandler.h"
+#include "downloader.h"
+#include "wininettransport.h"
+#include "trash.h"
 
 // Modern and efficient C++ Thread Pool Library
 // https://github.com/vit-vit/CTPL
@@ -82,11 +85,17 @@ int main(int argc, char *argv[])
     // July, 25 2018: "windowsvista", "Windows", "Fusion"
     qCDebug(npackd) << QStyleFactory::keys();
 
+    WinINetTransport transport;
+    Downloader::setDefaultTransport(&transport);
+
     CLProcessor clp;
 
     int errorCode;
     clp.process(argc, argv, &errorCode);
 
+    // the queued directories would stay in the trash otherwise
+    Trash::getDefault()->waitForDone();
+
     //WPMUtils::timer.dump();
 
     FreeLibrary(m);
@@ -38,6 +38,7 @@
 #include <QtConcurrent/QtConcurrentRun>
 #include <QDialogButtonBox>
 #include <QHeaderView>
+#include <QScrollBar>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
@@ -62,10 +63,10 @@
 #include "progresstree2.h"
 #include "exportrepositoryframe.h"
 #include "asyncdownloader.h"
+#include "wininettransport.h"
 #include "uimessagehandler.h"
 #include "packageutils.h"
 
-extern HWND defaultPasswordWindow;
 
 QIcon MainWindow::genericAppIcon;
 QIcon MainWindow::waitAppIcon;
@@ -194,6 +195,13 @@ MainWindow::MainWindow(QWidget *parent) :
             SLOT(downloadSizeCompleted(QString,qlonglong)),
             Qt::QueuedConnection);
 
+    // sizes are only computed for the visible rows. The rows shown after
+    // scrolling or filtering request their sizes again.
+    connect(t->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            &this->downloadSizeFinder, SLOT(cancelPending()));
+    connect(t->model(), SIGNAL(modelReset()),
+            &this->downloadSizeFinder, SLOT(cancelPending()));
+
     // copy toolTip to statusTip for all actions
     for (int i = 0; i < this->children().count(); i++) {
         QObject* ch = this->children().at(i);
@@ -224,7 +232,7 @@ MainWindow::MainWindow(QWidget *parent) :
             SLOT(repositoryStatusChanged(const QString&, const Version&)),
             Qt::QueuedConnection);
 
-    defaultPasswordWindow = reinterpret_cast<HWND>(this->winId());
+    WinINetTransport::parentWindow = reinterpret_cast<HWND>(this->winId());
 
     this->taskbarMessageId = RegisterWindowMessage(L"TaskbarButtonCreated");
     // qCDebug(npackd) << "id " << taskbarMessageId;
@@ -553,6 +561,10 @@ void MainWindow::repositoryStatusChanged(const QString& package,
 void MainWindow::downloadCompleted(const QString& url,
         const QString& /*filename*/, const QString& /*error*/)
 {
+    // the file may have changed on the server or a thumbnail was decoded
+    icons.remove(url);
+    screenshots.remove(url);
+
     updateIcon(url);
 }
 
@@ -629,6 +641,7 @@ MainWindow::~MainWindow()
 
     // if a timeout of 5 seconds is used here, there may an access
     // violation during program shutdown
+    downloadSizeFinder.cancelPending();
     DownloadSizeFinder::threadPool.clear();
     DownloadSizeFinder::threadPool.waitForDone(-1);
 
@@ -643,34 +656,16 @@ QIcon MainWindow::downloadIcon(const QString &url)
         r = *inCache;
     } else {
         QString err;
-        QString file = fileLoader.downloadOrQueue(url, &err);
+        QImage img = fileLoader.thumbnailOrQueue(url,
+                FileLoader::THUMBNAIL_LIST, &err);
         if (!err.isEmpty()) {
             r = MainWindow::genericAppIcon;
-        } else if (!file.isEmpty()) {
-            QPixmap pm(file);
-
-            /* gray
-            QStyleOption opt(0);
-            opt.palette = QApplication::palette();
-            pm = QApplication::style()->generatedIconPixmap(QIcon::Disabled, pm, &opt);
-            */
-
-            if (!pm.isNull()) {
-                pm = pm.scaled(32, 32, Qt::KeepAspectRatio,
-                        Qt::SmoothTransformation);
-
-                inCache = new QIcon(pm);
-                inCache->detach();
-
-                r = *inCache;
-                icons.insert(url, inCache);
-            } else {
-                r = MainWindow::genericAppIcon;
-                inCache = new QIcon(r);
-                inCache->detach();
+        } else if (!img.isNull()) {
+            inCache = new QIcon(QPixmap::fromImage(img));
+            inCache->detach();
 
-                icons.insert(url, inCache);
-            }
+            r = *inCache;
+            icons.insert(url, inCache);
         } else {
             r = MainWindow::waitAppIcon;
         }
@@ -685,31 +680,15 @@ QIcon MainWindow::downloadScreenshot(const QString &url)
         r = screenshots[url];
     } else {
         QString err;
-        QString filename = fileLoader.downloadOrQueue(url, &err);
-
+        QImage img = fileLoader.thumbnailOrQueue(url,
+                FileLoader::THUMBNAIL_DETAILS, &err);
         if (!err.isEmpty()) {
             r = MainWindow::brokenIcon;
-        } else if (!filename.isEmpty()) {
-            QPixmap pm;
-            pm.load(filename);
-
-            /* gray
-            QStyleOption opt(0);
-            opt.palette = QApplication::palette();
-            pm = QApplication::style()->generatedIconPixmap(QIcon::Disabled, pm, &opt);
-            */
-
-            if (!pm.isNull()) {
-                pm = pm.scaled(200, 200, Qt::KeepAspectRatio,
-                        Qt::SmoothTransformation);
-                r.addPixmap(pm);
-                r.detach();
-
-                screenshots.insert(url, r);
-            } else {
-                r = MainWindow::brokenIcon;
-                screenshots.insert(url, r);
-            }
+        } else if (!img.isNull()) {
+            r.addPixmap(QPixmap::fromImage(img));
+            r.detach();
+
+            screenshots.insert(url, r);
         } else {
             r = MainWindow::waitAppIcon;
         }
@@ -1049,7 +1028,8 @@ bool MainWindow::isUpdateEnabled(const QString& package)
     DBRepository* r = DBRepository::getDefault();
     PackageVersion* newest = r->findNewestInstallablePackageVersion_(
             package, &err);
-    InstalledPackageVersion* newesti = InstalledPackages::getDefault()->getNewestInstalled(
+    std::shared_ptr<const InstalledPackageVersion> newesti =
+            InstalledPackages::getDefault()->getNewestInstalledShared_(
             package);
     if (newest != nullptr && newesti != nullptr) {
         // qCDebug(npackd) << newest->version.getVersionString() << " " <<
@@ -1065,7 +1045,6 @@ bool MainWindow::isUpdateEnabled(const QString& package)
                 newest->version.compare(newesti->version) > 0;
     }
     delete newest;
-    delete newesti;
 
     return res;
 }
@@ -1209,14 +1188,13 @@ void MainWindow::updateShowFolderAction()
                 Package* p = static_cast<Package*>(selected.at(i));
 
                 QString err;
-                InstalledPackageVersion* pv = InstalledPackages::getDefault()->getNewestInstalled(
-                        p->name);
+                std::shared_ptr<const InstalledPackageVersion> pv =
+                        InstalledPackages::getDefault()->
+                        getNewestInstalledShared_(p->name);
 
                 enabled = enabled &&
                         pv && !PackageVersion::isLocked(pv->package, pv->version) &&
-                        pv->installed() && !pv->isInWindowsDir();
-
-                delete pv;
+                        !pv->isInWindowsDir();
             }
         }
     }
@@ -1256,14 +1234,13 @@ void MainWindow::updateUninstallAction()
 
                 Package* p = static_cast<Package*>(selected.at(i));
 
-                InstalledPackageVersion* pv = InstalledPackages::getDefault()->getNewestInstalled(
-                        p->name);
+                std::shared_ptr<const InstalledPackageVersion> pv =
+                        InstalledPackages::getDefault()->
+                        getNewestInstalledShared_(p->name);
 
                 enabled = enabled &&
                         pv && !PackageVersion::isLocked(pv->package, pv->version) &&
-                        pv->installed() && !pv->isInWindowsDir();
-
-                delete pv;
+                        !pv->isInWindowsDir();
             }
         }
     }
@@ -2434,29 +2411,27 @@ void MainWindow::on_actionCheck_dependencies_triggered()
     InstalledPackages* ip = InstalledPackages::getDefault();
     DBRepository* dbr = DBRepository::getDefault();
 
-    QList<InstalledPackageVersion*> all = ip->getAll();
+    QList<std::shared_ptr<const InstalledPackageVersion> > all =
+            ip->getAllShared_();
     int n = 0;
     for (int i = 0; i < all.size(); i++) {
-        InstalledPackageVersion* ipv = all.at(i);
-        if (ipv->installed()) {
-            std::unique_ptr<PackageVersion> pv(dbr->findPackageVersion_(
-                    ipv->package, ipv->version, &err));
-            if (!err.isEmpty())
-                break;
+        const InstalledPackageVersion* ipv = all.at(i).get();
+        std::unique_ptr<PackageVersion> pv(dbr->findPackageVersion_(
+                ipv->package, ipv->version, &err));
+        if (!err.isEmpty())
+            break;
 
-            for (int j = 0; j < pv->dependencies.count(); j++) {
-                Dependency* d = pv->dependencies.at(j);
-                if (!ip->isInstalled(*d)) {
-                    msg += "\r\n" + QString(
-                            "%1 depends on %2, which is not installed").
-                            arg(pv->toString(true)).
-                            arg(dbr->toString(*d, true));
-                    n++;
-                }
+        for (int j = 0; j < pv->dependencies.count(); j++) {
+            Dependency* d = pv->dependencies.at(j);
+            if (!ip->isInstalled(*d)) {
+                msg += "\r\n" + QString(
+                        "%1 depends on %2, which is not installed").
+                        arg(pv->toString(true)).
+                        arg(dbr->toString(*d, true));
+                n++;
             }
         }
     }
-    qDeleteAll(all);
 
     if (n > 0) {
         this->addErrorMessage(msg, msg, true, QMessageBox::Critical);
@@ -0,0 +1,178 @@
+#include <windows.h>
+#include <new>
+
+#include <QAtomicPointer>
+
+#include "memoryarena.h"
+
+/** allocations from the blocks keep this alignment */
+static const size_t ALIGNMENT = 16;
+
+/** bigger allocations do not use the blocks */
+static const size_t MAX_ARENA_ALLOCATION = MemoryArena::BLOCK_SIZE / 4;
+
+/** number of bits of an address inside of one block */
+static const int BLOCK_BITS = 16;
+
+static_assert(MemoryArena::BLOCK_SIZE == (1u << BLOCK_BITS),
+        "VirtualAlloc returns blocks aligned to 64 KiB");
+
+/** number of bits of a block number that select a leaf of blockMap */
+static const int LEAF_BITS = 16;
+
+/** number of QAtomicInt words in one leaf of blockMap */
+static const int LEAF_WORDS = (1 << LEAF_BITS) / 32;
+
+/** current arena in this thread */
+static thread_local MemoryArena* current = nullptr;
+
+/**
+ * one bit for every block of the address space (address >> BLOCK_BITS). The
+ * bit is set while the block belongs to an arena. The leaves with
+ * 2^LEAF_BITS bits are created on demand and never freed. Each of them
+ * covers 4 GiB of the address space.
+ */
+static QAtomicPointer<QAtomicInt> blockMap[1 << 16];
+
+/**
+ * @param block block number (address >> BLOCK_BITS)
+ * @param create true = create the leaf if it does not exist
+ * @return the leaf for the block or nullptr
+ */
+static QAtomicInt* getLeaf(quint64 block, bool create)
+{
+    QAtomicPointer<QAtomicInt>& p = blockMap[(block >> LEAF_BITS) & 0xffff];
+    QAtomicInt* leaf = p.loadAcquire();
+    if (!leaf && create) {
+        leaf = new QAtomicInt[LEAF_WORDS];
+        if (!p.testAndSetOrdered(nullptr, leaf)) {
+            delete[] leaf;
+            leaf = p.loadAcquire();
+        }
+    }
+    return leaf;
+}
+
+/**
+ * @brief marks a block as belonging to an arena or not
+ * @param block start of the block
+ * @param arena true = the block belongs to an arena
+ */
+static void markBlock(char* block, bool arena)
+{
+    quint64 n = reinterpret_cast<quintptr>(block) >> BLOCK_BITS;
+    QAtomicInt* leaf = getLeaf(n, true);
+    int bit = static_cast<int>(n & ((1 << LEAF_BITS) - 1));
+    int mask = 1 << (bit & 31);
+    if (arena)
+        leaf[bit >> 5].fetchAndOrOrdered(mask);
+    else
+        leaf[bit >> 5].fetchAndAndOrdered(~mask);
+}
+
+/**
+ * @param p an address
+ * @return the start of the arena block containing p or nullptr if p does
+ *     not belong to an arena
+ */
+static char* findBlock(void* p)
+{
+    quintptr a = reinterpret_cast<quintptr>(p);
+    quint64 n = a >> BLOCK_BITS;
+    QAtomicInt* leaf = getLeaf(n, false);
+    if (!leaf)
+        return nullptr;
+
+    int bit = static_cast<int>(n & ((1 << LEAF_BITS) - 1));
+    if (!(leaf[bit >> 5].loadAcquire() & (1 << (bit & 31))))
+        return nullptr;
+
+    return reinterpret_cast<char*>(a & ~(quintptr(MemoryArena::BLOCK_SIZE) -
+            1));
+}
+
+MemoryArena::Blocks::Blocks() : used(0), refs(1), allocated(0)
+{
+}
+
+MemoryArena::Blocks::~Blocks()
+{
+    for (int i = 0; i < data.size(); i++) {
+        markBlock(data.at(i), false);
+        VirtualFree(data.at(i), 0, MEM_RELEASE);
+    }
+}
+
+MemoryArena::Scope::Scope(MemoryArena* arena) : previous(current)
+{
+    current = arena;
+}
+
+MemoryArena::Scope::~Scope()
+{
+    current = previous;
+}
+
+MemoryArena::MemoryArena() : blocks(new Blocks())
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+    release(blocks);
+}
+
+void MemoryArena::release(Blocks* b)
+{
+    if (!b->refs.deref())
+        delete b;
+}
+
+int64_t MemoryArena::getAllocated() const
+{
+    return blocks->allocated;
+}
+
+void* MemoryArena::allocate(size_t size)
+{
+    if (!current || size > MAX_ARENA_ALLOCATION)
+        return ::operator new(size);
+
+    size_t total = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    Blocks* b = current->blocks;
+    if (b->data.isEmpty() || b->used + total > BLOCK_SIZE) {
+        // VirtualAlloc uses the allocation granularity of 64 KiB so that
+        // the start of a block can be found by masking an address
+        char* block = static_cast<char*>(VirtualAlloc(nullptr, BLOCK_SIZE,
+                MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        if (!block)
+            throw std::bad_alloc();
+
+        // the owner is stored at the start of the block
+        *reinterpret_cast<Blocks**>(block) = b;
+        b->data.append(block);
+        b->used = ALIGNMENT;
+        markBlock(block, true);
+    }
+
+    char* r = b->data.last() + b->used;
+    b->used += total;
+    b->allocated += total;
+    b->refs.ref();
+
+    return r;
+}
+
+void MemoryArena::free(void* p)
+{
+    if (!p)
+        return;
+
+    // a block stays marked until all objects in it are deleted
+    char* block = findBlock(p);
+    if (block)
+        release(*reinterpret_cast<Blocks**>(block));
+    else
+        ::operator delete(p);
+}
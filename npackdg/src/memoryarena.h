@@ -0,0 +1,120 @@
+#ifndef MEMORYARENA_H
+#define MEMORYARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <QList>
+#include <QAtomicInt>
+
+/**
+ * @brief monotonic memory for object graphs that are created and destroyed
+ *     together like the package versions of a repository being loaded or
+ *     the objects of one installation plan. An allocation only moves a
+ *     pointer in the current block. Deleting an object does not free its
+ *     memory. All blocks are freed at once.
+ *
+ * PackageVersion, PackageVersionFile, Dependency, InstallOperation and
+ * InstalledPackageVersion define operator new and delete with allocate() and
+ * free(). They are allocated from the arena of the current Scope in the
+ * current thread. Without a Scope they are allocated from the heap as any
+ * other object. The destructors run as usual as the objects own heap data
+ * like strings.
+ *
+ * All blocks are freed at once after the arena was destroyed and all
+ * objects allocated from it were deleted. Objects that outlive the arena are
+ * safe, but keep all its blocks. Objects can be deleted in any thread. An
+ * arena should only be used by one thread at a time.
+ *
+ * The blocks are aligned to BLOCK_SIZE and store the owning Blocks at the
+ * start. A lock-free bit map over the address space tells whether a block
+ * belongs to an arena so that free() never locks, even for memory from the
+ * heap.
+ */
+class MemoryArena
+{
+    /** memory shared by the arena and the allocated objects */
+    class Blocks
+    {
+    public:
+        /** allocated blocks. The last one is the current one. */
+        QList<char*> data;
+
+        /** number of used bytes in the current block */
+        size_t used;
+
+        /** 1 for the arena + 1 for every object that was not yet deleted */
+        QAtomicInt refs;
+
+        /** number of allocated bytes */
+        int64_t allocated;
+
+        Blocks();
+
+        ~Blocks();
+    };
+
+    Blocks* blocks;
+
+    /**
+     * @brief releases a reference to the blocks and frees them if it was
+     *     the last one
+     * @param b blocks
+     */
+    static void release(Blocks* b);
+
+    MemoryArena(const MemoryArena& other);
+    MemoryArena& operator=(const MemoryArena& other);
+public:
+    /**
+     * size of one block in bytes. This is the allocation granularity of
+     * VirtualAlloc.
+     */
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    /**
+     * @brief makes an arena current in this thread. The previous arena is
+     *     restored in the destructor.
+     */
+    class Scope
+    {
+        MemoryArena* previous;
+
+        Scope(const Scope& other);
+        Scope& operator=(const Scope& other);
+    public:
+        /**
+         * @param arena the new current arena or nullptr to allocate from the
+         *     heap
+         */
+        explicit Scope(MemoryArena* arena);
+
+        ~Scope();
+    };
+
+    MemoryArena();
+
+    ~MemoryArena();
+
+    /**
+     * @return number of bytes allocated from this arena
+     */
+    int64_t getAllocated() const;
+
+    /**
+     * @brief allocates memory from the current arena or the heap
+     * @param size size in bytes
+     * @return allocated memory
+     * @threadsafe
+     */
+    static void* allocate(size_t size);
+
+    /**
+     * @brief frees memory allocated by allocate() without locking
+     * @param p allocated memory or nullptr
+     * @threadsafe
+     */
+    static void free(void* p);
+};
+
+#endif // MEMORYARENA_H
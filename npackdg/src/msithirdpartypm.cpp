@@ -4,9 +4,11 @@
 #include <msi.h>
 #include <QBuffer>
 #include <QByteArray>
+#include <QFileInfo>
 
 #include "msithirdpartypm.h"
 #include "wpmutils.h"
+#include "windowsregistry.h"
 
 MSIThirdPartyPM::MSIThirdPartyPM()
 {
@@ -209,3 +211,32 @@ void MSIThirdPartyPM::scan(Job* job,
     job->setProgress(1);
     job->complete();
 }
+
+QString MSIThirdPartyPM::getSourcesFingerprint() const
+{
+    QStringList parts;
+
+    // per-machine and per-user advertised products
+    addRegistryFingerprint(HKEY_LOCAL_MACHINE,
+            "SOFTWARE\\Classes\\Installer\\Products", &parts);
+    addRegistryFingerprint(HKEY_CURRENT_USER,
+            "SOFTWARE\\Microsoft\\Installer\\Products", &parts);
+
+    // installed products and their properties for every user
+    QString userData = "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Installer\\UserData";
+    WindowsRegistry k;
+    QString err = k.open(HKEY_LOCAL_MACHINE, userData, false, KEY_READ);
+    QStringList users;
+    if (err.isEmpty())
+        users = k.list(&err);
+    for (int i = 0; i < users.count(); i++) {
+        addRegistryFingerprint(HKEY_LOCAL_MACHINE, userData + '\\' +
+                users.at(i) + "\\Products", &parts);
+    }
+
+    // the cached MSI databases
+    QFileInfo fi(WPMUtils::getWindowsDir() + "\\Installer");
+    parts.append(QString::number(fi.lastModified().toMSecsSinceEpoch()));
+
+    return hashFingerprint(parts);
+}
@@ -18,6 +18,12 @@ public:
 
     void scan(Job *job, QList<InstalledPackageVersion*>* installed,
             Repository* rep) const;
+
+    /**
+     * @return the times of the last change of the registry keys for the
+     *     installed MSI products and of the Windows Installer cache directory
+     */
+    QString getSourcesFingerprint() const;
 };
 
 #endif // MSITHIRDPARTYPM_H
@@ -110,7 +110,7 @@ void Package::toXML(QXmlStreamWriter *w) const
     }
 
     if (this->stars > 0) {
-        w->writeTextElement("tag", QString::number(this->stars));
+        w->writeTextElement("stars", QString::number(this->stars));
     }
 
     // <link>
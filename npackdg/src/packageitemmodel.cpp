@@ -41,12 +41,13 @@ PackageItemModel::Info* PackageItemModel::createInfo(
 
     // error is ignored here
     QString err;
-    QList<PackageVersion*> pvs = rep->getPackageVersions_(p->name, &err);
+    QList<std::shared_ptr<const PackageVersion> > pvs =
+            rep->getPackageVersionsShared_(p->name, &err);
 
-    PackageVersion* newestInstallable = nullptr;
-    PackageVersion* newestInstalled = nullptr;
+    const PackageVersion* newestInstallable = nullptr;
+    const PackageVersion* newestInstalled = nullptr;
     for (int j = 0; j < pvs.count(); j++) {
-        PackageVersion* pv = pvs.at(j);
+        const PackageVersion* pv = pvs.at(j).get();
         if (pv->installed()) {
             if (!r->installed.isEmpty())
                 r->installed.append(", ");
@@ -73,7 +74,6 @@ PackageItemModel::Info* PackageItemModel::createInfo(
             newestInstallable->version.compare(
             newestInstalled->version) > 0);
 
-    qDeleteAll(pvs);
     pvs.clear();
 
     QString s = p->description;
@@ -2,7 +2,10 @@
 
 #include "shlobj.h"
 
+#include <QFileInfo>
+
 #include "installedpackages.h"
+#include "trash.h"
 #include "wpmutils.h"
 
 bool PackageUtils::globalMode = true;
@@ -451,6 +454,147 @@ void PackageUtils::setCloseProcessType(DWORD cpt)
     }
 }
 
+DWORD PackageUtils::getBandwidthLimit()
+{
+    WindowsRegistry npackd;
+    QString err = npackd.open(
+            HKEY_LOCAL_MACHINE,
+            QStringLiteral("SOFTWARE\\Policies\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("bandwidthLimit"), &err);
+        if (err.isEmpty())
+            return v;
+    }
+    err = npackd.open(
+            PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+            QStringLiteral("Software\\Npackd\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("bandwidthLimit"), &err);
+        if (err.isEmpty())
+            return v;
+    }
+
+    return 0;
+}
+
+bool PackageUtils::getDeduplication()
+{
+    WindowsRegistry npackd;
+    QString err = npackd.open(
+            HKEY_LOCAL_MACHINE,
+            QStringLiteral("SOFTWARE\\Policies\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("deduplication"), &err);
+        if (err.isEmpty())
+            return v != 0;
+    }
+    err = npackd.open(
+            PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+            QStringLiteral("Software\\Npackd\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("deduplication"), &err);
+        if (err.isEmpty())
+            return v != 0;
+    }
+
+    return false;
+}
+
+bool PackageUtils::getDeferredDeletion()
+{
+    WindowsRegistry npackd;
+    QString err = npackd.open(
+            HKEY_LOCAL_MACHINE,
+            QStringLiteral("SOFTWARE\\Policies\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("deferredDeletion"), &err);
+        if (err.isEmpty())
+            return v != 0;
+    }
+    err = npackd.open(
+            PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+            QStringLiteral("Software\\Npackd\\Npackd"), false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD(QStringLiteral("deferredDeletion"), &err);
+        if (err.isEmpty())
+            return v != 0;
+    }
+
+    return false;
+}
+
+void PackageUtils::emptyTrash()
+{
+    QString err = InstalledPackages::getDefault()->readRegistryDatabase();
+    if (!err.isEmpty())
+        qCDebug(npackd).noquote() << err;
+
+    Trash::getDefault()->emptyLeftovers(getPackageParentDirectories());
+}
+
+QStringList PackageUtils::getPackageParentDirectories()
+{
+    QStringList r;
+    QStringList paths = InstalledPackages::getDefault()->
+            getAllInstalledPackagePaths();
+    for (int i = 0; i < paths.size(); i++) {
+        QString p = QFileInfo(QDir::cleanPath(paths.at(i))).absolutePath();
+        p = QDir::toNativeSeparators(p);
+        if (!r.contains(p, Qt::CaseInsensitive))
+            r.append(p);
+    }
+    QString p = QDir::toNativeSeparators(QDir::cleanPath(
+            getInstallationDirectory()));
+    if (!r.contains(p, Qt::CaseInsensitive))
+        r.append(p);
+
+    return r;
+}
+
+QList<QUrl> PackageUtils::getMirrorURLs(const QUrl &url)
+{
+    QString u = url.toString(QUrl::FullyEncoded);
+
+    // the policy overrides the user settings
+    WindowsRegistry wr;
+    QString err = wr.open(HKEY_LOCAL_MACHINE,
+            QStringLiteral("SOFTWARE\\Policies\\Npackd\\Mirrors"), false,
+            KEY_READ);
+    if (!err.isEmpty())
+        err = wr.open(
+                PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+                QStringLiteral("Software\\Npackd\\Npackd\\Mirrors"), false,
+                KEY_READ);
+
+    QList<QUrl> r;
+    if (err.isEmpty()) {
+        DWORD size = wr.getDWORD("size", &err);
+        if (err.isEmpty()) {
+            for (int i = 1; i <= static_cast<int>(size); i++) {
+                WindowsRegistry er;
+                err = er.open(wr, QString("%1").arg(i), KEY_READ);
+                if (!err.isEmpty())
+                    continue;
+
+                QString prefix = er.get("prefix", &err);
+                if (!err.isEmpty() || prefix.isEmpty() ||
+                        !u.startsWith(prefix, Qt::CaseInsensitive))
+                    continue;
+
+                QString mirror = er.get("mirror", &err);
+                if (!err.isEmpty() || mirror.isEmpty())
+                    continue;
+
+                QUrl m(mirror + u.mid(prefix.length()));
+                if (m.isValid() && m != url && !r.contains(m))
+                    r.append(m);
+            }
+        }
+    }
+
+    return r;
+}
+
 QList<QUrl *> PackageUtils::getRepositoryURLs(QString *err)
 {
     QStringList reps, comments;
@@ -87,6 +87,51 @@ public:
      */
     static void setCloseProcessType(DWORD cpt);
 
+    /**
+     * @return maximum data rate for all downloads in KiB per second or 0 for
+     *     no limit. The value is read from the "bandwidthLimit" registry
+     *     entry.
+     */
+    static DWORD getBandwidthLimit();
+
+    /**
+     * @return true if the files of the installed packages should be stored
+     *     only once (see FileStore). The value is read from the
+     *     "deduplication" registry entry. The default value is false.
+     */
+    static bool getDeduplication();
+
+    /**
+     * @return true if the directories of removed package versions should be
+     *     moved to the trash and deleted in the background (see Trash). The
+     *     value is read from the "deferredDeletion" registry entry. The
+     *     default value is false.
+     */
+    static bool getDeferredDeletion();
+
+    /**
+     * @brief starts deleting the directories left in the trash by previous
+     *     processes. The installed packages are read from the registry.
+     */
+    static void emptyTrash();
+
+    /**
+     * @return parent directories of all installed package versions and the
+     *     directory where the packages will be installed
+     */
+    static QStringList getPackageParentDirectories();
+
+    /**
+     * @brief returns the locally configured mirrors for a download URL. The
+     *     mirror map is read from the "Mirrors" registry key (the same layout
+     *     as for the repositories: "size" and the sub-keys 1, 2, ... with the
+     *     values "prefix" and "mirror"). An URL starting with "prefix" is
+     *     mapped to "mirror" followed by the rest of the URL.
+     * @param url original download URL
+     * @return alternative URLs for the same file. The list may be empty.
+     */
+    static QList<QUrl> getMirrorURLs(const QUrl& url);
+
     /**
      * @param err error message will be stored here
      * @return [move] newly created list of repositories
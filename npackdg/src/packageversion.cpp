@@ -38,8 +38,11 @@
 #include "dbrepository.h"
 #include "repositoryxmlhandler.h"
 #include "packageutils.h"
+#include "zipstreamextractor.h"
+#include "trash.h"
+#include "filestore.h"
+#include "memoryarena.h"
 
-QSemaphore PackageVersion::httpConnections(3);
 QSet<QString> PackageVersion::lockedPackageVersions;
 QMutex PackageVersion::lockedPackageVersionsMutex(QMutex::Recursive);
 
@@ -195,7 +198,8 @@ bool isFileSafeOfficeAntiVirus(const QString& filename, QString* err)
 }
 */
 
-int PackageVersion::indexOf(const QList<PackageVersion *> &pvs, PackageVersion* f)
+int PackageVersion::indexOf(const QList<PackageVersion *> &pvs,
+        const PackageVersion* f)
 {
     int r = -1;
     for (int i = 0; i < pvs.count(); i++) {
@@ -594,8 +598,21 @@ void PackageVersion::removeDirectory(Job* job, const QString& dir,
 
     QTemporaryDir tempDir;
 
+    bool deferred = PackageUtils::getDeferredDeletion();
+
     int n = 0;
     while (job->shouldProceed() && n < 10) {
+        // the content is deleted later in the background
+        d.refresh();
+        if (!d.exists()) {
+            break;
+        } else if (deferred) {
+            QString err = Trash::getDefault()->moveToTrash(d.absolutePath());
+            if (err.isEmpty())
+                break;
+            qCDebug(npackd) << err;
+        }
+
         d.refresh();
         if (d.exists()) {
             // qCDebug(npackd) << "moving to recycly bin" << d.absolutePath();
@@ -769,7 +786,6 @@ void PackageVersion::downloadTo(Job& job, const QString& filename, bool interact
 {
     QFile* f = new QFile(filename);
 
-    bool downloadOK = false;
     QString dsha1;
 
     if (job.shouldProceed()) {
@@ -777,51 +793,40 @@ void PackageVersion::downloadTo(Job& job, const QString& filename, bool interact
             job.setErrorMessage(QString(QObject::tr("Cannot open the file: %0")).
                     arg(f->fileName()));
         } else {
-            Job* djob = job.newSubJob(0.8,
+            Job* djob = job.newSubJob(0.9,
                     QObject::tr("Downloading & computing hash sum"));
 
+            // interrupted transfers are continued instead of being
+            // repeated from the beginning
             Downloader::Request request(this->download);
             request.file = f;
             if (!this->sha1.isEmpty())
                 request.hashSum = true;
             request.alg = this->hashSumType;
             request.interactive = interactive;
+            request.resumeAttempts = DOWNLOAD_RESUME_ATTEMPTS;
+            request.segments = DOWNLOAD_SEGMENTS;
+            QString err;
+            request.expectedLength = DBRepository::getDefault()->findURLSize(
+                    this->download.toString(), &err);
+            request.priority = TransferScheduler::INSTALL;
+            request.mirrors = this->mirrors +
+                    PackageUtils::getMirrorURLs(this->download);
             Downloader::Response response = Downloader::download(djob, request);
             dsha1 = response.hashSum;
-            downloadOK = djob->shouldProceed();
+            if (!djob->getErrorMessage().isEmpty())
+                job.setErrorMessage(QObject::tr("Error downloading %1: %2").
+                    arg(this->download.toString()).arg(
+                    djob->getErrorMessage()));
+            else
+                // the download size is shown in the package list and does
+                // not need to be requested from the server again
+                DBRepository::getDefault()->saveURLSize(
+                        this->download.toString(), f->size());
             f->close();
         }
     }
 
-    if (job.shouldProceed()) {
-        if (!downloadOK) {
-            if (!f->open(QIODevice::ReadWrite)) {
-                job.setErrorMessage(QObject::tr("Cannot open the file: %0").
-                        arg(f->fileName()));
-            } else {
-                double rest = 0.9 - job.getProgress();
-                Job* djob = job.newSubJob(rest,
-                        QObject::tr("Downloading & computing hash sum (2nd try)"));
-                Downloader::Request request(this->download);
-                request.file = f;
-                if (!this->sha1.isEmpty())
-                    request.hashSum = true;
-                request.alg = this->hashSumType;
-                request.interactive = interactive;
-                Downloader::Response response =
-                        Downloader::download(djob, request);
-                dsha1 = response.hashSum;
-                if (!djob->getErrorMessage().isEmpty())
-                    job.setErrorMessage(QObject::tr("Error downloading %1: %2").
-                        arg(this->download.toString()).arg(
-                        djob->getErrorMessage()));
-                f->close();
-            }
-        } else {
-            job.setProgress(0.9);
-        }
-    }
-
     delete f;
 
     if (job.shouldProceed())
@@ -1269,42 +1274,34 @@ QString PackageVersion::download_(Job* job, const QString& where,
     }
     job->setTitle(initialTitle);
 
-    bool httpConnectionAcquired = false;
-
-    if (job->shouldProceed()) {
-        job->setTitle(initialTitle + " / " +
-                QObject::tr("Waiting for a free HTTP connection"));
-
-        time_t start = time(nullptr);
-        while (!job->isCancelled()) {
-            httpConnectionAcquired = httpConnections.tryAcquire(1, 10000);
-            if (httpConnectionAcquired) {
-                job->setProgress(0.05);
-                break;
-            }
-
-            time_t seconds = time(nullptr) - start;
-            job->setTitle(initialTitle + " / " + QString(
-                    QObject::tr("Waiting for a free HTTP connection (%1 minutes)")).
-                    arg(seconds / 60));
-        }
-    }
-    job->setTitle(initialTitle);
-
     // qCDebug(npackd) << "install.3";
     QFile* f = new QFile(npackdDir + "\\__NpackdPackageDownload");
 
-    bool downloadOK = false;
     QString dsha1;
 
+    // ZIP files are extracted while they are being downloaded. The normal
+    // extraction is used if this fails.
+    std::unique_ptr<ZipStreamExtractor> extractor;
+    Job* ejob = nullptr;
+
     if (job->shouldProceed()) {
         if (!f->open(QIODevice::ReadWrite)) {
             job->setErrorMessage(QString(QObject::tr("Cannot open the file: %0")).
                     arg(f->fileName()));
         } else {
-            Job* djob = job->newSubJob(0.8,
+            if (this->type == 0) {
+                ejob = job->newSubJob(0, QObject::tr("Extracting files"),
+                        false, false);
+                extractor.reset(new ZipStreamExtractor(f->fileName(),
+                        npackdDir + "\\__NpackdStaging"));
+                extractor->start(ejob);
+            }
+
+            Job* djob = job->newSubJob(0.9 - job->getProgress(),
                     QObject::tr("Downloading & computing hash sum"));
 
+            // interrupted transfers are continued instead of being
+            // repeated from the beginning
             Downloader::Request request(this->download);
             request.file = f;
             if (!this->sha1.isEmpty())
@@ -1315,50 +1312,34 @@ QString PackageVersion::download_(Job* job, const QString& where,
             request.proxyPassword = proxyPassword;
             request.alg = this->hashSumType;
             request.interactive = interactive;
+            request.resumeAttempts = DOWNLOAD_RESUME_ATTEMPTS;
+            // the segments are written at their positions in the file and
+            // the streaming extraction needs the data in order
+            request.segments = extractor ? 1 : DOWNLOAD_SEGMENTS;
+            QString err;
+            request.expectedLength = DBRepository::getDefault()->findURLSize(
+                    this->download.toString(), &err);
+            request.priority = TransferScheduler::INSTALL;
+            request.mirrors = this->mirrors +
+                    PackageUtils::getMirrorURLs(this->download);
             Downloader::Response response = Downloader::download(djob, request);
             dsha1 = response.hashSum;
-            downloadOK = !djob->isCancelled() &&
-                    djob->getErrorMessage().isEmpty();
+            if (extractor)
+                extractor->finish(djob->getErrorMessage().isEmpty() &&
+                        !djob->isCancelled());
+            if (!djob->getErrorMessage().isEmpty())
+                job->setErrorMessage(QObject::tr("Error downloading %1: %2").
+                    arg(this->download.toString()).arg(
+                    djob->getErrorMessage()));
+            else
+                // the download size is shown in the package list and does
+                // not need to be requested from the server again
+                DBRepository::getDefault()->saveURLSize(
+                        this->download.toString(), f->size());
             f->close();
         }
     }
 
-    if (job->shouldProceed()) {
-        if (!downloadOK) {
-            if (!f->open(QIODevice::ReadWrite)) {
-                job->setErrorMessage(QObject::tr("Cannot open the file: %0").
-                        arg(f->fileName()));
-            } else {
-                double rest = 0.9 - job->getProgress();
-                Job* djob = job->newSubJob(rest,
-                        QObject::tr("Downloading & computing hash sum (2nd try)"));
-                Downloader::Request request(this->download);
-                request.file = f;
-                if (!this->sha1.isEmpty())
-                    request.hashSum = true;
-                request.user = user;
-                request.password = password;
-                request.proxyUser = proxyUser;
-                request.proxyPassword = proxyPassword;
-                request.alg = this->hashSumType;
-                request.interactive = interactive;
-                Downloader::Response response =
-                        Downloader::download(djob, request);
-                dsha1 = response.hashSum;
-                if (!djob->getErrorMessage().isEmpty())
-                    job->setErrorMessage(QObject::tr("Error downloading %1: %2").
-                        arg(this->download.toString()).arg(
-                        djob->getErrorMessage()));
-                f->close();
-            }
-        } else {
-            job->setProgress(0.9);
-        }
-    }
-
-    if (httpConnectionAcquired)
-        httpConnections.release();
-
     if (job->shouldProceed()) {
         if (!this->sha1.isEmpty()) {
             if (dsha1.toLower() != this->sha1.toLower()) {
@@ -1400,7 +1381,25 @@ QString PackageVersion::download_(Job* job, const QString& where,
 
     QString binary;
     if (job->shouldProceed()) {
-        if (this->type == 0) {
+        QString err;
+        if (this->type == 0 && extractor &&
+                ejob->getErrorMessage().isEmpty()) {
+            // the files were already extracted and verified
+            err = extractor->commit(d.absolutePath());
+            if (err.isEmpty())
+                job->setProgress(0.98);
+            else
+                qCDebug(npackd) << "PackageVersion::download_" << err;
+        }
+
+        if (this->type == 0 && (!extractor ||
+                !ejob->getErrorMessage().isEmpty() || !err.isEmpty())) {
+            if (ejob && !ejob->getErrorMessage().isEmpty())
+                qCDebug(npackd) << "PackageVersion::download_" <<
+                        ejob->getErrorMessage();
+            if (extractor)
+                extractor->discard();
+
             Job* djob = job->newSubJob(0.06, QObject::tr("Extracting files"));
             WPMUtils::unzip(djob, f->fileName(), d.absolutePath() + "\\");
             if (!djob->getErrorMessage().isEmpty())
@@ -1410,7 +1409,7 @@ QString PackageVersion::download_(Job* job, const QString& where,
                         arg(djob->getErrorMessage()));
             else if (!job->isCancelled())
                 job->setProgress(0.98);
-        } else {
+        } else if (this->type != 0) {
             job->setTitle(initialTitle + " / " +
                     QObject::tr("Renaming the downloaded file"));
             QString t = d.absolutePath();
@@ -1441,6 +1440,13 @@ QString PackageVersion::download_(Job* job, const QString& where,
         }
     }
 
+    // the extracted files are discarded if the hash sum or the antivirus
+    // check failed
+    if (extractor) {
+        extractor->finish(false);
+        extractor->discard();
+    }
+
     if (f && f->exists())
         f->remove();
 
@@ -1569,6 +1575,15 @@ void PackageVersion::install(Job* job, const QString& where,
         job->setProgress(0.98);
     }
 
+    if (job->shouldProceed() && PackageUtils::getDeduplication()) {
+        // the installation does not fail if the files cannot be shared
+        Job* sub = job->newSubJob(0.01,
+                QObject::tr("Sharing identical files with other installations"),
+                true, false);
+        FileStore store(QFileInfo(d.absolutePath()).absolutePath());
+        store.deduplicate(sub, d.absolutePath());
+    }
+
     bool success = false;
     if (job->shouldProceed()) {
         QString err = ip->setPackageVersionPath(
@@ -1635,10 +1650,10 @@ void PackageVersion::addDependencyVars(QStringList* vars)
         Dependency* d = this->dependencies.at(i);
         if (!d->var.isEmpty()) {
             vars->append(d->var);
-            InstalledPackageVersion* ipv = ip->findHighestInstalledMatch(*d);
+            std::shared_ptr<const InstalledPackageVersion> ipv =
+                    ip->findHighestInstalledMatchShared_(*d);
             if (ipv) {
                 vars->append(ipv->getDirectory());
-                delete ipv;
             } else {
                 // this could happen if a package was un-installed manually
                 // without Npackd or the repository has changed after this
@@ -1845,10 +1860,30 @@ PackageVersion* PackageVersion::clone() const
     r->sha1 = this->sha1;
     r->hashSumType = this->hashSumType;
     r->download = this->download;
+    r->mirrors = this->mirrors;
 
     return r;
 }
 
+void* PackageVersion::operator new(size_t size)
+{
+    return MemoryArena::allocate(size);
+}
+
+void PackageVersion::operator delete(void* p)
+{
+    MemoryArena::free(p);
+}
+
+void* PackageVersion::operator new(size_t /*size*/, void* place)
+{
+    return place;
+}
+
+void PackageVersion::operator delete(void* /*p*/, void* /*place*/)
+{
+}
+
 PackageVersion *PackageVersion::parse(const QByteArray &xml, QString *err,
         bool /*validate*/)
 {
@@ -1911,6 +1946,10 @@ void PackageVersion::toXML(QXmlStreamWriter *w) const
         w->writeTextElement("url", this->download.toString(
                 QUrl::FullyEncoded));
     }
+    for (int i = 0; i < this->mirrors.count(); i++) {
+        w->writeTextElement("mirror", this->mirrors.at(i).toString(
+                QUrl::FullyEncoded));
+    }
     if (!this->sha1.isEmpty()) {
         if (this->hashSumType == QCryptographicHash::Sha1)
             w->writeTextElement("sha1", this->sha1);
@@ -1977,6 +2016,13 @@ void PackageVersion::toJSON(QJsonObject& w) const
     if (this->download.isValid()) {
         w["url"] = this->download.toString(QUrl::FullyEncoded);
     }
+    if (!mirrors.isEmpty()) {
+        QJsonArray mirror;
+        for (int i = 0; i < this->mirrors.count(); i++) {
+            mirror.append(this->mirrors.at(i).toString(QUrl::FullyEncoded));
+        }
+        w["mirrors"] = mirror;
+    }
     if (!this->sha1.isEmpty()) {
         if (this->hashSumType == QCryptographicHash::Sha1)
             w["sha1"] = this->sha1;
@@ -41,7 +41,11 @@ class InstalledPackages;
 class PackageVersion
 {
 private:    
-    static QSemaphore httpConnections;
+    /** how many times an interrupted download of a binary is continued */
+    static const int DOWNLOAD_RESUME_ATTEMPTS = 3;
+
+    /** maximum number of parallel connections for one large binary */
+    static const int DOWNLOAD_SEGMENTS = 4;
 
     /**
      * Set of PackageVersion::getStringId() for the locked package versions.
@@ -88,7 +92,9 @@ private:
             Job* job, bool menu, bool desktop, bool quickLaunch);
 
     /**
-     * Deletes a directory. If something cannot be deleted, it waits and
+     * Deletes a directory. The directory is moved to the trash (see Trash)
+     * and deleted in the background. If this is not possible, the directory
+     * is deleted directly. If something cannot be deleted, it waits and
      * tries to delete the directory again. Moves the directory to .Trash if
      * it cannot be moved to the recycle bin.
      *
@@ -133,7 +139,8 @@ public:
      * @param f search for this object
      * @return index of the found object or -1
      */
-    static int indexOf(const QList<PackageVersion*>& pvs, PackageVersion* f);
+    static int indexOf(const QList<PackageVersion*>& pvs,
+            const PackageVersion* f);
 
     /**
      * @param package package name will be stored here or "" if none
@@ -222,6 +229,11 @@ public:
      */
     QUrl download;
 
+    /**
+     * alternative URLs for the same file as "download"
+     */
+    QList<QUrl> mirrors;
+
     /**
      * unknown/1.0
      */
@@ -435,6 +447,32 @@ public:
      */
     void toJSON(QJsonObject &w) const;
 
+    /**
+     * @brief allocates the memory from the current MemoryArena
+     * @param size size of the object
+     * @return memory
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * @param p memory allocated by operator new
+     */
+    static void operator delete(void* p);
+
+    /**
+     * @brief placement new is hidden by operator new and used by QMetaType
+     * @param size size of the object
+     * @param place memory for the object
+     * @return place
+     */
+    static void* operator new(size_t size, void* place);
+
+    /**
+     * @param p memory
+     * @param place memory for the object
+     */
+    static void operator delete(void* p, void* place);
+
     /**
      * @return a copy
      */
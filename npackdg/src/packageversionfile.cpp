@@ -1,4 +1,5 @@
 #include "packageversionfile.h"
+#include "memoryarena.h"
 
 PackageVersionFile::PackageVersionFile(const QString& path,
         const QString& content): path(path), content(content)
@@ -10,3 +11,13 @@ PackageVersionFile *PackageVersionFile::clone() const
     PackageVersionFile* r = new PackageVersionFile(path, content);
     return r;
 }
+
+void* PackageVersionFile::operator new(size_t size)
+{
+    return MemoryArena::allocate(size);
+}
+
+void PackageVersionFile::operator delete(void* p)
+{
+    MemoryArena::free(p);
+}
@@ -17,6 +17,18 @@ public:
 
     PackageVersionFile(const QString& path, const QString& content);
 
+    /**
+     * @brief allocates the memory from the current MemoryArena
+     * @param size size of the object
+     * @return memory
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * @param p memory allocated by operator new
+     */
+    static void operator delete(void* p);
+
     /**
      * @return [move] copy of this object
      */
@@ -0,0 +1,235 @@
+#include <functional>
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QAuthenticator>
+#include <QNetworkProxy>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QLoggingCategory>
+
+#include "qttransport.h"
+#include "wpmutils.h"
+
+/**
+ * @brief runs a local event loop until a condition is met
+ * @param job the waiting is stopped if this job is cancelled
+ * @param reply the loop is woken up by the signals of this reply
+ * @param timeout maximum time in seconds without receiving any data
+ * @param done condition
+ * @return error message or ""
+ */
+static QString waitForReply(Job* job, QNetworkReply* reply, int timeout,
+        const std::function<bool()>& done)
+{
+    QString err;
+
+    QElapsedTimer idle;
+    idle.start();
+
+    QEventLoop loop;
+    QObject::connect(reply, &QNetworkReply::readyRead, &loop, [&]() {
+        idle.restart();
+        loop.quit();
+    });
+    QObject::connect(reply, &QNetworkReply::metaDataChanged,
+            &loop, &QEventLoop::quit);
+    QObject::connect(reply, &QNetworkReply::finished,
+            &loop, &QEventLoop::quit);
+
+    // check for the cancellation regularly
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    timer.start(100);
+
+    while (!done()) {
+        if (job->isCancelled()) {
+            err = QObject::tr("Cancelled by the user");
+            break;
+        }
+
+        if (idle.elapsed() > static_cast<qint64>(timeout) * 1000) {
+            err = QObject::tr("The operation timed out");
+            break;
+        }
+
+        loop.exec();
+    }
+
+    return err;
+}
+
+/**
+ * @brief response data of a QNetworkReply. The device owns the reply and the
+ *     manager.
+ */
+class QtTransportDevice: public QIODevice
+{
+    QNetworkAccessManager* manager;
+    QNetworkReply* reply;
+    Job* job;
+    int timeout;
+public:
+    QtTransportDevice(QNetworkAccessManager* manager, QNetworkReply* reply,
+            Job* job, int timeout): manager(manager), reply(reply), job(job),
+            timeout(timeout) {
+        QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    ~QtTransportDevice() override {
+        close();
+        if (!reply->isFinished())
+            reply->abort();
+        delete reply;
+        delete manager;
+    }
+
+    bool isSequential() const override {
+        return true;
+    }
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        QString err = waitForReply(job, reply, timeout, [this]() {
+            return reply->bytesAvailable() > 0 || reply->isFinished();
+        });
+
+        if (err.isEmpty() && reply->bytesAvailable() == 0 &&
+                reply->error() != QNetworkReply::NoError &&
+                reply->error() < QNetworkReply::ContentAccessDenied)
+            err = reply->errorString();
+
+        if (!err.isEmpty()) {
+            setErrorString(err);
+            return -1;
+        }
+
+        return reply->read(data, maxSize);
+    }
+
+    qint64 writeData(const char * /*data*/, qint64 /*maxSize*/) override {
+        return -1;
+    }
+};
+
+QIODevice* QtTransport::open(Job* job, const Downloader::Request& request,
+        Downloader::Response* response, bool* gzip)
+{
+    // Qt decodes the compressed data itself
+    *gzip = false;
+
+    QNetworkRequest r(request.url);
+    r.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    r.setHeader(QNetworkRequest::UserAgentHeader,
+            QString("Npackd/%1").arg(NPACKD_VERSION));
+
+    if (!request.useCache) {
+        r.setRawHeader("Cache-Control", "no-cache");
+        r.setRawHeader("Pragma", "no-cache");
+    }
+
+    // Qt adds "Accept-Encoding: gzip, deflate" otherwise
+    if (!request.canBeCompressed())
+        r.setRawHeader("Accept-Encoding", "identity");
+
+    if (!request.ifNoneMatch.isEmpty())
+        r.setRawHeader("If-None-Match", request.ifNoneMatch.toLatin1());
+    if (!request.ifModifiedSince.isEmpty())
+        r.setRawHeader("If-Modified-Since", request.ifModifiedSince.toLatin1());
+
+    if (request.isPartial())
+        r.setRawHeader("Range", request.getRange().toLatin1());
+
+    // additional headers like "Content-Type: text/xml\r\n"
+    const QStringList headers = request.headers.split("\r\n",
+            QString::SkipEmptyParts);
+    for (int i = 0; i < headers.size(); i++) {
+        const QString& h = headers.at(i);
+        int pos = h.indexOf(':');
+        if (pos > 0)
+            r.setRawHeader(h.left(pos).trimmed().toLatin1(),
+                    h.mid(pos + 1).trimmed().toLatin1());
+    }
+
+    QNetworkAccessManager* manager = new QNetworkAccessManager();
+
+    // the credentials are only offered once. Otherwise Qt would repeat the
+    // request forever.
+    QString user = request.user, password = request.password;
+    QObject::connect(manager, &QNetworkAccessManager::authenticationRequired,
+            [user, password](QNetworkReply*, QAuthenticator* a) mutable {
+        if (!user.isEmpty()) {
+            a->setUser(user);
+            a->setPassword(password);
+            user.clear();
+        }
+    });
+    QString proxyUser = request.proxyUser,
+            proxyPassword = request.proxyPassword;
+    QObject::connect(manager,
+            &QNetworkAccessManager::proxyAuthenticationRequired,
+            [proxyUser, proxyPassword](const QNetworkProxy&,
+            QAuthenticator* a) mutable {
+        if (!proxyUser.isEmpty()) {
+            a->setUser(proxyUser);
+            a->setPassword(proxyPassword);
+            proxyUser.clear();
+        }
+    });
+
+    QNetworkReply* reply;
+    if (request.httpMethod == "HEAD")
+        reply = manager->head(r);
+    else
+        reply = manager->sendCustomRequest(r, request.httpMethod.toLatin1(),
+                request.postData);
+
+    // wait for the response headers
+    QString err = waitForReply(job, reply, request.timeout, [reply]() {
+        return reply->isFinished() || reply->attribute(
+                QNetworkRequest::HttpStatusCodeAttribute).isValid();
+    });
+
+    QVariant status = reply->attribute(
+            QNetworkRequest::HttpStatusCodeAttribute);
+    if (err.isEmpty() && !status.isValid())
+        err = reply->errorString();
+
+    qCDebug(npackd) << "QtTransport::open" << request.url << status << err;
+
+    QIODevice* result = nullptr;
+    if (err.isEmpty()) {
+        response->statusCode = status.toInt();
+
+        response->mimeType = reply->header(
+                QNetworkRequest::ContentTypeHeader).toString();
+        if (response->mimeType.isEmpty())
+            response->mimeType = "application/octet-stream";
+
+        response->contentDisposition = QString::fromLatin1(
+                reply->rawHeader("Content-Disposition"));
+
+        // the length of the encoded data cannot be compared with the
+        // decoded data
+        QVariant cl = reply->header(QNetworkRequest::ContentLengthHeader);
+        if (cl.isValid() && !reply->hasRawHeader("Content-Encoding"))
+            response->contentLength = cl.toLongLong();
+
+        response->etag = QString::fromLatin1(reply->rawHeader("ETag"));
+        response->lastModified = QString::fromLatin1(
+                reply->rawHeader("Last-Modified"));
+        response->acceptRanges = QString::fromLatin1(
+                reply->rawHeader("Accept-Ranges")).trimmed().toLower() ==
+                "bytes";
+
+        result = new QtTransportDevice(manager, reply, job, request.timeout);
+    } else {
+        job->setErrorMessage(err);
+        reply->abort();
+        delete reply;
+        delete manager;
+    }
+
+    return result;
+}
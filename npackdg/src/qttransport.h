@@ -0,0 +1,21 @@
+#ifndef QTTRANSPORT_H
+#define QTTRANSPORT_H
+
+#include "abstracttransport.h"
+
+/**
+ * @brief portable HTTP transport based on QNetworkAccessManager. A new
+ *     manager is created for every request in the calling thread and the
+ *     response is read by running a local event loop. gzip and deflate
+ *     encoded responses are decoded by Qt. The WinINet cache, the Windows
+ *     dialogs for the authentication and Request::useInternet are not
+ *     supported.
+ */
+class QtTransport: public AbstractTransport
+{
+public:
+    QIODevice* open(Job* job, const Downloader::Request& request,
+            Downloader::Response* response, bool* gzip) override;
+};
+
+#endif // QTTRANSPORT_H
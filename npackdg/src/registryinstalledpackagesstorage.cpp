@@ -0,0 +1,129 @@
+#include <windows.h>
+
+#include <QDir>
+
+#include "registryinstalledpackagesstorage.h"
+#include "windowsregistry.h"
+#include "packageutils.h"
+#include "package.h"
+#include "wpmutils.h"
+
+const QString RegistryInstalledPackagesStorage::KEY_NAME =
+        QStringLiteral("SOFTWARE\\Npackd\\Npackd\\Packages");
+
+QString RegistryInstalledPackagesStorage::load(
+        QList<InstalledPackageVersion*>* ipvs)
+{
+    QString err;
+
+    WindowsRegistry packagesWR;
+    LONG e;
+    err = packagesWR.open(
+        PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+            KEY_NAME, false, KEY_READ, &e);
+
+    if (e == ERROR_FILE_NOT_FOUND || e == ERROR_PATH_NOT_FOUND) {
+        err = "";
+    } else if (err.isEmpty()) {
+        QStringList entries = packagesWR.list(&err);
+        for (int i = 0; i < entries.count(); ++i) {
+            QString name = entries.at(i);
+            int pos = name.lastIndexOf("-");
+            if (pos <= 0)
+                continue;
+
+            QString packageName = name.left(pos);
+            if (!Package::isValidName(packageName))
+                continue;
+
+            QString versionName = name.right(name.length() - pos - 1);
+            Version version;
+            if (!version.setVersion(versionName))
+                continue;
+
+            WindowsRegistry entryWR;
+            err = entryWR.open(packagesWR, name, KEY_READ);
+            if (!err.isEmpty())
+                continue;
+
+            QString p = entryWR.get("Path", &err).trimmed();
+            if (!err.isEmpty())
+                continue;
+
+            QString dir;
+            if (p.isEmpty())
+                dir = "";
+            else {
+                QDir d(p);
+                if (d.exists()) {
+                    dir = p;
+                } else {
+                    dir = "";
+                }
+            }
+
+            if (dir.isEmpty()) {
+                packagesWR.remove(name);
+            } else {
+                dir = WPMUtils::normalizePath(dir, false);
+
+                InstalledPackageVersion* ipv = new InstalledPackageVersion(
+                        packageName, version, dir);
+                ipv->detectionInfo = entryWR.get("DetectionInfo", &err);
+                if (!err.isEmpty()) {
+                    // ignore
+                    ipv->detectionInfo = "";
+                    err = "";
+                }
+
+                if (!ipv->directory.isEmpty()) {
+                    ipvs->append(ipv);
+                } else {
+                    delete ipv;
+                }
+            }
+        }
+    }
+
+    return err;
+}
+
+QString RegistryInstalledPackagesStorage::save(
+        const QList<InstalledPackageVersion*>& ipvs)
+{
+    QString r;
+
+    if (ipvs.isEmpty())
+        return r;
+
+    // the key for all packages is only opened once
+    WindowsRegistry machineWR(
+            PackageUtils::globalMode ? HKEY_LOCAL_MACHINE : HKEY_CURRENT_USER,
+            false);
+    WindowsRegistry packages = machineWR.createSubKey(KEY_NAME, &r);
+
+    for (int i = 0; i < ipvs.size() && r.isEmpty(); i++) {
+        InstalledPackageVersion* ipv = ipvs.at(i);
+
+        Version v = ipv->version;
+        v.normalize();
+        QString pn = ipv->package + "-" + v.getVersionString();
+
+        if (!ipv->directory.isEmpty()) {
+            WindowsRegistry wr = packages.createSubKey(pn, &r);
+            if (r.isEmpty()) {
+                wr.set("DetectionInfo", ipv->detectionInfo);
+
+                // for compatibility with Npackd 1.16 and earlier. They
+                // see all package versions by default as "externally installed"
+                wr.setDWORD("External", 0);
+
+                r = wr.set("Path", ipv->directory);
+            }
+        } else {
+            r = packages.remove(pn);
+        }
+    }
+
+    return r;
+}
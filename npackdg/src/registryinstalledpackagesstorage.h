@@ -0,0 +1,19 @@
+#ifndef REGISTRYINSTALLEDPACKAGESSTORAGE_H
+#define REGISTRYINSTALLEDPACKAGESSTORAGE_H
+
+#include "abstractinstalledpackagesstorage.h"
+
+/**
+ * @brief stores the installed package versions in the Windows registry under
+ *     SOFTWARE\Npackd\Npackd\Packages (HKLM or HKCU depending on
+ *     PackageUtils::globalMode)
+ */
+class RegistryInstalledPackagesStorage: public AbstractInstalledPackagesStorage
+{
+    static const QString KEY_NAME;
+public:
+    QString load(QList<InstalledPackageVersion*>* ipvs);
+    QString save(const QList<InstalledPackageVersion*>& ipvs);
+};
+
+#endif // REGISTRYINSTALLEDPACKAGESSTORAGE_H
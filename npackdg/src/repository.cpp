@@ -268,6 +268,9 @@ QString Repository::savePackage(Package *p, bool replace)
         fp->description = p->description;
         fp->license = p->license;
         fp->categories = p->categories;
+        fp->tags = p->tags;
+        fp->links = p->links;
+        fp->stars = p->stars;
     }
 
     return "";
@@ -0,0 +1,330 @@
+#include <QObject>
+#include <QMap>
+#include <QByteArray>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QXmlSimpleReader>
+#include <QXmlInputSource>
+#include <QCryptographicHash>
+
+#include "repositorydelta.h"
+#include "repositoryxmlhandler.h"
+#include "wpmutils.h"
+#include "memoryarena.h"
+
+const QString RepositoryDelta::HEADER = QStringLiteral(
+        "X-Npackd-Repository-SHA1");
+
+/**
+ * @param lic a license
+ * @return XML for the comparison
+ */
+static QByteArray toXMLBytes(const License* lic)
+{
+    QByteArray r;
+    QXmlStreamWriter w(&r);
+    lic->toXML(w);
+    return r;
+}
+
+/**
+ * @param p a package
+ * @return XML for the comparison
+ */
+static QByteArray toXMLBytes(const Package* p)
+{
+    QByteArray r;
+    QXmlStreamWriter w(&r);
+    p->toXML(&w);
+    return r;
+}
+
+/**
+ * @param pv a package version
+ * @return XML for the comparison
+ */
+static QByteArray toXMLBytes(const PackageVersion* pv)
+{
+    QByteArray r;
+    QXmlStreamWriter w(&r);
+    pv->toXML(&w);
+    return r;
+}
+
+/**
+ * @param pv a package version
+ * @return key for the comparison
+ */
+static QString versionKey(const PackageVersion* pv)
+{
+    Version v(pv->version);
+    v.normalize();
+    return pv->package + '/' + v.getVersionString();
+}
+
+bool RepositoryDelta::hasRemovals() const
+{
+    return !removedLicenses.isEmpty() || !removedPackages.isEmpty() ||
+            !removedVersions.isEmpty();
+}
+
+bool RepositoryDelta::isDelta(QFile* f)
+{
+    bool r = false;
+    if (f->open(QFile::ReadOnly)) {
+        QXmlStreamReader reader(f);
+        if (reader.readNextStartElement())
+            r = reader.name() == QStringLiteral("delta");
+        f->close();
+    }
+    return r;
+}
+
+QString RepositoryDelta::parseRemovals(QFile* f)
+{
+    QString err;
+
+    QXmlStreamReader reader(f);
+    if (!reader.readNextStartElement() ||
+            reader.name() != QStringLiteral("delta"))
+        err = QObject::tr("<delta> expected");
+
+    if (err.isEmpty()) {
+        from = reader.attributes().value(QStringLiteral("from")).toString();
+        to = reader.attributes().value(QStringLiteral("to")).toString();
+
+        while (err.isEmpty() && reader.readNextStartElement()) {
+            QXmlStreamAttributes atts = reader.attributes();
+            if (reader.name() == QStringLiteral("remove-license")) {
+                removedLicenses.append(
+                        atts.value(QStringLiteral("name")).toString());
+            } else if (reader.name() == QStringLiteral("remove-package")) {
+                removedPackages.append(
+                        atts.value(QStringLiteral("name")).toString());
+            } else if (reader.name() == QStringLiteral("remove-version")) {
+                QString package = atts.value(
+                        QStringLiteral("package")).toString();
+                QString name = atts.value(QStringLiteral("name")).toString();
+                Version v;
+                if (v.setVersion(name)) {
+                    v.normalize();
+                    removedVersions.append(qMakePair(package, v));
+                } else {
+                    err = QObject::tr("Not a valid version for %1: %2").
+                            arg(package).arg(name);
+                }
+            }
+            reader.skipCurrentElement();
+        }
+    }
+
+    if (err.isEmpty() && reader.hasError())
+        err = reader.errorString();
+
+    if (err.isEmpty() && (!WPMUtils::validateSHA1(from).isEmpty() ||
+            !WPMUtils::validateSHA1(to).isEmpty()))
+        err = QObject::tr("Invalid SHA1 values in <delta>");
+
+    return err;
+}
+
+QString RepositoryDelta::parse(QFile* f, const QUrl& url)
+{
+    QString err;
+
+    if (!f->open(QFile::ReadOnly))
+        err = f->errorString();
+
+    if (err.isEmpty())
+        err = parseRemovals(f);
+
+    // the added and changed entries have the same format as in a repository
+    if (err.isEmpty() && !f->seek(0))
+        err = f->errorString();
+
+    if (err.isEmpty()) {
+        RepositoryXMLHandler handler(&changed, url);
+        QXmlSimpleReader reader;
+        reader.setContentHandler(&handler);
+        reader.setErrorHandler(&handler);
+        QXmlInputSource inputSource(f);
+        if (!reader.parse(inputSource))
+            err = handler.errorString();
+    }
+
+    f->close();
+
+    return err;
+}
+
+void RepositoryDelta::loadRepository(Job* job, const QString& filename,
+        Repository* rep)
+{
+    QFile file(filename);
+    QFile* f = &file;
+
+    QTemporaryDir dir;
+    QFile xmlInZIP(dir.path() + QStringLiteral("\\Rep.xml"));
+    if (job->shouldProceed()) {
+        if (!f->open(QFile::ReadOnly)) {
+            job->setErrorMessage(QObject::tr("Cannot open the file: %0").
+                    arg(filename));
+        } else if (f->read(4) == QByteArray::fromRawData("PK\x03\x04", 4)) {
+            Job* sub = job->newSubJob(0.3, QObject::tr("Extracting"));
+            WPMUtils::unzip(sub, filename, dir.path() + "\\");
+            if (!sub->getErrorMessage().isEmpty())
+                job->setErrorMessage(
+                        QObject::tr("Unzipping the repository %1 failed: %2").
+                        arg(filename).arg(sub->getErrorMessage()));
+            else if (!xmlInZIP.exists())
+                job->setErrorMessage(QObject::tr(
+                        "Rep.xml is missing in a repository in ZIP format"));
+            else
+                f = &xmlInZIP;
+        }
+        file.close();
+    }
+
+    if (job->shouldProceed()) {
+        // the copies stored in the repository keep the memory of the arena
+        MemoryArena arena;
+        MemoryArena::Scope scope(&arena);
+
+        RepositoryXMLHandler handler(rep, QUrl::fromLocalFile(filename));
+        QXmlSimpleReader reader;
+        reader.setContentHandler(&handler);
+        reader.setErrorHandler(&handler);
+        QXmlInputSource inputSource(f);
+        if (!reader.parse(inputSource))
+            job->setErrorMessage(QObject::tr("Error parsing %1: %2").
+                    arg(filename).arg(handler.errorString()));
+        else
+            job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+void RepositoryDelta::create(Job* job, const QString& oldFile,
+        const QString& newFile)
+{
+    QStringList files;
+    files << oldFile << newFile;
+    QStringList sha1s;
+    for (int i = 0; i < files.size(); i++) {
+        if (!job->shouldProceed())
+            break;
+
+        QFile f(files.at(i));
+        if (!f.open(QFile::ReadOnly)) {
+            job->setErrorMessage(QObject::tr("Cannot open the file: %0").
+                    arg(files.at(i)));
+        } else {
+            Job* sub = job->newSubJob(0.1, QObject::tr("Computing SHA1 for %1").
+                    arg(files.at(i)), true, true);
+            sha1s.append(WPMUtils::fileCheckSum(sub, &f,
+                    QCryptographicHash::Sha1));
+        }
+    }
+
+    Repository old, current;
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.3, QObject::tr("Reading %1").arg(oldFile),
+                true, true);
+        loadRepository(sub, oldFile, &old);
+    }
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.3, QObject::tr("Reading %1").arg(newFile),
+                true, true);
+        loadRepository(sub, newFile, &current);
+    }
+
+    if (job->shouldProceed()) {
+        from = sha1s.at(0);
+        to = sha1s.at(1);
+
+        QMap<QString, QByteArray> oldLicenses;
+        for (int i = 0; i < old.licenses.size(); i++) {
+            License* lic = old.licenses.at(i);
+            oldLicenses.insert(lic->name, toXMLBytes(lic));
+        }
+        for (int i = 0; i < current.licenses.size(); i++) {
+            License* lic = current.licenses.at(i);
+            if (oldLicenses.value(lic->name) != toXMLBytes(lic))
+                changed.saveLicense(lic, false);
+            oldLicenses.remove(lic->name);
+        }
+        removedLicenses = oldLicenses.keys();
+
+        QMap<QString, QByteArray> oldPackages;
+        for (int i = 0; i < old.packages.size(); i++) {
+            Package* p = old.packages.at(i);
+            oldPackages.insert(p->name, toXMLBytes(p));
+        }
+        for (int i = 0; i < current.packages.size(); i++) {
+            Package* p = current.packages.at(i);
+            if (oldPackages.value(p->name) != toXMLBytes(p))
+                changed.savePackage(p, false);
+            oldPackages.remove(p->name);
+        }
+        removedPackages = oldPackages.keys();
+
+        QMap<QString, QByteArray> oldVersions;
+        QMap<QString, PackageVersion*> oldVersionObjects;
+        for (int i = 0; i < old.packageVersions.size(); i++) {
+            PackageVersion* pv = old.packageVersions.at(i);
+            oldVersions.insert(versionKey(pv), toXMLBytes(pv));
+            oldVersionObjects.insert(versionKey(pv), pv);
+        }
+        for (int i = 0; i < current.packageVersions.size(); i++) {
+            PackageVersion* pv = current.packageVersions.at(i);
+            QString key = versionKey(pv);
+            if (oldVersions.value(key) != toXMLBytes(pv))
+                changed.savePackageVersion(pv, false);
+            oldVersions.remove(key);
+        }
+        QList<QString> keys = oldVersions.keys();
+        for (int i = 0; i < keys.size(); i++) {
+            PackageVersion* pv = oldVersionObjects.value(keys.at(i));
+            Version v(pv->version);
+            v.normalize();
+            removedVersions.append(qMakePair(pv->package, v));
+        }
+
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+void RepositoryDelta::toXML(QXmlStreamWriter& w) const
+{
+    w.writeStartElement(QStringLiteral("delta"));
+    w.writeAttribute(QStringLiteral("from"), from);
+    w.writeAttribute(QStringLiteral("to"), to);
+
+    for (int i = 0; i < removedLicenses.size(); i++) {
+        w.writeEmptyElement(QStringLiteral("remove-license"));
+        w.writeAttribute(QStringLiteral("name"), removedLicenses.at(i));
+    }
+    for (int i = 0; i < removedPackages.size(); i++) {
+        w.writeEmptyElement(QStringLiteral("remove-package"));
+        w.writeAttribute(QStringLiteral("name"), removedPackages.at(i));
+    }
+    for (int i = 0; i < removedVersions.size(); i++) {
+        w.writeEmptyElement(QStringLiteral("remove-version"));
+        w.writeAttribute(QStringLiteral("package"),
+                removedVersions.at(i).first);
+        w.writeAttribute(QStringLiteral("name"),
+                removedVersions.at(i).second.getVersionString());
+    }
+
+    for (int i = 0; i < changed.licenses.size(); i++)
+        changed.licenses.at(i)->toXML(w);
+    for (int i = 0; i < changed.packages.size(); i++)
+        changed.packages.at(i)->toXML(&w);
+    for (int i = 0; i < changed.packageVersions.size(); i++)
+        changed.packageVersions.at(i)->toXML(&w);
+
+    w.writeEndElement();
+}
@@ -0,0 +1,107 @@
+#ifndef REPOSITORYDELTA_H
+#define REPOSITORYDELTA_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QFile>
+#include <QUrl>
+#include <QXmlStreamWriter>
+
+#include "repository.h"
+#include "version.h"
+#include "job.h"
+
+/**
+ * @brief changes between two published versions of a repository.
+ *
+ * A client sends the SHA-1 of the repository data it already has in the
+ * HTTP header "X-Npackd-Repository-SHA1". The server may answer with a delta
+ * instead of the whole repository:
+ *
+ * <delta from="SHA-1 of the old data" to="SHA-1 of the new data">
+ *     <remove-license name="..."/>
+ *     <remove-package name="..."/>
+ *     <remove-version package="..." name="..."/>
+ *     <license>, <package> and <version> for added or changed entries in the
+ *         same format as in a repository
+ * </delta>
+ *
+ * The SHA-1 values are computed over the repository file as it is served
+ * (.xml or .zip).
+ */
+class RepositoryDelta
+{
+    /**
+     * @brief reads a repository from an .xml or .zip file
+     * @param job job
+     * @param filename file name
+     * @param rep the data will be stored here
+     */
+    static void loadRepository(Job* job, const QString& filename,
+            Repository* rep);
+
+    /**
+     * @brief reads the <remove-...> entries and the attributes of <delta>
+     * @param f the file
+     * @return error message or ""
+     */
+    QString parseRemovals(QFile* f);
+public:
+    /** name of the HTTP request header for the SHA-1 of the current data */
+    static const QString HEADER;
+
+    /** SHA-1 of the repository data this delta should be applied to */
+    QString from;
+
+    /** SHA-1 of the repository data after applying this delta */
+    QString to;
+
+    /** added or changed licenses, packages and package versions */
+    Repository changed;
+
+    /** names of the removed licenses */
+    QStringList removedLicenses;
+
+    /** names of the removed packages */
+    QStringList removedPackages;
+
+    /** full package names and normalized versions of the removed versions */
+    QList<QPair<QString, Version> > removedVersions;
+
+    /**
+     * @return true if this delta removes at least one entry
+     */
+    bool hasRemovals() const;
+
+    /**
+     * @param f a downloaded repository or delta. The file should be closed.
+     * @return true if the file contains a delta and not a whole repository
+     */
+    static bool isDelta(QFile* f);
+
+    /**
+     * @brief reads a delta
+     * @param f the file. The file should be closed.
+     * @param url this value will be used for resolving relative URLs
+     * @return error message or ""
+     */
+    QString parse(QFile* f, const QUrl& url);
+
+    /**
+     * @brief computes the changes between two versions of a repository
+     * @param job job
+     * @param oldFile previous version of the repository (.xml or .zip)
+     * @param newFile current version of the repository (.xml or .zip)
+     */
+    void create(Job* job, const QString& oldFile, const QString& newFile);
+
+    /**
+     * @brief stores this object as XML <delta>
+     * @param w output
+     */
+    void toXML(QXmlStreamWriter& w) const;
+};
+
+#endif // REPOSITORYDELTA_H
@@ -6,6 +6,7 @@
 #include "wpmutils.h"
 #include "packageversionfile.h"
 #include "packageutils.h"
+#include "stringpool.h"
 
 int RepositoryXMLHandler::findWhere()
 {
@@ -39,6 +40,8 @@ int RepositoryXMLHandler::findWhere()
                     r = TAG_VERSION_DETECT_FILE;
                 else if (tag2 == QStringLiteral("url"))
                     r = TAG_VERSION_URL;
+                else if (tag2 == QStringLiteral("mirror"))
+                    r = TAG_VERSION_MIRROR;
                 else if (tag2 == QStringLiteral("sha1"))
                     r = TAG_VERSION_SHA1;
                 else if (tag2 == QStringLiteral("hash-sum"))
@@ -133,7 +136,7 @@ bool RepositoryXMLHandler::startElement(const QString &/*namespaceURI*/,
             error = QObject::tr("Error in the attribute 'package' in <version>: %1").
                     arg(error);
         } else {
-            pv->package = packageName;
+            pv->package = StringPool::intern(packageName);
         }
 
         if (error.isEmpty()) {
@@ -232,12 +235,12 @@ bool RepositoryXMLHandler::startElement(const QString &/*namespaceURI*/,
         QString versions = atts.value(QStringLiteral("versions"));
         dep = new Dependency();
         pv->dependencies.append(dep);
-        dep->package = package;
+        dep->package = StringPool::intern(package);
         if (!dep->setVersions(versions))
             error = QObject::tr("Error in attribute 'versions' in <dependency> in %1").
                     arg(pv->toString());
     } else if (where == TAG_PACKAGE) {
-        QString name = atts.value(QStringLiteral("name"));
+        QString name = StringPool::intern(atts.value(QStringLiteral("name")));
         p = new Package(name, name);
 
         error = PackageUtils::validateFullPackageName(name);
@@ -295,6 +298,13 @@ bool RepositoryXMLHandler::endElement(const QString &/*namespaceURI*/,
         if (error.isEmpty()) {
             pv->download.setUrl(url);
         }
+    } else if (where == TAG_VERSION_MIRROR) {
+        QString url = chars;
+        error = WPMUtils::checkURL(this->url, &url, true);
+
+        if (error.isEmpty()) {
+            pv->mirrors.append(QUrl(url));
+        }
     } else if (where == TAG_VERSION_SHA1) {
         pv->sha1 = chars.trimmed().toLower();
         pv->hashSumType = QCryptographicHash::Sha1;
@@ -27,6 +27,7 @@ class RepositoryXMLHandler: public QXmlDefaultHandler
         TAG_PACKAGE_CHANGELOG,
         TAG_LICENSE,
         TAG_VERSION_URL,
+        TAG_VERSION_MIRROR,
         TAG_VERSION_SHA1,
         TAG_VERSION_HASH_SUM,
         TAG_VERSION_DETECT_MSI,
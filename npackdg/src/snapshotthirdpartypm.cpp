@@ -0,0 +1,96 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QCryptographicHash>
+
+#include "snapshotthirdpartypm.h"
+
+SnapshotThirdPartyPM::SnapshotThirdPartyPM(const QString& filename,
+        const QString& detectionPrefix)
+{
+    this->detectionPrefix = detectionPrefix;
+
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly)) {
+        err = QObject::tr("Cannot open the file: %1").arg(filename);
+        return;
+    }
+
+    QByteArray data = f.readAll();
+    f.close();
+    source = QString::fromLatin1(QCryptographicHash::hash(data,
+            QCryptographicHash::Sha1).toHex());
+
+    QJsonParseError pe;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &pe);
+    if (pe.error != QJsonParseError::NoError) {
+        err = QObject::tr("Error parsing %1: %2").arg(filename).
+                arg(pe.errorString());
+        return;
+    }
+
+    QJsonArray a = doc.object().value(QStringLiteral("entries")).toArray();
+    for (int i = 0; i < a.size(); i++) {
+        QJsonObject o = a.at(i).toObject();
+        Entry e;
+        e.package = o.value(QStringLiteral("package")).toString();
+        e.title = o.value(QStringLiteral("title")).toString();
+        e.directory = o.value(QStringLiteral("directory")).toString();
+        e.detectionInfo = o.value(QStringLiteral("detectionInfo")).toString();
+        e.fingerprint = o.value(QStringLiteral("fingerprint")).toString();
+        if (!e.version.setVersion(
+                o.value(QStringLiteral("version")).toString())) {
+            err = QObject::tr("Not a valid version for %1: %2").
+                    arg(e.package).
+                    arg(o.value(QStringLiteral("version")).toString());
+            break;
+        }
+        e.version.normalize();
+        entries.append(e);
+        fingerprints.insert(e.detectionInfo, e.fingerprint);
+    }
+}
+
+void SnapshotThirdPartyPM::scan(Job* job,
+        QList<InstalledPackageVersion*>* installed, Repository* rep) const
+{
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+
+    if (job->shouldProceed()) {
+        for (int i = 0; i < entries.size(); i++) {
+            const Entry& e = entries.at(i);
+
+            Package p(e.package, e.title.isEmpty() ? e.package : e.title);
+            p.description = p.title;
+            rep->savePackage(&p, true);
+
+            PackageVersion pv(e.package, e.version);
+            rep->savePackageVersion(&pv, true);
+
+            InstalledPackageVersion* ipv = new InstalledPackageVersion(
+                    e.package, e.version, e.directory);
+            ipv->detectionInfo = e.detectionInfo;
+            installed->append(ipv);
+        }
+
+        job->setProgress(1);
+    }
+
+    job->complete();
+}
+
+QString SnapshotThirdPartyPM::getFingerprint(
+        const InstalledPackageVersion& ipv) const
+{
+    return fingerprints.value(ipv.detectionInfo);
+}
+
+QString SnapshotThirdPartyPM::getSourcesFingerprint() const
+{
+    if (!err.isEmpty())
+        return QString();
+
+    return source;
+}
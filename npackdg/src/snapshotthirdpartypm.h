@@ -0,0 +1,67 @@
+#ifndef SNAPSHOTTHIRDPARTYPM_H
+#define SNAPSHOTTHIRDPARTYPM_H
+
+#include <QList>
+#include <QMap>
+#include <QString>
+
+#include "job.h"
+#include "installedpackageversion.h"
+#include "repository.h"
+#include "abstractthirdpartypm.h"
+
+/**
+ * @brief package manager that reads the detected package versions and their
+ *     fingerprints from a JSON file instead of the system. This is a stand-in
+ *     for the other package managers in tests and benchmarks.
+ *
+ * Format:
+ * {
+ *     "entries": [
+ *         {"package": "...", "version": "...", "title": "...",
+ *          "directory": "...", "detectionInfo": "...",
+ *          "fingerprint": "..."}
+ *     ]
+ * }
+ */
+class SnapshotThirdPartyPM: public AbstractThirdPartyPM
+{
+    class Entry
+    {
+    public:
+        QString package;
+        Version version;
+        QString title;
+        QString directory;
+        QString detectionInfo;
+        QString fingerprint;
+    };
+
+    QString err;
+    QList<Entry> entries;
+
+    /** detection info -> fingerprint */
+    QMap<QString, QString> fingerprints;
+
+    /** SHA-1 of the file */
+    QString source;
+public:
+    /**
+     * @param filename JSON file
+     * @param detectionPrefix prefix for the detection info
+     */
+    SnapshotThirdPartyPM(const QString& filename,
+            const QString& detectionPrefix);
+
+    void scan(Job *job, QList<InstalledPackageVersion*>* installed,
+              Repository* rep) const;
+
+    QString getFingerprint(const InstalledPackageVersion& ipv) const;
+
+    /**
+     * @return SHA-1 of the file or "" if it could not be read
+     */
+    QString getSourcesFingerprint() const;
+};
+
+#endif // SNAPSHOTTHIRDPARTYPM_H
@@ -0,0 +1,49 @@
+#include <QSet>
+#include <QReadWriteLock>
+
+#include "stringpool.h"
+
+/**
+ * @return lock for getStrings(). A function is used so that the strings can
+ *     be interned during the static initialization.
+ */
+static QReadWriteLock* getLock()
+{
+    static QReadWriteLock lock;
+    return &lock;
+}
+
+/**
+ * @return interned strings
+ */
+static QSet<QString>* getStrings()
+{
+    static QSet<QString> strings;
+    return &strings;
+}
+
+QString StringPool::intern(const QString& s)
+{
+    if (s.isEmpty())
+        return QString();
+
+    QSet<QString>* strings = getStrings();
+    {
+        QReadLocker rl(getLock());
+        QSet<QString>::const_iterator it = strings->constFind(s);
+        if (it != strings->constEnd())
+            return *it;
+    }
+
+    QWriteLocker wl(getLock());
+
+    // another thread may have added the value in the meantime
+    QSet<QString>::const_iterator it = strings->constFind(s);
+    if (it != strings->constEnd())
+        return *it;
+
+    // a copy without unused capacity that does not reference foreign data
+    QString copy(s.constData(), s.size());
+    strings->insert(copy);
+    return copy;
+}
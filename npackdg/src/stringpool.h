@@ -0,0 +1,32 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+/**
+ * @brief process-wide table of interned strings. Equal strings returned by
+ *     intern() share the same data. This saves memory for values that are
+ *     repeated many times like package names or installation directories
+ *     and makes the comparison of equal strings fast as QString compares
+ *     shared data by the pointer first.
+ *
+ * Interned strings are never removed. Only values from a limited set should
+ * be interned. The values are interned where they are loaded (the XML
+ * parser, the database and InstalledPackages) and not in the constructors
+ * of the model classes as copies share the data anyway. This class is
+ * thread-safe.
+ */
+class StringPool
+{
+    StringPool();
+public:
+    /**
+     * @param s a string
+     * @return a string equal to s that shares the data with all other
+     *     interned strings with the same value
+     * @threadsafe
+     */
+    static QString intern(const QString& s);
+};
+
+#endif // STRINGPOOL_H
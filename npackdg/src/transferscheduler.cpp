@@ -0,0 +1,200 @@
+#include <math.h>
+
+#include <QThread>
+
+#include "transferscheduler.h"
+
+/**
+ * @brief passes the data read from another device to
+ *     TransferScheduler::transferred()
+ */
+class ThrottledDevice: public QIODevice
+{
+    QIODevice* device;
+    TransferScheduler* scheduler;
+    TransferScheduler::Priority priority;
+public:
+    ThrottledDevice(QIODevice* device, TransferScheduler* scheduler,
+            TransferScheduler::Priority priority): device(device),
+            scheduler(scheduler), priority(priority) {
+        QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    ~ThrottledDevice() override {
+        close();
+        delete device;
+    }
+
+    bool isSequential() const override {
+        return true;
+    }
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        qint64 r = device->read(data, maxSize);
+        if (r < 0)
+            setErrorString(device->errorString());
+        else if (r > 0)
+            scheduler->transferred(priority, r);
+        return r;
+    }
+
+    qint64 writeData(const char * /*data*/, qint64 /*maxSize*/) override {
+        return -1;
+    }
+};
+
+/**
+ * @brief moves a pacing time point forward
+ * @param next time point in milliseconds
+ * @param now current time in milliseconds
+ * @param burst unused time in milliseconds that can be used now
+ * @param bytes number of transferred bytes
+ * @param rate data rate in bytes per second
+ * @return milliseconds to wait
+ */
+static double pace(double* next, double now, int burst, int64_t bytes,
+        int64_t rate)
+{
+    *next = qMax(*next, now - burst) + bytes * 1000.0 / rate;
+    return *next - now;
+}
+
+TransferScheduler::TransferScheduler(): bandwidthLimit(0), globalNext(0)
+{
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        running[i] = 0;
+        classNext[i] = 0;
+    }
+
+    limits[INSTALL] = 3;
+    limits[REPOSITORY] = 4;
+    limits[ICON] = 4;
+    limits[SIZE_PROBE] = 4;
+
+    clock.start();
+}
+
+TransferScheduler* TransferScheduler::getDefault()
+{
+    static TransferScheduler def;
+    return &def;
+}
+
+bool TransferScheduler::isYielding(Priority p) const
+{
+    bool r = false;
+    for (int i = 0; i < p; i++) {
+        if (running[i] > 0) {
+            r = true;
+            break;
+        }
+    }
+    return r;
+}
+
+int TransferScheduler::getLimit(Priority p) const
+{
+    return isYielding(p) ? 1 : limits[p];
+}
+
+void TransferScheduler::setBandwidthLimit(int64_t bytesPerSecond)
+{
+    mutex.lock();
+    bandwidthLimit = bytesPerSecond;
+    mutex.unlock();
+}
+
+int64_t TransferScheduler::getBandwidthLimit() const
+{
+    mutex.lock();
+    int64_t r = bandwidthLimit;
+    mutex.unlock();
+
+    return r;
+}
+
+void TransferScheduler::setConcurrency(Priority p, int max)
+{
+    mutex.lock();
+    limits[p] = max;
+    slotFreed.wakeAll();
+    mutex.unlock();
+}
+
+int TransferScheduler::getRunning(Priority p) const
+{
+    mutex.lock();
+    int r = running[p];
+    mutex.unlock();
+
+    return r;
+}
+
+bool TransferScheduler::acquire(Job* job, Priority p)
+{
+    QString initialTitle = job->getTitle();
+    bool waiting = false;
+
+    mutex.lock();
+    while (!job->isCancelled() && running[p] >= getLimit(p)) {
+        if (!waiting) {
+            mutex.unlock();
+            job->setTitle(initialTitle + " / " +
+                    QObject::tr("Waiting for a free HTTP connection"));
+            waiting = true;
+            mutex.lock();
+        } else {
+            slotFreed.wait(&mutex, 1000);
+        }
+    }
+    bool r = !job->isCancelled();
+    if (r)
+        running[p]++;
+    mutex.unlock();
+
+    if (waiting)
+        job->setTitle(initialTitle);
+
+    return r;
+}
+
+bool TransferScheduler::tryAcquire(Priority p)
+{
+    mutex.lock();
+    bool r = running[p] < getLimit(p);
+    if (r)
+        running[p]++;
+    mutex.unlock();
+
+    return r;
+}
+
+void TransferScheduler::release(Priority p)
+{
+    mutex.lock();
+    running[p]--;
+
+    // the limits for the classes with a lower priority may have changed
+    slotFreed.wakeAll();
+    mutex.unlock();
+}
+
+void TransferScheduler::transferred(Priority p, int64_t bytes)
+{
+    mutex.lock();
+    double now = clock.nsecsElapsed() / 1000000.0;
+    double wait = 0;
+    if (bandwidthLimit > 0)
+        wait = pace(&globalNext, now, BURST, bytes, bandwidthLimit);
+    if (isYielding(p))
+        wait = qMax(wait, pace(&classNext[p], now, BURST, bytes, YIELD_RATE));
+    mutex.unlock();
+
+    if (wait >= 1)
+        QThread::msleep(static_cast<unsigned long>(lround(wait)));
+}
+
+QIODevice* TransferScheduler::throttle(QIODevice* device, Priority p)
+{
+    return new ThrottledDevice(device, this, p);
+}
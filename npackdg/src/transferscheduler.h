@@ -0,0 +1,164 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include <stdint.h>
+
+#include <QIODevice>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+#include "job.h"
+
+/**
+ * @brief coordinates all HTTP transfers of the process. Every transfer
+ *     belongs to a priority class. Each class has a maximum number of
+ *     parallel transfers. A class "yields" while a class with a higher
+ *     priority has running transfers: only one transfer of the class is
+ *     started and its data rate is limited to YIELD_RATE. Additionally the
+ *     data rate of all transfers together can be limited.
+ *
+ * This class is thread-safe.
+ */
+class TransferScheduler
+{
+public:
+    /** priority classes. A lower value means a higher priority. */
+    enum Priority {
+        /** package binaries for an installation */
+        INSTALL = 0,
+
+        /** repositories */
+        REPOSITORY = 1,
+
+        /** icons and screen shots */
+        ICON = 2,
+
+        /** computation of download sizes */
+        SIZE_PROBE = 3
+    };
+
+    /** number of priority classes */
+    static const int PRIORITY_COUNT = 4;
+
+    /** maximum data rate of a yielding class in bytes per second */
+    static const int64_t YIELD_RATE = 256 * 1024;
+private:
+    /**
+     * data that was not transferred for this number of milliseconds can be
+     * transferred later at a higher rate
+     */
+    static const int BURST = 100;
+
+    mutable QMutex mutex;
+
+    /** a transfer was finished */
+    QWaitCondition slotFreed;
+
+    /** priority -> number of running transfers */
+    int running[PRIORITY_COUNT];
+
+    /** priority -> maximum number of parallel transfers */
+    int limits[PRIORITY_COUNT];
+
+    /** maximum data rate for all transfers or 0 for no limit */
+    int64_t bandwidthLimit;
+
+    QElapsedTimer clock;
+
+    /**
+     * time on the clock in milliseconds until which the transferred data
+     * fits into the bandwidth limit
+     */
+    double globalNext;
+
+    /** the same as globalNext for the yielding classes */
+    double classNext[PRIORITY_COUNT];
+
+    /**
+     * @param p priority class
+     * @return true if a class with a higher priority has running transfers.
+     *     Should be called under the mutex.
+     */
+    bool isYielding(Priority p) const;
+
+    /**
+     * @param p priority class
+     * @return current maximum number of parallel transfers. Should be called
+     *     under the mutex.
+     */
+    int getLimit(Priority p) const;
+public:
+    TransferScheduler();
+
+    /**
+     * @return process-wide scheduler used by Downloader
+     */
+    static TransferScheduler* getDefault();
+
+    /**
+     * @brief changes the data rate limit for all transfers
+     * @param bytesPerSecond new limit or 0 for no limit
+     */
+    void setBandwidthLimit(int64_t bytesPerSecond);
+
+    /**
+     * @return data rate limit for all transfers in bytes per second or 0
+     */
+    int64_t getBandwidthLimit() const;
+
+    /**
+     * @brief changes the maximum number of parallel transfers for a class
+     * @param p priority class
+     * @param max new maximum
+     */
+    void setConcurrency(Priority p, int max);
+
+    /**
+     * @param p priority class
+     * @return number of running transfers
+     */
+    int getRunning(Priority p) const;
+
+    /**
+     * @brief waits for a free slot. Every successful call should be followed
+     *     by a call to release().
+     * @param job job object. The title is changed while waiting.
+     * @param p priority class
+     * @return false if the job was cancelled while waiting
+     */
+    bool acquire(Job* job, Priority p);
+
+    /**
+     * @brief takes a free slot without waiting. Every successful call should
+     *     be followed by a call to release().
+     * @param p priority class
+     * @return true if a slot was taken
+     */
+    bool tryAcquire(Priority p);
+
+    /**
+     * @brief frees a slot acquired with acquire() or tryAcquire()
+     * @param p priority class
+     */
+    void release(Priority p);
+
+    /**
+     * @brief accounts for transferred data and blocks if the data rate is
+     *     too high
+     * @param p priority class
+     * @param bytes number of transferred bytes
+     */
+    void transferred(Priority p, int64_t bytes);
+
+    /**
+     * @brief wraps a device so that the data read from it is passed to
+     *     transferred()
+     * @param device [ownership:callee] sequential device opened for reading
+     * @param p priority class
+     * @return [ownership:caller] new device opened for reading
+     */
+    QIODevice* throttle(QIODevice* device, Priority p);
+};
+
+#endif // TRANSFERSCHEDULER_H
@@ -0,0 +1,211 @@
+#include <windows.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QThread>
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "trash.h"
+#include "wpmutils.h"
+
+const QString Trash::NAME = QStringLiteral(".NpackdTrash");
+
+Trash::Trash()
+{
+    // the global thread pool is not used as the deletion of a large
+    // directory could block other tasks for a long time
+    pool.setMaxThreadCount(2);
+    filePool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+Trash::~Trash()
+{
+    stopping.storeRelease(1);
+    pool.waitForDone();
+    filePool.waitForDone();
+}
+
+Trash* Trash::getDefault()
+{
+    static Trash trash;
+    return &trash;
+}
+
+QString Trash::moveToTrash(const QString& dir)
+{
+    QString err;
+
+    QFileInfo fi(dir);
+    QString from = QDir::toNativeSeparators(fi.absoluteFilePath());
+    QString parent = QDir::toNativeSeparators(fi.absolutePath());
+    QString trash = parent + '\\' + NAME;
+
+    if (!fi.isDir())
+        err = QObject::tr("Directory does not exist: %1").arg(from);
+    else if (fi.isRoot() || parent == from)
+        err = QObject::tr("Cannot move a root directory to the trash: %1").
+                arg(from);
+
+    QDir d;
+    QString to;
+    if (err.isEmpty()) {
+        QMutexLocker ml(&mutex);
+
+        if (!d.exists(trash)) {
+            if (!d.mkdir(trash))
+                err = QObject::tr("Cannot create the directory: %1").
+                        arg(trash);
+            else
+                SetFileAttributesW(WPMUtils::toLPWSTR(trash),
+                        FILE_ATTRIBUTE_HIDDEN);
+        }
+
+        if (err.isEmpty()) {
+            // renaming is atomic on the same volume
+            to = WPMUtils::findNonExistingFile(trash + '\\' + fi.fileName(),
+                    "");
+            if (!d.rename(from, to))
+                err = QObject::tr("Cannot move the directory %1 to %2").
+                        arg(from).arg(to);
+        }
+    }
+
+    if (err.isEmpty()) {
+        qCInfo(npackd).noquote() << QObject::tr("Deleting \"%1\"").arg(from);
+        queue(to);
+    }
+
+    return err;
+}
+
+void Trash::emptyLeftovers(const QStringList& parents)
+{
+    QSet<QString> trashes;
+    for (int i = 0; i < parents.size(); i++) {
+        QString parent = parents.at(i);
+        if (!parent.isEmpty())
+            trashes.insert(QDir::toNativeSeparators(
+                    QDir::cleanPath(parent)).toLower() + '\\' + NAME);
+    }
+
+    for (QSet<QString>::const_iterator it = trashes.constBegin();
+            it != trashes.constEnd(); ++it) {
+        QDir d(*it);
+        if (!d.exists())
+            continue;
+
+        QFileInfoList entries = d.entryInfoList(QDir::NoDotAndDotDot |
+                QDir::AllEntries | QDir::System | QDir::Hidden);
+        for (int j = 0; j < entries.size(); j++) {
+            queue(QDir::toNativeSeparators(
+                    entries.at(j).absoluteFilePath()));
+        }
+
+        // an empty trash directory is simply removed
+        if (entries.isEmpty()) {
+            QMutexLocker ml(&mutex);
+            d.rmdir(d.absolutePath());
+        }
+    }
+}
+
+void Trash::waitForDone()
+{
+    pool.waitForDone();
+}
+
+void Trash::queue(const QString& dir)
+{
+    QMutexLocker ml(&mutex);
+    QString key = dir.toLower();
+    if (!queued.contains(key)) {
+        queued.insert(key);
+        QtConcurrent::run(&pool, this, &Trash::deleteDirectory, dir);
+    }
+}
+
+/**
+ * @brief deletes one file or a symbolic link. Read-only files are deleted
+ *     too.
+ * @param path full path
+ */
+static void deleteFile(const QString& path)
+{
+    if (!QFile::remove(path) && !QDir().rmdir(path)) {
+        QFile::setPermissions(path, QFile::ReadOwner | QFile::WriteOwner);
+        QFile::remove(path);
+    }
+}
+
+/**
+ * @brief deletes the files from a shared list
+ * @param files files
+ * @param next index of the next file
+ * @param stopping != 0 = stop
+ */
+static void deleteFilesWorker(const QStringList* files, QAtomicInt* next,
+        QAtomicInt* stopping)
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    int i;
+    while ((i = next->fetchAndAddOrdered(1)) < files->size() &&
+            stopping->loadAcquire() == 0) {
+        deleteFile(files->at(i));
+    }
+}
+
+void Trash::deleteDirectory(const QString& dir)
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    // symbolic links and junctions are deleted, but never followed
+    QStringList files, dirs;
+    if (QFileInfo(dir).isDir()) {
+        QDirIterator it(dir, QDir::NoDotAndDotDot | QDir::AllEntries |
+                QDir::System | QDir::Hidden, QDirIterator::Subdirectories);
+        while (it.hasNext() && stopping.loadAcquire() == 0) {
+            it.next();
+            QFileInfo fi = it.fileInfo();
+            if (fi.isDir() && !fi.isSymLink())
+                dirs.append(fi.absoluteFilePath());
+            else
+                files.append(fi.absoluteFilePath());
+        }
+    } else {
+        files.append(dir);
+    }
+
+    // the files are deleted in parallel as the deletion mostly waits for the
+    // file system
+    QAtomicInt next;
+    int threads = qBound(1, files.size() / 64, filePool.maxThreadCount());
+    QList<QFuture<void> > futures;
+    for (int i = 1; i < threads; i++) {
+        futures.append(QtConcurrent::run(&filePool, deleteFilesWorker,
+                &files, &next, &stopping));
+    }
+    deleteFilesWorker(&files, &next, &stopping);
+    for (int i = 0; i < futures.size(); i++) {
+        futures[i].waitForFinished();
+    }
+
+    // the deepest directories first
+    QDir d;
+    if (stopping.loadAcquire() == 0) {
+        for (int i = dirs.size() - 1; i >= 0; i--) {
+            d.rmdir(dirs.at(i));
+        }
+        d.rmdir(dir);
+    }
+
+    QMutexLocker ml(&mutex);
+    queued.remove(dir.toLower());
+
+    // the trash directory itself is removed when it is empty
+    if (stopping.loadAcquire() == 0)
+        d.rmdir(QFileInfo(dir).absolutePath());
+}
@@ -0,0 +1,96 @@
+#ifndef TRASH_H
+#define TRASH_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+/**
+ * @brief deferred deletion of directories. A directory is renamed to
+ *     ".NpackdTrash" in its parent directory. This is fast and keeps the
+ *     data on the same volume. The content of ".NpackdTrash" is deleted by
+ *     background threads with the lowest priority. Directories that were not
+ *     deleted before the process ended are deleted by emptyLeftovers().
+ *
+ * The trash is only used for removed package versions if the
+ * "deferredDeletion" setting is enabled (see
+ * PackageUtils::getDeferredDeletion()). The programs call
+ * PackageUtils::emptyTrash() at the start and waitForDone() before they
+ * exit.
+ *
+ * This class is thread-safe.
+ */
+class Trash
+{
+    /** name of the trash directory */
+    static const QString NAME;
+
+    /** directories are deleted here */
+    QThreadPool pool;
+
+    /** files of one directory are deleted in parallel here */
+    QThreadPool filePool;
+
+    /** != 0 = stop deleting */
+    QAtomicInt stopping;
+
+    /**
+     * protects "queued" and the creation and removal of the trash
+     * directories
+     */
+    QMutex mutex;
+
+    /** directories queued for deletion */
+    QSet<QString> queued;
+
+    Trash();
+
+    /**
+     * @brief queues a directory from a trash directory for the deletion
+     * @param dir full path
+     */
+    void queue(const QString& dir);
+
+    /**
+     * @brief deletes a directory. Executed by the background threads.
+     * @param dir full path
+     */
+    void deleteDirectory(const QString& dir);
+public:
+    /**
+     * @return default instance
+     */
+    static Trash* getDefault();
+
+    /**
+     * @brief stops the background threads. The current files are deleted,
+     *     everything else stays in the trash until emptyLeftovers() is called
+     *     in the next process.
+     */
+    ~Trash();
+
+    /**
+     * @brief moves a directory to the trash and starts deleting it in the
+     *     background
+     * @param dir a directory
+     * @return error message or "" if the directory was moved
+     */
+    QString moveToTrash(const QString& dir);
+
+    /**
+     * @brief starts deleting the directories left in the trash by previous
+     *     processes
+     * @param parents the trash directories are searched here
+     */
+    void emptyLeftovers(const QStringList& parents);
+
+    /**
+     * @brief waits until all queued directories are deleted
+     */
+    void waitForDone();
+};
+
+#endif // TRASH_H
@@ -151,6 +151,27 @@ DWORD WindowsRegistry::getDWORD(QString name, QString* err) const
     return value;
 }
 
+quint64 WindowsRegistry::getLastWriteTime(QString* err) const
+{
+    err->clear();
+
+    if (this->hkey == nullptr) {
+        err->append(QObject::tr("No key is open"));
+        return 0;
+    }
+
+    FILETIME ft;
+    LONG r = RegQueryInfoKey(this->hkey, nullptr, nullptr, nullptr, nullptr,
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, &ft);
+    if (r != ERROR_SUCCESS) {
+        WPMUtils::formatMessage(r, err);
+        return 0;
+    }
+
+    return (static_cast<quint64>(ft.dwHighDateTime) << 32) |
+            ft.dwLowDateTime;
+}
+
 QString WindowsRegistry::setDWORD(QString name, DWORD value) const
 {
     QString err;
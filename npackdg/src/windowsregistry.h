@@ -85,6 +85,14 @@ public:
      */
     DWORD getDWORD(QString name, QString* err) const;
 
+    /**
+     * Reads the time of the last change of this key or its values.
+     *
+     * @param err error message will be stored here
+     * @return FILETIME as a 64-bit value
+     */
+    quint64 getLastWriteTime(QString* err) const;
+
     /**
      * Reads a DWORD value and interpretes it as an int32_t.
      *
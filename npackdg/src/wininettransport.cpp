@@ -0,0 +1,656 @@
+#include <stdint.h>
+
+#include <QObject>
+#include <QMutex>
+#include <QLoggingCategory>
+
+#include "wininettransport.h"
+#include "connectionpool.h"
+#include "wpmutils.h"
+
+/**
+ * @brief response data of a WinINet request. The device owns the handles.
+ */
+class WinINetDevice: public QIODevice
+{
+    HINTERNET internet;
+    HINTERNET hConnectHandle;
+    HINTERNET hResourceHandle;
+    QString poolKey;
+    bool failed;
+public:
+    /**
+     * @param internet session handle or nullptr if the shared session is used
+     * @param hConnectHandle connection handle
+     * @param hResourceHandle request handle
+     * @param poolKey the connection handle will be returned to the pool
+     *     under this key or "" if the handle should be closed
+     */
+    WinINetDevice(HINTERNET internet, HINTERNET hConnectHandle,
+            HINTERNET hResourceHandle, const QString& poolKey):
+            internet(internet), hConnectHandle(hConnectHandle),
+            hResourceHandle(hResourceHandle), poolKey(poolKey),
+            failed(false) {
+        QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    ~WinINetDevice() override {
+        close();
+        InternetCloseHandle(hResourceHandle);
+        if (!poolKey.isEmpty() && !failed)
+            WinINetTransport::getConnectionPool()->release(poolKey,
+                    hConnectHandle);
+        else
+            InternetCloseHandle(hConnectHandle);
+        if (internet)
+            InternetCloseHandle(internet);
+    }
+
+    bool isSequential() const override {
+        return true;
+    }
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        DWORD read;
+        if (!InternetReadFile(hResourceHandle, data,
+                static_cast<DWORD>(qMin(maxSize,
+                static_cast<qint64>(INT32_MAX))), &read)) {
+            QString errMsg;
+            WPMUtils::formatMessage(GetLastError(), &errMsg);
+            setErrorString(errMsg);
+            failed = true;
+            return -1;
+        }
+        return read;
+    }
+
+    qint64 writeData(const char * /*data*/, qint64 /*maxSize*/) override {
+        return -1;
+    }
+};
+
+HWND WinINetTransport::parentWindow = nullptr;
+
+QMutex WinINetTransport::loginDialogMutex;
+
+static void closeInternetHandle(ConnectionPool::Handle handle)
+{
+    InternetCloseHandle(handle);
+}
+
+ConnectionPool* WinINetTransport::getConnectionPool()
+{
+    static ConnectionPool pool(closeInternetHandle, MAX_CONNECTIONS_PER_HOST,
+            IDLE_TIMEOUT);
+    return &pool;
+}
+
+HINTERNET WinINetTransport::createSession()
+{
+    QString agent("Npackd/");
+    agent.append(NPACKD_VERSION);
+
+    agent += " (compatible; MSIE 9.0)";
+
+    HINTERNET internet = InternetOpenW(WPMUtils::toLPWSTR(agent),
+            INTERNET_OPEN_TYPE_PRECONFIG,
+            nullptr, nullptr, 0);
+
+    if (internet != nullptr) {
+        // enable automatic gzip decoding
+#ifndef INTERNET_OPTION_HTTP_DECODING
+        const DWORD INTERNET_OPTION_HTTP_DECODING = 65;
+#endif
+        BOOL b = TRUE;
+        InternetSetOption(internet, INTERNET_OPTION_HTTP_DECODING,
+                &b, sizeof(b));
+    }
+
+    return internet;
+}
+
+HINTERNET WinINetTransport::getSharedSession()
+{
+    // WinINet keeps the TCP connections of a session open and re-uses them
+    // for the next request to the same server. The session is never closed.
+    static HINTERNET session = []() {
+        // these options are process-wide
+        DWORD max = MAX_CONNECTIONS_PER_HOST;
+        InternetSetOption(nullptr, INTERNET_OPTION_MAX_CONNS_PER_SERVER,
+                &max, sizeof(max));
+        InternetSetOption(nullptr, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER,
+                &max, sizeof(max));
+
+        return createSession();
+    }();
+
+    return session;
+}
+
+QIODevice* WinINetTransport::open(Job* job, const Downloader::Request& request,
+        Downloader::Response* response, bool* gzip)
+{
+    QUrl url = request.url;
+    QString verb = request.httpMethod;
+    bool useCache = request.useCache;
+    bool keepConnection = request.keepConnection;
+    bool interactive = request.interactive;
+    bool conditional = request.isConditional();
+
+    // a conditional request should not be answered by the WinINet cache
+    if (conditional)
+        useCache = false;
+
+    *gzip = false;
+
+    QString server = url.host();
+    QString resource = url.path();
+    QString encQuery = url.query(QUrl::FullyEncoded);
+    if (!encQuery.isEmpty())
+        resource.append('?').append(encQuery);
+
+    // connections with credentials are not shared
+    bool pooled = keepConnection && request.user.isEmpty() &&
+            request.proxyUser.isEmpty();
+    QString poolKey;
+    if (pooled)
+        poolKey = ConnectionPool::getKey(url);
+
+    // session handle owned by this request
+    HINTERNET internet = nullptr;
+
+    HINTERNET session;
+    if (pooled)
+        session = getSharedSession();
+    else
+        session = internet = createSession();
+
+    if (session == nullptr) {
+        QString errMsg;
+        WPMUtils::formatMessage(GetLastError(), &errMsg);
+        job->setErrorMessage(errMsg);
+    }
+
+    // here "session" cannot be 0, but we add the comparison to silence
+    // Coverity
+    HINTERNET hConnectHandle = nullptr;
+    if (job->shouldProceed() && session != nullptr) {
+        if (pooled)
+            hConnectHandle = getConnectionPool()->acquire(poolKey);
+
+        if (hConnectHandle == nullptr) {
+            INTERNET_PORT port = static_cast<INTERNET_PORT>(
+                    url.port(url.scheme() == "https" ?
+                    INTERNET_DEFAULT_HTTPS_PORT: INTERNET_DEFAULT_HTTP_PORT));
+            hConnectHandle = InternetConnectW(session,
+                    WPMUtils::toLPWSTR(server), port, nullptr, nullptr,
+                    INTERNET_SERVICE_HTTP, 0, 0);
+        }
+
+        if (hConnectHandle == nullptr) {
+            QString errMsg;
+            WPMUtils::formatMessage(GetLastError(), &errMsg);
+            job->setErrorMessage(errMsg);
+        }
+    }
+
+    if (job->shouldProceed()) {
+        // the request handle inherits the timeouts from the connection
+        DWORD rec_timeout = static_cast<DWORD>(request.timeout) * 1000;
+        InternetSetOption(hConnectHandle, INTERNET_OPTION_RECEIVE_TIMEOUT,
+                &rec_timeout, sizeof(rec_timeout));
+        InternetSetOption(hConnectHandle, INTERNET_OPTION_SEND_TIMEOUT,
+                &rec_timeout, sizeof(rec_timeout));
+    }
+
+    if (job->shouldProceed()) {
+        if (!request.user.isEmpty()) {
+            setStringOption(hConnectHandle, INTERNET_OPTION_USERNAME,
+                    request.user);
+
+            if (!request.password.isEmpty()) {
+                setStringOption(hConnectHandle, INTERNET_OPTION_PASSWORD,
+                        request.password);
+            }
+        }
+    }
+
+    if (job->shouldProceed()) {
+        if (!request.proxyUser.isEmpty()) {
+            setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_USERNAME,
+                    request.proxyUser);
+
+            if (!request.proxyPassword.isEmpty()) {
+                setStringOption(hConnectHandle, INTERNET_OPTION_PROXY_PASSWORD,
+                        request.proxyPassword);
+            }
+        }
+    }
+
+    // flags: http://msdn.microsoft.com/en-us/library/aa383661(v=vs.85).aspx
+    // We support accepting any mime file type since this is a simple download
+    // of a file
+    //
+    // hConnectHandle is only checked here to silence Coverity
+    HINTERNET hResourceHandle = nullptr;
+    if (job->shouldProceed() && hConnectHandle != nullptr) {
+        LPCTSTR ppszAcceptTypes[2];
+        ppszAcceptTypes[0] = L"*/*";
+        ppszAcceptTypes[1] = nullptr;
+        DWORD flags = (url.scheme() == "https" ? INTERNET_FLAG_SECURE : 0);
+        if (keepConnection)
+            flags |= INTERNET_FLAG_KEEP_CONNECTION;
+        if (!request.useInternet)
+            flags |= INTERNET_FLAG_FROM_CACHE;
+        flags |= INTERNET_FLAG_RESYNCHRONIZE;
+        if (!useCache)
+            flags |= INTERNET_FLAG_DONT_CACHE | INTERNET_FLAG_PRAGMA_NOCACHE |
+                    INTERNET_FLAG_RELOAD;
+        hResourceHandle = HttpOpenRequestW(hConnectHandle,
+                WPMUtils::toLPWSTR(verb),
+                WPMUtils::toLPWSTR(resource),
+                nullptr, nullptr, ppszAcceptTypes,
+                flags, 0);
+        if (hResourceHandle == nullptr) {
+            QString errMsg;
+            WPMUtils::formatMessage(GetLastError(), &errMsg);
+            job->setErrorMessage(errMsg);
+        }
+    }
+
+    qCDebug(npackd) << "HttpOpenRequestW succeeded";
+
+    if (hResourceHandle != nullptr && hConnectHandle != nullptr) {
+        if (job->shouldProceed() && request.canBeCompressed()) {
+            // do not check for errors here
+            HttpAddRequestHeadersW(hResourceHandle,
+                    L"Accept-Encoding: gzip, deflate",
+                    static_cast<DWORD>(-1),
+                    HTTP_ADDREQ_FLAG_ADD);
+        }
+
+        if (job->shouldProceed() && conditional) {
+            QString h;
+            if (!request.ifNoneMatch.isEmpty())
+                h.append("If-None-Match: ").append(request.ifNoneMatch).
+                        append("\r\n");
+            if (!request.ifModifiedSince.isEmpty())
+                h.append("If-Modified-Since: ").append(
+                        request.ifModifiedSince).append("\r\n");
+            if (!HttpAddRequestHeadersW(hResourceHandle,
+                    WPMUtils::toLPWSTR(h),
+                    static_cast<DWORD>(-1),
+                    HTTP_ADDREQ_FLAG_ADD | HTTP_ADDREQ_FLAG_REPLACE)) {
+                QString errMsg;
+                WPMUtils::formatMessage(GetLastError(), &errMsg);
+                job->setErrorMessage(errMsg);
+            }
+        }
+
+        if (job->shouldProceed() && request.isPartial()) {
+            if (!HttpAddRequestHeadersW(hResourceHandle,
+                    WPMUtils::toLPWSTR("Range: " + request.getRange()),
+                    static_cast<DWORD>(-1),
+                    HTTP_ADDREQ_FLAG_ADD | HTTP_ADDREQ_FLAG_REPLACE)) {
+                QString errMsg;
+                WPMUtils::formatMessage(GetLastError(), &errMsg);
+                job->setErrorMessage(errMsg);
+            }
+        }
+
+        // qCDebug(npackd) << "download.5";
+        int callNumber = 0;
+        while (job->shouldProceed()) {
+            // qCDebug(npackd) << "download.5.1";
+
+            // NOTE: dwStatus is only valid if sendRequestError == 0
+            DWORD dwStatus = 0, dwStatusSize = sizeof(dwStatus);
+
+            DWORD sendRequestError = 0;
+
+            // the following call uses NULL for headers in case there are no headers
+            // because Windows 2003 generates the error 12150 otherwise
+            if (!HttpSendRequestW(hResourceHandle,
+                    request.headers.length() == 0 ? nullptr : WPMUtils::toLPWSTR(request.headers),
+                    static_cast<DWORD>(-1),
+                    request.postData.length() == 0 ? nullptr : const_cast<char*>(request.postData.data()),
+                    static_cast<DWORD>(request.postData.length()))) {
+                sendRequestError = GetLastError();
+            }
+
+            // http://msdn.microsoft.com/en-us/library/aa384220(v=vs.85).aspx
+            if (sendRequestError == 0) {
+                if (!HttpQueryInfo(hResourceHandle, HTTP_QUERY_FLAG_NUMBER |
+                        HTTP_QUERY_STATUS_CODE, &dwStatus, &dwStatusSize, nullptr)) {
+                    QString errMsg;
+                    WPMUtils::formatMessage(GetLastError(), &errMsg);
+                    job->setErrorMessage(errMsg);
+                    break;
+                }
+            }
+
+            qCDebug(npackd) << "WinINetTransport::open callNumber="
+                    << callNumber << ", sendRequestError="
+                    << sendRequestError << ", dwStatus=" << dwStatus;
+
+            // 2XX
+            if (sendRequestError == 0) {
+                DWORD hundreds = dwStatus / 100;
+                if (hundreds == 2 || hundreds == 5)
+                    break;
+                if (conditional && dwStatus == HTTP_STATUS_NOT_MODIFIED)
+                    break;
+            }
+
+            // the InternetErrorDlg calls below can either handle
+            // sendRequestError <> 0 or HTTP error code <> 2xx
+
+            void* p = nullptr;
+
+            // both calls to InternetErrorDlg should be enclosed by one
+            // mutex, so that only one dialog will be shown
+            loginDialogMutex.lock();
+
+            DWORD r;
+
+            // first call is processed differently
+            if (callNumber == 0) {
+                r = InternetErrorDlg(nullptr,
+                       hResourceHandle, sendRequestError,
+                        FLAGS_ERROR_UI_FILTER_FOR_ERRORS |
+                        FLAGS_ERROR_UI_FLAGS_CHANGE_OPTIONS |
+                        FLAGS_ERROR_UI_FLAGS_GENERATE_DATA |
+                        FLAGS_ERROR_UI_FLAGS_NO_UI, &p);
+                if ((r == ERROR_SUCCESS || r == ERROR_INTERNET_INTERNAL_ERROR) && interactive)
+                    r = ERROR_INTERNET_FORCE_RETRY;
+            } else {
+                if (interactive) {
+                    if (parentWindow) {
+                        r = InternetErrorDlg(parentWindow,
+                                hResourceHandle, sendRequestError,
+                                FLAGS_ERROR_UI_FILTER_FOR_ERRORS |
+                                FLAGS_ERROR_UI_FLAGS_CHANGE_OPTIONS |
+                                FLAGS_ERROR_UI_FLAGS_GENERATE_DATA, &p);
+                    } else {
+                        if (sendRequestError == 0) {
+                            QString e = inputPassword(hConnectHandle, dwStatus);
+
+                            //qCDebug(npackd) << "inputPassword: " << e;
+                            if (!e.isEmpty()) {
+                                job->setErrorMessage(e);
+                                r = ERROR_CANCELLED;
+                            } else {
+                                r = ERROR_INTERNET_FORCE_RETRY;
+                            }
+                        } else {
+                            // cannot help
+                            r = ERROR_SUCCESS;
+                        }
+                    }
+                } else {
+                    if (sendRequestError == 0) {
+                        QString e = setPassword(hConnectHandle, dwStatus,
+                                request);
+
+                        if (!e.isEmpty()) {
+                            job->setErrorMessage(e);
+                            r = ERROR_CANCELLED;
+                        } else {
+                            r = ERROR_INTERNET_FORCE_RETRY;
+                        }
+                    } else {
+                        // cannot help
+                        r = ERROR_SUCCESS;
+                    }
+                }
+            }
+
+            //qCDebug(npackd) << callNumber << r << dwStatus << url.toString();
+
+            if (job->shouldProceed()) {
+                if (r == ERROR_SUCCESS) {
+                    if (sendRequestError) {
+                        QString errMsg;
+                        WPMUtils::formatMessage(sendRequestError, &errMsg);
+                        job->setErrorMessage(errMsg);
+                    } else {
+                        job->setErrorMessage(QString(
+                                QObject::tr("HTTP status code %1")).arg(dwStatus));
+                    }
+                } else if (r == ERROR_INTERNET_FORCE_RETRY) {
+                    // the entered credentials are stored in the connection
+                    // handle, which must not be re-used by other requests
+                    if (sendRequestError == 0 &&
+                            (dwStatus == HTTP_STATUS_DENIED ||
+                            dwStatus == HTTP_STATUS_PROXY_AUTH_REQ))
+                        poolKey.clear();
+                } else if (r == ERROR_CANCELLED) {
+                    job->setErrorMessage(QObject::tr("Cancelled by the user"));
+                } else if (r == ERROR_INVALID_HANDLE) {
+                    job->setErrorMessage(QObject::tr("Invalid handle"));
+                } else {
+                    job->setErrorMessage(QString(
+                            QObject::tr("Unknown error %1 from InternetErrorDlg in attempt %2")).arg(r).arg(callNumber + 1));
+                }
+            }
+
+            loginDialogMutex.unlock();
+
+            if (!job->shouldProceed())
+                break;
+
+            // read all the data before re-sending the request
+            char smallBuffer[4 * 1024];
+            while (true) {
+                DWORD read;
+                if (!InternetReadFile(hResourceHandle, &smallBuffer,
+                        sizeof(smallBuffer), &read)) {
+                    QString errMsg;
+                    WPMUtils::formatMessage(GetLastError(), &errMsg);
+                    job->setErrorMessage(errMsg);
+                    goto out;
+                }
+
+                // qCDebug(npackd) << "read some bytes " << read;
+                if (read == 0)
+                    break;
+            }
+
+            callNumber++;
+        }; // while (job->shouldProceed())
+
+    out:
+        if (job->shouldProceed()) {
+            DWORD dwStatus, dwStatusSize = sizeof(dwStatus);
+
+            // http://msdn.microsoft.com/en-us/library/aa384220(v=vs.85).aspx
+            if (!HttpQueryInfo(hResourceHandle, HTTP_QUERY_FLAG_NUMBER |
+                    HTTP_QUERY_STATUS_CODE, &dwStatus, &dwStatusSize, nullptr)) {
+                QString errMsg;
+                WPMUtils::formatMessage(GetLastError(), &errMsg);
+                job->setErrorMessage(errMsg);
+            } else {
+                response->statusCode = static_cast<int>(dwStatus);
+            }
+        }
+
+        if (job->shouldProceed()) {
+            // MIME type
+            if (!queryHeader(hResourceHandle, HTTP_QUERY_CONTENT_TYPE,
+                    &response->mimeType))
+                response->mimeType = "application/octet-stream";
+
+            // Content-Encoding
+            QString contentEncoding;
+            if (queryHeader(hResourceHandle, HTTP_QUERY_CONTENT_ENCODING,
+                    &contentEncoding))
+                *gzip = contentEncoding == "gzip" ||
+                        contentEncoding == "deflate";
+
+            // Content-Disposition
+            WCHAR cdBuffer[1024];
+            wcscpy(cdBuffer, L"Content-Disposition");
+            DWORD bufferLength = sizeof(cdBuffer);
+            DWORD index = 0;
+            if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_CUSTOM,
+                    &cdBuffer, &bufferLength, &index)) {
+                response->contentDisposition = QString::fromWCharArray(
+                        cdBuffer, bufferLength / 2);
+            }
+
+            // content length
+            QString s;
+            if (queryHeader(hResourceHandle, HTTP_QUERY_CONTENT_LENGTH, &s)) {
+                bool ok;
+                response->contentLength = s.toLongLong(&ok, 10);
+                if (!ok)
+                    response->contentLength = 0;
+            }
+
+            // ETag and Last-Modified
+            queryHeader(hResourceHandle, HTTP_QUERY_ETAG, &response->etag);
+            queryHeader(hResourceHandle, HTTP_QUERY_LAST_MODIFIED,
+                    &response->lastModified);
+
+            // Accept-Ranges
+            if (queryHeader(hResourceHandle, HTTP_QUERY_ACCEPT_RANGES, &s))
+                response->acceptRanges = s.trimmed().toLower() == "bytes";
+        }
+    }
+
+    QIODevice* result = nullptr;
+    if (job->shouldProceed()) {
+        result = new WinINetDevice(internet, hConnectHandle, hResourceHandle,
+                poolKey);
+    } else {
+        if (hResourceHandle)
+            InternetCloseHandle(hResourceHandle);
+        if (hConnectHandle)
+            InternetCloseHandle(hConnectHandle);
+        if (internet)
+            InternetCloseHandle(internet);
+
+        // the error message may be missing if the job was cancelled
+        if (job->getErrorMessage().isEmpty())
+            job->setErrorMessage(QObject::tr("Cancelled by the user"));
+    }
+
+    return result;
+}
+
+bool WinINetTransport::queryHeader(HINTERNET hResourceHandle, DWORD infoLevel,
+        QString* value)
+{
+    WCHAR buffer[1024];
+    DWORD bufferLength = sizeof(buffer);
+    DWORD index = 0;
+    bool result = HttpQueryInfoW(hResourceHandle, infoLevel,
+            buffer, &bufferLength, &index);
+    if (result)
+        *value = QString::fromWCharArray(buffer, bufferLength / 2);
+    return result;
+}
+
+QString WinINetTransport::setStringOption(HINTERNET hInternet, DWORD dwOption,
+        const QString& value)
+{
+    QString result;
+    if (!InternetSetOptionW(hInternet,
+            dwOption, WPMUtils::toLPWSTR(value),
+            static_cast<DWORD>(value.length() + 1))) {
+        WPMUtils::formatMessage(GetLastError(), &result);
+    }
+    return result;
+}
+
+QString WinINetTransport::setPassword(HINTERNET hConnectHandle,
+        DWORD dwStatus, const Downloader::Request& request)
+{
+    QString result;
+
+    if (dwStatus == HTTP_STATUS_PROXY_AUTH_REQ) {
+        if (request.proxyUser.isEmpty()) {
+            result = QString(QObject::tr("Cannot handle HTTP status code %1")).
+                    arg(dwStatus);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                    INTERNET_OPTION_PROXY_USERNAME, request.proxyUser);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_PROXY_PASSWORD, request.proxyPassword);
+        }
+    } else if (dwStatus == HTTP_STATUS_DENIED) {
+        if (request.user.isEmpty()) {
+            result = QString(QObject::tr("Cannot handle HTTP status code %1")).
+                    arg(dwStatus);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_USERNAME, request.user);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_PASSWORD, request.password);
+        }
+    } else {
+        result = QString(QObject::tr("Cannot handle HTTP status code %1")).
+                arg(dwStatus);
+    }
+
+    return result;
+}
+
+QString WinINetTransport::inputPassword(HINTERNET hConnectHandle,
+        DWORD dwStatus)
+{
+    QString result;
+
+    QString username, password;
+    if (dwStatus == HTTP_STATUS_PROXY_AUTH_REQ) {
+        WPMUtils::writeln("\r\n" +
+                QObject::tr("The HTTP proxy requires authentication."));
+        WPMUtils::outputTextConsole(QObject::tr("Username") + ": ");
+        username = WPMUtils::inputTextConsole();
+        WPMUtils::outputTextConsole(QObject::tr("Password") + ": ");
+        password = WPMUtils::inputPasswordConsole();
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_PROXY_USERNAME, username);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_PROXY_PASSWORD, password);
+        }
+    } else if (dwStatus == HTTP_STATUS_DENIED) {
+        WPMUtils::writeln("\r\n" +
+                QObject::tr("The HTTP server requires authentication.")
+                );
+        WPMUtils::outputTextConsole(QObject::tr("Username") + ": ");
+        username = WPMUtils::inputTextConsole();
+        WPMUtils::outputTextConsole(QObject::tr("Password") + ": ");
+        password = WPMUtils::inputPasswordConsole();
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_USERNAME, username);
+        }
+
+        if (result.isEmpty()) {
+            result = setStringOption(hConnectHandle,
+                INTERNET_OPTION_PASSWORD, password);
+        }
+    } else {
+        result = QString(QObject::tr("Cannot handle HTTP status code %1")).
+                arg(dwStatus);
+    }
+
+    return result;
+}
@@ -0,0 +1,88 @@
+#ifndef WININETTRANSPORT_H
+#define WININETTRANSPORT_H
+
+#include <windows.h>
+#include <wininet.h>
+
+#include <QMutex>
+
+#include "abstracttransport.h"
+#include "connectionpool.h"
+
+/**
+ * @brief HTTP transport based on WinINet. The WinINet cache, the proxy
+ *     settings of the system and the Windows dialogs for the authentication
+ *     are used.
+ *
+ * Requests with Request::keepConnection and without credentials share one
+ * WinINet session so that the TCP and TLS connections are re-used. Their
+ * connection handles are kept in a process-wide ConnectionPool.
+ */
+class WinINetTransport: public AbstractTransport
+{
+    /** maximum number of connections to one server */
+    static const int MAX_CONNECTIONS_PER_HOST = 6;
+
+    /** idle connections are closed after this number of milliseconds */
+    static const int IDLE_TIMEOUT = 60000;
+
+    /**
+     * @return new WinINet session or nullptr if an error occured
+     *     (GetLastError())
+     */
+    static HINTERNET createSession();
+
+    /**
+     * @return WinINet session shared by all requests that keep the connection
+     *     or nullptr if an error occured (GetLastError())
+     */
+    static HINTERNET getSharedSession();
+
+    static QString setPassword(HINTERNET hConnectHandle, DWORD dwStatus,
+            const Downloader::Request &request);
+
+    static QString inputPassword(HINTERNET hConnectHandle, DWORD dwStatus);
+
+    /**
+     * @brief reads the value of a response header
+     * @param hResourceHandle request handle
+     * @param infoLevel HTTP_QUERY_*
+     * @param value the value will be stored here
+     * @return true if the header is available
+     */
+    static bool queryHeader(HINTERNET hResourceHandle, DWORD infoLevel,
+            QString* value);
+public:
+    /**
+     * parent window for the authentication dialogs or nullptr. The GUI sets
+     * it once at the start.
+     */
+    static HWND parentWindow;
+
+    /**
+     * both calls to InternetErrorDlg are enclosed by this mutex so that only
+     * one dialog is shown at a time
+     */
+    static QMutex loginDialogMutex;
+
+    /**
+     * @return process-wide pool for the connection handles. The hit and miss
+     *     counters show how often a connection was re-used.
+     */
+    static ConnectionPool* getConnectionPool();
+
+    QIODevice* open(Job* job, const Downloader::Request& request,
+            Downloader::Response* response, bool* gzip) override;
+
+    /**
+     * @brief changes a string option for a WinINet handle
+     * @param hInternet WinINet handle
+     * @param dwOption INTERNET_OPTION_*
+     * @param value new value
+     * @return error message or ""
+     */
+    static QString setStringOption(HINTERNET hInternet, DWORD dwOption,
+            const QString &value);
+};
+
+#endif // WININETTRANSPORT_H
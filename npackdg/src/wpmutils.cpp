@@ -37,6 +37,11 @@
 #include <QUrl>
 #include <QLoggingCategory>
 #include <QDirIterator>
+#include <QVector>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <quazip.h>
 #include <quazipfile.h>
@@ -49,6 +54,7 @@
 #include "wpmutils.h"
 #include "version.h"
 #include "windowsregistry.h"
+#include "hashingwriter.h"
 
 QAtomicInt WPMUtils::nextNamePipeId;
 
@@ -3153,19 +3159,18 @@ DWORD WPMUtils::getProgramCloseType(const CommandLine& cl, QString* err)
 QString WPMUtils::fileCheckSum(Job* job,
         QFile* file, QCryptographicHash::Algorithm alg)
 {
-    QString initialTitle = job->getTitle();
+    JobProgressReporter progress(job);
 
-    // download/compute SHA1 loop
     QCryptographicHash hash(alg);
-    const int bufferSize = 512 * 1024;
-    char* buffer = new char[bufferSize];
 
-    QString sha1;
+    QString result;
 
+    qint64 size = file->size() - file->pos();
+    HashingWriter writer(nullptr, &hash, size);
     qint64 alreadyRead = 0;
-    qint64 bufferLength;
-    do {
-        bufferLength = file->read(buffer, bufferSize);
+    while (!job->isCancelled()) {
+        char* buffer = writer.nextBuffer();
+        qint64 bufferLength = file->read(buffer, HashingWriter::BUFFER_SIZE);
 
         if (bufferLength == 0)
             break;
@@ -3175,93 +3180,217 @@ QString WPMUtils::fileCheckSum(Job* job,
             break;
         }
 
-        // update SHA1 if necessary
-        hash.addData((char*) buffer, bufferLength);
+        writer.commit(static_cast<int>(bufferLength));
 
         alreadyRead += bufferLength;
-        job->setProgress(0.5);
-        job->setTitle(initialTitle + QStringLiteral(" / ") +
-                QObject::tr("%L0 bytes").
-                arg(alreadyRead));
-    } while (bufferLength != 0 && !job->isCancelled());
+        progress.reportBytes(alreadyRead, size);
+    }
+    writer.finish();
 
     if (job->shouldProceed()) {
-        sha1 = hash.result().toHex().toLower();
+        result = hash.result().toHex().toLower();
         job->setProgress(1);
     }
 
-    delete[] buffer;
-
     job->complete();
 
-    return sha1;
+    return result;
+}
+
+/**
+ * @return thread pool for the ZIP extraction. The global thread pool is not
+ *     used as unzip() may be called from there.
+ */
+static QThreadPool* getUnzipThreadPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+/**
+ * @brief extracts files from a ZIP file. Many workers can run in parallel,
+ *     each with its own handle for the ZIP file. The entries are taken from
+ *     a shared counter and the workers only move forward in the central
+ *     directory.
+ * @param job job
+ * @param zipfile .zip file
+ * @param odir output directory ending with \ or /
+ * @param entries entries from the central directory
+ * @param next index of the next entry that should be extracted
+ * @param done number of extracted entries
+ */
+static void unzipWorker(Job* job, const QString& zipfile, const QString& odir,
+        const QList<QuaZipFileInfo64>* entries, QAtomicInt* next,
+        QAtomicInt* done)
+{
+    QuaZip zip(zipfile);
+    if (!zip.open(QuaZip::mdUnzip)) {
+        job->setErrorMessage(QString(QObject::tr("Cannot open the ZIP file %1: %2")).
+                arg(zipfile).arg(zip.getZipError()));
+        return;
+    }
+
+    QuaZipFile file(&zip);
+    const int blockSize = 1024 * 1024;
+    std::unique_ptr<char[]> block(new char[blockSize]);
+    int current = 0;
+    bool more = zip.goToFirstFile();
+    while (job->shouldProceed()) {
+        int index = next->fetchAndAddOrdered(1);
+        if (index >= entries->size())
+            break;
+
+        while (more && current < index) {
+            more = zip.goToNextFile();
+            current++;
+        }
+
+        const QuaZipFileInfo64& entry = entries->at(index);
+        if (!more) {
+            job->setErrorMessage(QString(
+                    QObject::tr("Error unzipping the file %1: Error %2 in %3")).
+                    arg(zipfile).arg(zip.getZipError()).
+                    arg(entry.name));
+            break;
+        }
+
+        // the directories were already created
+        if (!entry.name.endsWith('/')) {
+            if (!file.open(QIODevice::ReadOnly)) {
+                job->setErrorMessage(QString(
+                        QObject::tr("Error unzipping the file %1: Error %2 in %3")).
+                        arg(zipfile).arg(file.getZipError()).
+                        arg(entry.name));
+                break;
+            }
+
+            QFile out(odir + entry.name);
+            if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                job->setErrorMessage(QString(
+                        QObject::tr("Cannot open the file %1: %2")).
+                        arg(out.fileName()).arg(out.errorString()));
+                file.close();
+                break;
+            }
+
+            // preallocating the space avoids fragmentation
+            qint64 size = static_cast<qint64>(entry.uncompressedSize);
+            out.resize(size);
+
+            qint64 written = 0;
+            while (true) {
+                qint64 read = file.read(block.get(), blockSize);
+                if (read <= 0)
+                    break;
+                if (out.write(block.get(), read) != read) {
+                    job->setErrorMessage(out.errorString());
+                    break;
+                }
+                written += read;
+            }
+            if (written != size)
+                out.resize(written);
+            out.close();
+            file.close();
+        }
+
+        done->fetchAndAddOrdered(1);
+    }
+
+    zip.close();
 }
 
-void WPMUtils::unzip(Job* job, const QString zipfile, const QString outputdir)
+void WPMUtils::unzip(Job* job, const QString zipfile, const QString outputdir,
+        int threads)
 {
     QString initialTitle = job->getTitle();
 
+    // the central directory is only read once
+    QList<QuaZipFileInfo64> entries;
     QuaZip zip(zipfile);
     if (!zip.open(QuaZip::mdUnzip)) {
         job->setErrorMessage(QString(QObject::tr("Cannot open the ZIP file %1: %2")).
                        arg(zipfile).arg(zip.getZipError()));
     } else {
+        entries = zip.getFileInfoList64();
+        if (zip.getZipError() != UNZ_OK)
+            job->setErrorMessage(QString(QObject::tr("Cannot open the ZIP file %1: %2")).
+                    arg(zipfile).arg(zip.getZipError()));
+        zip.close();
         job->setProgress(0.01);
     }
 
+    QString odir = outputdir;
+    if (!odir.endsWith('\\') && !odir.endsWith('/'))
+        odir.append('\\');
+
+    // the directory tree is created before the files are extracted in
+    // parallel
     if (job->shouldProceed()) {
-        QString odir = outputdir;
-        if (!odir.endsWith('\\') && !odir.endsWith('/'))
-            odir.append('\\');
+        QSet<QString> dirs;
+        for (int i = 0; i < entries.size(); i++) {
+            const QString& name = entries.at(i).name;
+            int pos = name.lastIndexOf('/');
+            if (pos >= 0)
+                dirs.insert(name.left(pos));
+        }
+
+        QDir d;
+        for (QSet<QString>::const_iterator it = dirs.constBegin();
+                it != dirs.constEnd(); ++it) {
+            if (!d.mkpath(odir + *it)) {
+                job->setErrorMessage(QString(QObject::tr("Cannot create directory %1")).arg(
+                        odir + *it));
+                break;
+            }
+        }
+        job->setProgress(0.05);
+    }
 
+    if (job->shouldProceed()) {
         job->setTitle(initialTitle + QStringLiteral(" / ") +
                 QObject::tr("Extracting"));
-        QuaZipFile file(&zip);
-        int n = zip.getEntriesCount();
-        int blockSize = 1024 * 1024;
-        char* block = new char[blockSize];
-        int i = 0;
-        for (bool more = zip.goToFirstFile(); more; more = zip.goToNextFile()) {
-            QString name = zip.getCurrentFileName();
-            if (!file.open(QIODevice::ReadOnly)) {
-                job->setErrorMessage(QString(
-                        QObject::tr("Error unzipping the file %1: Error %2 in %3")).
-                        arg(zipfile).arg(file.getZipError()).
-                        arg(name));
-                break;
+
+        // small archives are extracted in the current thread
+        if (threads <= 0)
+            threads = qBound(1, entries.size() / 64,
+                    QThread::idealThreadCount());
+        QThreadPool* pool = getUnzipThreadPool();
+        if (pool->maxThreadCount() < threads)
+            pool->setMaxThreadCount(threads);
+
+        QAtomicInt next, done;
+        QList<QFuture<void> > futures;
+        if (threads > 1) {
+            for (int i = 0; i < threads; i++) {
+                futures.append(QtConcurrent::run(pool, unzipWorker, job,
+                        zipfile, odir, &entries, &next, &done));
             }
-            name.prepend(odir);
-            QFile meminfo(name);
-            QFileInfo infofile(meminfo);
-            QDir dira(infofile.absolutePath());
-            if (dira.mkpath(infofile.absolutePath())) {
-                if (meminfo.open(QIODevice::ReadWrite)) {
-                    while (true) {
-                        qint64 read = file.read(block, blockSize);
-                        if (read <= 0)
-                            break;
-                        meminfo.write(block, read);
-                    }
-                    meminfo.close();
-                }
-            } else {
-                job->setErrorMessage(QString(QObject::tr("Cannot create directory %1")).arg(
-                        infofile.absolutePath()));
-                file.close();
+        } else {
+            unzipWorker(job, zipfile, odir, &entries, &next, &done);
+        }
+
+        JobProgressReporter progress(job);
+        int n = entries.size();
+        while (true) {
+            bool finished = true;
+            for (int i = 0; i < futures.size(); i++) {
+                if (!futures.at(i).isFinished())
+                    finished = false;
             }
-            file.close(); // do not forget to close!
-            i++;
-            job->setProgress(0.01 + 0.99 * i / n);
-            if (i % 100 == 0)
+
+            int i = done.load();
+            if (finished || progress.isDue()) {
+                job->setProgress(0.05 + 0.95 * i / qMax(n, 1));
                 job->setTitle(initialTitle + QStringLiteral(" / ") +
                         QString(QObject::tr("%L1 files")).arg(i));
+            }
 
-            if (!job->shouldProceed())
+            if (finished)
                 break;
-        }
-        zip.close();
 
-        delete[] block;
+            Sleep(50);
+        }
     }
 
     job->complete();
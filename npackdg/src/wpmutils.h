@@ -590,12 +590,15 @@ public:
             QCryptographicHash::Algorithm alg);
 
     /**
-     * @brief unzips a file
+     * @brief unzips a file. The files are extracted in parallel.
      * @param job job
      * @param zipfile .zip file
      * @param outputdir output directory
+     * @param threads number of threads or 0 for the default value depending
+     *     on the number of entries and CPUs
      */
-    static void unzip(Job* job, const QString zipfile, const QString outputdir);
+    static void unzip(Job* job, const QString zipfile, const QString outputdir,
+            int threads=0);
 
     /**
      * @param job job to monitor the progress. The error message will be set
@@ -0,0 +1,523 @@
+#include <windows.h>
+#include <zlib.h>
+
+#include <memory>
+
+#include <QObject>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextCodec>
+#include <QThreadPool>
+#include <QtEndian>
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "zipstreamextractor.h"
+
+static const quint32 LOCAL_HEADER = 0x04034b50;
+static const quint32 DATA_DESCRIPTOR = 0x08074b50;
+static const quint32 CENTRAL_HEADER = 0x02014b50;
+static const quint32 END_OF_CENTRAL_DIRECTORY = 0x06054b50;
+static const quint32 ZIP64_END_OF_CENTRAL_DIRECTORY = 0x06064b50;
+
+static const int CHUNK_SIZE = 256 * 1024;
+
+/**
+ * @return thread pool for the extraction. The global thread pool is not used
+ *     as the download may run there.
+ */
+static QThreadPool* getExtractionThreadPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+static quint16 le16(const char* p)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(p));
+}
+
+static quint32 le32(const char* p)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(p));
+}
+
+static quint64 le64(const char* p)
+{
+    return qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(p));
+}
+
+/**
+ * @brief reads the ZIP64 extended information
+ * @param extra extra fields
+ * @param uncompressedSize will be replaced if it is 0xFFFFFFFF
+ * @param compressedSize will be replaced if it is 0xFFFFFFFF
+ * @param offset will be replaced if it is not 0 and is 0xFFFFFFFF
+ * @return true if the ZIP64 extended information is present
+ */
+static bool readZip64(const QByteArray& extra, quint64* uncompressedSize,
+        quint64* compressedSize, quint64* offset)
+{
+    int p = 0;
+    while (p + 4 <= extra.size()) {
+        quint16 id = le16(extra.constData() + p);
+        int size = le16(extra.constData() + p + 2);
+        if (id == 1) {
+            const char* data = extra.constData() + p + 4;
+            int q = 0;
+            if (*uncompressedSize == 0xFFFFFFFF && q + 8 <= size) {
+                *uncompressedSize = le64(data + q);
+                q += 8;
+            }
+            if (*compressedSize == 0xFFFFFFFF && q + 8 <= size) {
+                *compressedSize = le64(data + q);
+                q += 8;
+            }
+            if (offset && *offset == 0xFFFFFFFF && q + 8 <= size) {
+                *offset = le64(data + q);
+            }
+            return true;
+        }
+        p += 4 + size;
+    }
+    return false;
+}
+
+ZipStreamExtractor::ZipStreamExtractor(const QString& filename,
+        const QString& stagingDir): filename(filename),
+        stagingDir(stagingDir), finished(false), success(false), pos(0),
+        maxSize(0)
+{
+    if (!this->stagingDir.endsWith('\\') && !this->stagingDir.endsWith('/'))
+        this->stagingDir.append('\\');
+}
+
+ZipStreamExtractor::~ZipStreamExtractor()
+{
+    finish(false);
+}
+
+void ZipStreamExtractor::start(Job* job)
+{
+    future = QtConcurrent::run(getExtractionThreadPool(), this,
+            &ZipStreamExtractor::run, job);
+}
+
+void ZipStreamExtractor::finish(bool success)
+{
+    mutex.lock();
+    if (!finished) {
+        finished = true;
+        this->success = success;
+    }
+    mutex.unlock();
+
+    future.waitForFinished();
+}
+
+qint64 ZipStreamExtractor::available(Job* job, QString* err)
+{
+    while (true) {
+        mutex.lock();
+        bool f = finished;
+        bool s = success;
+        mutex.unlock();
+
+        qint64 size = file.size();
+
+        // the download was started again from the beginning
+        if (size < maxSize) {
+            *err = QObject::tr("The file was truncated during the download");
+            return 0;
+        }
+        maxSize = size;
+
+        if (size > pos)
+            return size - pos;
+
+        if (f && !s)
+            *err = QObject::tr("The download failed");
+        if (f || job->isCancelled())
+            return 0;
+
+        Sleep(50);
+    }
+}
+
+qint64 ZipStreamExtractor::readSome(Job* job, char* data, qint64 maxSize,
+        QString* err)
+{
+    qint64 r = 0;
+    qint64 n = available(job, err);
+    if (err->isEmpty() && n == 0 && !job->isCancelled())
+        *err = QObject::tr("Unexpected end of the ZIP file");
+
+    if (err->isEmpty() && n > 0) {
+        if (!file.seek(pos)) {
+            *err = file.errorString();
+        } else {
+            r = file.read(data, qMin(n, maxSize));
+            if (r < 0) {
+                *err = file.errorString();
+                r = 0;
+            } else {
+                pos += r;
+            }
+        }
+    }
+
+    return r;
+}
+
+QString ZipStreamExtractor::readFully(Job* job, char* data, qint64 size)
+{
+    QString err;
+    while (size > 0 && err.isEmpty() && !job->isCancelled()) {
+        qint64 r = readSome(job, data, size, &err);
+        data += r;
+        size -= r;
+    }
+    return err;
+}
+
+void ZipStreamExtractor::run(Job* job)
+{
+    QString initialTitle = job->getTitle();
+
+    QString err;
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        err = file.errorString();
+
+    JobProgressReporter progress(job);
+    while (err.isEmpty() && !job->isCancelled()) {
+        qint64 offset = pos;
+        char sig[4];
+        err = readFully(job, sig, 4);
+        if (!err.isEmpty())
+            break;
+
+        if (le32(sig) == LOCAL_HEADER) {
+            err = extractEntry(job, offset);
+        } else if (le32(sig) == CENTRAL_HEADER) {
+            pos = offset;
+            break;
+        } else {
+            err = QObject::tr("Unexpected signature at the position %L1").
+                    arg(offset);
+        }
+
+        if (progress.isDue())
+            job->setTitle(initialTitle + QStringLiteral(" / ") +
+                    QString(QObject::tr("%L1 files")).arg(entries.size()));
+    }
+
+    if (err.isEmpty() && !job->isCancelled())
+        err = verifyCentralDirectory(job);
+
+    file.close();
+
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+    else if (!job->isCancelled())
+        job->setProgress(1);
+
+    job->setTitle(initialTitle);
+
+    job->complete();
+}
+
+QString ZipStreamExtractor::extractEntry(Job* job, qint64 offset)
+{
+    char h[26] = {};
+    QString err = readFully(job, h, sizeof(h));
+
+    quint16 flags = le16(h + 2);
+    quint16 method = le16(h + 4);
+    quint32 crc = le32(h + 10);
+    quint64 compressedSize = le32(h + 14);
+    quint64 uncompressedSize = le32(h + 18);
+
+    QByteArray name(le16(h + 22), 0), extra(le16(h + 24), 0);
+    if (err.isEmpty())
+        err = readFully(job, name.data(), name.size());
+    if (err.isEmpty())
+        err = readFully(job, extra.data(), extra.size());
+    if (!err.isEmpty() || job->isCancelled())
+        return err;
+
+    bool zip64 = readZip64(extra, &uncompressedSize, &compressedSize,
+            nullptr);
+    bool descriptor = (flags & 8) != 0;
+
+    // the same encoding as used by QuaZip
+    QString fileName = (flags & 0x800) ? QString::fromUtf8(name) :
+            QTextCodec::codecForLocale()->toUnicode(name);
+
+    if (flags & 1)
+        return QObject::tr("Encrypted entries are not supported: %1").
+                arg(fileName);
+    if (method != 0 && method != Z_DEFLATED)
+        return QObject::tr("The compression method %1 is not supported: %2").
+                arg(method).arg(fileName);
+    if (method == 0 && descriptor)
+        return QObject::tr("Stored entries with a data descriptor are not supported: %1").
+                arg(fileName);
+
+    // the name is checked before anything is written so that an entry
+    // cannot be placed outside of the staging directory
+    QString clean = QDir::cleanPath(QString(fileName).replace('\\', '/'));
+    if (clean.isEmpty() || QDir::isAbsolutePath(clean) ||
+            (clean.length() >= 2 && clean.at(1) == ':') ||
+            clean == QStringLiteral("..") ||
+            clean.startsWith(QStringLiteral("../")))
+        return QObject::tr("Invalid file name in the ZIP file: %1").
+                arg(fileName);
+
+    Entry e;
+    e.name = name;
+    e.offset = offset;
+
+    QString target = stagingDir + fileName;
+    if (fileName.endsWith('/')) {
+        if (!QDir().mkpath(target))
+            return QObject::tr("Cannot create directory %1").arg(target);
+        pos += static_cast<qint64>(compressedSize);
+        e.crc = crc;
+        e.compressedSize = compressedSize;
+        e.uncompressedSize = uncompressedSize;
+        entries.append(e);
+        return err;
+    }
+
+    QString dir = QFileInfo(target).absolutePath();
+    if (dir != lastDir) {
+        if (!QDir().mkpath(dir))
+            return QObject::tr("Cannot create directory %1").arg(dir);
+        lastDir = dir;
+    }
+
+    QFile out(target);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QObject::tr("Cannot open the file %1: %2").arg(target).
+                arg(out.errorString());
+
+    // preallocating the space avoids fragmentation
+    if (!descriptor)
+        out.resize(static_cast<qint64>(uncompressedSize));
+
+    std::unique_ptr<char[]> in(new char[CHUNK_SIZE]);
+    uLong computedCRC = crc32(0L, Z_NULL, 0);
+    quint64 written = 0, consumed = 0;
+    if (method == 0) {
+        while (err.isEmpty() && consumed < compressedSize &&
+                !job->isCancelled()) {
+            qint64 r = readSome(job, in.get(), static_cast<qint64>(qMin(
+                    static_cast<quint64>(CHUNK_SIZE),
+                    compressedSize - consumed)), &err);
+            computedCRC = crc32(computedCRC,
+                    reinterpret_cast<const Bytef*>(in.get()),
+                    static_cast<uInt>(r));
+            if (out.write(in.get(), r) != r)
+                err = out.errorString();
+            consumed += static_cast<quint64>(r);
+            written += static_cast<quint64>(r);
+        }
+    } else {
+        std::unique_ptr<char[]> buffer(new char[CHUNK_SIZE]);
+        z_stream s;
+        memset(&s, 0, sizeof(s));
+        if (inflateInit2(&s, -MAX_WBITS) != Z_OK)
+            err = QObject::tr("Cannot initialize zlib");
+
+        bool ended = false;
+        while (err.isEmpty() && !ended && !job->isCancelled()) {
+            quint64 want = CHUNK_SIZE;
+            if (!descriptor) {
+                if (consumed >= compressedSize) {
+                    err = QObject::tr("Invalid compressed data for %1").
+                            arg(fileName);
+                    break;
+                }
+                want = qMin(want, compressedSize - consumed);
+            }
+
+            qint64 n = readSome(job, in.get(), static_cast<qint64>(want),
+                    &err);
+            if (n == 0)
+                break;
+
+            s.next_in = reinterpret_cast<Bytef*>(in.get());
+            s.avail_in = static_cast<uInt>(n);
+            do {
+                s.next_out = reinterpret_cast<Bytef*>(buffer.get());
+                s.avail_out = CHUNK_SIZE;
+                int r = inflate(&s, Z_NO_FLUSH);
+                if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+                    err = QObject::tr("Invalid compressed data for %1").
+                            arg(fileName);
+                    break;
+                }
+
+                qint64 produced = CHUNK_SIZE - s.avail_out;
+                computedCRC = crc32(computedCRC,
+                        reinterpret_cast<const Bytef*>(buffer.get()),
+                        static_cast<uInt>(produced));
+                if (out.write(buffer.get(), produced) != produced) {
+                    err = out.errorString();
+                    break;
+                }
+                written += static_cast<quint64>(produced);
+
+                if (r == Z_STREAM_END) {
+                    ended = true;
+                    break;
+                }
+            } while (s.avail_in > 0 || s.avail_out == 0);
+
+            consumed += static_cast<quint64>(n) - s.avail_in;
+
+            // the rest of the input belongs to the next record
+            pos -= s.avail_in;
+        }
+        inflateEnd(&s);
+    }
+
+    if (written != uncompressedSize || descriptor)
+        out.resize(static_cast<qint64>(written));
+    out.close();
+
+    if (err.isEmpty() && descriptor && !job->isCancelled()) {
+        // the signature is optional
+        char d[20];
+        err = readFully(job, d, 4);
+        if (err.isEmpty() && le32(d) == DATA_DESCRIPTOR)
+            err = readFully(job, d, 4);
+        if (err.isEmpty())
+            err = readFully(job, d + 4, zip64 ? 16 : 8);
+        if (err.isEmpty()) {
+            crc = le32(d);
+            compressedSize = zip64 ? le64(d + 4) : le32(d + 4);
+            uncompressedSize = zip64 ? le64(d + 12) : le32(d + 8);
+        }
+    }
+
+    if (err.isEmpty() && !job->isCancelled()) {
+        if (computedCRC != crc || written != uncompressedSize ||
+                consumed != compressedSize)
+            err = QObject::tr("CRC error in %1").arg(fileName);
+    }
+
+    e.crc = crc;
+    e.compressedSize = compressedSize;
+    e.uncompressedSize = uncompressedSize;
+    entries.append(e);
+
+    return err;
+}
+
+QString ZipStreamExtractor::verifyCentralDirectory(Job* job)
+{
+    QString err;
+
+    // the rest of the file
+    QByteArray cd;
+    std::unique_ptr<char[]> buffer(new char[CHUNK_SIZE]);
+    while (err.isEmpty() && !job->isCancelled()) {
+        qint64 n = available(job, &err);
+        if (n == 0 || !err.isEmpty())
+            break;
+        n = readSome(job, buffer.get(), CHUNK_SIZE, &err);
+        cd.append(buffer.get(), static_cast<int>(n));
+    }
+
+    int p = 0;
+    int index = 0;
+    const char* data = cd.constData();
+    while (err.isEmpty() && p + 46 <= cd.size() &&
+            le32(data + p) == CENTRAL_HEADER) {
+        quint32 crc = le32(data + p + 16);
+        quint64 compressedSize = le32(data + p + 20);
+        quint64 uncompressedSize = le32(data + p + 24);
+        int nameLength = le16(data + p + 28);
+        int extraLength = le16(data + p + 30);
+        int commentLength = le16(data + p + 32);
+        quint64 offset = le32(data + p + 42);
+        QByteArray name = cd.mid(p + 46, nameLength);
+        QByteArray extra = cd.mid(p + 46 + nameLength, extraLength);
+        readZip64(extra, &uncompressedSize, &compressedSize, &offset);
+
+        if (index >= entries.size()) {
+            err = QObject::tr("The central directory contains more entries than the ZIP file");
+            break;
+        }
+
+        const Entry& e = entries.at(index);
+        if (e.name != name || e.crc != crc ||
+                e.compressedSize != compressedSize ||
+                e.uncompressedSize != uncompressedSize ||
+                static_cast<quint64>(e.offset) != offset) {
+            err = QObject::tr("The entry %1 does not match the central directory").
+                    arg(QString::fromLocal8Bit(name));
+            break;
+        }
+
+        index++;
+        p += 46 + nameLength + extraLength + commentLength;
+    }
+
+    if (err.isEmpty() && !job->isCancelled()) {
+        if (index != entries.size())
+            err = QObject::tr("The central directory contains %L1 entries instead of %L2").
+                    arg(index).arg(entries.size());
+        else if (p + 4 > cd.size() ||
+                (le32(data + p) != END_OF_CENTRAL_DIRECTORY &&
+                le32(data + p) != ZIP64_END_OF_CENTRAL_DIRECTORY))
+            err = QObject::tr("The end of the central directory was not found");
+    }
+
+    return err;
+}
+
+QString ZipStreamExtractor::moveContent(const QString& from,
+        const QString& to)
+{
+    QString err;
+
+    QDir d(from);
+    QFileInfoList entries = d.entryInfoList(QDir::AllEntries |
+            QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    for (int i = 0; i < entries.size() && err.isEmpty(); i++) {
+        const QFileInfo& fi = entries.at(i);
+        QString target = to + '\\' + fi.fileName();
+        if (fi.isDir() && QFileInfo(target).isDir()) {
+            err = moveContent(fi.absoluteFilePath(), target);
+        } else if (!d.rename(fi.absoluteFilePath(), target)) {
+            err = QObject::tr("Cannot rename %1 to %2").
+                    arg(fi.absoluteFilePath()).arg(target);
+        }
+    }
+
+    if (err.isEmpty())
+        d.rmdir(from);
+
+    return err;
+}
+
+QString ZipStreamExtractor::commit(const QString& dir)
+{
+    QString err;
+
+    // the staging directory may be inside of the destination
+    QString from = QDir(stagingDir).absolutePath();
+    if (QFileInfo(from).isDir())
+        err = moveContent(from, QDir(dir).absolutePath());
+
+    return err;
+}
+
+void ZipStreamExtractor::discard()
+{
+    QDir d(stagingDir);
+    if (d.exists())
+        d.removeRecursively();
+}
@@ -0,0 +1,145 @@
+#ifndef ZIPSTREAMEXTRACTOR_H
+#define ZIPSTREAMEXTRACTOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include <QMutex>
+#include <QFuture>
+
+#include "job.h"
+
+/**
+ * @brief extracts a ZIP file while it is being downloaded. The file is read
+ *     while it grows. The entries are found using the local file headers and
+ *     are verified against the central directory at the end. The files are
+ *     extracted in a staging directory that is either moved to the
+ *     destination or discarded.
+ *
+ * Encrypted entries, compression methods other than "stored" and "deflate"
+ * and stored entries with a data descriptor are not supported. The caller
+ * should extract the whole file using WPMUtils::unzip() in this case.
+ */
+class ZipStreamExtractor
+{
+    class Entry
+    {
+    public:
+        /** file name as stored in the ZIP file */
+        QByteArray name;
+
+        /** position of the local file header */
+        qint64 offset;
+
+        quint32 crc;
+        quint64 compressedSize;
+        quint64 uncompressedSize;
+    };
+
+    QString filename;
+    QString stagingDir;
+
+    /** protects "finished" and "success" */
+    QMutex mutex;
+
+    /** true = the download was completed */
+    bool finished;
+
+    /** true = the download was successful */
+    bool success;
+
+    QFuture<void> future;
+
+    /** the following fields are only used by the extraction thread */
+    QFile file;
+    qint64 pos;
+    qint64 maxSize;
+    QList<Entry> entries;
+    QString lastDir;
+
+    void run(Job* job);
+
+    /**
+     * @brief waits until the file contains more data
+     * @param job job
+     * @param err error message will be stored here
+     * @return number of available bytes after the current position or 0 for
+     *     the end of the file
+     */
+    qint64 available(Job* job, QString* err);
+
+    /**
+     * @brief reads the data available at the current position
+     * @param job job
+     * @param data output buffer
+     * @param maxSize size of the buffer
+     * @param err error message will be stored here
+     * @return number of read bytes
+     */
+    qint64 readSome(Job* job, char* data, qint64 maxSize, QString* err);
+
+    /**
+     * @brief reads the specified number of bytes
+     * @param job job
+     * @param data output buffer
+     * @param size number of bytes
+     * @return error message
+     */
+    QString readFully(Job* job, char* data, qint64 size);
+
+    /**
+     * @brief extracts one entry. The signature of the local file header was
+     *     already read.
+     * @param job job
+     * @param offset position of the local file header
+     * @return error message
+     */
+    QString extractEntry(Job* job, qint64 offset);
+
+    /**
+     * @brief reads the central directory and compares it with the extracted
+     *     entries
+     * @param job job
+     * @return error message
+     */
+    QString verifyCentralDirectory(Job* job);
+
+    static QString moveContent(const QString& from, const QString& to);
+public:
+    /**
+     * @param filename the ZIP file. The file should already exist.
+     * @param stagingDir staging directory
+     */
+    ZipStreamExtractor(const QString& filename, const QString& stagingDir);
+
+    ~ZipStreamExtractor();
+
+    /**
+     * @brief starts the extraction in a separate thread
+     * @param job job. The error message will be set if the file cannot be
+     *     extracted while it is downloaded.
+     */
+    void start(Job* job);
+
+    /**
+     * @brief informs that the download is over and waits for the
+     *     extraction to finish
+     * @param success true = the file was downloaded completely
+     */
+    void finish(bool success);
+
+    /**
+     * @brief moves the extracted files to the destination directory
+     * @param dir destination directory. Existing directories are merged.
+     * @return error message
+     */
+    QString commit(const QString& dir);
+
+    /**
+     * @brief deletes the staging directory
+     */
+    void discard();
+};
+
+#endif // ZIPSTREAMEXTRACTOR_H